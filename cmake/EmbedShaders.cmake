@@ -0,0 +1,54 @@
+# Writes OUTPUT, defining EmbeddedShaders with the SPIR-V in <SPIRV_DIR>/<shader>.spv of every shader in the comma
+# separated SHADERS as constexpr arrays. Run as a script at build time, once the shaders were compiled.
+string(REPLACE "," ";" SHADERS "${SHADERS}")
+
+set(arrays "")
+set(entries "")
+foreach (shader ${SHADERS})
+  file(READ ${SPIRV_DIR}/${shader}.spv hex HEX)
+  string(LENGTH "${hex}" length)
+  if (length EQUAL 0)
+    message(FATAL_ERROR "${SPIRV_DIR}/${shader}.spv is empty")
+  endif ()
+  string(MAKE_C_IDENTIFIER ${shader} identifier)
+  string(TOUPPER ${identifier} identifier)
+  string(APPEND arrays "constexpr uint32_t ${identifier}[] = {")
+  # SPIR-V is a stream of little endian words, 8 of them per line.
+  math(EXPR last "${length} - 1")
+  foreach (offset RANGE 0 ${last} 64)
+    string(SUBSTRING "${hex}" ${offset} 64 line)
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " line "${line}")
+    string(STRIP "${line}" line)
+    string(APPEND arrays "\n    ${line}")
+  endforeach ()
+  string(APPEND arrays "\n};\n\n")
+  string(APPEND entries "    Shader{\"${shader}\", ${identifier}},\n")
+endforeach ()
+
+list(LENGTH SHADERS count)
+set(source "// Generated by cmake/EmbedShaders.cmake, do not edit.
+#include \"EmbeddedShaders.h\"
+
+#include <array>
+
+namespace {
+
+struct Shader {
+  std::string_view name;
+  std::span<const uint32_t> spirv;
+};
+
+${arrays}constexpr std::array<Shader, ${count}> SHADERS = {
+${entries}};
+
+}
+
+std::span<const uint32_t> EmbeddedShaders::find(std::string_view name) {
+  for(const Shader& shader : SHADERS)
+    if(shader.name == name)
+      return shader.spirv;
+  return {};
+}
+")
+
+file(WRITE ${OUTPUT} "${source}")
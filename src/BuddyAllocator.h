@@ -0,0 +1,148 @@
+#ifndef VULKAN_BUDDYALLOCATOR_H
+#define VULKAN_BUDDYALLOCATOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Binary buddy allocator over the range [0, size) of some larger resource. Blocks are powers of two and naturally
+ * aligned to their size, so any alignment up to the block size comes for free.
+ */
+class BuddyAllocator {
+
+public:
+
+  /**
+   * @param size The managed size, rounded down to a power of two.
+   * @param minBlockSize The smallest block handed out, rounded up to a power of two.
+   */
+  BuddyAllocator(uint64_t size, uint64_t minBlockSize) {
+    minOrder = log2(roundUpToPowerOfTwo(std::max<uint64_t>(minBlockSize, 1)));
+    maxOrder = std::max(log2(size), minOrder);
+    freeBlocks.resize(maxOrder - minOrder + 1);
+    freeBlocks.back().insert(0);
+    freeSize = getSize();
+  }
+
+  /**
+   * @return The offset of a block of at least size bytes aligned to alignment, or nothing if none is free.
+   */
+  std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment = 1) {
+    uint32_t order = std::max(log2(roundUpToPowerOfTwo(std::max({size, alignment, uint64_t(1)}))), minOrder);
+    if(order > maxOrder) return {};
+
+    uint32_t freeOrder = order;
+    while(freeOrder <= maxOrder && getFreeList(freeOrder).empty())
+      ++freeOrder;
+    if(freeOrder > maxOrder) return {};
+
+    // Lowest offsets first keeps live blocks packed towards the start.
+    uint64_t offset = *getFreeList(freeOrder).begin();
+    getFreeList(freeOrder).erase(getFreeList(freeOrder).begin());
+    // Split down to the requested order, freeing the upper halves.
+    while(freeOrder > order) {
+      --freeOrder;
+      getFreeList(freeOrder).insert(offset + (uint64_t(1) << freeOrder));
+    }
+    allocated[offset] = order;
+    freeSize -= uint64_t(1) << order;
+    ++allocationCount;
+    return offset;
+  }
+
+  /**
+   * Returns a block to the allocator, merging it with its buddy for as long as the buddy is free too.
+   */
+  void free(uint64_t offset) {
+    auto it = allocated.find(offset);
+    if(it == allocated.end()) return;
+    uint32_t order = it->second;
+    allocated.erase(it);
+    freeSize += uint64_t(1) << order;
+    --allocationCount;
+
+    while(order < maxOrder) {
+      uint64_t buddy = offset ^ (uint64_t(1) << order);
+      auto buddyIt = getFreeList(order).find(buddy);
+      if(buddyIt == getFreeList(order).end()) break;
+      getFreeList(order).erase(buddyIt);
+      offset = std::min(offset, buddy);
+      ++order;
+    }
+    getFreeList(order).insert(offset);
+  }
+
+  /**
+   * @return The size of the block backing the allocation at offset, 0 if there is none.
+   */
+  uint64_t getBlockSize(uint64_t offset) const {
+    auto it = allocated.find(offset);
+    return it == allocated.end() ? 0 : uint64_t(1) << it->second;
+  }
+
+  uint64_t getSize() const {
+    return uint64_t(1) << maxOrder;
+  }
+
+  uint64_t getFreeSize() const {
+    return freeSize;
+  }
+
+  uint64_t getLargestFreeBlock() const {
+    for(uint32_t order = maxOrder + 1; order-- > minOrder;)
+      if(!getFreeList(order).empty())
+        return uint64_t(1) << order;
+    return 0;
+  }
+
+  uint32_t getAllocationCount() const {
+    return allocationCount;
+  }
+
+  bool empty() const {
+    return allocationCount == 0;
+  }
+
+  static uint64_t roundUpToPowerOfTwo(uint64_t value) {
+    uint64_t power = 1;
+    while(power < value)
+      power <<= 1U;
+    return power;
+  }
+
+  static uint64_t roundDownToPowerOfTwo(uint64_t value) {
+    return value == 0 ? 0 : uint64_t(1) << log2(value);
+  }
+
+private:
+  uint32_t minOrder;
+  uint32_t maxOrder;
+  // Free block offsets per order, starting at minOrder.
+  std::vector<std::set<uint64_t>> freeBlocks;
+  // Order of every allocated block by offset.
+  std::unordered_map<uint64_t, uint32_t> allocated;
+  uint64_t freeSize;
+  uint32_t allocationCount = 0;
+
+  std::set<uint64_t>& getFreeList(uint32_t order) {
+    return freeBlocks[order - minOrder];
+  }
+
+  const std::set<uint64_t>& getFreeList(uint32_t order) const {
+    return freeBlocks[order - minOrder];
+  }
+
+  static uint32_t log2(uint64_t value) {
+    uint32_t log = 0;
+    while(value >>= 1U)
+      ++log;
+    return log;
+  }
+
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <experimental/vector>
+
+#include "HashUtils.h"
+#include "Macros.h"
+#include "VkUtils.h"
+
+DescriptorBindings& DescriptorBindings::image(uint32_t binding, vk::DescriptorType type, vk::Sampler sampler,
+                                              vk::ImageView imageView, vk::ImageLayout layout) {
+  bindings.push_back({binding, type, {sampler, imageView, layout}, {}});
+  return *this;
+}
+
+DescriptorBindings& DescriptorBindings::buffer(uint32_t binding, vk::DescriptorType type, vk::Buffer buffer,
+                                               vk::DeviceSize offset, vk::DeviceSize range) {
+  bindings.push_back({binding, type, {}, {buffer, offset, range}});
+  return *this;
+}
+
+void DescriptorBindings::write(const vk::UniqueDevice& device, vk::DescriptorSet set) const {
+  std::vector<vk::WriteDescriptorSet> writes;
+  writes.reserve(bindings.size());
+  for(const Binding& binding : bindings)
+    writes.emplace_back(set, binding.binding, 0, 1, binding.type, &binding.imageInfo, &binding.bufferInfo);
+  device->updateDescriptorSets(vk::size(writes), writes.data(), 0, nullptr);
+}
+
+uint64_t DescriptorBindings::hash(uint64_t seed) const {
+  uint64_t hash = seed;
+  // Field by field, the infos have padding.
+  for(const Binding& binding : bindings) {
+    hash = HashUtils::hashValue(binding.binding, hash);
+    hash = HashUtils::hashValue(binding.type, hash);
+    hash = HashUtils::hashValue(binding.imageInfo.sampler, hash);
+    hash = HashUtils::hashValue(binding.imageInfo.imageView, hash);
+    hash = HashUtils::hashValue(binding.imageInfo.imageLayout, hash);
+    hash = HashUtils::hashValue(binding.bufferInfo.buffer, hash);
+    hash = HashUtils::hashValue(binding.bufferInfo.offset, hash);
+    hash = HashUtils::hashValue(binding.bufferInfo.range, hash);
+  }
+  return hash;
+}
+
+DescriptorAllocator::DescriptorAllocator(const vk::UniqueDevice& device, uint32_t framesInFlight)
+    : device(device), frames(framesInFlight) {}
+
+vk::DescriptorSetLayout DescriptorAllocator::getLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings) {
+  uint64_t key = HashUtils::FNV_OFFSET_BASIS;
+  for(const vk::DescriptorSetLayoutBinding& binding : bindings) {
+    key = HashUtils::hashValue(binding.binding, key);
+    key = HashUtils::hashValue(binding.descriptorType, key);
+    key = HashUtils::hashValue(binding.descriptorCount, key);
+    key = HashUtils::hashValue(static_cast<VkShaderStageFlags>(binding.stageFlags), key);
+    key = HashUtils::hashValue(binding.pImmutableSamplers, key);
+  }
+  auto it = layouts.find(key);
+  if(it != layouts.end()) {
+    if(it->second.bindings == bindings)
+      return it->second.layout.get();
+    // Sets may still use the colliding layout, so it is kept alive under a key of its own.
+    std::cerr << "Descriptor set layout hash collision on " << std::hex << key << std::dec << std::endl;
+    uint64_t movedKey = key;
+    while(layouts.count(movedKey))
+      ++movedKey;
+    layouts[movedKey] = std::move(it->second);
+    layoutsByHandle[layouts[movedKey].layout.get()] = &layouts[movedKey];
+  }
+  Layout& layout = layouts[key];
+  layout.bindings = bindings;
+  layout.layout = device->createDescriptorSetLayoutUnique({{}, vk::size(bindings), bindings.data()});
+  layout.descriptorCounts.clear();
+  for(const vk::DescriptorSetLayoutBinding& binding : bindings)
+    layout.descriptorCounts[binding.descriptorType] += binding.descriptorCount;
+  layoutsByHandle[layout.layout.get()] = &layout;
+  return layout.layout.get();
+}
+
+void DescriptorAllocator::beginFrame(uint32_t frameIndex) {
+  ++frameCount;
+  currentFrame = frameIndex;
+  reset(frames[currentFrame]);
+  // A frame waited for here was the last one able to use cached sets cleared framesInFlight frames ago.
+  std::experimental::erase_if(retiredChains, [&](const RetiredChain& retired) {
+    return retired.frame + frames.size() <= frameCount;
+  });
+}
+
+vk::DescriptorSet DescriptorAllocator::allocate(vk::DescriptorSetLayout layout) {
+  return allocate(frames[currentFrame], layout);
+}
+
+vk::DescriptorSet DescriptorAllocator::getCachedSet(vk::DescriptorSetLayout layout,
+                                                    const DescriptorBindings& bindings) {
+  uint64_t key = bindings.hash(HashUtils::hashValue(layout));
+  auto it = cachedSets.find(key);
+  if(it != cachedSets.end()) {
+    if(it->second.layout == layout && it->second.bindings == bindings)
+      return it->second.set;
+    // The colliding set stays allocated until the cache is cleared, it is merely no longer found.
+    std::cerr << "Descriptor set hash collision on " << std::hex << key << std::dec << std::endl;
+  }
+  vk::DescriptorSet set = allocate(cachedPools, layout);
+  bindings.write(device, set);
+  cachedSets[key] = {layout, bindings, set};
+  return set;
+}
+
+void DescriptorAllocator::clearCache() {
+  cachedSets.clear();
+  if(cachedPools.pools.empty()) return;
+  retiredChains.push_back({std::move(cachedPools), frameCount});
+  cachedPools = {};
+}
+
+uint32_t DescriptorAllocator::getPoolCount() const {
+  std::size_t count = cachedPools.pools.size();
+  for(const PoolChain& chain : frames)
+    count += chain.pools.size();
+  for(const RetiredChain& retired : retiredChains)
+    count += retired.chain.pools.size();
+  return uint32(count);
+}
+
+uint32_t DescriptorAllocator::getCachedSetCount() const {
+  return uint32(cachedSets.size());
+}
+
+vk::DescriptorSet DescriptorAllocator::allocate(PoolChain& chain, vk::DescriptorSetLayout layout) {
+  const Layout& info = *layoutsByHandle.at(static_cast<VkDescriptorSetLayout>(layout));
+  vk::DescriptorSet set;
+  for(; chain.current < chain.pools.size(); ++chain.current) {
+    try {
+      set = device->allocateDescriptorSets({chain.pools[chain.current].get(), 1, &layout}).front();
+      break;
+    } catch(const vk::OutOfPoolMemoryError&) {
+    } catch(const vk::FragmentedPoolError&) {
+    }
+  }
+  if(!set) {
+    grow(chain, info);
+    set = device->allocateDescriptorSets({chain.pools[chain.current].get(), 1, &layout}).front();
+  }
+  for(const auto& [type, count] : info.descriptorCounts)
+    chain.descriptorCounts[type] += count;
+  ++chain.setCount;
+  return set;
+}
+
+void DescriptorAllocator::grow(PoolChain& chain, const Layout& layout) {
+  // Doubles what the chain holds, with the descriptors split between types as they were so far.
+  uint32_t setCount = std::max(DEFAULT_POOL_SETS, chain.setCount);
+  std::map<vk::DescriptorType, uint32_t> descriptorCounts;
+  for(const auto& [type, count] : chain.descriptorCounts)
+    descriptorCounts[type] = uint32((uint64_t(count) * setCount + chain.setCount - 1) / std::max(chain.setCount, 1U));
+  for(const auto& [type, count] : layout.descriptorCounts)
+    descriptorCounts[type] = std::max(descriptorCounts[type], chain.setCount == 0 ? count * setCount : count);
+  chain.pools.push_back(createPool(descriptorCounts, setCount));
+  chain.current = chain.pools.size() - 1;
+}
+
+vk::UniqueDescriptorPool DescriptorAllocator::createPool(const std::map<vk::DescriptorType, uint32_t>& descriptorCounts,
+                                                         uint32_t setCount) const {
+  std::vector<vk::DescriptorPoolSize> poolSizes;
+  for(const auto& [type, count] : descriptorCounts)
+    if(count > 0)
+      poolSizes.emplace_back(type, count);
+  return device->createDescriptorPoolUnique({{}, setCount, vk::size(poolSizes), poolSizes.data()});
+}
+
+void DescriptorAllocator::reset(PoolChain& chain) const {
+  if(chain.pools.size() > 1) {
+    // A quarter of headroom, so a frame slightly busier than the last still fits.
+    uint32_t setCount = std::max(DEFAULT_POOL_SETS, chain.setCount + chain.setCount / 4);
+    std::map<vk::DescriptorType, uint32_t> descriptorCounts;
+    for(const auto& [type, count] : chain.descriptorCounts)
+      descriptorCounts[type] = count + count / 4;
+    chain.pools.clear();
+    chain.pools.push_back(createPool(descriptorCounts, setCount));
+  } else {
+    for(const vk::UniqueDescriptorPool& pool : chain.pools)
+      device->resetDescriptorPool(pool.get());
+  }
+  chain.current = 0;
+  chain.descriptorCounts.clear();
+  chain.setCount = 0;
+}
@@ -0,0 +1,158 @@
+#ifndef VULKAN_DESCRIPTORALLOCATOR_H
+#define VULKAN_DESCRIPTORALLOCATOR_H
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * The resources written to the bindings of a descriptor set, one descriptor per binding.
+ */
+class DescriptorBindings {
+
+public:
+  DescriptorBindings& image(uint32_t binding, vk::DescriptorType type, vk::Sampler sampler, vk::ImageView imageView,
+                            vk::ImageLayout layout);
+
+  DescriptorBindings& buffer(uint32_t binding, vk::DescriptorType type, vk::Buffer buffer, vk::DeviceSize offset = 0,
+                             vk::DeviceSize range = VK_WHOLE_SIZE);
+
+  /**
+   * Writes every binding into set.
+   */
+  void write(const vk::UniqueDevice& device, vk::DescriptorSet set) const;
+
+  uint64_t hash(uint64_t seed) const;
+
+  bool operator==(const DescriptorBindings& other) const = default;
+
+private:
+
+  struct Binding {
+    uint32_t binding;
+    vk::DescriptorType type;
+    vk::DescriptorImageInfo imageInfo;
+    vk::DescriptorBufferInfo bufferInfo;
+
+    bool operator==(const Binding& other) const = default;
+  };
+
+  std::vector<Binding> bindings;
+
+};
+
+/**
+ * Creates descriptor set layouts and allocates descriptor sets from chains of pools that grow on demand, so running out
+ * of descriptors never fails an allocation.
+ *
+ * Sets for a single frame come from a chain per frame in flight, reset as a whole once the frame comes round again
+ * instead of freeing sets one by one. A chain that needed more than one pool is replaced by a single pool sized for
+ * what it held, so a steady workload settles on one pool per frame. Sets that outlive frames are cached by their layout
+ * and bindings, so everything binding the same resources shares one set.
+ */
+class DescriptorAllocator {
+
+public:
+  // Sets the first pool of a chain has room for. Later pools are sized from the descriptors the chain handed out.
+  static constexpr uint32_t DEFAULT_POOL_SETS = 64;
+
+  DescriptorAllocator(const vk::UniqueDevice& device, uint32_t framesInFlight);
+
+  DescriptorAllocator(const DescriptorAllocator&) = delete;
+
+  DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+  /**
+   * @return The layout of bindings, created on first use. Owned by the allocator.
+   */
+  vk::DescriptorSetLayout getLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
+
+  /**
+   * Resets the pools of frameIndex. The frame last recorded with them must have finished.
+   */
+  void beginFrame(uint32_t frameIndex);
+
+  /**
+   * @return An unwritten set of layout, valid until beginFrame() resets the current frame's pools.
+   * @throws vk::SystemError if a new pool can not be created.
+   */
+  vk::DescriptorSet allocate(vk::DescriptorSetLayout layout);
+
+  /**
+   * @return A set of layout written with bindings, shared by every call passing the same layout and bindings until
+   * clearCache(). Resources destroyed while a set still names them must be followed by clearCache().
+   * @throws vk::SystemError if a new pool can not be created.
+   */
+  vk::DescriptorSet getCachedSet(vk::DescriptorSetLayout layout, const DescriptorBindings& bindings);
+
+  /**
+   * Forgets every cached set. Their pools are reset once no frame in flight can use them anymore.
+   */
+  void clearCache();
+
+  uint32_t getPoolCount() const;
+
+  uint32_t getCachedSetCount() const;
+
+private:
+
+  struct Layout {
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    vk::UniqueDescriptorSetLayout layout;
+    // Descriptors of every type a set of it takes.
+    std::map<vk::DescriptorType, uint32_t> descriptorCounts;
+  };
+
+  /**
+   * Pools allocated from in order, a new one is added once the last is exhausted.
+   */
+  struct PoolChain {
+    std::vector<vk::UniqueDescriptorPool> pools;
+    std::size_t current = 0;
+    // Handed out since the last reset.
+    std::map<vk::DescriptorType, uint32_t> descriptorCounts;
+    uint32_t setCount = 0;
+  };
+
+  struct CachedSet {
+    vk::DescriptorSetLayout layout;
+    DescriptorBindings bindings;
+    vk::DescriptorSet set;
+  };
+
+  // The pools of cleared cached sets, along with frameCount when they were cleared.
+  struct RetiredChain {
+    PoolChain chain;
+    uint64_t frame;
+  };
+
+  const vk::UniqueDevice& device;
+  std::unordered_map<uint64_t, Layout> layouts;
+  std::unordered_map<VkDescriptorSetLayout, const Layout *> layoutsByHandle;
+  std::vector<PoolChain> frames;
+  uint32_t currentFrame = 0;
+  // beginFrame() calls so far.
+  uint64_t frameCount = 0;
+  PoolChain cachedPools;
+  std::unordered_map<uint64_t, CachedSet> cachedSets;
+  std::vector<RetiredChain> retiredChains;
+
+  vk::DescriptorSet allocate(PoolChain& chain, vk::DescriptorSetLayout layout);
+
+  /**
+   * Adds a pool with room for at least one more set of layout and, going by what chain handed out so far, about as many
+   * sets as chain holds already.
+   */
+  void grow(PoolChain& chain, const Layout& layout);
+
+  vk::UniqueDescriptorPool createPool(const std::map<vk::DescriptorType, uint32_t>& descriptorCounts,
+                                      uint32_t setCount) const;
+
+  void reset(PoolChain& chain) const;
+
+};
+
+#endif
@@ -3,10 +3,17 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <algorithm>
+#include <cctype>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
 #include <vector>
-#include <experimental/vector>
 
 #include "Macros.h"
 
@@ -14,17 +21,121 @@ class DeviceUtils {
 
 public:
 
-  static vk::PhysicalDevice getOptimalPhysicalDevice(const vk::UniqueInstance& uniqueInstance) {
-    vk::PhysicalDevice physicalDevice;
+  /**
+   * Picks the physical device with the highest score. An override naming a device by its index in enumeration order
+   * or by a case insensitive substring of its name takes precedence, as long as that device is suitable.
+   * @param uniqueInstance The instance to enumerate physical devices from.
+   * @param requiredExtensions Device extensions the device must support.
+   * @param requiredVertexFormats Formats the device must be able to read from vertex buffers.
+   * @param surface The surface the device must be able to present to, or a null handle if it will not present.
+   * @param override The device to prefer, falls back to the VULKAN_DEVICE environment variable when empty.
+   * @throws std::runtime_error if no device is suitable.
+   */
+  static vk::PhysicalDevice getOptimalPhysicalDevice(const vk::UniqueInstance& uniqueInstance,
+                                                     const std::vector<const char *>& requiredExtensions,
+                                                     const std::vector<vk::Format>& requiredVertexFormats,
+                                                     const vk::UniqueSurfaceKHR& surface,
+                                                     std::string override = "") {
     auto physicalDevices = uniqueInstance->enumeratePhysicalDevices();
-    std::experimental::erase_if(physicalDevices,
-                                [](const auto& physicalDevice) {
-                                  return physicalDevice.getProperties().deviceType !=
-                                         vk::PhysicalDeviceType::eDiscreteGpu;
-                                });
-
-    physicalDevice = physicalDevices.front();
-    return physicalDevice;
+    if(override.empty())
+      if(const char *environmentOverride = std::getenv("VULKAN_DEVICE"))
+        override = environmentOverride;
+
+    std::optional<vk::PhysicalDevice> best;
+    int64_t bestScore = -1;
+    for(uint32_t i = 0; i < physicalDevices.size(); ++i) {
+      int64_t score = scorePhysicalDevice(physicalDevices[i], requiredExtensions, requiredVertexFormats,
+                                          surface);
+      if(score < 0) continue;
+      if(!override.empty() && matchesOverride(physicalDevices[i], i, override))
+        return physicalDevices[i];
+      if(score > bestScore) {
+        best = physicalDevices[i];
+        bestScore = score;
+      }
+    }
+
+    if(!override.empty())
+      std::cerr << "No suitable physical device matches \"" << override << "\", using the highest scoring one"
+                << std::endl;
+    if(!best)
+      throw std::runtime_error("no physical device supports graphics, the required extensions and vertex formats");
+    return *best;
+  }
+
+  /**
+   * Rates how well suited a physical device is for rendering. Device type dominates, then device local memory, then
+   * queue family layout and limits.
+   * @return The score, or -1 if the device lacks a graphics queue, a required extension, a required vertex format or
+   * presentation support.
+   */
+  static int64_t scorePhysicalDevice(const vk::PhysicalDevice& physicalDevice,
+                                     const std::vector<const char *>& requiredExtensions,
+                                     const std::vector<vk::Format>& requiredVertexFormats,
+                                     const vk::UniqueSurfaceKHR& surface) {
+    std::vector<vk::ExtensionProperties> extensions = physicalDevice.enumerateDeviceExtensionProperties();
+    for(const char *requiredExtension : requiredExtensions)
+      if(std::none_of(extensions.begin(), extensions.end(),
+                      [=](const auto& extension) { return !std::strcmp(extension.extensionName, requiredExtension); }))
+        return -1;
+    for(vk::Format format : requiredVertexFormats)
+      if(!(physicalDevice.getFormatProperties(format).bufferFeatures & vk::FormatFeatureFlagBits::eVertexBuffer))
+        return -1;
+
+    std::vector<vk::QueueFamilyProperties> queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+    bool graphics = false;
+    bool present = !surface;
+    bool dedicatedTransfer = false;
+    bool dedicatedCompute = false;
+    for(uint32_t i = 0; i < uint32(queueFamilyProperties.size()); ++i) {
+      vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+      graphics |= static_cast<bool>(flags & vk::QueueFlagBits::eGraphics);
+      if(surface && physicalDevice.getSurfaceSupportKHR(i, surface.get()))
+        present = true;
+      if(!(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) &&
+         (flags & vk::QueueFlagBits::eTransfer))
+        dedicatedTransfer = true;
+      if(!(flags & vk::QueueFlagBits::eGraphics) && (flags & vk::QueueFlagBits::eCompute))
+        dedicatedCompute = true;
+    }
+    if(!graphics || !present)
+      return -1;
+
+    vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+    int64_t score = 0;
+    switch(properties.deviceType) {
+      case vk::PhysicalDeviceType::eDiscreteGpu:
+        score += 1'000'000;
+        break;
+      case vk::PhysicalDeviceType::eIntegratedGpu:
+        score += 500'000;
+        break;
+      case vk::PhysicalDeviceType::eVirtualGpu:
+        score += 250'000;
+        break;
+      case vk::PhysicalDeviceType::eCpu:
+        score += 100'000;
+        break;
+      default:
+        break;
+    }
+
+    // One point per MiB of device local memory, capped so memory never outweighs the device type.
+    vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
+    vk::DeviceSize deviceLocalMemory = 0;
+    for(uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+      if(memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+        deviceLocalMemory += memoryProperties.memoryHeaps[i].size;
+    score += std::min<int64_t>(int64_t(deviceLocalMemory >> 20U), 64 * 1024);
+
+    if(dedicatedTransfer)
+      score += 20'000;
+    if(dedicatedCompute)
+      score += 10'000;
+
+    score += properties.limits.maxImageDimension2D / 16;
+    score += std::min<int64_t>(properties.limits.maxPushConstantsSize, 256);
+    return score;
   }
 
   /**
@@ -45,7 +156,6 @@ public:
       if(physicalDevice.getSurfaceSupportKHR(i, surface.get()))
         presentQueueFamilyIndex = i;
       if(graphicsQueueFamilyIndex == presentQueueFamilyIndex) break;
-      ++i;
     }
     std::set<std::optional<uint32_t>> ret;
     if(graphicsQueueFamilyIndex != uint32(queueFamilyProperties.size()))
@@ -57,7 +167,143 @@ public:
     return ret;
   }
 
+  /**
+   * Returns the first queue family supporting graphics.
+   * @param physicalDevice The physical device to to select the queue family from.
+   * @return The graphics queue family index if there is one.
+   */
+  static std::optional<uint32_t> getGraphicsQueueFamilyIndex(const vk::PhysicalDevice& physicalDevice) {
+    std::vector<vk::QueueFamilyProperties> queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+    for(uint32_t i = 0; i < uint32(queueFamilyProperties.size()); ++i)
+      if(queueFamilyProperties[i].queueFlags & vk::QueueFlagBits::eGraphics)
+        return i;
+    return {};
+  }
+
+  /**
+   * Returns a queue family dedicated to transfers, i.e. one supporting neither graphics nor compute. Such families
+   * usually map to the device's copy engines and run alongside graphics work.
+   * @param physicalDevice The physical device to select the queue family from.
+   * @return The transfer queue family index if the device has a dedicated one.
+   */
+  static std::optional<uint32_t> getDedicatedTransferQueueFamilyIndex(const vk::PhysicalDevice& physicalDevice) {
+    std::vector<vk::QueueFamilyProperties> queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+    for(uint32_t i = 0; i < uint32(queueFamilyProperties.size()); ++i) {
+      vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+      if((flags & vk::QueueFlagBits::eTransfer) &&
+         !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+        return i;
+    }
+    return {};
+  }
+
+  /**
+   * Returns a queue family supporting compute but not graphics. Work submitted to it can run alongside the graphics
+   * queue's, e.g. post-processing the previous frame while the next one is drawn.
+   * @param physicalDevice The physical device to select the queue family from.
+   * @return The compute queue family index if the device has a dedicated one.
+   */
+  static std::optional<uint32_t> getDedicatedComputeQueueFamilyIndex(const vk::PhysicalDevice& physicalDevice) {
+    std::vector<vk::QueueFamilyProperties> queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+    for(uint32_t i = 0; i < uint32(queueFamilyProperties.size()); ++i) {
+      vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+      if((flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics))
+        return i;
+    }
+    return {};
+  }
+
+  static bool supportsExtension(const vk::PhysicalDevice& physicalDevice, const char *extensionName) {
+    std::vector<vk::ExtensionProperties> extensions = physicalDevice.enumerateDeviceExtensionProperties();
+    return std::any_of(extensions.begin(), extensions.end(),
+                       [=](const auto& extension) { return !std::strcmp(extension.extensionName, extensionName); });
+  }
+
+  /**
+   * Queries the descriptor indexing features of physicalDevice, all unsupported if it lacks VK_EXT_descriptor_indexing
+   * or uniqueInstance was created without VK_KHR_get_physical_device_properties2.
+   */
+  static vk::PhysicalDeviceDescriptorIndexingFeaturesEXT
+  getDescriptorIndexingFeatures(const vk::UniqueInstance& uniqueInstance, const vk::PhysicalDevice& physicalDevice) {
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+    auto getFeatures2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+        uniqueInstance->getProcAddr("vkGetPhysicalDeviceFeatures2KHR"));
+    if(!getFeatures2KHR || !supportsExtension(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+      return descriptorIndexingFeatures;
+    vk::PhysicalDeviceFeatures2 features2;
+    features2.pNext = &descriptorIndexingFeatures;
+    getFeatures2KHR(static_cast<VkPhysicalDevice>(physicalDevice),
+                    reinterpret_cast<VkPhysicalDeviceFeatures2 *>(&features2));
+    return descriptorIndexingFeatures;
+  }
+
+  /**
+   * Queries the timeline semaphore features of physicalDevice, all unsupported if it lacks VK_KHR_timeline_semaphore
+   * or uniqueInstance was created without VK_KHR_get_physical_device_properties2.
+   */
+  static vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR
+  getTimelineSemaphoreFeatures(const vk::UniqueInstance& uniqueInstance, const vk::PhysicalDevice& physicalDevice) {
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures;
+    auto getFeatures2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+        uniqueInstance->getProcAddr("vkGetPhysicalDeviceFeatures2KHR"));
+    if(!getFeatures2KHR || !supportsExtension(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+      return timelineSemaphoreFeatures;
+    vk::PhysicalDeviceFeatures2 features2;
+    features2.pNext = &timelineSemaphoreFeatures;
+    getFeatures2KHR(static_cast<VkPhysicalDevice>(physicalDevice),
+                    reinterpret_cast<VkPhysicalDeviceFeatures2 *>(&features2));
+    return timelineSemaphoreFeatures;
+  }
+
+  /**
+   * Queries the limits of descriptor sets created with update after bind. Only meaningful if
+   * getDescriptorIndexingFeatures() reports support.
+   */
+  static vk::PhysicalDeviceDescriptorIndexingPropertiesEXT
+  getDescriptorIndexingProperties(const vk::UniqueInstance& uniqueInstance, const vk::PhysicalDevice& physicalDevice) {
+    vk::PhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties;
+    auto getProperties2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+        uniqueInstance->getProcAddr("vkGetPhysicalDeviceProperties2KHR"));
+    if(!getProperties2KHR)
+      return descriptorIndexingProperties;
+    vk::PhysicalDeviceProperties2 properties2;
+    properties2.pNext = &descriptorIndexingProperties;
+    getProperties2KHR(static_cast<VkPhysicalDevice>(physicalDevice),
+                      reinterpret_cast<VkPhysicalDeviceProperties2 *>(&properties2));
+    return descriptorIndexingProperties;
+  }
+
+  /**
+   * Finds a memory type allowed by typeBits that has all of the requested properties.
+   * @throws std::runtime_error if there is no such memory type.
+   */
+  static uint32_t findMemoryType(const vk::PhysicalDevice& physicalDevice, uint32_t typeBits,
+                                 vk::MemoryPropertyFlags properties) {
+    vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
+    for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+      if((typeBits & (1U << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        return i;
+    throw std::runtime_error("no memory type with properties " + vk::to_string(properties));
+  }
+
 private:
+
+  static bool matchesOverride(const vk::PhysicalDevice& physicalDevice, uint32_t index, const std::string& override) {
+    if(std::all_of(override.begin(), override.end(), [](unsigned char c) { return std::isdigit(c); })) {
+      // An index too large for stoul matches no device, which getOptimalPhysicalDevice() reports.
+      try {
+        return std::stoul(override) == index;
+      } catch(const std::logic_error&) {
+        return false;
+      }
+    }
+    auto lower = [](std::string str) {
+      std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return std::tolower(c); });
+      return str;
+    };
+    return lower(physicalDevice.getProperties().deviceName).find(lower(override)) != std::string::npos;
+  }
+
 protected:
 
 };
@@ -0,0 +1,24 @@
+#ifndef VULKAN_EMBEDDEDSHADERS_H
+#define VULKAN_EMBEDDEDSHADERS_H
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+/**
+ * Optimised SPIR-V of every shader in src/shaders, compiled and embedded at build time so startup neither compiles
+ * shaders nor reads them from the working directory. Defined by EmbeddedShaders.cpp, which cmake/EmbedShaders.cmake
+ * generates in the build directory.
+ */
+class EmbeddedShaders {
+
+public:
+  /**
+   * @param name The file name of the source, like vertex.vert.
+   * @return Its SPIR-V, empty if there is no such shader.
+   */
+  static std::span<const uint32_t> find(std::string_view name);
+
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef VULKAN_FRAMEDATA_H
+#define VULKAN_FRAMEDATA_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * CPU side timings of a single frame.
+ */
+struct FrameStats {
+  uint64_t frame = 0;
+  // Time spent blocked on the GPU, waiting for this frame's resources and swap chain image to be free again.
+  std::chrono::duration<double, std::milli> cpuWait{0};
+  // Time spent recording and submitting the frame's command buffer.
+  std::chrono::duration<double, std::milli> cpuRecord{0};
+};
+
+/**
+ * Resources owned by one frame in flight. Nothing in here is touched by the CPU until inFlight, and with async compute
+ * postFinished, is signaled.
+ */
+struct FrameData {
+  vk::UniqueSemaphore imageAvailable;
+  vk::UniqueSemaphore renderFinished;
+  vk::UniqueFence inFlight;
+  vk::UniqueCommandPool commandPool;
+  vk::UniqueCommandBuffer commandBuffer;
+  // With async compute, submitted behind commandBuffer to copy the previous frame's post-processed output to the
+  // backbuffer.
+  vk::UniqueCommandBuffer presentCommandBuffer;
+  // With async compute, the pool of the compute family, its command buffer post-processing the frame's scene and the
+  // fence signaled once it has.
+  vk::UniqueCommandPool postCommandPool;
+  vk::UniqueCommandBuffer postCommandBuffer;
+  vk::UniqueFence postFinished;
+  // One pool per recording thread, each with the secondary command buffer that thread records its slice of the
+  // draws into. Pools are only used by one thread at a time and reset as a whole once per frame.
+  std::vector<vk::UniqueCommandPool> slicePools;
+  std::vector<vk::UniqueCommandBuffer> sliceCommandBuffers;
+  // Signaled by the uploads the frame acquired, waited on by its submission.
+  std::vector<vk::Semaphore> uploadSemaphores;
+  FrameStats stats;
+};
+
+#endif
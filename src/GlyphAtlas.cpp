@@ -0,0 +1,255 @@
+#include "GlyphAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace {
+
+  /**
+   * Squared euclidean distance transform of one row or column, after Felzenszwalb and Huttenlocher. f holds 0 at the
+   * features and infinity elsewhere on input and the squared distance to the nearest feature on output.
+   */
+  void transform(std::vector<double>& f, std::size_t first, std::size_t stride, std::size_t count,
+                 std::vector<double>& values, std::vector<std::size_t>& parabolas, std::vector<double>& bounds) {
+    for(std::size_t i = 0; i < count; ++i)
+      values[i] = f[first + i * stride];
+    std::size_t k = 0;
+    parabolas[0] = 0;
+    bounds[0] = -std::numeric_limits<double>::infinity();
+    bounds[1] = std::numeric_limits<double>::infinity();
+    for(std::size_t q = 1; q < count; ++q) {
+      if(std::isinf(values[q])) continue;
+      double s;
+      while(true) {
+        std::size_t v = parabolas[k];
+        s = std::isinf(values[v]) ? -std::numeric_limits<double>::infinity()
+                                  : ((values[q] + double(q * q)) - (values[v] + double(v * v))) /
+                                    (2.0 * double(q) - 2.0 * double(v));
+        if(s > bounds[k] || k == 0) break;
+        --k;
+      }
+      if(s <= bounds[k]) {
+        parabolas[k] = q;
+      } else {
+        ++k;
+        parabolas[k] = q;
+        bounds[k] = s;
+      }
+      bounds[k + 1] = std::numeric_limits<double>::infinity();
+    }
+    k = 0;
+    for(std::size_t q = 0; q < count; ++q) {
+      while(bounds[k + 1] < double(q))
+        ++k;
+      double distance = double(q) - double(parabolas[k]);
+      f[first + q * stride] = distance * distance + values[parabolas[k]];
+    }
+  }
+
+  /**
+   * Squared distance of every pixel to the nearest pixel of grid that is 0.
+   */
+  void transform(std::vector<double>& grid, std::size_t width, std::size_t height) {
+    std::size_t length = std::max(width, height);
+    std::vector<double> values(length);
+    std::vector<std::size_t> parabolas(length);
+    std::vector<double> bounds(length + 1);
+    for(std::size_t x = 0; x < width; ++x)
+      transform(grid, x, width, height, values, parabolas, bounds);
+    for(std::size_t y = 0; y < height; ++y)
+      transform(grid, y * width, 1, width, values, parabolas, bounds);
+  }
+
+}
+
+GlyphAtlas::GlyphAtlas(const vk::UniqueDevice& device, MemoryAllocator& allocator, UploadManager& uploadManager,
+                       const fs::path& fontPath, uint32_t framesInFlight, uint32_t size)
+    : uploadManager(uploadManager), size(size), framesInFlight(framesInFlight) {
+  if(FT_Init_FreeType(&library))
+    throw std::runtime_error("could not initialize FreeType");
+  if(FT_New_Face(library, fontPath.string().c_str(), 0, &face)) {
+    FT_Done_FreeType(library);
+    throw std::runtime_error("could not load font " + fontPath.string());
+  }
+  FT_Set_Pixel_Sizes(face, 0, GLYPH_SIZE);
+
+  // Glyphs are copied on the graphics queue, so only the initial clear moves the atlas over from the transfer queue.
+  vk::ImageCreateInfo imageCreateInfo = {{}, vk::ImageType::e2D, vk::Format::eR8Unorm, {size, size, 1}, 1, 1,
+                                         vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal,
+                                         vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                                         vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined};
+  image = allocator.createImage(imageCreateInfo, MemoryUsage::eGpuOnly);
+  vk::ImageViewCreateInfo imageViewCreateInfo = {{}, image.image.get(), vk::ImageViewType::e2D,
+                                                 vk::Format::eR8Unorm, {},
+                                                 {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}};
+  imageView = device->createImageViewUnique(imageViewCreateInfo);
+  std::vector<uint8_t> empty(std::size_t(size) * size, 0);
+  uploadManager.uploadImage(image.image.get(), empty.data(), empty.size(), {size, size, 1},
+                            vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+  uint32_t slotsPerRow = size / SLOT_SIZE;
+  slots.resize(slotsPerRow * slotsPerRow);
+  // Popped from the back, so glyphs fill the atlas from the top left.
+  for(auto slot = uint32(slots.size()); slot > 0; --slot)
+    freeSlots.push_back(slot - 1);
+}
+
+GlyphAtlas::~GlyphAtlas() {
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+}
+
+std::optional<GlyphPlacement> GlyphAtlas::acquire(uint32_t codepoint) {
+  if(!hasPixels(codepoint))
+    return {};
+  auto resident = residentSlots.find(codepoint);
+  if(resident != residentSlots.end()) {
+    Slot& slot = slots[resident->second];
+    if(slot.references++ == 0)
+      evictable.erase(slot.lruPosition);
+    return slot.placement;
+  }
+  std::optional<uint32_t> slot = allocateSlot();
+  if(!slot)
+    return {};
+  rasterize(codepoint, *slot);
+  residentSlots[codepoint] = *slot;
+  slots[*slot].codepoint = codepoint;
+  slots[*slot].references = 1;
+  return slots[*slot].placement;
+}
+
+void GlyphAtlas::release(uint32_t codepoint, uint64_t frame) {
+  Slot& slot = slots[residentSlots.at(codepoint)];
+  slot.releaseFrame = std::max(slot.releaseFrame, frame);
+  if(--slot.references == 0)
+    slot.lruPosition = evictable.insert(evictable.end(), residentSlots[codepoint]);
+}
+
+void GlyphAtlas::setFrame(uint64_t frame) {
+  this->frame = frame;
+}
+
+float GlyphAtlas::getAdvance(uint32_t codepoint) {
+  return getMetrics(codepoint).advance;
+}
+
+float GlyphAtlas::getKerning(uint32_t left, uint32_t right) const {
+  if(!FT_HAS_KERNING(face)) return 0.0F;
+  FT_Vector kerning;
+  if(FT_Get_Kerning(face, FT_Get_Char_Index(face, left), FT_Get_Char_Index(face, right), FT_KERNING_DEFAULT,
+                    &kerning))
+    return 0.0F;
+  return float(kerning.x) / 64.0F;
+}
+
+bool GlyphAtlas::hasPixels(uint32_t codepoint) {
+  return !getMetrics(codepoint).empty;
+}
+
+float GlyphAtlas::getAscender() const {
+  return float(face->size->metrics.ascender) / 64.0F;
+}
+
+float GlyphAtlas::getLineHeight() const {
+  return float(face->size->metrics.height) / 64.0F;
+}
+
+vk::ImageView GlyphAtlas::getImageView() const {
+  return imageView.get();
+}
+
+uint32_t GlyphAtlas::getResidentCount() const {
+  return uint32(residentSlots.size());
+}
+
+uint64_t GlyphAtlas::getEvictionCount() const {
+  return evictionCount;
+}
+
+std::vector<uint8_t> GlyphAtlas::createDistanceField(const uint8_t *coverage, uint32_t width, uint32_t height,
+                                                     int32_t pitch) {
+  std::size_t fieldWidth = width + 2 * SPREAD;
+  std::size_t fieldHeight = height + 2 * SPREAD;
+  // Distances to the nearest pixel inside and outside of the outline.
+  std::vector<double> toInside(fieldWidth * fieldHeight, std::numeric_limits<double>::infinity());
+  std::vector<double> toOutside(fieldWidth * fieldHeight, 0.0);
+  for(uint32_t y = 0; y < height; ++y) {
+    for(uint32_t x = 0; x < width; ++x) {
+      if(coverage[std::ptrdiff_t(y) * pitch + x] < 128) continue;
+      std::size_t i = (y + SPREAD) * fieldWidth + x + SPREAD;
+      toInside[i] = 0.0;
+      toOutside[i] = std::numeric_limits<double>::infinity();
+    }
+  }
+  transform(toInside, fieldWidth, fieldHeight);
+  transform(toOutside, fieldWidth, fieldHeight);
+
+  std::vector<uint8_t> field(fieldWidth * fieldHeight);
+  for(std::size_t i = 0; i < field.size(); ++i) {
+    // Pixel centers lie half a pixel off the outline they border.
+    double distance = std::sqrt(toOutside[i]) - std::sqrt(toInside[i]);
+    distance -= std::copysign(0.5, distance);
+    double value = std::clamp(0.5 + distance / (2.0 * SPREAD), 0.0, 1.0);
+    field[i] = uint8_t(std::lround(value * 255.0));
+  }
+  return field;
+}
+
+const GlyphAtlas::Metrics& GlyphAtlas::getMetrics(uint32_t codepoint) {
+  auto it = metrics.find(codepoint);
+  if(it != metrics.end())
+    return it->second;
+  Metrics glyphMetrics = {0.0F, true};
+  if(!FT_Load_Char(face, codepoint, FT_LOAD_DEFAULT))
+    glyphMetrics = {float(face->glyph->advance.x) / 64.0F,
+                    face->glyph->metrics.width == 0 || face->glyph->metrics.height == 0};
+  return metrics.emplace(codepoint, glyphMetrics).first->second;
+}
+
+std::optional<uint32_t> GlyphAtlas::allocateSlot() {
+  if(!freeSlots.empty()) {
+    uint32_t slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+  }
+  // Released in frame order, so if the oldest may still be sampled, every other one may be too.
+  if(evictable.empty() || slots[evictable.front()].releaseFrame + framesInFlight > frame)
+    return {};
+  uint32_t slot = evictable.front();
+  evictable.pop_front();
+  residentSlots.erase(*slots[slot].codepoint);
+  slots[slot].codepoint.reset();
+  ++evictionCount;
+  return slot;
+}
+
+void GlyphAtlas::rasterize(uint32_t codepoint, uint32_t slot) {
+  if(FT_Load_Char(face, codepoint, FT_LOAD_RENDER))
+    throw std::runtime_error("could not rasterize glyph " + std::to_string(codepoint));
+  const FT_Bitmap& bitmap = face->glyph->bitmap;
+  // Glyphs too large for a slot are cropped.
+  uint32_t width = std::min(uint32(bitmap.width), SLOT_SIZE - 2 * SPREAD);
+  uint32_t height = std::min(uint32(bitmap.rows), SLOT_SIZE - 2 * SPREAD);
+  std::vector<uint8_t> field = createDistanceField(bitmap.buffer, width, height, bitmap.pitch);
+
+  uint32_t slotsPerRow = size / SLOT_SIZE;
+  uint32_t x = slot % slotsPerRow * SLOT_SIZE;
+  uint32_t y = slot / slotsPerRow * SLOT_SIZE;
+  glm::vec2 fieldSize = {float(width + 2 * SPREAD), float(height + 2 * SPREAD)};
+  // Frames in flight may be sampling other glyphs, so the copy waits for them on the graphics queue.
+  uploadManager.updateImage(image.image.get(), field.data(), field.size(),
+                            {uint32(fieldSize.x), uint32(fieldSize.y), 1}, {int32_t(x), int32_t(y), 0});
+
+  glm::vec2 position = {float(x), float(y)};
+  slots[slot].placement = {glm::vec4(position, position + fieldSize) / float(size),
+                           {float(face->glyph->bitmap_left) - float(SPREAD),
+                            -float(face->glyph->bitmap_top) - float(SPREAD)},
+                           fieldSize};
+}
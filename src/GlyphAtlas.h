@@ -0,0 +1,158 @@
+#ifndef VULKAN_GLYPHATLAS_H
+#define VULKAN_GLYPHATLAS_H
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+
+#include "Macros.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+
+typedef struct FT_LibraryRec_ *FT_Library;
+typedef struct FT_FaceRec_ *FT_Face;
+
+/**
+ * Where a glyph lies in the atlas and where its quad goes relative to the pen position on the baseline, in pixels at
+ * GlyphAtlas::GLYPH_SIZE.
+ */
+struct GlyphPlacement {
+  glm::vec4 uvRect;
+  glm::vec2 offset;
+  glm::vec2 size;
+};
+
+/**
+ * Rasterizes glyphs of a font on demand into signed distance fields packed in a single texture, so text renders sharp
+ * at any scale from one set of glyphs.
+ *
+ * The atlas is split into equally sized slots, so any glyph fits any free slot and evicting never fragments it. Glyphs
+ * are reference counted by the text using them, and a glyph nothing references stays resident until its slot is
+ * needed, least recently released first. Slots are only reused once the frames that could still sample the old glyph
+ * finished. Every new glyph is uploaded on its own as a sub-rectangle of the texture, copied on the graphics queue
+ * after the frames sampling the atlas.
+ */
+class GlyphAtlas {
+
+public:
+  // Pixels per em the glyphs are rasterized at.
+  static constexpr uint32_t GLYPH_SIZE = 32;
+  // Pixels the distance field extends beyond the outline, which bounds how far it can be scaled down.
+  static constexpr uint32_t SPREAD = 4;
+  static constexpr uint32_t SLOT_SIZE = 48;
+  static constexpr uint32_t DEFAULT_SIZE = 1024;
+
+  /**
+   * @throws std::runtime_error if the font can not be loaded.
+   */
+  GlyphAtlas(const vk::UniqueDevice& device, MemoryAllocator& allocator, UploadManager& uploadManager,
+             const fs::path& fontPath, uint32_t framesInFlight, uint32_t size = DEFAULT_SIZE);
+
+  ~GlyphAtlas();
+
+  GlyphAtlas(const GlyphAtlas&) = delete;
+
+  GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+  /**
+   * References the glyph of codepoint, rasterizing and uploading it if it is not resident.
+   * @return Where to draw it, or nothing for glyphs without pixels, like spaces, or if every slot is referenced.
+   */
+  std::optional<GlyphPlacement> acquire(uint32_t codepoint);
+
+  /**
+   * Drops a reference taken by acquire() that returned a placement.
+   * @param frame The frame counter of the last frame that may draw the glyph.
+   */
+  void release(uint32_t codepoint, uint64_t frame);
+
+  /**
+   * Marks frame as submitted, slots released before the frames still in flight become reusable.
+   */
+  void setFrame(uint64_t frame);
+
+  /**
+   * @return How far the pen moves after codepoint, in pixels at GLYPH_SIZE.
+   */
+  float getAdvance(uint32_t codepoint);
+
+  float getKerning(uint32_t left, uint32_t right) const;
+
+  /**
+   * @return Whether the glyph of codepoint covers any pixels, unlike a space.
+   */
+  bool hasPixels(uint32_t codepoint);
+
+  // Distance from the top of a line to its baseline and between baselines, in pixels at GLYPH_SIZE.
+  float getAscender() const;
+
+  float getLineHeight() const;
+
+  vk::ImageView getImageView() const;
+
+  uint32_t getResidentCount() const;
+
+  uint64_t getEvictionCount() const;
+
+  /**
+   * Converts 8 bit coverage into a signed distance field SPREAD pixels larger on every side, 0.5 on the outline and
+   * increasing inwards.
+   */
+  static std::vector<uint8_t> createDistanceField(const uint8_t *coverage, uint32_t width, uint32_t height,
+                                                  int32_t pitch);
+
+private:
+
+  struct Slot {
+    std::optional<uint32_t> codepoint;
+    GlyphPlacement placement;
+    uint32_t references = 0;
+    // The last frame that may sample it.
+    uint64_t releaseFrame = 0;
+    // Position in the eviction order while unreferenced.
+    std::list<uint32_t>::iterator lruPosition;
+  };
+
+  struct Metrics {
+    float advance;
+    // Whether the glyph has no pixels.
+    bool empty;
+  };
+
+  UploadManager& uploadManager;
+  FT_Library library = nullptr;
+  FT_Face face = nullptr;
+  AllocatedImage image;
+  vk::UniqueImageView imageView;
+  uint32_t size;
+  uint32_t framesInFlight;
+  uint64_t frame = 0;
+  std::vector<Slot> slots;
+  std::unordered_map<uint32_t, uint32_t> residentSlots;
+  // Unreferenced slots, least recently released first.
+  std::list<uint32_t> evictable;
+  std::vector<uint32_t> freeSlots;
+  std::unordered_map<uint32_t, Metrics> metrics;
+  uint64_t evictionCount = 0;
+
+  const Metrics& getMetrics(uint32_t codepoint);
+
+  /**
+   * @return A slot that is free or holds the least recently released glyph no frame in flight may sample.
+   */
+  std::optional<uint32_t> allocateSlot();
+
+  /**
+   * Rasterizes the glyph of codepoint into slot and uploads it.
+   */
+  void rasterize(uint32_t codepoint, uint32_t slot);
+
+};
+
+#endif
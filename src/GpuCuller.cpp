@@ -0,0 +1,152 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#include "Macros.h"
+#include "VkUtils.h"
+
+GpuCuller::GpuCuller(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice,
+                     MemoryAllocator& allocator, DescriptorAllocator& descriptorAllocator,
+                     PipelineCache& pipelineCache, vk::UniqueShaderModule shader, uint32_t framesInFlight,
+                     uint32_t capacity, bool drawIndirectCount, bool multiDrawIndirect,
+                     bool drawIndirectFirstInstance)
+    : device(device), shader(std::move(shader)), capacity(capacity),
+      drawIndirectFirstInstance(drawIndirectFirstInstance) {
+  uint32_t maxDrawIndirectCount = physicalDevice.getProperties().limits.maxDrawIndirectCount;
+  maxDrawCount = multiDrawIndirect && drawIndirectFirstInstance ? std::max(maxDrawIndirectCount, 1U) : 1U;
+  // A single vkCmdDrawIndirectCountKHR has to be able to draw every chunk, each from its own first instance.
+  if(drawIndirectCount && multiDrawIndirect && drawIndirectFirstInstance && maxDrawIndirectCount >= getChunkCount())
+    drawIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndirectCountKHR>(
+        device->getProcAddr("vkCmdDrawIndirectCountKHR"));
+
+  vk::DescriptorSetLayout descriptorSetLayout = descriptorAllocator.getLayout({
+      vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+      {1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+      {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute}});
+  vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants)};
+  pipelineLayout = device->createPipelineLayoutUnique({{}, 1, &descriptorSetLayout, 1, &pushConstantRange});
+  pipeline = pipelineCache.getComputePipeline({this->shader.get(), pipelineLayout.get()});
+
+  // Chunks are culled whole, so the instance buffer has room for the last one's padding.
+  vk::DeviceSize instancesSize = vk::DeviceSize(getChunkCount()) * CHUNK_SIZE * sizeof(SpriteInstance);
+  vk::DeviceSize drawsSize = DRAWS_OFFSET + vk::DeviceSize(getChunkCount()) * sizeof(vk::DrawIndirectCommand);
+  objectBuffer = allocator.createBuffer({{}, std::max<vk::DeviceSize>(vk::DeviceSize(capacity) *
+                                                                      sizeof(SpriteInstance), 4),
+                                         vk::BufferUsageFlagBits::eStorageBuffer |
+                                         vk::BufferUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive},
+                                        MemoryUsage::eGpuOnly);
+  frames.resize(framesInFlight);
+  for(uint32_t i = 0; i < framesInFlight; ++i) {
+    Frame& frame = frames[i];
+    frame.instanceBuffer = allocator.createBuffer({{}, std::max<vk::DeviceSize>(instancesSize, 4),
+                                                   vk::BufferUsageFlagBits::eStorageBuffer |
+                                                   vk::BufferUsageFlagBits::eVertexBuffer,
+                                                   vk::SharingMode::eExclusive}, MemoryUsage::eGpuOnly);
+    frame.drawBuffer = allocator.createBuffer({{}, drawsSize, vk::BufferUsageFlagBits::eStorageBuffer |
+                                                              vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                              vk::BufferUsageFlagBits::eTransferDst,
+                                               vk::SharingMode::eExclusive}, MemoryUsage::eGpuOnly);
+    frame.descriptorSet = descriptorAllocator.getCachedSet(
+        descriptorSetLayout,
+        DescriptorBindings().buffer(0, vk::DescriptorType::eStorageBuffer, objectBuffer.buffer.get())
+                            .buffer(1, vk::DescriptorType::eStorageBuffer, frame.instanceBuffer.buffer.get())
+                            .buffer(2, vk::DescriptorType::eStorageBuffer, frame.drawBuffer.buffer.get()));
+  }
+}
+
+void GpuCuller::setObjects(UploadManager& uploadManager, const std::vector<SpriteInstance>& objects) {
+  if(objects.size() > capacity)
+    throw std::runtime_error(std::to_string(objects.size()) + " objects exceed the GPU culling capacity of " +
+                             std::to_string(capacity));
+  if(!objects.empty())
+    uploadManager.uploadBuffer(objectBuffer.buffer.get(), 0, objects.data(),
+                               vk::DeviceSize(objects.size()) * sizeof(SpriteInstance));
+  objectCount = uint32(objects.size());
+}
+
+void GpuCuller::clearObjects() {
+  objectCount = 0;
+}
+
+void GpuCuller::record(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, const Aabb& viewport) const {
+  if(objectCount == 0) return;
+  const Frame& frame = frames[frameIndex];
+  vk::PipelineStageFlags cullStages = vk::PipelineStageFlagBits::eComputeShader;
+  if(isCompacting()) {
+    commandBuffer.fillBuffer(frame.drawBuffer.buffer.get(), 0, sizeof(uint32_t), 0);
+    vk::BufferMemoryBarrier countBarrier = {vk::AccessFlagBits::eTransferWrite,
+                                            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                                            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                            frame.drawBuffer.buffer.get(), 0, sizeof(uint32_t)};
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, cullStages, {}, 0, nullptr, 1, &countBarrier,
+                                  0, nullptr);
+  }
+
+  PushConstants pushConstants = {{viewport.min, viewport.max}, objectCount, isCompacting() ? 1U : 0U,
+                                 drawIndirectFirstInstance ? 1U : 0U};
+  commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout.get(), 0, 1, &frame.descriptorSet,
+                                   0, nullptr);
+  commandBuffer.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants),
+                              &pushConstants);
+  commandBuffer.dispatch((objectCount + CHUNK_SIZE - 1) / CHUNK_SIZE, 1, 1);
+
+  // The frame's fence guarantees its previous draws finished, so only the draws of this frame wait.
+  std::array<vk::BufferMemoryBarrier, 2> barriers = {
+      vk::BufferMemoryBarrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eVertexAttributeRead,
+                              VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, frame.instanceBuffer.buffer.get(), 0,
+                              VK_WHOLE_SIZE},
+      {vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead, VK_QUEUE_FAMILY_IGNORED,
+       VK_QUEUE_FAMILY_IGNORED, frame.drawBuffer.buffer.get(), 0, VK_WHOLE_SIZE}};
+  commandBuffer.pipelineBarrier(cullStages, vk::PipelineStageFlagBits::eDrawIndirect |
+                                            vk::PipelineStageFlagBits::eVertexInput, {}, 0, nullptr,
+                                vk::size(barriers), barriers.data(), 0, nullptr);
+}
+
+void GpuCuller::draw(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex) const {
+  if(objectCount == 0) return;
+  const Frame& frame = frames[frameIndex];
+  uint32_t chunkCount = (objectCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  if(!drawIndirectFirstInstance) {
+    // The commands all start at instance 0, so each chunk's survivors are bound in turn.
+    for(uint32_t chunk = 0; chunk < chunkCount; ++chunk) {
+      vk::DeviceSize offset = vk::DeviceSize(chunk) * CHUNK_SIZE * sizeof(SpriteInstance);
+      commandBuffer.bindVertexBuffers(0, 1, &frame.instanceBuffer.buffer.get(), &offset);
+      commandBuffer.drawIndirect(frame.drawBuffer.buffer.get(),
+                                 DRAWS_OFFSET + vk::DeviceSize(chunk) * sizeof(vk::DrawIndirectCommand), 1,
+                                 sizeof(vk::DrawIndirectCommand));
+    }
+    return;
+  }
+  vk::DeviceSize offset = 0;
+  commandBuffer.bindVertexBuffers(0, 1, &frame.instanceBuffer.buffer.get(), &offset);
+  if(isCompacting()) {
+    auto drawBuffer = static_cast<VkBuffer>(frame.drawBuffer.buffer.get());
+    drawIndirectCountKHR(static_cast<VkCommandBuffer>(commandBuffer), drawBuffer, DRAWS_OFFSET, drawBuffer, 0,
+                         chunkCount, sizeof(vk::DrawIndirectCommand));
+    return;
+  }
+  for(uint32_t first = 0; first < chunkCount; first += maxDrawCount)
+    commandBuffer.drawIndirect(frame.drawBuffer.buffer.get(),
+                               DRAWS_OFFSET + vk::DeviceSize(first) * sizeof(vk::DrawIndirectCommand),
+                               std::min(maxDrawCount, chunkCount - first), sizeof(vk::DrawIndirectCommand));
+}
+
+uint32_t GpuCuller::getObjectCount() const {
+  return objectCount;
+}
+
+uint32_t GpuCuller::getCapacity() const {
+  return capacity;
+}
+
+bool GpuCuller::isCompacting() const {
+  return drawIndirectCountKHR != nullptr;
+}
+
+uint32_t GpuCuller::getChunkCount() const {
+  return std::max((capacity + CHUNK_SIZE - 1) / CHUNK_SIZE, 1U);
+}
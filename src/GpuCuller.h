@@ -0,0 +1,117 @@
+#ifndef VULKAN_GPUCULLER_H
+#define VULKAN_GPUCULLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "SceneIndex.h"
+#include "SpriteBatch.h"
+#include "UploadManager.h"
+
+/**
+ * Culls sprites uploaded once against the viewport in a compute shader every frame, so drawing them costs the CPU
+ * nothing but a dispatch and a few indirect draws however many there are.
+ *
+ * Objects are culled in chunks of CHUNK_SIZE. The survivors of a chunk are compacted, in their original order, into
+ * the frame's instance buffer along with a VkDrawIndirectCommand drawing them. With VK_KHR_draw_indirect_count only
+ * the chunks with survivors append a command and a single vkCmdDrawIndirectCountKHR draws them, in no particular
+ * order. Without it every chunk writes a command, empty ones included, drawn in chunk order by vkCmdDrawIndirect, once
+ * per chunk unless multiDrawIndirect is enabled. Without drawIndirectFirstInstance the commands can't start at their
+ * chunk, so every chunk is drawn on its own with the instance buffer bound at its offset, and never compacted.
+ */
+class GpuCuller {
+
+public:
+  // Objects per workgroup of shaders/cull.comp.
+  static constexpr uint32_t CHUNK_SIZE = 64;
+
+  /**
+   * @param shader shaders/cull.comp.
+   * @param capacity The most objects setObjects() accepts.
+   * @param drawIndirectCount Whether VK_KHR_draw_indirect_count is enabled.
+   * @param multiDrawIndirect Whether the multiDrawIndirect feature is enabled.
+   * @param drawIndirectFirstInstance Whether the drawIndirectFirstInstance feature is enabled.
+   */
+  GpuCuller(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice, MemoryAllocator& allocator,
+            DescriptorAllocator& descriptorAllocator, PipelineCache& pipelineCache, vk::UniqueShaderModule shader,
+            uint32_t framesInFlight, uint32_t capacity, bool drawIndirectCount, bool multiDrawIndirect,
+            bool drawIndirectFirstInstance);
+
+  GpuCuller(const GpuCuller&) = delete;
+
+  GpuCuller& operator=(const GpuCuller&) = delete;
+
+  /**
+   * Uploads the objects culled and drawn from now on. No frame in flight may still be culling the previous ones.
+   * @throws std::runtime_error if there are more than the capacity.
+   */
+  void setObjects(UploadManager& uploadManager, const std::vector<SpriteInstance>& objects);
+
+  /**
+   * Stops drawing any objects.
+   */
+  void clearObjects();
+
+  /**
+   * Records the culling of a frame against viewport, in pixels, outside of any render pass. Its results are visible
+   * to the indirect draws and vertex input afterwards.
+   */
+  void record(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, const Aabb& viewport) const;
+
+  /**
+   * Records the draws of the objects culled by record() for the same frame. The sprite pipeline must be bound.
+   */
+  void draw(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex) const;
+
+  uint32_t getObjectCount() const;
+
+  uint32_t getCapacity() const;
+
+  /**
+   * @return Whether the draws are compacted and drawn with vkCmdDrawIndirectCountKHR.
+   */
+  bool isCompacting() const;
+
+private:
+
+  struct PushConstants {
+    glm::vec4 viewport;
+    uint32_t objectCount;
+    uint32_t compact;
+    uint32_t offsetInstances;
+  };
+
+  struct Frame {
+    AllocatedBuffer instanceBuffer;
+    // The draw count, padded to DRAWS_OFFSET, followed by a command per chunk.
+    AllocatedBuffer drawBuffer;
+    // Owned by the descriptor allocator.
+    vk::DescriptorSet descriptorSet;
+  };
+
+  static constexpr vk::DeviceSize DRAWS_OFFSET = 16;
+
+  const vk::UniqueDevice& device;
+  vk::UniqueShaderModule shader;
+  vk::UniquePipelineLayout pipelineLayout;
+  // Owned by the pipeline cache.
+  vk::Pipeline pipeline;
+  AllocatedBuffer objectBuffer;
+  std::vector<Frame> frames;
+  PFN_vkCmdDrawIndirectCountKHR drawIndirectCountKHR = nullptr;
+  uint32_t capacity;
+  uint32_t objectCount = 0;
+  // Draws per vkCmdDrawIndirect without draw count support.
+  uint32_t maxDrawCount;
+  bool drawIndirectFirstInstance;
+
+  uint32_t getChunkCount() const;
+
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+GpuProfiler::Scope::Scope(GpuProfiler& profiler, const vk::CommandBuffer& commandBuffer, const char *name)
+    : profiler(profiler), commandBuffer(commandBuffer), scope(profiler.begin(commandBuffer, name)) {
+}
+
+GpuProfiler::Scope::~Scope() {
+  profiler.end(commandBuffer, scope);
+}
+
+GpuProfiler::GpuProfiler(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice,
+                         uint32_t queueFamilyIndex, uint32_t framesInFlight) : device(device) {
+  vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+  timestampPeriod = properties.limits.timestampPeriod;
+  uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+  timestampMask = validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits) - 1;
+  // Without valid bits the queue cannot write timestamps at all, every scope is then a no-op.
+  if(validBits == 0) return;
+
+  vk::QueryPoolCreateInfo queryPoolCreateInfo = {{}, vk::QueryType::eTimestamp, 2 * MAX_SCOPES_PER_FRAME, {}};
+  for(uint32_t i = 0; i < framesInFlight; ++i) {
+    frames.push_back(std::make_unique<FrameQueries>());
+    frames.back()->queryPool = device->createQueryPoolUnique(queryPoolCreateInfo);
+  }
+}
+
+void GpuProfiler::beginFrame(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, uint64_t frame) {
+  if(!isSupported()) return;
+  currentFrameIndex = frameIndex;
+  FrameQueries& queries = *frames[frameIndex];
+  queries.scopeCount = 0;
+  queries.frame = frame;
+  queries.pending = true;
+  commandBuffer.resetQueryPool(queries.queryPool.get(), 0, 2 * MAX_SCOPES_PER_FRAME);
+}
+
+uint32_t GpuProfiler::begin(const vk::CommandBuffer& commandBuffer, const char *name,
+                            vk::PipelineStageFlagBits stage) {
+  if(!isSupported()) return NO_SCOPE;
+  FrameQueries& queries = *frames[currentFrameIndex];
+  uint32_t scope = queries.scopeCount++;
+  if(scope >= MAX_SCOPES_PER_FRAME) return NO_SCOPE;
+  queries.names[scope] = name;
+  commandBuffer.writeTimestamp(stage, queries.queryPool.get(), 2 * scope);
+  return scope;
+}
+
+void GpuProfiler::end(const vk::CommandBuffer& commandBuffer, uint32_t scope, vk::PipelineStageFlagBits stage) {
+  if(scope == NO_SCOPE) return;
+  commandBuffer.writeTimestamp(stage, frames[currentFrameIndex]->queryPool.get(), 2 * scope + 1);
+}
+
+void GpuProfiler::collect(uint32_t frameIndex) {
+  if(!isSupported()) return;
+  FrameQueries& queries = *frames[frameIndex];
+  if(!queries.pending) return;
+  queries.pending = false;
+  uint32_t scopeCount = std::min(queries.scopeCount.load(), MAX_SCOPES_PER_FRAME);
+  if(scopeCount == 0) return;
+
+  std::vector<uint64_t> timestamps(2 * scopeCount);
+  // The frame's fence has signaled, so this returns right away. eNotReady would mean a scope was never ended.
+  if(device->getQueryPoolResults<uint64_t>(queries.queryPool.get(), 0, 2 * scopeCount, timestamps, sizeof(uint64_t),
+                                           vk::QueryResultFlagBits::e64) != vk::Result::eSuccess)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for(uint32_t scope = 0; scope < scopeCount; ++scope) {
+    uint64_t begin = timestamps[2 * scope] & timestampMask;
+    uint64_t end = timestamps[2 * scope + 1] & timestampMask;
+    if(!origin)
+      origin = begin;
+    // Masked subtraction stays correct across a wrap of the valid bits.
+    double duration = double((end - begin) & timestampMask) * timestampPeriod;
+
+    std::string_view name = queries.names[scope];
+    auto [it, inserted] = histories.try_emplace(name);
+    if(inserted)
+      scopeOrder.push_back(name);
+    History& history = it->second;
+    if(history.samples.size() < HISTORY_SIZE) {
+      history.samples.push_back(duration);
+    } else {
+      history.samples[history.next] = duration;
+      history.next = (history.next + 1) % HISTORY_SIZE;
+    }
+
+    if(traceEvents.size() < MAX_TRACE_EVENTS)
+      traceEvents.push_back({queries.names[scope], queries.frame,
+                             double((begin - *origin) & timestampMask) * timestampPeriod, duration});
+  }
+}
+
+std::vector<GpuScopeStats> GpuProfiler::getStats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<GpuScopeStats> stats;
+  for(std::string_view name : scopeOrder) {
+    std::vector<double> samples = histories.at(name).samples;
+    if(samples.empty()) continue;
+    auto p99 = samples.begin() + std::ptrdiff_t((samples.size() - 1) * 99 / 100);
+    std::nth_element(samples.begin(), p99, samples.end());
+    // Nanoseconds to milliseconds.
+    stats.push_back({name, *std::min_element(samples.begin(), samples.end()) / 1e6,
+                     std::accumulate(samples.begin(), samples.end(), 0.0) / double(samples.size()) / 1e6,
+                     *p99 / 1e6, uint32(samples.size())});
+  }
+  return stats;
+}
+
+void GpuProfiler::resetStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  histories.clear();
+  scopeOrder.clear();
+}
+
+void GpuProfiler::writeTrace(const fs::path& path) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ofstream file(path, std::ios_base::trunc);
+  file << std::fixed << std::setprecision(3);
+  file << R"({"displayTimeUnit":"ms","traceEvents":[)" << '\n'
+       << R"({"name":"process_name","ph":"M","pid":1,"tid":0,"args":{"name":"GPU"}})";
+  for(const TraceEvent& event : traceEvents) {
+    file << ",\n{\"name\":\"";
+    for(const char *c = event.name; *c; ++c) {
+      if(*c == '"' || *c == '\\')
+        file << '\\';
+      file << *c;
+    }
+    // Chrome traces are in microseconds.
+    file << R"(","cat":"gpu","ph":"X","pid":1,"tid":0,"ts":)" << event.start / 1e3 << R"(,"dur":)"
+         << event.duration / 1e3 << R"(,"args":{"frame":)" << event.frame << "}}";
+  }
+  file << "\n]}\n";
+  if(!file)
+    std::cerr << "Could not write GPU trace " << path << std::endl;
+
+#ifdef DEBUG
+  std::cout << "Wrote " << traceEvents.size() << " GPU scopes to " << path << std::endl;
+#endif
+}
+
+bool GpuProfiler::isSupported() const {
+  return !frames.empty();
+}
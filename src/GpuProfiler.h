@@ -0,0 +1,150 @@
+#ifndef VULKAN_GPUPROFILER_H
+#define VULKAN_GPUPROFILER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "Macros.h"
+
+/**
+ * GPU durations of one scope over the last GpuProfiler::HISTORY_SIZE frames, in milliseconds.
+ */
+struct GpuScopeStats {
+  std::string_view name;
+  double min = 0;
+  double average = 0;
+  double p99 = 0;
+  uint32_t sampleCount = 0;
+};
+
+/**
+ * Measures named regions of command buffers with timestamp queries. Every frame in flight owns a query pool, which is
+ * read back once the frame's fence has signaled, so collecting results never waits for the GPU.
+ *
+ * Scopes may be recorded from several threads into different command buffers of the same frame. Scope names must be
+ * string literals or otherwise outlive the profiler.
+ */
+class GpuProfiler {
+
+public:
+  static constexpr uint32_t MAX_SCOPES_PER_FRAME = 128;
+  static constexpr uint32_t HISTORY_SIZE = 240;
+  static constexpr std::size_t MAX_TRACE_EVENTS = std::size_t(1) << 20U;
+  static constexpr uint32_t NO_SCOPE = ~0U;
+
+  /**
+   * Writes the begin timestamp on construction and the end timestamp on destruction.
+   */
+  class Scope {
+
+  public:
+    Scope(GpuProfiler& profiler, const vk::CommandBuffer& commandBuffer, const char *name);
+
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    GpuProfiler& profiler;
+    vk::CommandBuffer commandBuffer;
+    uint32_t scope;
+
+  };
+
+  /**
+   * @param queueFamilyIndex The family of the queue the profiled command buffers are submitted to.
+   */
+  GpuProfiler(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice, uint32_t queueFamilyIndex,
+              uint32_t framesInFlight);
+
+  GpuProfiler(const GpuProfiler&) = delete;
+
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  /**
+   * Starts profiling a frame by resetting its queries. Must be recorded at the start of its primary command buffer,
+   * outside of any render pass, after collect() returned for the previous use of frameIndex.
+   */
+  void beginFrame(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, uint64_t frame);
+
+  /**
+   * @return The scope to pass to end(), NO_SCOPE if timestamps are unsupported or the frame ran out of queries.
+   */
+  uint32_t begin(const vk::CommandBuffer& commandBuffer, const char *name,
+                 vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eTopOfPipe);
+
+  void end(const vk::CommandBuffer& commandBuffer, uint32_t scope,
+           vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe);
+
+  /**
+   * Reads back the timestamps of the last frame submitted with frameIndex. Its fence must be signaled.
+   */
+  void collect(uint32_t frameIndex);
+
+  /**
+   * @return Rolling statistics of every scope, in the order they were first seen.
+   */
+  std::vector<GpuScopeStats> getStats() const;
+
+  /**
+   * Forgets the statistics collected so far, e.g. between benchmark runs. The trace is kept.
+   */
+  void resetStats();
+
+  /**
+   * Writes every collected scope as a Chrome trace_event JSON file, loadable in chrome://tracing or Perfetto.
+   */
+  void writeTrace(const fs::path& path) const;
+
+  bool isSupported() const;
+
+private:
+
+  struct FrameQueries {
+    vk::UniqueQueryPool queryPool;
+    std::array<const char *, MAX_SCOPES_PER_FRAME> names{};
+    std::atomic<uint32_t> scopeCount = 0;
+    uint64_t frame = 0;
+    bool pending = false;
+  };
+
+  struct History {
+    std::vector<double> samples;
+    std::size_t next = 0;
+  };
+
+  struct TraceEvent {
+    const char *name;
+    uint64_t frame;
+    // Nanoseconds since the first collected timestamp.
+    double start;
+    double duration;
+  };
+
+  const vk::UniqueDevice& device;
+  // Nanoseconds per timestamp tick.
+  double timestampPeriod;
+  uint64_t timestampMask;
+  std::vector<std::unique_ptr<FrameQueries>> frames;
+  uint32_t currentFrameIndex = 0;
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::string_view, History> histories;
+  std::vector<std::string_view> scopeOrder;
+  std::vector<TraceEvent> traceEvents;
+  std::optional<uint64_t> origin;
+
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef VULKAN_HASHUTILS_H
+#define VULKAN_HASHUTILS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * 64 bit FNV-1a, stable across runs and platforms so it can key data stored on disk.
+ */
+class HashUtils {
+
+public:
+  static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+  static constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+  static constexpr uint64_t hash(const void *data, std::size_t size, uint64_t seed = FNV_OFFSET_BASIS) {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for(std::size_t i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= FNV_PRIME;
+    }
+    return hash;
+  }
+
+  static constexpr uint64_t hash(std::string_view str, uint64_t seed = FNV_OFFSET_BASIS) {
+    uint64_t hash = seed;
+    for(char c : str) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= FNV_PRIME;
+    }
+    return hash;
+  }
+
+  /**
+   * Hashes the object representation of a trivially copyable value. Padding bytes must be zeroed by the caller.
+   */
+  template<class T>
+  static uint64_t hashValue(const T& value, uint64_t seed = FNV_OFFSET_BASIS) {
+    static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable values can be hashed bytewise");
+    return hash(&value, sizeof(T), seed);
+  }
+
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <bitset>
+#include <iostream>
+
+#include "Macros.h"
+
+struct MemoryBlock {
+  vk::UniqueDeviceMemory memory;
+  void *mapped = nullptr;
+  vk::DeviceSize size = 0;
+  uint32_t memoryType = 0;
+  bool linear = true;
+  bool coherent = true;
+  // Empty for dedicated allocations, which hold a single resource.
+  std::optional<BuddyAllocator> buddy;
+  vk::DeviceSize requestedSize = 0;
+};
+
+UniqueAllocation::UniqueAllocation(MemoryAllocator *allocator, const Allocation& allocation) : allocator(allocator),
+                                                                                             allocation(allocation) {
+}
+
+UniqueAllocation::UniqueAllocation(UniqueAllocation&& other) noexcept : allocator(other.allocator),
+                                                                       allocation(other.allocation) {
+  other.allocator = nullptr;
+}
+
+UniqueAllocation& UniqueAllocation::operator=(UniqueAllocation&& other) noexcept {
+  if(this != &other) {
+    reset();
+    allocator = other.allocator;
+    allocation = other.allocation;
+    other.allocator = nullptr;
+  }
+  return *this;
+}
+
+UniqueAllocation::~UniqueAllocation() {
+  reset();
+}
+
+void UniqueAllocation::reset() {
+  if(allocator)
+    allocator->free(allocation);
+  allocator = nullptr;
+  allocation = {};
+}
+
+MemoryAllocator::MemoryAllocator(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice,
+                                 vk::DeviceSize blockSize) : device(device),
+                                                             memoryProperties(physicalDevice.getMemoryProperties()),
+                                                             blockSize(blockSize) {
+  vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+  bufferImageGranularity = limits.bufferImageGranularity;
+  nonCoherentAtomSize = limits.nonCoherentAtomSize;
+}
+
+MemoryAllocator::~MemoryAllocator() {
+#ifdef DEBUG
+  for(const auto& block : blocks)
+    if(block->buddy ? !block->buddy->empty() : true)
+      std::cerr << "Memory block of type " << block->memoryType << " still in use on destruction" << std::endl;
+#endif
+}
+
+UniqueAllocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements, MemoryUsage usage,
+                                           bool linear) {
+  std::lock_guard<std::mutex> lock(mutex);
+  // Without a granularity constraint buffers and images can share blocks.
+  if(bufferImageGranularity <= 1)
+    linear = true;
+
+  std::vector<uint32_t> memoryTypes = getMemoryTypes(requirements.memoryTypeBits, usage);
+  if(memoryTypes.empty())
+    throw std::runtime_error("no memory type suits usage " + std::to_string(static_cast<int>(usage)));
+
+  for(std::size_t i = 0; i < memoryTypes.size(); ++i) {
+    uint32_t memoryType = memoryTypes[i];
+    try {
+      // Large resources would waste most of a block to rounding, give them their own memory instead.
+      if(requirements.size > getBlockSize(memoryType) / 2) {
+        MemoryBlock& block = createBlock(requirements.size, memoryType, linear, true);
+        block.requestedSize = requirements.size;
+        return UniqueAllocation(this, {block.memory.get(), 0, requirements.size, block.mapped, memoryType,
+                                       block.coherent, &block});
+      }
+      if(std::optional<Allocation> allocation = allocateFromBlocks(requirements, memoryType, linear))
+        return UniqueAllocation(this, *allocation);
+      createBlock(getBlockSize(memoryType), memoryType, linear, false);
+      if(std::optional<Allocation> allocation = allocateFromBlocks(requirements, memoryType, linear))
+        return UniqueAllocation(this, *allocation);
+    } catch(const vk::OutOfDeviceMemoryError&) {
+      // The heap behind this type is full, fall through to the next best type.
+      if(i + 1 == memoryTypes.size()) throw;
+    } catch(const vk::OutOfHostMemoryError&) {
+      if(i + 1 == memoryTypes.size()) throw;
+    }
+  }
+  throw std::runtime_error("could not allocate " + std::to_string(requirements.size) + " bytes");
+}
+
+AllocatedBuffer MemoryAllocator::createBuffer(const vk::BufferCreateInfo& createInfo, MemoryUsage usage) {
+  AllocatedBuffer buffer;
+  buffer.buffer = device->createBufferUnique(createInfo);
+  buffer.allocation = allocate(device->getBufferMemoryRequirements(buffer.buffer.get()), usage, true);
+  device->bindBufferMemory(buffer.buffer.get(), buffer.allocation->memory, buffer.allocation->offset);
+  return buffer;
+}
+
+AllocatedImage MemoryAllocator::createImage(const vk::ImageCreateInfo& createInfo, MemoryUsage usage) {
+  AllocatedImage image;
+  image.image = device->createImageUnique(createInfo);
+  image.allocation = allocate(device->getImageMemoryRequirements(image.image.get()), usage,
+                              createInfo.tiling == vk::ImageTiling::eLinear);
+  device->bindImageMemory(image.image.get(), image.allocation->memory, image.allocation->offset);
+  return image;
+}
+
+void MemoryAllocator::free(const Allocation& allocation) {
+  std::lock_guard<std::mutex> lock(mutex);
+  MemoryBlock *block = allocation.block;
+  auto it = std::find_if(blocks.begin(), blocks.end(), [=](const auto& b) { return b.get() == block; });
+  if(it == blocks.end()) return;
+
+  block->requestedSize -= allocation.size;
+  if(block->buddy)
+    block->buddy->free(allocation.offset);
+  if(block->buddy && !block->buddy->empty()) return;
+
+  // Keep one empty block per memory type around so a resource recreated every frame does not allocate every frame.
+  bool spare = block->buddy && std::none_of(blocks.begin(), blocks.end(), [=](const auto& b) {
+    return b.get() != block && b->buddy && b->buddy->empty() && b->memoryType == block->memoryType &&
+           b->linear == block->linear;
+  });
+  if(!spare)
+    blocks.erase(it);
+}
+
+void MemoryAllocator::flush(const Allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const {
+  if(allocation.coherent) return;
+  device->flushMappedMemoryRanges(getMappedRange(allocation, offset, size));
+}
+
+void MemoryAllocator::invalidate(const Allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const {
+  if(allocation.coherent) return;
+  device->invalidateMappedMemoryRanges(getMappedRange(allocation, offset, size));
+}
+
+MemoryStats MemoryAllocator::getStats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  MemoryStats stats;
+  for(const auto& block : blocks) {
+    stats.reservedSize += block->size;
+    stats.requestedSize += block->requestedSize;
+    if(block->buddy) {
+      ++stats.blockCount;
+      stats.allocationCount += block->buddy->getAllocationCount();
+      stats.usedSize += block->buddy->getSize() - block->buddy->getFreeSize();
+      stats.freeSize += block->buddy->getFreeSize();
+      stats.largestFreeBlock = std::max(stats.largestFreeBlock, vk::DeviceSize(block->buddy->getLargestFreeBlock()));
+    } else {
+      ++stats.dedicatedAllocationCount;
+      ++stats.allocationCount;
+      stats.usedSize += block->size;
+    }
+  }
+  return stats;
+}
+
+void MemoryAllocator::printStats(std::ostream& out) const {
+  MemoryStats stats = getStats();
+  out << "GPU memory: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks and "
+      << stats.dedicatedAllocationCount << " dedicated allocations" << std::endl;
+  out << "\treserved: " << (stats.reservedSize >> 10U) << " KiB, used: " << (stats.usedSize >> 10U)
+      << " KiB, requested: " << (stats.requestedSize >> 10U) << " KiB" << std::endl;
+  out << "\tfree: " << (stats.freeSize >> 10U) << " KiB, largest free block: " << (stats.largestFreeBlock >> 10U)
+      << " KiB, fragmentation: " << stats.getFragmentation() << std::endl;
+}
+
+std::vector<uint32_t> MemoryAllocator::getMemoryTypes(uint32_t typeBits, MemoryUsage usage) const {
+  vk::MemoryPropertyFlags required;
+  vk::MemoryPropertyFlags preferred;
+  vk::MemoryPropertyFlags avoided;
+  switch(usage) {
+    case MemoryUsage::eGpuOnly:
+      preferred = vk::MemoryPropertyFlagBits::eDeviceLocal;
+      // Leave the usually small host visible device local heap to uploads.
+      avoided = vk::MemoryPropertyFlagBits::eHostVisible;
+      break;
+    case MemoryUsage::eCpuToGpu:
+      required = vk::MemoryPropertyFlagBits::eHostVisible;
+      preferred = vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eDeviceLocal;
+      // Host writes to cached memory gain nothing and may cost snooping on the device side.
+      avoided = vk::MemoryPropertyFlagBits::eHostCached;
+      break;
+    case MemoryUsage::eGpuToCpu:
+      required = vk::MemoryPropertyFlagBits::eHostVisible;
+      preferred = vk::MemoryPropertyFlagBits::eHostCached | vk::MemoryPropertyFlagBits::eHostCoherent;
+      break;
+  }
+
+  std::vector<std::pair<int, uint32_t>> candidates;
+  for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+    vk::MemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+    if(!(typeBits & (1U << i)) || (flags & required) != required)
+      continue;
+    auto count = [](vk::MemoryPropertyFlags f) {
+      return int(std::bitset<32>(static_cast<VkMemoryPropertyFlags>(f)).count());
+    };
+    candidates.emplace_back(2 * count(flags & preferred) - count(flags & avoided), i);
+  }
+  std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+    return a.first > b.first;
+  });
+  std::vector<uint32_t> memoryTypes;
+  for(const auto& candidate : candidates)
+    memoryTypes.push_back(candidate.second);
+  return memoryTypes;
+}
+
+std::optional<Allocation> MemoryAllocator::allocateFromBlocks(const vk::MemoryRequirements& requirements,
+                                                              uint32_t memoryType, bool linear) {
+  for(const auto& block : blocks) {
+    if(!block->buddy || block->memoryType != memoryType || block->linear != linear)
+      continue;
+    if(std::optional<uint64_t> offset = block->buddy->allocate(requirements.size, requirements.alignment)) {
+      block->requestedSize += requirements.size;
+      return Allocation{block->memory.get(), *offset, requirements.size,
+                        block->mapped ? static_cast<char *>(block->mapped) + *offset : nullptr, memoryType,
+                        block->coherent, block.get()};
+    }
+  }
+  return {};
+}
+
+MemoryBlock& MemoryAllocator::createBlock(vk::DeviceSize size, uint32_t memoryType, bool linear, bool dedicated) {
+  auto block = std::make_unique<MemoryBlock>();
+  vk::MemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+  block->memory = device->allocateMemoryUnique({size, memoryType});
+  block->size = size;
+  block->memoryType = memoryType;
+  block->linear = linear;
+  block->coherent = static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+  if(flags & vk::MemoryPropertyFlagBits::eHostVisible)
+    block->mapped = device->mapMemory(block->memory.get(), 0, VK_WHOLE_SIZE);
+  if(!dedicated)
+    block->buddy.emplace(size, MIN_ALLOCATION_SIZE);
+
+#ifdef DEBUG
+  std::cout << "Allocated " << (dedicated ? "dedicated " : "") << "memory block of " << (size >> 10U)
+            << " KiB from memory type " << memoryType << std::endl;
+#endif
+
+  blocks.push_back(std::move(block));
+  return *blocks.back();
+}
+
+vk::DeviceSize MemoryAllocator::getBlockSize(uint32_t memoryType) const {
+  // Blocks never take more than an eighth of their heap so small heaps still fit several.
+  vk::DeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+  return BuddyAllocator::roundDownToPowerOfTwo(std::min(blockSize, std::max(heapSize / 8, MIN_ALLOCATION_SIZE)));
+}
+
+vk::MappedMemoryRange MemoryAllocator::getMappedRange(const Allocation& allocation, vk::DeviceSize offset,
+                                                      vk::DeviceSize size) const {
+  if(size == VK_WHOLE_SIZE)
+    size = allocation.size - offset;
+  // Ranges must be aligned to nonCoherentAtomSize and stay within the block.
+  vk::DeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+  vk::DeviceSize end = (allocation.offset + offset + size + nonCoherentAtomSize - 1) / nonCoherentAtomSize *
+                       nonCoherentAtomSize;
+  if(end >= allocation.block->size)
+    return {allocation.memory, begin, VK_WHOLE_SIZE};
+  return {allocation.memory, begin, end - begin};
+}
+
+LinearAllocator::LinearAllocator(MemoryAllocator& allocator, vk::DeviceSize frameSize, uint32_t framesInFlight,
+                                 vk::BufferUsageFlags usage) : allocator(allocator), frameSize(frameSize) {
+  buffers.resize(framesInFlight);
+  for(auto& buffer : buffers)
+    buffer = allocator.createBuffer({{}, frameSize, usage, vk::SharingMode::eExclusive}, MemoryUsage::eCpuToGpu);
+}
+
+void LinearAllocator::begin(uint32_t frameIndex) {
+  this->frameIndex = frameIndex;
+  head = 0;
+}
+
+std::optional<LinearAllocator::Range> LinearAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+  vk::DeviceSize offset = (head + alignment - 1) / alignment * alignment;
+  if(offset + size > frameSize)
+    return {};
+  head = offset + size;
+  const AllocatedBuffer& buffer = buffers[frameIndex];
+  return Range{buffer.buffer.get(), offset, static_cast<char *>(buffer.allocation->mapped) + offset};
+}
+
+void LinearAllocator::flush() const {
+  if(head > 0)
+    allocator.flush(buffers[frameIndex].allocation.get(), 0, head);
+}
+
+vk::Buffer LinearAllocator::getBuffer() const {
+  return buffers[frameIndex].buffer.get();
+}
+
+vk::DeviceSize LinearAllocator::getUsedSize() const {
+  return head;
+}
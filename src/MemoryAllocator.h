@@ -0,0 +1,241 @@
+#ifndef VULKAN_MEMORYALLOCATOR_H
+#define VULKAN_MEMORYALLOCATOR_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "BuddyAllocator.h"
+
+enum class MemoryUsage {
+  // Only touched by the device.
+  eGpuOnly,
+  // Written by the host every frame or once, read by the device.
+  eCpuToGpu,
+  // Written by the device, read back by the host.
+  eGpuToCpu
+};
+
+struct MemoryBlock;
+
+/**
+ * A range of device memory handed out by MemoryAllocator.
+ */
+struct Allocation {
+  vk::DeviceMemory memory;
+  vk::DeviceSize offset = 0;
+  vk::DeviceSize size = 0;
+  // Host address of offset if the memory is host visible.
+  void *mapped = nullptr;
+  uint32_t memoryType = 0;
+  bool coherent = true;
+  MemoryBlock *block = nullptr;
+};
+
+class MemoryAllocator;
+
+/**
+ * Returns its allocation to the allocator when destroyed.
+ */
+class UniqueAllocation {
+
+public:
+  UniqueAllocation() = default;
+
+  UniqueAllocation(MemoryAllocator *allocator, const Allocation& allocation);
+
+  UniqueAllocation(UniqueAllocation&& other) noexcept;
+
+  UniqueAllocation& operator=(UniqueAllocation&& other) noexcept;
+
+  UniqueAllocation(const UniqueAllocation&) = delete;
+
+  UniqueAllocation& operator=(const UniqueAllocation&) = delete;
+
+  ~UniqueAllocation();
+
+  const Allocation *operator->() const {
+    return &allocation;
+  }
+
+  const Allocation& get() const {
+    return allocation;
+  }
+
+  explicit operator bool() const {
+    return allocator != nullptr;
+  }
+
+  void reset();
+
+private:
+  MemoryAllocator *allocator = nullptr;
+  Allocation allocation;
+
+};
+
+/**
+ * A buffer bound to sub-allocated memory. The buffer is destroyed before its memory is released.
+ */
+struct AllocatedBuffer {
+  UniqueAllocation allocation;
+  vk::UniqueBuffer buffer;
+};
+
+/**
+ * An image bound to sub-allocated memory. The image is destroyed before its memory is released.
+ */
+struct AllocatedImage {
+  UniqueAllocation allocation;
+  vk::UniqueImage image;
+};
+
+struct MemoryStats {
+  uint32_t blockCount = 0;
+  uint32_t dedicatedAllocationCount = 0;
+  uint32_t allocationCount = 0;
+  // Memory allocated from the device.
+  vk::DeviceSize reservedSize = 0;
+  // Bytes requested by resources.
+  vk::DeviceSize requestedSize = 0;
+  // Bytes of blocks handed out, including the rounding up to a power of two.
+  vk::DeviceSize usedSize = 0;
+  vk::DeviceSize freeSize = 0;
+  vk::DeviceSize largestFreeBlock = 0;
+
+  /**
+   * @return 0 if all free memory is one contiguous block, approaching 1 the more it is split up.
+   */
+  double getFragmentation() const {
+    return freeSize == 0 ? 0.0 : 1.0 - double(largestFreeBlock) / double(freeSize);
+  }
+};
+
+/**
+ * Carves resources out of large vk::DeviceMemory blocks with a buddy allocator so vkAllocateMemory is only called per
+ * block. Host visible blocks are mapped once for their lifetime.
+ *
+ * Buffers and optimally tiled images are kept in separate blocks whenever bufferImageGranularity is larger than 1, so
+ * linear and non-linear resources never share a granularity page.
+ */
+class MemoryAllocator {
+
+public:
+  static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = vk::DeviceSize(64) << 20U;
+  static constexpr vk::DeviceSize MIN_ALLOCATION_SIZE = 256;
+
+  MemoryAllocator(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice,
+                  vk::DeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+
+  ~MemoryAllocator();
+
+  MemoryAllocator(const MemoryAllocator&) = delete;
+
+  MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+  /**
+   * @param linear Whether the memory is for a buffer or linearly tiled image rather than an optimally tiled image.
+   * @throws vk::SystemError if no memory type allowed by requirements has room left.
+   */
+  UniqueAllocation allocate(const vk::MemoryRequirements& requirements, MemoryUsage usage, bool linear);
+
+  AllocatedBuffer createBuffer(const vk::BufferCreateInfo& createInfo, MemoryUsage usage);
+
+  AllocatedImage createImage(const vk::ImageCreateInfo& createInfo, MemoryUsage usage);
+
+  void free(const Allocation& allocation);
+
+  /**
+   * Makes host writes to a range of the allocation visible to the device. Does nothing for coherent memory.
+   */
+  void flush(const Allocation& allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+
+  /**
+   * Makes device writes to a range of the allocation visible to the host. Does nothing for coherent memory.
+   */
+  void invalidate(const Allocation& allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+
+  MemoryStats getStats() const;
+
+  void printStats(std::ostream& out) const;
+
+private:
+  const vk::UniqueDevice& device;
+  vk::PhysicalDeviceMemoryProperties memoryProperties;
+  vk::DeviceSize bufferImageGranularity;
+  vk::DeviceSize nonCoherentAtomSize;
+  vk::DeviceSize blockSize;
+  std::vector<std::unique_ptr<MemoryBlock>> blocks;
+  mutable std::mutex mutex;
+
+  /**
+   * @return Memory types allowed by typeBits that suit usage, best first.
+   */
+  std::vector<uint32_t> getMemoryTypes(uint32_t typeBits, MemoryUsage usage) const;
+
+  std::optional<Allocation> allocateFromBlocks(const vk::MemoryRequirements& requirements, uint32_t memoryType,
+                                               bool linear);
+
+  MemoryBlock& createBlock(vk::DeviceSize size, uint32_t memoryType, bool linear, bool dedicated);
+
+  vk::DeviceSize getBlockSize(uint32_t memoryType) const;
+
+  vk::MappedMemoryRange getMappedRange(const Allocation& allocation, vk::DeviceSize offset,
+                                       vk::DeviceSize size) const;
+
+};
+
+/**
+ * Bump allocator over one host visible buffer per frame in flight for data that only lives for a frame. Every
+ * allocation of a frame is released at once when the frame begins again.
+ */
+class LinearAllocator {
+
+public:
+
+  struct Range {
+    vk::Buffer buffer;
+    vk::DeviceSize offset;
+    void *mapped;
+  };
+
+  LinearAllocator(MemoryAllocator& allocator, vk::DeviceSize frameSize, uint32_t framesInFlight,
+                  vk::BufferUsageFlags usage);
+
+  /**
+   * Releases everything allocated for frameIndex the last time. The frame's previous submission must have finished.
+   */
+  void begin(uint32_t frameIndex);
+
+  /**
+   * @return A range of size bytes aligned to alignment, or nothing if the frame's buffer is full.
+   */
+  std::optional<Range> allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+  /**
+   * Makes everything allocated since begin() visible to the device.
+   */
+  void flush() const;
+
+  /**
+   * @return The buffer of the frame begun last, which every range allocated since begin() lies in.
+   */
+  vk::Buffer getBuffer() const;
+
+  vk::DeviceSize getUsedSize() const;
+
+private:
+  MemoryAllocator& allocator;
+  std::vector<AllocatedBuffer> buffers;
+  vk::DeviceSize frameSize;
+  vk::DeviceSize head = 0;
+  uint32_t frameIndex = 0;
+
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "Mesh.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "Macros.h"
+
+Mesh::Mesh(MemoryAllocator& allocator, UploadManager& uploadManager, const std::vector<MeshVertex>& vertices,
+           const std::vector<uint16_t>& indices) : vertexCount(uint32(vertices.size())),
+                                                   indexCount(uint32(indices.size())) {
+  if(indices.empty())
+    throw std::runtime_error("Meshes need at least one triangle");
+  if(*std::max_element(indices.begin(), indices.end()) >= vertices.size())
+    throw std::runtime_error("Mesh indices exceed its " + std::to_string(vertices.size()) + " vertices");
+  vk::DeviceSize vertexSize = vk::DeviceSize(vertices.size()) * sizeof(MeshVertex);
+  vk::DeviceSize indexSize = vk::DeviceSize(indices.size()) * sizeof(uint16_t);
+  vertexBuffer = allocator.createBuffer({{}, vertexSize, vk::BufferUsageFlagBits::eVertexBuffer |
+                                                         vk::BufferUsageFlagBits::eTransferDst,
+                                         vk::SharingMode::eExclusive}, MemoryUsage::eGpuOnly);
+  indexBuffer = allocator.createBuffer({{}, indexSize, vk::BufferUsageFlagBits::eIndexBuffer |
+                                                       vk::BufferUsageFlagBits::eTransferDst,
+                                        vk::SharingMode::eExclusive}, MemoryUsage::eGpuOnly);
+  uploadManager.uploadBuffer(vertexBuffer.buffer.get(), 0, vertices.data(), vertexSize);
+  uploadManager.uploadBuffer(indexBuffer.buffer.get(), 0, indices.data(), indexSize);
+}
+
+void Mesh::bind(const vk::CommandBuffer& commandBuffer) const {
+  vk::DeviceSize offset = 0;
+  commandBuffer.bindVertexBuffers(MESH_VERTEX_LAYOUT.binding, 1, &vertexBuffer.buffer.get(), &offset);
+  commandBuffer.bindIndexBuffer(indexBuffer.buffer.get(), 0, vk::IndexType::eUint16);
+}
+
+uint32_t Mesh::getIndexCount() const {
+  return indexCount;
+}
+
+uint32_t Mesh::getVertexCount() const {
+  return vertexCount;
+}
@@ -0,0 +1,89 @@
+#ifndef VULKAN_MESH_H
+#define VULKAN_MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "MemoryAllocator.h"
+#include "SpriteBatch.h"
+#include "UploadManager.h"
+#include "VertexLayout.h"
+
+/**
+ * A vertex of a Mesh, quantized to 12 bytes where full floats would take 32.
+ */
+struct MeshVertex {
+  // Two half floats, x in the low bits, -1 to 1 spans the quad a sprite of the same instance covers.
+  uint32_t position;
+  // 16 bit unorm, within the instance's uvRect.
+  glm::u16vec2 uv;
+  // RGBA8, red in the lowest byte, multiplied with the instance's color.
+  uint32_t color;
+};
+
+static_assert(sizeof(MeshVertex) == 12, "MeshVertex must match the vertex input layout");
+
+/**
+ * Read per vertex from binding 1 by the mesh vertex shader, after the instance inputs.
+ */
+constexpr VertexLayout<3> MESH_VERTEX_LAYOUT = {1, vk::VertexInputRate::eVertex, sizeof(MeshVertex),
+                                                SPRITE_INSTANCE_LAYOUT.getEndLocation(), {{
+    {"inPosition", vk::Format::eR16G16Sfloat, offsetof(MeshVertex, position)},
+    {"inUv", vk::Format::eR16G16Unorm, offsetof(MeshVertex, uv)},
+    {"inVertexColor", vk::Format::eR8G8B8A8Unorm, offsetof(MeshVertex, color)}}}};
+
+static_assert(MESH_VERTEX_LAYOUT.isValid(), "MESH_VERTEX_LAYOUT must lie within MeshVertex");
+
+/**
+ * Quantizes a vertex, position is clamped to [-1, 1] and uv to [0, 1].
+ */
+inline MeshVertex packMeshVertex(const glm::vec2& position, const glm::vec2& uv, uint32_t color) {
+  return {glm::packHalf2x16(glm::clamp(position, -1.0F, 1.0F)),
+          glm::u16vec2(glm::round(glm::clamp(uv, 0.0F, 1.0F) * 65535.0F)), color};
+}
+
+/**
+ * Indexed triangles in device local vertex and index buffers, uploaded once and drawn through a SpriteBatch by
+ * instances placing them like sprites.
+ */
+class Mesh {
+
+public:
+  /**
+   * Uploads the mesh through uploadManager, it can be drawn from the next frame submitted on.
+   * @param indices 16 bit, so at most 65536 vertices can be referenced.
+   * @throws std::runtime_error if there are no indices or they reference missing vertices.
+   */
+  Mesh(MemoryAllocator& allocator, UploadManager& uploadManager, const std::vector<MeshVertex>& vertices,
+       const std::vector<uint16_t>& indices);
+
+  Mesh(const Mesh&) = delete;
+
+  Mesh& operator=(const Mesh&) = delete;
+
+  /**
+   * Binds the vertex and index buffers, the instances stay bound to binding 0.
+   */
+  void bind(const vk::CommandBuffer& commandBuffer) const;
+
+  uint32_t getIndexCount() const;
+
+  uint32_t getVertexCount() const;
+
+private:
+
+  AllocatedBuffer vertexBuffer;
+  AllocatedBuffer indexBuffer;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef VULKAN_OFFSCREENUTILS_H
+#define VULKAN_OFFSCREENUTILS_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "Macros.h"
+#include "MemoryAllocator.h"
+
+/**
+ * A device local color image rendered to in headless mode along with the host visible buffer it is read back into.
+ * Each frame in flight owns one, so its fence also guards the readback.
+ */
+struct OffscreenTarget {
+  AllocatedImage image;
+  vk::UniqueImageView imageView;
+  AllocatedBuffer readbackBuffer;
+  // True while a submitted frame has not been handed to the readback callback yet.
+  bool pending = false;
+  uint64_t frame = 0;
+};
+
+/**
+ * Pixels of a finished headless frame. data is only valid for the duration of the readback callback.
+ */
+struct Readback {
+  const void *data;
+  vk::Extent2D extent;
+  vk::Format format;
+  vk::DeviceSize rowPitch;
+  uint64_t frame;
+};
+
+class OffscreenUtils {
+
+public:
+
+  static std::vector<OffscreenTarget>
+  createTargets(const vk::UniqueDevice& device, MemoryAllocator& allocator, vk::Format format, vk::Extent2D extent,
+                uint32_t count) {
+    std::vector<OffscreenTarget> targets(count);
+    for(auto& target : targets) {
+      vk::ImageCreateInfo imageCreateInfo = {{}, vk::ImageType::e2D, format, {extent.width, extent.height, 1}, 1, 1,
+                                             vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal,
+                                             vk::ImageUsageFlagBits::eColorAttachment |
+                                             vk::ImageUsageFlagBits::eTransferSrc |
+                                             vk::ImageUsageFlagBits::eTransferDst,
+                                             vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined};
+      target.image = allocator.createImage(imageCreateInfo, MemoryUsage::eGpuOnly);
+
+      vk::ImageViewCreateInfo viewCreateInfo = {{}, target.image.image.get(), vk::ImageViewType::e2D, format, {},
+                                                {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}};
+      target.imageView = device->createImageViewUnique(viewCreateInfo);
+
+      vk::BufferCreateInfo bufferCreateInfo = {{}, getReadbackSize(format, extent),
+                                               vk::BufferUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive};
+      target.readbackBuffer = allocator.createBuffer(bufferCreateInfo, MemoryUsage::eGpuToCpu);
+    }
+    return targets;
+  }
+
+  /**
+   * Records the copy of a target's image, which must be in eTransferSrcOptimal, into its readback buffer.
+   */
+  static void recordReadback(const vk::CommandBuffer& commandBuffer, const OffscreenTarget& target,
+                             vk::Extent2D extent) {
+    vk::BufferImageCopy region = {0, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {0, 0, 0},
+                                  {extent.width, extent.height, 1}};
+    commandBuffer.copyImageToBuffer(target.image.image.get(), vk::ImageLayout::eTransferSrcOptimal,
+                                    target.readbackBuffer.buffer.get(), 1, &region);
+    vk::BufferMemoryBarrier barrier = {vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead,
+                                       VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                       target.readbackBuffer.buffer.get(), 0, VK_WHOLE_SIZE};
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, 0,
+                                  nullptr, 1, &barrier, 0, nullptr);
+  }
+
+  static vk::DeviceSize getReadbackSize(vk::Format format, vk::Extent2D extent) {
+    return getRowPitch(format, extent) * extent.height;
+  }
+
+  static vk::DeviceSize getRowPitch(vk::Format format, vk::Extent2D extent) {
+    return vk::DeviceSize(extent.width) * getTexelSize(format);
+  }
+
+  static uint32_t getTexelSize(vk::Format format) {
+    switch(format) {
+      case vk::Format::eR8G8B8A8Unorm:
+      case vk::Format::eR8G8B8A8Srgb:
+      case vk::Format::eB8G8R8A8Unorm:
+      case vk::Format::eB8G8R8A8Srgb:
+        return 4;
+      case vk::Format::eR16G16B16A16Sfloat:
+        return 8;
+      case vk::Format::eR32G32B32A32Sfloat:
+        return 16;
+      default:
+        throw std::runtime_error("unsupported offscreen format " + vk::to_string(format));
+    }
+  }
+
+};
+
+#endif
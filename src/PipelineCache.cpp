@@ -0,0 +1,219 @@
+#include "PipelineCache.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+#include "HashUtils.h"
+#include "VkUtils.h"
+
+uint64_t GraphicsPipelineState::hash() const {
+  uint64_t hash = HashUtils::hashValue(vertexShader);
+  hash = HashUtils::hashValue(fragmentShader, hash);
+  hash = HashUtils::hashValue(layout, hash);
+  hash = HashUtils::hashValue(renderPass, hash);
+  hash = HashUtils::hashValue(subpass, hash);
+  hash = HashUtils::hashValue(topology, hash);
+  hash = HashUtils::hashValue(polygonMode, hash);
+  hash = HashUtils::hashValue(static_cast<VkCullModeFlags>(cullMode), hash);
+  hash = HashUtils::hashValue(frontFace, hash);
+  hash = HashUtils::hashValue(samples, hash);
+  hash = HashUtils::hashValue(blendMode, hash);
+  hash = HashUtils::hash(bindings.data(), bindings.size() * sizeof(vk::VertexInputBindingDescription), hash);
+  hash = HashUtils::hash(attributes.data(), attributes.size() * sizeof(vk::VertexInputAttributeDescription), hash);
+  hash = HashUtils::hash(dynamicStates.data(), dynamicStates.size() * sizeof(vk::DynamicState), hash);
+  return HashUtils::hashValue(extent, hash);
+}
+
+uint64_t ComputePipelineState::hash() const {
+  return HashUtils::hashValue(layout, HashUtils::hashValue(shader));
+}
+
+PipelineCache::PipelineCache(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice, fs::path path)
+    : device(device), properties(physicalDevice.getProperties()), path(std::move(path)) {
+  std::vector<uint8_t> blob = loadBlob();
+  loaded = !blob.empty();
+  vk::PipelineCacheCreateInfo createInfo = {{}, blob.size(), blob.data()};
+  pipelineCache = device->createPipelineCacheUnique(createInfo);
+
+#ifdef DEBUG
+  std::cout << (loaded ? "Loaded " : "Created empty ") << "pipeline cache " << this->path << std::endl;
+#endif
+}
+
+PipelineCache::~PipelineCache() {
+  // Pipelines go before the cache they were created from.
+  graphicsPipelines.clear();
+  computePipelines.clear();
+}
+
+vk::Pipeline PipelineCache::getGraphicsPipeline(const GraphicsPipelineState& state) {
+  auto it = graphicsPipelines.find(state);
+  if(it == graphicsPipelines.end())
+    it = graphicsPipelines.emplace(state, createGraphicsPipeline(state)).first;
+  return it->second.get();
+}
+
+vk::Pipeline PipelineCache::getComputePipeline(const ComputePipelineState& state) {
+  auto it = computePipelines.find(state);
+  if(it == computePipelines.end())
+    it = computePipelines.emplace(state, createComputePipeline(state)).first;
+  return it->second.get();
+}
+
+void PipelineCache::save() const {
+  std::vector<uint8_t> blob = device->getPipelineCacheData(pipelineCache.get());
+  FileHeader header = {FILE_MAGIC, 0, blob.size(), HashUtils::hash(blob.data(), blob.size())};
+  fs::path tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios_base::binary | std::ios_base::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+    file.write(reinterpret_cast<const char *>(blob.data()), std::streamsize(blob.size()));
+    if(!file) {
+      std::cerr << "Could not write pipeline cache " << tmpPath << std::endl;
+      return;
+    }
+  }
+  std::error_code error;
+  fs::rename(tmpPath, path, error);
+  if(error)
+    std::cerr << "Could not write pipeline cache " << path << ": " << error.message() << std::endl;
+
+#ifdef DEBUG
+  std::cout << "Saved " << blob.size() << " bytes of pipeline cache for " << size() << " pipelines" << std::endl;
+#endif
+}
+
+vk::PipelineCache PipelineCache::get() const {
+  return pipelineCache.get();
+}
+
+std::size_t PipelineCache::size() const {
+  return graphicsPipelines.size() + computePipelines.size();
+}
+
+bool PipelineCache::wasLoaded() const {
+  return loaded;
+}
+
+std::vector<uint8_t> PipelineCache::loadBlob() const {
+  std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
+  if(!file) return {};
+  auto fileSize = static_cast<std::size_t>(file.tellg());
+  file.seekg(0);
+  FileHeader header{};
+  if(fileSize < sizeof(FileHeader) || !file.read(reinterpret_cast<char *>(&header), sizeof(FileHeader)) ||
+     header.magic != FILE_MAGIC || header.size != fileSize - sizeof(FileHeader)) {
+    std::cerr << "Ignoring malformed pipeline cache " << path << std::endl;
+    return {};
+  }
+  std::vector<uint8_t> blob(header.size);
+  if(!file.read(reinterpret_cast<char *>(blob.data()), std::streamsize(blob.size())) ||
+     HashUtils::hash(blob.data(), blob.size()) != header.checksum) {
+    std::cerr << "Ignoring corrupted pipeline cache " << path << std::endl;
+    return {};
+  }
+  if(!isCompatible(blob)) {
+#ifdef DEBUG
+    std::cout << "Ignoring pipeline cache " << path << " from a different driver or device" << std::endl;
+#endif
+    return {};
+  }
+  return blob;
+}
+
+bool PipelineCache::isCompatible(const std::vector<uint8_t>& blob) const {
+  // VkPipelineCacheHeaderVersionOne: header size, header version, vendor id, device id, pipeline cache UUID.
+  struct {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  } header{};
+  static_assert(sizeof(header) == 16 + VK_UUID_SIZE);
+  if(blob.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, blob.data(), sizeof(header));
+  return header.headerSize >= sizeof(header) && header.headerSize <= blob.size() &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+         !std::memcmp(header.pipelineCacheUUID, &properties.pipelineCacheUUID[0], VK_UUID_SIZE);
+}
+
+vk::UniquePipeline PipelineCache::createGraphicsPipeline(const GraphicsPipelineState& state) const {
+  std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStageCreateInfos = {
+      vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eVertex, state.vertexShader, "main", nullptr},
+      {{}, vk::ShaderStageFlagBits::eFragment, state.fragmentShader, "main", nullptr}};
+
+  vk::PipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {{}, vk::size(state.bindings),
+                                                                       state.bindings.data(),
+                                                                       vk::size(state.attributes),
+                                                                       state.attributes.data()};
+  vk::PipelineInputAssemblyStateCreateInfo assemblyStateCreateInfo = {{}, state.topology, VK_FALSE};
+  vk::Viewport viewport = {0, 0, static_cast<float>(state.extent.width), static_cast<float>(state.extent.height), 0,
+                           1};
+  vk::Rect2D scissor = {{0, 0}, state.extent};
+  vk::PipelineViewportStateCreateInfo viewportStateCreateInfo = {{}, 1, &viewport, 1, &scissor};
+  vk::PipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {{}, VK_FALSE, VK_FALSE,
+                                                                                   state.polygonMode, state.cullMode,
+                                                                                   state.frontFace, 0, 0, 0, 0, 1};
+  vk::PipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {{}, state.samples, VK_FALSE, 0,
+                                                                               nullptr, VK_FALSE, VK_FALSE};
+
+  vk::PipelineColorBlendAttachmentState colorBlendAttachmentState = {VK_FALSE, vk::BlendFactor::eOne,
+                                                                     vk::BlendFactor::eZero, vk::BlendOp::eAdd,
+                                                                     vk::BlendFactor::eOne, vk::BlendFactor::eZero,
+                                                                     vk::BlendOp::eAdd, vk::ColorComponentFlagBits::eR |
+                                                                                        vk::ColorComponentFlagBits::eG |
+                                                                                        vk::ColorComponentFlagBits::eB |
+                                                                                        vk::ColorComponentFlagBits::eA};
+  switch(state.blendMode) {
+    case BlendMode::eOpaque:
+      break;
+    case BlendMode::eAlpha:
+      colorBlendAttachmentState.setBlendEnable(VK_TRUE)
+                               .setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
+                               .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+                               .setDstAlphaBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha);
+      break;
+    case BlendMode::ePremultipliedAlpha:
+      colorBlendAttachmentState.setBlendEnable(VK_TRUE)
+                               .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+                               .setDstAlphaBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha);
+      break;
+    case BlendMode::eAdditive:
+      colorBlendAttachmentState.setBlendEnable(VK_TRUE)
+                               .setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
+                               .setDstColorBlendFactor(vk::BlendFactor::eOne)
+                               .setDstAlphaBlendFactor(vk::BlendFactor::eOne);
+      break;
+  }
+  std::array<float, 4> blendConstants = {0, 0, 0, 0};
+  vk::PipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {{}, VK_FALSE, vk::LogicOp::eCopy, 1,
+                                                                     &colorBlendAttachmentState, blendConstants};
+  vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo = {{}, vk::size(state.dynamicStates),
+                                                               state.dynamicStates.data()};
+
+  vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {{}, vk::size(shaderStageCreateInfos),
+                                                               shaderStageCreateInfos.data(),
+                                                               &vertexInputStateCreateInfo, &assemblyStateCreateInfo,
+                                                               nullptr, &viewportStateCreateInfo,
+                                                               &pipelineRasterizationStateCreateInfo,
+                                                               &pipelineMultisampleStateCreateInfo, nullptr,
+                                                               &colorBlendStateCreateInfo,
+                                                               state.dynamicStates.empty() ? nullptr
+                                                                                           : &dynamicStateCreateInfo,
+                                                               state.layout, state.renderPass, state.subpass,
+                                                               nullptr, -1};
+  return device->createGraphicsPipelineUnique(pipelineCache.get(), graphicsPipelineCreateInfo);
+}
+
+vk::UniquePipeline PipelineCache::createComputePipeline(const ComputePipelineState& state) const {
+  vk::ComputePipelineCreateInfo computePipelineCreateInfo = {{}, {{}, vk::ShaderStageFlagBits::eCompute, state.shader,
+                                                                  "main", nullptr}, state.layout, nullptr, -1};
+  return device->createComputePipelineUnique(pipelineCache.get(), computePipelineCreateInfo);
+}
@@ -0,0 +1,139 @@
+#ifndef VULKAN_PIPELINECACHE_H
+#define VULKAN_PIPELINECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "Macros.h"
+
+enum class BlendMode : uint32_t {
+  eOpaque,
+  eAlpha,
+  ePremultipliedAlpha,
+  eAdditive
+};
+
+/**
+ * Everything that distinguishes one graphics pipeline variant from another.
+ */
+struct GraphicsPipelineState {
+  vk::ShaderModule vertexShader;
+  vk::ShaderModule fragmentShader;
+  vk::PipelineLayout layout;
+  vk::RenderPass renderPass;
+  uint32_t subpass = 0;
+  vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+  vk::PolygonMode polygonMode = vk::PolygonMode::eFill;
+  vk::CullModeFlags cullMode = vk::CullModeFlagBits::eNone;
+  vk::FrontFace frontFace = vk::FrontFace::eClockwise;
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+  BlendMode blendMode = BlendMode::eOpaque;
+  std::vector<vk::VertexInputBindingDescription> bindings;
+  std::vector<vk::VertexInputAttributeDescription> attributes;
+  std::vector<vk::DynamicState> dynamicStates;
+  // Baked into the pipeline unless the viewport and scissor are dynamic.
+  vk::Extent2D extent;
+
+  uint64_t hash() const;
+
+  bool operator==(const GraphicsPipelineState& other) const = default;
+};
+
+struct ComputePipelineState {
+  vk::ShaderModule shader;
+  vk::PipelineLayout layout;
+
+  uint64_t hash() const;
+
+  bool operator==(const ComputePipelineState& other) const = default;
+};
+
+/**
+ * Creates pipelines through a vk::PipelineCache persisted to disk and keeps every pipeline it created, so asking for
+ * the same state twice returns the existing pipeline instead of compiling a new one.
+ */
+class PipelineCache {
+
+public:
+
+  /**
+   * Seeds the driver cache from path if the blob there was written by the same driver and device.
+   */
+  PipelineCache(const vk::UniqueDevice& device, const vk::PhysicalDevice& physicalDevice, fs::path path);
+
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache&) = delete;
+
+  PipelineCache& operator=(const PipelineCache&) = delete;
+
+  /**
+   * @return The pipeline for state, created on first use. Owned by the cache.
+   * @throws vk::SystemError if the pipeline can not be created.
+   */
+  vk::Pipeline getGraphicsPipeline(const GraphicsPipelineState& state);
+
+  /**
+   * @return The pipeline for state, created on first use. Owned by the cache.
+   * @throws vk::SystemError if the pipeline can not be created.
+   */
+  vk::Pipeline getComputePipeline(const ComputePipelineState& state);
+
+  /**
+   * Writes the driver cache back to disk.
+   */
+  void save() const;
+
+  vk::PipelineCache get() const;
+
+  std::size_t size() const;
+
+  /**
+   * @return Whether a cache blob was loaded from disk and accepted.
+   */
+  bool wasLoaded() const;
+
+private:
+
+  // Keys the maps on the full state, so states whose hashes collide still get pipelines of their own.
+  template<class State>
+  struct StateHash {
+    std::size_t operator()(const State& state) const {
+      return std::size_t(state.hash());
+    }
+  };
+
+  // Precedes the driver's blob on disk to catch truncated or corrupted files before the driver sees them.
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t checksum;
+  };
+
+  static constexpr uint32_t FILE_MAGIC = 0x56504331; // VPC1
+
+  const vk::UniqueDevice& device;
+  vk::PhysicalDeviceProperties properties;
+  fs::path path;
+  vk::UniquePipelineCache pipelineCache;
+  // Never erased, command buffers of frames in flight may still use any of the pipelines.
+  std::unordered_map<GraphicsPipelineState, vk::UniquePipeline, StateHash<GraphicsPipelineState>> graphicsPipelines;
+  std::unordered_map<ComputePipelineState, vk::UniquePipeline, StateHash<ComputePipelineState>> computePipelines;
+  bool loaded = false;
+
+  std::vector<uint8_t> loadBlob() const;
+
+  bool isCompatible(const std::vector<uint8_t>& blob) const;
+
+  vk::UniquePipeline createGraphicsPipeline(const GraphicsPipelineState& state) const;
+
+  vk::UniquePipeline createComputePipeline(const ComputePipelineState& state) const;
+
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "PostProcessor.h"
+
+#include <algorithm>
+#include <array>
+
+#include "Macros.h"
+#include "VkUtils.h"
+
+PostProcessor::PostProcessor(const vk::UniqueDevice& device, DescriptorAllocator& descriptorAllocator,
+                             PipelineCache& pipelineCache, vk::UniqueShaderModule downsampleShader,
+                             vk::UniqueShaderModule blurShader, vk::UniqueShaderModule gradeShader)
+    : device(device), descriptorAllocator(descriptorAllocator), downsampleShader(std::move(downsampleShader)),
+      blurShader(std::move(blurShader)), gradeShader(std::move(gradeShader)) {
+  vk::SamplerCreateInfo samplerCreateInfo = {{}, vk::Filter::eLinear, vk::Filter::eLinear,
+                                             vk::SamplerMipmapMode::eNearest, vk::SamplerAddressMode::eClampToEdge,
+                                             vk::SamplerAddressMode::eClampToEdge,
+                                             vk::SamplerAddressMode::eClampToEdge};
+  sampler = device->createSamplerUnique(samplerCreateInfo);
+
+  filterSetLayout = descriptorAllocator.getLayout({
+      vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eCombinedImageSampler, 1,
+                                     vk::ShaderStageFlagBits::eCompute},
+      {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}});
+  gradeSetLayout = descriptorAllocator.getLayout({
+      vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eCombinedImageSampler, 1,
+                                     vk::ShaderStageFlagBits::eCompute},
+      {1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute},
+      {2, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}});
+  static_assert(sizeof(DownsamplePushConstants) == sizeof(BlurPushConstants),
+                "downsampling and blurring share a pipeline layout");
+  vk::PushConstantRange filterPushConstants = {vk::ShaderStageFlagBits::eCompute, 0,
+                                               sizeof(DownsamplePushConstants)};
+  filterLayout = device->createPipelineLayoutUnique({{}, 1, &filterSetLayout, 1, &filterPushConstants});
+  vk::PushConstantRange gradePushConstants = {vk::ShaderStageFlagBits::eCompute, 0, sizeof(PostSettings)};
+  gradeLayout = device->createPipelineLayoutUnique({{}, 1, &gradeSetLayout, 1, &gradePushConstants});
+
+  downsamplePipeline = pipelineCache.getComputePipeline({this->downsampleShader.get(), filterLayout.get()});
+  blurPipeline = pipelineCache.getComputePipeline({this->blurShader.get(), filterLayout.get()});
+  gradePipeline = pipelineCache.getComputePipeline({this->gradeShader.get(), gradeLayout.get()});
+}
+
+std::vector<PostTarget> PostProcessor::createTargets(const vk::UniqueDevice& device, MemoryAllocator& allocator,
+                                                     vk::Extent2D extent, uint32_t count,
+                                                     const std::vector<uint32_t>& queueFamilyIndices) {
+  vk::SharingMode sharingMode = queueFamilyIndices.size() > 1 ? vk::SharingMode::eConcurrent
+                                                              : vk::SharingMode::eExclusive;
+  auto createImage = [&](vk::Format format, vk::ImageUsageFlags usage, AllocatedImage& image,
+                         vk::UniqueImageView& imageView) {
+    vk::ImageCreateInfo imageCreateInfo = {{}, vk::ImageType::e2D, format, {extent.width, extent.height, 1}, 1, 1,
+                                           vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, usage, sharingMode,
+                                           vk::size(queueFamilyIndices), queueFamilyIndices.data(),
+                                           vk::ImageLayout::eUndefined};
+    image = allocator.createImage(imageCreateInfo, MemoryUsage::eGpuOnly);
+    vk::ImageViewCreateInfo viewCreateInfo = {{}, image.image.get(), vk::ImageViewType::e2D, format, {},
+                                              {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}};
+    imageView = device->createImageViewUnique(viewCreateInfo);
+  };
+
+  std::vector<PostTarget> targets(count);
+  for(PostTarget& target : targets) {
+    createImage(SCENE_FORMAT, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
+                target.scene, target.sceneView);
+    createImage(OUTPUT_FORMAT, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc, target.output,
+                target.outputView);
+  }
+  return targets;
+}
+
+void PostProcessor::addPasses(RenderGraph& graph, RenderGraph::Handle scene, RenderGraph::Handle output,
+                              vk::Extent2D extent) {
+  vk::Extent2D halfExtent = {std::max((extent.width + 1) / 2, 1U), std::max((extent.height + 1) / 2, 1U)};
+  vk::Extent2D quarterExtent = {std::max((halfExtent.width + 1) / 2, 1U), std::max((halfExtent.height + 1) / 2, 1U)};
+  RenderGraph::Handle bright = graph.createImage("bloom bright", BLOOM_FORMAT, halfExtent);
+  RenderGraph::Handle downsampled = graph.createImage("bloom downsampled", BLOOM_FORMAT, quarterExtent);
+  RenderGraph::Handle blurredX = graph.createImage("bloom blurred x", BLOOM_FORMAT, quarterExtent);
+  RenderGraph::Handle bloom = graph.createImage("bloom", BLOOM_FORMAT, quarterExtent);
+
+  // Settings are read when recording, so changes apply from the next frame on.
+  addFilterPass(graph, "bloom bright pass", downsamplePipeline, scene, bright, halfExtent, [this]() {
+    return DownsamplePushConstants{settings.bloomThreshold, settings.bloomKnee};
+  });
+  addFilterPass(graph, "bloom downsample", downsamplePipeline, bright, downsampled, quarterExtent, []() {
+    return DownsamplePushConstants{0.0F, 0.0F};
+  });
+  addFilterPass(graph, "bloom blur x", blurPipeline, downsampled, blurredX, quarterExtent, [=]() {
+    return BlurPushConstants{{1.0F / float(quarterExtent.width), 0.0F}};
+  });
+  addFilterPass(graph, "bloom blur y", blurPipeline, blurredX, bloom, quarterExtent, [=]() {
+    return BlurPushConstants{{0.0F, 1.0F / float(quarterExtent.height)}};
+  });
+
+  graph.addPass("grade", RenderGraph::PassType::eCompute)
+      .addSampledInput(scene)
+      .addSampledInput(bloom)
+      .addStorageOutput(output)
+      .setRecord([=, this](const RenderGraph::Context& context) {
+        vk::DescriptorSet descriptorSet = descriptorAllocator.allocate(gradeSetLayout);
+        DescriptorBindings()
+            .image(0, vk::DescriptorType::eCombinedImageSampler, sampler.get(), context.getImageView(scene),
+                   vk::ImageLayout::eShaderReadOnlyOptimal)
+            .image(1, vk::DescriptorType::eCombinedImageSampler, sampler.get(), context.getImageView(bloom),
+                   vk::ImageLayout::eShaderReadOnlyOptimal)
+            .image(2, vk::DescriptorType::eStorageImage, nullptr, context.getImageView(output),
+                   vk::ImageLayout::eGeneral)
+            .write(device, descriptorSet);
+        const vk::CommandBuffer& commandBuffer = context.commandBuffer;
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, gradePipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, gradeLayout.get(), 0, 1, &descriptorSet, 0,
+                                         nullptr);
+        commandBuffer.pushConstants(gradeLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PostSettings),
+                                    &settings);
+        dispatch(commandBuffer, extent);
+      });
+}
+
+void PostProcessor::recordPresent(const vk::CommandBuffer& commandBuffer, vk::Image output,
+                                  vk::ImageLayout outputLayout, vk::Image backbuffer, vk::Extent2D extent) {
+  vk::ImageSubresourceLayers subresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+  std::array<vk::Offset3D, 2> offsets = {vk::Offset3D{0, 0, 0},
+                                         vk::Offset3D{int32_t(extent.width), int32_t(extent.height), 1}};
+  // A blit rather than a copy, as the backbuffer's format generally differs.
+  vk::ImageBlit region = {subresource, offsets, subresource, offsets};
+  commandBuffer.blitImage(output, outputLayout, backbuffer, vk::ImageLayout::eTransferDstOptimal, 1, &region,
+                          vk::Filter::eNearest);
+}
+
+template<class GetPushConstants>
+void PostProcessor::addFilterPass(RenderGraph& graph, const char *name, vk::Pipeline pipeline,
+                                  RenderGraph::Handle input, RenderGraph::Handle output, vk::Extent2D extent,
+                                  GetPushConstants getPushConstants) {
+  graph.addPass(name, RenderGraph::PassType::eCompute)
+      .addSampledInput(input)
+      .addStorageOutput(output)
+      .setRecord([=, this](const RenderGraph::Context& context) {
+        vk::DescriptorSet descriptorSet = descriptorAllocator.allocate(filterSetLayout);
+        DescriptorBindings()
+            .image(0, vk::DescriptorType::eCombinedImageSampler, sampler.get(), context.getImageView(input),
+                   vk::ImageLayout::eShaderReadOnlyOptimal)
+            .image(1, vk::DescriptorType::eStorageImage, nullptr, context.getImageView(output),
+                   vk::ImageLayout::eGeneral)
+            .write(device, descriptorSet);
+        auto pushConstants = getPushConstants();
+        const vk::CommandBuffer& commandBuffer = context.commandBuffer;
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, filterLayout.get(), 0, 1, &descriptorSet, 0,
+                                         nullptr);
+        commandBuffer.pushConstants(filterLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants),
+                                    &pushConstants);
+        dispatch(commandBuffer, extent);
+      });
+}
+
+void PostProcessor::dispatch(const vk::CommandBuffer& commandBuffer, vk::Extent2D extent) {
+  commandBuffer.dispatch((extent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                         (extent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+}
@@ -0,0 +1,135 @@
+#ifndef VULKAN_POSTPROCESSOR_H
+#define VULKAN_POSTPROCESSOR_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "RenderGraph.h"
+
+/**
+ * How a frame is graded, pushed to shaders/grade.comp as is.
+ */
+struct PostSettings {
+  // Scene brightness above which pixels bloom, fading in over knee below it.
+  float bloomThreshold = 0.8F;
+  float bloomKnee = 0.2F;
+  float bloomIntensity = 0.6F;
+  float exposure = 1.0F;
+  float contrast = 1.05F;
+  float saturation = 1.1F;
+  // How much the corners are darkened, 0 to disable.
+  float vignette = 0.3F;
+};
+
+/**
+ * The scene drawn by the graphics queue and the image post-processed from it by the compute queue, shared by both
+ * queue families so neither needs ownership transfers.
+ */
+struct PostTarget {
+  AllocatedImage scene;
+  vk::UniqueImageView sceneView;
+  AllocatedImage output;
+  vk::UniqueImageView outputView;
+};
+
+/**
+ * Post-processes the drawn scene in compute shaders: a bright pass downsampling it to half size, a second downsample to
+ * a quarter, a separable gaussian blur of that and a grading pass adding the blurred bloom back onto the scene, then
+ * adjusting exposure, contrast, saturation and vignette.
+ *
+ * The passes go into whichever render graph they are added to, so the chain runs on the graphics queue behind the
+ * sprites or in a graph of its own submitted to a compute queue. Descriptor sets are allocated per frame, which keeps
+ * the passes indifferent to which image of an imported image a frame uses.
+ */
+class PostProcessor {
+
+public:
+  static constexpr vk::Format SCENE_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+  static constexpr vk::Format BLOOM_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+  static constexpr vk::Format OUTPUT_FORMAT = vk::Format::eR8G8B8A8Unorm;
+  // Width and height of the workgroups of every post-processing shader.
+  static constexpr uint32_t WORKGROUP_SIZE = 8;
+
+  /**
+   * @param downsampleShader shaders/downsample.comp.
+   * @param blurShader shaders/blur.comp.
+   * @param gradeShader shaders/grade.comp.
+   */
+  PostProcessor(const vk::UniqueDevice& device, DescriptorAllocator& descriptorAllocator, PipelineCache& pipelineCache,
+                vk::UniqueShaderModule downsampleShader, vk::UniqueShaderModule blurShader,
+                vk::UniqueShaderModule gradeShader);
+
+  PostProcessor(const PostProcessor&) = delete;
+
+  PostProcessor& operator=(const PostProcessor&) = delete;
+
+  /**
+   * Creates count targets of extent, the scene a color attachment read by the passes and the output written by them and
+   * copied from afterwards.
+   * @param queueFamilyIndices The families using the targets, they are shared concurrently if there are several.
+   */
+  static std::vector<PostTarget> createTargets(const vk::UniqueDevice& device, MemoryAllocator& allocator,
+                                               vk::Extent2D extent, uint32_t count,
+                                               const std::vector<uint32_t>& queueFamilyIndices);
+
+  /**
+   * Declares the passes post-processing scene, an image of SCENE_FORMAT, into output, an image of OUTPUT_FORMAT, both
+   * of extent. The bloom chain lives in transient images of graph.
+   */
+  void addPasses(RenderGraph& graph, RenderGraph::Handle scene, RenderGraph::Handle output, vk::Extent2D extent);
+
+  /**
+   * Records copying output, in outputLayout, to backbuffer, in eTransferDstOptimal, converting it to the backbuffer's
+   * format. Both must be of extent.
+   */
+  static void recordPresent(const vk::CommandBuffer& commandBuffer, vk::Image output, vk::ImageLayout outputLayout,
+                            vk::Image backbuffer, vk::Extent2D extent);
+
+  PostSettings settings;
+
+private:
+
+  struct DownsamplePushConstants {
+    float threshold;
+    float knee;
+  };
+
+  struct BlurPushConstants {
+    glm::vec2 direction;
+  };
+
+  const vk::UniqueDevice& device;
+  DescriptorAllocator& descriptorAllocator;
+  vk::UniqueShaderModule downsampleShader;
+  vk::UniqueShaderModule blurShader;
+  vk::UniqueShaderModule gradeShader;
+  vk::UniqueSampler sampler;
+  // Owned by the descriptor allocator. Downsampling and blurring read one image and write another.
+  vk::DescriptorSetLayout filterSetLayout;
+  vk::DescriptorSetLayout gradeSetLayout;
+  vk::UniquePipelineLayout filterLayout;
+  vk::UniquePipelineLayout gradeLayout;
+  // Owned by the pipeline cache.
+  vk::Pipeline downsamplePipeline;
+  vk::Pipeline blurPipeline;
+  vk::Pipeline gradePipeline;
+
+  /**
+   * Adds a pass running pipeline over output with input sampled, pushing what getPushConstants returns when recorded.
+   */
+  template<class GetPushConstants>
+  void addFilterPass(RenderGraph& graph, const char *name, vk::Pipeline pipeline, RenderGraph::Handle input,
+                     RenderGraph::Handle output, vk::Extent2D extent, GetPushConstants getPushConstants);
+
+  static void dispatch(const vk::CommandBuffer& commandBuffer, vk::Extent2D extent);
+
+};
+
+#endif
@@ -0,0 +1,562 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "Macros.h"
+#include "VkUtils.h"
+
+namespace {
+
+  const vk::AccessFlags WRITE_ACCESS = vk::AccessFlagBits::eColorAttachmentWrite |
+                                           vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
+
+  bool contains(vk::PipelineStageFlags flags, vk::PipelineStageFlags subset) {
+    return (flags & subset) == subset;
+  }
+
+  bool contains(vk::AccessFlags flags, vk::AccessFlags subset) {
+    return (flags & subset) == subset;
+  }
+
+}
+
+void RenderGraph::Context::beginRenderPass(vk::SubpassContents contents) const {
+  if(!renderPass)
+    throw std::runtime_error("only graphics passes have a render pass");
+  vk::RenderPassBeginInfo renderPassBeginInfo = {renderPass, framebuffer, {{}, extent}, vk::size(clearValues),
+                                                 clearValues.data()};
+  commandBuffer.beginRenderPass(renderPassBeginInfo, contents);
+  renderPassBegun = true;
+}
+
+vk::Image RenderGraph::Context::getImage(Handle image) const {
+  return graph.getImage(image, index);
+}
+
+vk::ImageView RenderGraph::Context::getImageView(Handle image) const {
+  return graph.getImageView(image, index);
+}
+
+RenderGraph::Pass::Pass(const char *name, PassType type) : name(name), type(type) {
+}
+
+RenderGraph::Pass& RenderGraph::Pass::addColorOutput(Handle image, std::optional<vk::ClearColorValue> clearColor) {
+  uses.push_back({image, Usage::eColorAttachment, clearColor});
+  return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::addSampledInput(Handle image) {
+  uses.push_back({image, Usage::eSampled, std::nullopt});
+  return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::addStorageInput(Handle image) {
+  uses.push_back({image, Usage::eStorageRead, std::nullopt});
+  return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::addStorageOutput(Handle image) {
+  uses.push_back({image, Usage::eStorageWrite, std::nullopt});
+  return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::addTransferInput(Handle image) {
+  uses.push_back({image, Usage::eTransferSrc, std::nullopt});
+  return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::addTransferOutput(Handle image) {
+  uses.push_back({image, Usage::eTransferDst, std::nullopt});
+  return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::setRecord(RecordFunction record) {
+  this->record = std::move(record);
+  return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::setSideEffects() {
+  sideEffects = true;
+  return *this;
+}
+
+RenderGraph::RenderGraph(const vk::UniqueDevice& device, MemoryAllocator& allocator) : device(device),
+                                                                                       allocator(allocator) {
+}
+
+RenderGraph::Handle RenderGraph::createImage(const char *name, vk::Format format, vk::Extent2D extent) {
+  if(compiled)
+    throw std::runtime_error(std::string("image ") + name + " declared after the render graph was compiled");
+  Image& image = images.emplace_back();
+  image.name = name;
+  image.format = format;
+  image.extent = extent;
+  return uint32(images.size() - 1);
+}
+
+RenderGraph::Handle RenderGraph::importImage(const char *name, vk::Format format, vk::Extent2D extent,
+                                             std::vector<ImportedImage> imported, const ImageState& initialState,
+                                             std::optional<ImageState> finalState) {
+  if(imported.empty())
+    throw std::runtime_error(std::string("imported image ") + name + " has no images");
+  Handle handle = createImage(name, format, extent);
+  Image& image = images[handle];
+  image.imported = std::move(imported);
+  image.initialState = initialState;
+  image.finalState = finalState;
+  return handle;
+}
+
+RenderGraph::Pass& RenderGraph::addPass(const char *name, PassType type) {
+  if(compiled)
+    throw std::runtime_error(std::string("pass ") + name + " declared after the render graph was compiled");
+  passes.push_back(std::unique_ptr<Pass>(new Pass(name, type)));
+  return *passes.back();
+}
+
+void RenderGraph::compile() {
+  if(compiled)
+    throw std::runtime_error("the render graph is already compiled");
+  for(const auto& pass : passes)
+    for(const Pass::Use& use : pass->uses)
+      if(use.image >= images.size())
+        throw std::runtime_error(std::string("pass ") + pass->name + " uses an undeclared image");
+
+  std::vector<const Pass *> order = schedule();
+  stats.passCount = uint32(order.size());
+  stats.culledPassCount = uint32(passes.size() - order.size());
+  for(uint32_t position = 0; position < order.size(); ++position) {
+    steps.push_back({order[position]});
+    for(const Pass::Use& use : order[position]->uses) {
+      Image& image = images[use.image];
+      if(!image.used)
+        image.firstUse = position;
+      image.used = true;
+      image.lastUse = position;
+      image.usage |= getImageUsage(use.usage);
+    }
+  }
+
+  createTransientImages();
+  // The second run starts every memory slot in the state the first one left it in, so the first use of a slot in a
+  // frame waits for its last use in the previous frame.
+  std::vector<Tracker> slotStates(memorySlots.size());
+  deriveBarriers(slotStates);
+  deriveBarriers(slotStates);
+  createRenderPasses();
+  compiled = true;
+
+#ifdef DEBUG
+  std::cout << "Compiled render graph of " << stats.passCount << " passes, " << stats.culledPassCount << " culled, "
+            << stats.barrierCount << " barriers, " << stats.transientImageCount << " transient images in "
+            << stats.aliasedSize << " instead of " << stats.transientSize << " bytes" << std::endl;
+#endif
+}
+
+void RenderGraph::execute(const vk::CommandBuffer& commandBuffer, uint32_t index, GpuProfiler *profiler) const {
+  for(const Step& step : steps) {
+    recordBarriers(commandBuffer, step.barriers, index);
+    uint32_t scope = profiler ? profiler->begin(commandBuffer, step.pass->name) : GpuProfiler::NO_SCOPE;
+    vk::Framebuffer framebuffer = step.framebuffers.empty() ? vk::Framebuffer()
+                                                            : step.framebuffers[index % step.framebuffers.size()].get();
+    Context context = {commandBuffer, step.renderPass.get(), framebuffer, step.extent, index, *this,
+                       step.clearValues};
+    if(step.pass->record)
+      step.pass->record(context);
+    if(step.renderPass) {
+      if(!context.renderPassBegun)
+        context.beginRenderPass();
+      commandBuffer.endRenderPass();
+    }
+    if(profiler)
+      profiler->end(commandBuffer, scope);
+  }
+  recordBarriers(commandBuffer, finalBarriers, index);
+}
+
+vk::RenderPass RenderGraph::getRenderPass(std::string_view passName) const {
+  for(const Step& step : steps)
+    if(step.pass->name == passName && step.renderPass)
+      return step.renderPass.get();
+  throw std::runtime_error("no graphics pass " + std::string(passName) + " in the compiled render graph");
+}
+
+vk::Image RenderGraph::getImage(Handle image, uint32_t index) const {
+  const Image& resource = images[image];
+  if(!resource.imported.empty())
+    return resource.imported[index % resource.imported.size()].image;
+  return resource.image.get();
+}
+
+vk::ImageView RenderGraph::getImageView(Handle image, uint32_t index) const {
+  const Image& resource = images[image];
+  if(!resource.imported.empty())
+    return resource.imported[index % resource.imported.size()].imageView;
+  return resource.imageView.get();
+}
+
+const RenderGraphStats& RenderGraph::getStats() const {
+  return stats;
+}
+
+std::vector<const RenderGraph::Pass *> RenderGraph::schedule() {
+  std::size_t passCount = passes.size();
+  // Passes whose results a pass consumes, and passes it merely has to run after as it overwrites what they read.
+  std::vector<std::vector<uint32_t>> dataDependencies(passCount);
+  std::vector<std::vector<uint32_t>> orderDependencies(passCount);
+  std::vector<std::optional<uint32_t>> lastWriters(images.size());
+  std::vector<std::vector<uint32_t>> readers(images.size());
+  for(uint32_t pass = 0; pass < passCount; ++pass) {
+    // Reads first, so a pass reading and writing an image depends on the previous writer rather than itself.
+    for(const Pass::Use& use : passes[pass]->uses) {
+      if(isWrite(use.usage)) continue;
+      if(lastWriters[use.image])
+        dataDependencies[pass].push_back(*lastWriters[use.image]);
+      else if(images[use.image].imported.empty())
+        throw std::runtime_error(std::string("pass ") + passes[pass]->name + " reads " + images[use.image].name +
+                                 " before any pass writes it");
+      readers[use.image].push_back(pass);
+    }
+    for(const Pass::Use& use : passes[pass]->uses) {
+      if(!isWrite(use.usage)) continue;
+      // Cleared attachments replace the previous contents entirely, every other write keeps parts of them.
+      bool replaces = use.usage == Pass::Usage::eColorAttachment && use.clearColor;
+      if(lastWriters[use.image])
+        (replaces ? orderDependencies : dataDependencies)[pass].push_back(*lastWriters[use.image]);
+      for(uint32_t reader : readers[use.image])
+        if(reader != pass)
+          orderDependencies[pass].push_back(reader);
+      readers[use.image].clear();
+      lastWriters[use.image] = pass;
+    }
+  }
+
+  // Only passes with side effects, the last writers of imported images and whatever they consume survive.
+  std::vector<bool> alive(passCount, false);
+  std::vector<uint32_t> pending;
+  for(uint32_t pass = 0; pass < passCount; ++pass)
+    if(passes[pass]->sideEffects)
+      pending.push_back(pass);
+  for(Handle image = 0; image < images.size(); ++image)
+    if(!images[image].imported.empty() && lastWriters[image])
+      pending.push_back(*lastWriters[image]);
+  while(!pending.empty()) {
+    uint32_t pass = pending.back();
+    pending.pop_back();
+    if(alive[pass]) continue;
+    alive[pass] = true;
+    pending.insert(pending.end(), dataDependencies[pass].begin(), dataDependencies[pass].end());
+  }
+
+  // Of the passes ready to run, the one whose dependencies finished longest ago goes first. This spreads dependent
+  // passes apart so the GPU can overlap them, and keeps the declaration order where nothing is gained.
+  std::vector<std::optional<uint32_t>> positions(passCount);
+  std::vector<const Pass *> order;
+  auto aliveCount = std::size_t(std::count(alive.begin(), alive.end(), true));
+  while(order.size() < aliveCount) {
+    std::optional<uint32_t> best;
+    int64_t bestLatest = 0;
+    for(uint32_t pass = 0; pass < passCount; ++pass) {
+      if(!alive[pass] || positions[pass]) continue;
+      bool ready = true;
+      int64_t latest = -1;
+      for(const auto *dependencies : {&dataDependencies[pass], &orderDependencies[pass]}) {
+        for(uint32_t dependency : *dependencies) {
+          if(!alive[dependency]) continue;
+          if(!positions[dependency]) {
+            ready = false;
+            break;
+          }
+          latest = std::max<int64_t>(latest, *positions[dependency]);
+        }
+      }
+      if(ready && (!best || latest < bestLatest)) {
+        best = pass;
+        bestLatest = latest;
+      }
+    }
+    // Dependencies only ever point to passes declared earlier, so some pass is always ready.
+    positions[*best] = uint32(order.size());
+    order.push_back(passes[*best].get());
+  }
+  return order;
+}
+
+void RenderGraph::createTransientImages() {
+  std::vector<Handle> transients;
+  for(Handle handle = 0; handle < images.size(); ++handle) {
+    Image& image = images[handle];
+    if(!image.imported.empty() || !image.used) continue;
+    vk::ImageCreateInfo imageCreateInfo = {{}, vk::ImageType::e2D, image.format,
+                                           {image.extent.width, image.extent.height, 1}, 1, 1,
+                                           vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, image.usage,
+                                           vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined};
+    image.image = device->createImageUnique(imageCreateInfo);
+    image.requirements = device->getImageMemoryRequirements(image.image.get());
+    stats.transientSize += image.requirements.size;
+    transients.push_back(handle);
+  }
+  stats.transientImageCount = uint32(transients.size());
+
+  // Largest first, so smaller images fill the slots the large ones leave free over time.
+  std::stable_sort(transients.begin(), transients.end(), [&](Handle a, Handle b) {
+    return images[a].requirements.size > images[b].requirements.size;
+  });
+  for(Handle handle : transients) {
+    Image& image = images[handle];
+    auto slot = std::find_if(memorySlots.begin(), memorySlots.end(), [&](const MemorySlot& slot) {
+      if(!(slot.requirements.memoryTypeBits & image.requirements.memoryTypeBits)) return false;
+      return std::all_of(slot.images.begin(), slot.images.end(), [&](Handle other) {
+        return images[other].lastUse < image.firstUse || images[other].firstUse > image.lastUse;
+      });
+    });
+    if(slot == memorySlots.end()) {
+      slot = memorySlots.emplace(memorySlots.end());
+      slot->requirements = image.requirements;
+    }
+    slot->requirements.size = std::max(slot->requirements.size, image.requirements.size);
+    slot->requirements.alignment = std::max(slot->requirements.alignment, image.requirements.alignment);
+    slot->requirements.memoryTypeBits &= image.requirements.memoryTypeBits;
+    slot->images.push_back(handle);
+    image.memorySlot = uint32(slot - memorySlots.begin());
+  }
+
+  for(MemorySlot& slot : memorySlots) {
+    slot.allocation = allocator.allocate(slot.requirements, MemoryUsage::eGpuOnly, false);
+    stats.aliasedSize += slot.requirements.size;
+    for(Handle handle : slot.images) {
+      Image& image = images[handle];
+      device->bindImageMemory(image.image.get(), slot.allocation->memory, slot.allocation->offset);
+      vk::ImageViewCreateInfo viewCreateInfo = {{}, image.image.get(), vk::ImageViewType::e2D, image.format, {},
+                                                {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}};
+      image.imageView = device->createImageViewUnique(viewCreateInfo);
+    }
+  }
+}
+
+void RenderGraph::deriveBarriers(std::vector<Tracker>& slotStates) {
+  stats.barrierCount = 0;
+  stats.imageBarrierCount = 0;
+  std::vector<Tracker> trackers(images.size());
+  for(Handle handle = 0; handle < images.size(); ++handle) {
+    const ImageState& initialState = images[handle].initialState;
+    trackers[handle] = {initialState.layout, initialState.stages, initialState.access, {}, {}, {}};
+  }
+
+  for(uint32_t position = 0; position < steps.size(); ++position) {
+    Step& step = steps[position];
+    const Pass& pass = *step.pass;
+
+    // Several uses of one image by a pass are combined into one state.
+    struct Target {
+      Handle image;
+      ImageState state;
+      bool write;
+    };
+    std::vector<Target> targets;
+    for(const Pass::Use& use : pass.uses) {
+      ImageState state = getUseState(use.usage, pass.type, !use.clearColor);
+      auto target = std::find_if(targets.begin(), targets.end(), [&](const Target& t) { return t.image == use.image; });
+      if(target == targets.end()) {
+        targets.push_back({use.image, state, isWrite(use.usage)});
+        continue;
+      }
+      if(target->state.layout != state.layout)
+        target->state.layout = vk::ImageLayout::eGeneral;
+      target->state.stages |= state.stages;
+      target->state.access |= state.access;
+      target->write = target->write || isWrite(use.usage);
+    }
+
+    BarrierBatch batch;
+    for(const Target& target : targets) {
+      Image& image = images[target.image];
+      Tracker& tracker = trackers[target.image];
+      bool transient = image.imported.empty();
+      // A transient's contents never outlive a frame, it only waits for the previous user of its memory.
+      if(transient && position == image.firstUse) {
+        tracker = slotStates[image.memorySlot];
+        tracker.layout = vk::ImageLayout::eUndefined;
+      }
+
+      const ImageState& state = target.state;
+      bool transition = tracker.layout != state.layout;
+      bool needed;
+      vk::PipelineStageFlags srcStages;
+      if(transition || target.write) {
+        // Layout transitions and writes have to wait for every earlier access.
+        srcStages = tracker.writeStages | tracker.readStages;
+        needed = transition || srcStages;
+      } else {
+        // Reads only wait for the last write, unless an earlier barrier already made it visible to them.
+        srcStages = tracker.writeStages;
+        needed = srcStages &&
+                 (!contains(tracker.visibleStages, state.stages) || !contains(tracker.visibleAccess, state.access));
+      }
+      if(needed) {
+        batch.srcStages |= srcStages ? srcStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+        batch.dstStages |= state.stages;
+        batch.barriers.push_back({target.image, tracker.writeAccess, state.access, tracker.layout, state.layout});
+      }
+
+      if(transition || target.write) {
+        tracker.layout = state.layout;
+        tracker.writeStages = state.stages;
+        tracker.writeAccess = target.write ? state.access & WRITE_ACCESS : vk::AccessFlags();
+        tracker.visibleStages = state.stages;
+        tracker.visibleAccess = state.access;
+        tracker.readStages = target.write ? vk::PipelineStageFlags() : state.stages;
+      } else {
+        if(needed) {
+          tracker.visibleStages |= state.stages;
+          tracker.visibleAccess |= state.access;
+        }
+        tracker.readStages |= state.stages;
+      }
+      if(transient && position == image.lastUse)
+        slotStates[image.memorySlot] = tracker;
+    }
+    if(!batch.barriers.empty()) {
+      ++stats.barrierCount;
+      stats.imageBarrierCount += uint32(batch.barriers.size());
+    }
+    step.barriers = std::move(batch);
+  }
+
+  finalBarriers = {};
+  for(Handle handle = 0; handle < images.size(); ++handle) {
+    const std::optional<ImageState>& finalState = images[handle].finalState;
+    if(!finalState) continue;
+    const Tracker& tracker = trackers[handle];
+    if(tracker.layout == finalState->layout && !tracker.writeAccess) continue;
+    vk::PipelineStageFlags srcStages = tracker.writeStages | tracker.readStages;
+    finalBarriers.srcStages |= srcStages ? srcStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+    finalBarriers.dstStages |= finalState->stages;
+    finalBarriers.barriers.push_back({handle, tracker.writeAccess, finalState->access, tracker.layout,
+                                      finalState->layout});
+  }
+  if(!finalBarriers.barriers.empty()) {
+    ++stats.barrierCount;
+    stats.imageBarrierCount += uint32(finalBarriers.barriers.size());
+  }
+}
+
+void RenderGraph::createRenderPasses() {
+  for(uint32_t position = 0; position < steps.size(); ++position) {
+    Step& step = steps[position];
+    const Pass& pass = *step.pass;
+    if(pass.type != PassType::eGraphics) continue;
+
+    std::vector<vk::AttachmentDescription> attachments;
+    std::vector<vk::AttachmentReference> references;
+    std::vector<Handle> outputs;
+    std::size_t framebufferCount = 1;
+    for(const Pass::Use& use : pass.uses) {
+      if(use.usage != Pass::Usage::eColorAttachment) continue;
+      const Image& image = images[use.image];
+      if(outputs.empty())
+        step.extent = image.extent;
+      else if(image.extent != step.extent)
+        throw std::runtime_error(std::string("the color outputs of pass ") + pass.name + " differ in size");
+
+      bool transient = image.imported.empty();
+      vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eLoad;
+      if(use.clearColor)
+        loadOp = vk::AttachmentLoadOp::eClear;
+      else if(transient && image.firstUse == position)
+        loadOp = vk::AttachmentLoadOp::eDontCare;
+      // Nothing after the pass reads a transient it wrote last, so it need not be written back to memory.
+      vk::AttachmentStoreOp storeOp = !transient || image.lastUse > position ? vk::AttachmentStoreOp::eStore
+                                                                             : vk::AttachmentStoreOp::eDontCare;
+      // Layouts are transitioned by the graph's barriers, the render pass keeps them as they are.
+      attachments.emplace_back(vk::AttachmentDescriptionFlags(), image.format, vk::SampleCountFlagBits::e1, loadOp,
+                               storeOp, vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+                               vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eColorAttachmentOptimal);
+      references.emplace_back(uint32(references.size()), vk::ImageLayout::eColorAttachmentOptimal);
+      step.clearValues.emplace_back(use.clearColor ? vk::ClearValue(*use.clearColor) : vk::ClearValue());
+      outputs.push_back(use.image);
+      framebufferCount = std::max(framebufferCount, image.imported.size());
+    }
+    if(outputs.empty())
+      throw std::runtime_error(std::string("graphics pass ") + pass.name + " has no color outputs");
+
+    vk::SubpassDescription subpass = {{}, vk::PipelineBindPoint::eGraphics, 0, nullptr, vk::size(references),
+                                      references.data(), nullptr, nullptr, 0, nullptr};
+    vk::RenderPassCreateInfo renderPassCreateInfo = {{}, vk::size(attachments), attachments.data(), 1, &subpass, 0,
+                                                     nullptr};
+    step.renderPass = device->createRenderPassUnique(renderPassCreateInfo);
+
+    for(uint32_t i = 0; i < framebufferCount; ++i) {
+      std::vector<vk::ImageView> imageViews;
+      for(Handle output : outputs)
+        imageViews.push_back(getImageView(output, i));
+      vk::FramebufferCreateInfo framebufferCreateInfo = {{}, step.renderPass.get(), vk::size(imageViews),
+                                                         imageViews.data(), step.extent.width, step.extent.height, 1};
+      step.framebuffers.push_back(device->createFramebufferUnique(framebufferCreateInfo));
+    }
+  }
+}
+
+void RenderGraph::recordBarriers(const vk::CommandBuffer& commandBuffer, const BarrierBatch& batch,
+                                 uint32_t index) const {
+  if(batch.barriers.empty()) return;
+  std::vector<vk::ImageMemoryBarrier> barriers;
+  barriers.reserve(batch.barriers.size());
+  for(const Barrier& barrier : batch.barriers)
+    barriers.emplace_back(barrier.srcAccess, barrier.dstAccess, barrier.oldLayout, barrier.newLayout,
+                          VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, getImage(barrier.image, index),
+                          vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+  commandBuffer.pipelineBarrier(batch.srcStages, batch.dstStages, {}, 0, nullptr, 0, nullptr, vk::size(barriers),
+                                barriers.data());
+}
+
+ImageState RenderGraph::getUseState(Pass::Usage usage, PassType type, bool load) {
+  vk::PipelineStageFlags shaderStages = type == PassType::eCompute
+                                        ? vk::PipelineStageFlags(vk::PipelineStageFlagBits::eComputeShader)
+                                        : vk::PipelineStageFlagBits::eVertexShader |
+                                          vk::PipelineStageFlagBits::eFragmentShader;
+  switch(usage) {
+    case Pass::Usage::eColorAttachment:
+      return {vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits::eColorAttachmentOutput,
+              load ? vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+                   : vk::AccessFlags(vk::AccessFlagBits::eColorAttachmentWrite)};
+    case Pass::Usage::eSampled:
+      return {vk::ImageLayout::eShaderReadOnlyOptimal, shaderStages, vk::AccessFlagBits::eShaderRead};
+    case Pass::Usage::eStorageRead:
+      return {vk::ImageLayout::eGeneral, shaderStages, vk::AccessFlagBits::eShaderRead};
+    case Pass::Usage::eStorageWrite:
+      return {vk::ImageLayout::eGeneral, shaderStages, vk::AccessFlagBits::eShaderWrite};
+    case Pass::Usage::eTransferSrc:
+      return {vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits::eTransfer,
+              vk::AccessFlagBits::eTransferRead};
+    case Pass::Usage::eTransferDst:
+      return {vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eTransfer,
+              vk::AccessFlagBits::eTransferWrite};
+  }
+  return {};
+}
+
+bool RenderGraph::isWrite(Pass::Usage usage) {
+  return usage == Pass::Usage::eColorAttachment || usage == Pass::Usage::eStorageWrite ||
+         usage == Pass::Usage::eTransferDst;
+}
+
+vk::ImageUsageFlags RenderGraph::getImageUsage(Pass::Usage usage) {
+  switch(usage) {
+    case Pass::Usage::eColorAttachment:
+      return vk::ImageUsageFlagBits::eColorAttachment;
+    case Pass::Usage::eSampled:
+      return vk::ImageUsageFlagBits::eSampled;
+    case Pass::Usage::eStorageRead:
+    case Pass::Usage::eStorageWrite:
+      return vk::ImageUsageFlagBits::eStorage;
+    case Pass::Usage::eTransferSrc:
+      return vk::ImageUsageFlagBits::eTransferSrc;
+    case Pass::Usage::eTransferDst:
+      return vk::ImageUsageFlagBits::eTransferDst;
+  }
+  return {};
+}
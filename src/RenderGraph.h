@@ -0,0 +1,307 @@
+#ifndef VULKAN_RENDERGRAPH_H
+#define VULKAN_RENDERGRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "GpuProfiler.h"
+#include "MemoryAllocator.h"
+
+/**
+ * The layout of an image along with the stages and accesses that must complete before it is used otherwise.
+ */
+struct ImageState {
+  vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+  vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eTopOfPipe;
+  vk::AccessFlags access;
+};
+
+/**
+ * An image owned outside of the graph, like a swap chain image.
+ */
+struct ImportedImage {
+  vk::Image image;
+  vk::ImageView imageView;
+};
+
+struct RenderGraphStats {
+  uint32_t passCount = 0;
+  uint32_t culledPassCount = 0;
+  // vkCmdPipelineBarrier calls per execute() and the image barriers they carry.
+  uint32_t barrierCount = 0;
+  uint32_t imageBarrierCount = 0;
+  uint32_t transientImageCount = 0;
+  // Memory the transient images would need on their own and what they take with aliasing.
+  vk::DeviceSize transientSize = 0;
+  vk::DeviceSize aliasedSize = 0;
+};
+
+/**
+ * Records a frame from passes declaring which images they read and write, instead of hand written render passes and
+ * barriers.
+ *
+ * compile() culls every pass that neither has side effects nor contributes to an imported image, orders the rest by
+ * their dependencies, and derives the barriers each pass needs, merged into a single vkCmdPipelineBarrier in front of
+ * it. Transient images, which only live within the graph, share memory whenever their lifetimes do not overlap. A
+ * transient's first use in a frame waits for the last use of its memory in the previous frame, so a single set of
+ * transients serves every frame in flight.
+ *
+ * Passes are declared in the order they would run in; a pass reads what the passes declared before it wrote.
+ */
+class RenderGraph {
+
+public:
+  using Handle = uint32_t;
+
+  enum class PassType {
+    // Renders to its color outputs inside a render pass created by the graph.
+    eGraphics,
+    eCompute,
+    eTransfer
+  };
+
+  /**
+   * Handed to a pass while it records.
+   */
+  struct Context {
+    vk::CommandBuffer commandBuffer;
+    // Only set for graphics passes.
+    vk::RenderPass renderPass;
+    vk::Framebuffer framebuffer;
+    vk::Extent2D extent;
+    // The index passed to execute(), which selects the image of every imported image.
+    uint32_t index;
+    const RenderGraph& graph;
+    const std::vector<vk::ClearValue>& clearValues;
+    mutable bool renderPassBegun = false;
+
+    /**
+     * Begins the render pass of a graphics pass, which the graph ends once the pass returns. A pass that does not
+     * begin it itself has it begun inline afterwards, so its clears still happen.
+     */
+    void beginRenderPass(vk::SubpassContents contents = vk::SubpassContents::eInline) const;
+
+    vk::Image getImage(Handle image) const;
+
+    vk::ImageView getImageView(Handle image) const;
+  };
+
+  using RecordFunction = std::function<void(const Context&)>;
+
+  class Pass {
+
+  public:
+    /**
+     * Renders to image. Without a clear color the previous contents are loaded.
+     */
+    Pass& addColorOutput(Handle image, std::optional<vk::ClearColorValue> clearColor = std::nullopt);
+
+    Pass& addSampledInput(Handle image);
+
+    Pass& addStorageInput(Handle image);
+
+    /**
+     * Writes image as a storage image. Writes are assumed to be partial, so the previous contents are kept.
+     */
+    Pass& addStorageOutput(Handle image);
+
+    Pass& addTransferInput(Handle image);
+
+    Pass& addTransferOutput(Handle image);
+
+    Pass& setRecord(RecordFunction record);
+
+    /**
+     * Keeps the pass even if nothing reads what it writes, e.g. a readback to the host.
+     */
+    Pass& setSideEffects();
+
+  private:
+    friend class RenderGraph;
+
+    enum class Usage {
+      eColorAttachment,
+      eSampled,
+      eStorageRead,
+      eStorageWrite,
+      eTransferSrc,
+      eTransferDst
+    };
+
+    struct Use {
+      Handle image;
+      Usage usage;
+      std::optional<vk::ClearColorValue> clearColor;
+    };
+
+    const char *name;
+    PassType type;
+    std::vector<Use> uses;
+    RecordFunction record;
+    bool sideEffects = false;
+
+    Pass(const char *name, PassType type);
+
+  };
+
+  RenderGraph(const vk::UniqueDevice& device, MemoryAllocator& allocator);
+
+  RenderGraph(const RenderGraph&) = delete;
+
+  RenderGraph& operator=(const RenderGraph&) = delete;
+
+  /**
+   * Declares an image created by compile() that only lives within the graph. Its usage flags follow from the passes
+   * using it.
+   */
+  Handle createImage(const char *name, vk::Format format, vk::Extent2D extent);
+
+  /**
+   * Declares images owned outside of the graph, of which execute() uses the one its index selects. Imported images
+   * count as used after the graph, so the passes writing them are never culled.
+   * @param initialState The state every image is in, and the work that has to finish, before the graph runs.
+   * @param finalState The state to leave the images in, or none to leave them as the last pass used them.
+   */
+  Handle importImage(const char *name, vk::Format format, vk::Extent2D extent, std::vector<ImportedImage> images,
+                     const ImageState& initialState, std::optional<ImageState> finalState = std::nullopt);
+
+  /**
+   * Declares a pass. Names must be string literals, they name the pass's GPU profiler scope.
+   */
+  Pass& addPass(const char *name, PassType type);
+
+  /**
+   * Orders and culls the passes and creates the transient images, render passes and framebuffers. Nothing may be
+   * declared afterwards.
+   * @throws std::runtime_error if the declarations are inconsistent.
+   */
+  void compile();
+
+  /**
+   * Records every pass that survived compile() into commandBuffer, outside of any render pass. With a profiler every
+   * pass is timed as a scope of its name.
+   */
+  void execute(const vk::CommandBuffer& commandBuffer, uint32_t index, GpuProfiler *profiler = nullptr) const;
+
+  /**
+   * @return The render pass of a graphics pass, to create pipelines with.
+   * @throws std::runtime_error if there is no such pass or it was culled.
+   */
+  vk::RenderPass getRenderPass(std::string_view passName) const;
+
+  vk::Image getImage(Handle image, uint32_t index) const;
+
+  vk::ImageView getImageView(Handle image, uint32_t index) const;
+
+  const RenderGraphStats& getStats() const;
+
+private:
+
+  struct Image {
+    const char *name;
+    vk::Format format;
+    vk::Extent2D extent;
+    vk::ImageUsageFlags usage;
+    // Empty for transient images.
+    std::vector<ImportedImage> imported;
+    ImageState initialState;
+    std::optional<ImageState> finalState;
+    vk::UniqueImage image;
+    vk::UniqueImageView imageView;
+    vk::MemoryRequirements requirements;
+    uint32_t memorySlot = 0;
+    // Positions in execution order of the first and last pass using it.
+    uint32_t firstUse = 0;
+    uint32_t lastUse = 0;
+    bool used = false;
+  };
+
+  /**
+   * Memory shared by transient images with disjoint lifetimes.
+   */
+  struct MemorySlot {
+    vk::MemoryRequirements requirements;
+    std::vector<Handle> images;
+    UniqueAllocation allocation;
+  };
+
+  struct Barrier {
+    Handle image;
+    vk::AccessFlags srcAccess;
+    vk::AccessFlags dstAccess;
+    vk::ImageLayout oldLayout;
+    vk::ImageLayout newLayout;
+  };
+
+  struct BarrierBatch {
+    vk::PipelineStageFlags srcStages;
+    vk::PipelineStageFlags dstStages;
+    std::vector<Barrier> barriers;
+  };
+
+  struct Step {
+    const Pass *pass;
+    BarrierBatch barriers;
+    vk::UniqueRenderPass renderPass;
+    // One per image of the imported images it renders to.
+    std::vector<vk::UniqueFramebuffer> framebuffers;
+    std::vector<vk::ClearValue> clearValues;
+    vk::Extent2D extent;
+  };
+
+  /**
+   * Tracks an image while deriving barriers.
+   */
+  struct Tracker {
+    vk::ImageLayout layout;
+    // The last write, or layout transition, and the stages and accesses it has been made visible to.
+    vk::PipelineStageFlags writeStages;
+    vk::AccessFlags writeAccess;
+    vk::PipelineStageFlags visibleStages;
+    vk::AccessFlags visibleAccess;
+    // Reads since the last write, which a write has to wait for.
+    vk::PipelineStageFlags readStages;
+  };
+
+  const vk::UniqueDevice& device;
+  MemoryAllocator& allocator;
+  std::vector<Image> images;
+  std::vector<std::unique_ptr<Pass>> passes;
+  std::vector<MemorySlot> memorySlots;
+  std::vector<Step> steps;
+  BarrierBatch finalBarriers;
+  RenderGraphStats stats;
+  bool compiled = false;
+
+  /**
+   * @return The passes, in execution order, that have to run.
+   */
+  std::vector<const Pass *> schedule();
+
+  void createTransientImages();
+
+  /**
+   * Simulates one execution to derive the barriers in front of every step and the final transitions.
+   * @param slotStates The state each memory slot is left in by the previous execution, updated to this one's.
+   */
+  void deriveBarriers(std::vector<Tracker>& slotStates);
+
+  void createRenderPasses();
+
+  void recordBarriers(const vk::CommandBuffer& commandBuffer, const BarrierBatch& batch, uint32_t index) const;
+
+  static ImageState getUseState(Pass::Usage usage, PassType type, bool load);
+
+  static bool isWrite(Pass::Usage usage);
+
+  static vk::ImageUsageFlags getImageUsage(Pass::Usage usage);
+
+};
+
+#endif
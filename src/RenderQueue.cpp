@@ -0,0 +1,51 @@
+#include "RenderQueue.h"
+
+#include <array>
+
+#include "Trace.h"
+
+uint64_t RenderQueue::makeKey(uint8_t layer, bool translucent, uint8_t pipeline, uint16_t material, uint32_t depth) {
+  uint64_t key = uint64_t(layer) << 56U | uint64_t(translucent) << 55U;
+  uint64_t state = uint64_t(pipeline) << 16U | material;
+  if(translucent)
+    return key | uint64_t(depth & MAX_DEPTH) << 24U | state;
+  return key | state << 31U | (depth & MAX_DEPTH);
+}
+
+void RenderQueue::clear() {
+  items.clear();
+}
+
+void RenderQueue::push(uint64_t key, uint32_t index) {
+  items.push_back({key, index});
+}
+
+void RenderQueue::sort() {
+  TRACE_FUNCTION();
+  if(items.size() < 2) return;
+  // Counts every byte in a single read of the keys.
+  std::array<std::array<uint32_t, 256>, 8> counts{};
+  for(const Item& item : items)
+    for(uint32_t byte = 0; byte < 8; ++byte)
+      ++counts[byte][(item.key >> (byte * 8U)) & 0xFFU];
+
+  scratch.resize(items.size());
+  for(uint32_t byte = 0; byte < 8; ++byte) {
+    std::array<uint32_t, 256>& count = counts[byte];
+    // Every key has the same byte, the pass would not move anything.
+    if(count[(items.front().key >> (byte * 8U)) & 0xFFU] == items.size()) continue;
+    uint32_t offset = 0;
+    for(uint32_t& bucket : count) {
+      uint32_t size = bucket;
+      bucket = offset;
+      offset += size;
+    }
+    for(const Item& item : items)
+      scratch[count[(item.key >> (byte * 8U)) & 0xFFU]++] = item;
+    items.swap(scratch);
+  }
+}
+
+const std::vector<RenderQueue::Item>& RenderQueue::getItems() const {
+  return items;
+}
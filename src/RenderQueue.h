@@ -0,0 +1,53 @@
+#ifndef VULKAN_RENDERQUEUE_H
+#define VULKAN_RENDERQUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Draws of a frame ordered by 64 bit sort keys, so draws sharing state end up next to each other and the state is
+ * bound once for all of them.
+ *
+ * From the most significant bit on, a key holds the layer, whether the draw is translucent and then, for opaque
+ * draws, the pipeline, the material and the depth. Translucent draws have to be blended in order, so their depth
+ * comes right after the translucency bit instead and state only breaks ties. Layers are drawn in ascending order, and
+ * within a layer opaque draws come before translucent ones.
+ *
+ * Keys are sorted by a least significant digit radix sort, a pass per byte, which skips bytes every key shares.
+ */
+class RenderQueue {
+
+public:
+  static constexpr uint32_t MAX_DEPTH = (1U << 31U) - 1;
+
+  struct Item {
+    uint64_t key;
+    // Identifies the draw to whoever pushed it.
+    uint32_t index;
+  };
+
+  /**
+   * @param depth Drawn in ascending order, at most MAX_DEPTH. Back to front for translucent draws.
+   */
+  static uint64_t makeKey(uint8_t layer, bool translucent, uint8_t pipeline, uint16_t material, uint32_t depth);
+
+  void clear();
+
+  void push(uint64_t key, uint32_t index);
+
+  /**
+   * Sorts the items by key, items with equal keys keep the order they were pushed in.
+   */
+  void sort();
+
+  const std::vector<Item>& getItems() const;
+
+private:
+
+  std::vector<Item> items;
+  // The other half of every pass, kept to not allocate per frame.
+  std::vector<Item> scratch;
+
+};
+
+#endif
@@ -1,24 +1,42 @@
 #include "Renderer.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <filesystem>
+#include <limits>
+#include <map>
 
+#ifdef VULKAN_SHADER_HOT_RELOAD
 #include <shaderc/shaderc.hpp>
+#endif
 
 #include "Macros.h"
 #include "DeviceUtils.h"
+#include "Mesh.h"
+#include "Trace.h"
+#ifdef VULKAN_SHADER_HOT_RELOAD
 #include "ShaderUtils.h"
+#else
+#include "EmbeddedShaders.h"
+#endif
+
+#ifdef VULKAN_SHADER_HOT_RELOAD
+static shaderc_shader_kind getShaderKind(const fs::path& path) {
+  std::string extension = path.extension().string();
+  return extension == ".vert" ? shaderc_shader_kind::shaderc_vertex_shader
+         : extension == ".frag" ? shaderc_shader_kind::shaderc_fragment_shader
+         : shaderc_shader_kind::shaderc_compute_shader;
+}
+#endif
 
 void Renderer::initVk() {
-  try {
-    vk::ApplicationInfo applicationInfo("vulkan", vk::makeVersion(1, 0, 0), "", vk::makeVersion(1, 0, 0),
-                                        vk::makeVersion(1, 0, 0));
-    vk::InstanceCreateInfo createInfo({}, &applicationInfo, vk::size(enabledLayers), enabledLayers.data(),
-                                      vk::size(enabledExtensions), enabledExtensions.data());
-    vkInstance = vk::createInstanceUnique(createInfo);
-  } catch(const std::runtime_error& e) {
-    std::cerr << e.what() << std::endl;
-    exit(-1);
-  }
+  TRACE_FUNCTION();
+  vk::ApplicationInfo applicationInfo("vulkan", vk::makeVersion(1, 0, 0), "", vk::makeVersion(1, 0, 0),
+                                      vk::makeVersion(1, 0, 0));
+  vk::InstanceCreateInfo createInfo({}, &applicationInfo, vk::size(enabledLayers), enabledLayers.data(),
+                                    vk::size(enabledExtensions), enabledExtensions.data());
+  vkInstance = vk::createInstanceUnique(createInfo);
 
 #ifdef DEBUG
   std::cout << "vulkan initialized" << std::endl;
@@ -27,8 +45,6 @@ void Renderer::initVk() {
 }
 
 void Renderer::enableRequiredDeviceExtensions(vk::PhysicalDevice device) {
-  enabledDeviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-
   std::vector<vk::ExtensionProperties> deviceExtensions = device.enumerateDeviceExtensionProperties();
   std::vector<const char *> deviceExtensionNames(deviceExtensions.size());
   std::transform(deviceExtensions.begin(), deviceExtensions.end(), deviceExtensionNames.begin(),
@@ -51,14 +67,15 @@ void Renderer::enableRequiredDeviceExtensions(vk::PhysicalDevice device) {
   });
 
   if(!unsupportedExtensions.empty()) {
-    std::cerr << "Missing Device Extensions:" << std::endl;
+    std::string message = "Missing Device Extensions:";
     for(const auto& i : unsupportedExtensions)
-      std::cerr << "\t" << i << std::endl;
-    exit(-1);
+      message += std::string("\n\t") + i;
+    throw std::runtime_error(message);
   }
 }
 
 void Renderer::enableRequiredExtensions() {
+  TRACE_FUNCTION();
   std::vector<vk::ExtensionProperties> supportedExtensions = vk::enumerateInstanceExtensionProperties();
 
 #ifdef DEBUG
@@ -67,10 +84,13 @@ void Renderer::enableRequiredExtensions() {
     std::cout << "\t" << ext.extensionName << std::endl;
 #endif
 
-  std::size_t numExtensions = 0;
-  const char **glfwExtensions = glfwGetRequiredInstanceExtensions(reinterpret_cast<uint32_t *>(&numExtensions));
-  for(std::size_t i = 0; i < numExtensions; ++i)
-    enabledExtensions.push_back(glfwExtensions[i]);
+  // Headless rendering never presents, so it needs none of the surface extensions.
+  if(!headless) {
+    uint32_t numExtensions = 0;
+    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&numExtensions);
+    for(uint32_t i = 0; i < numExtensions; ++i)
+      enabledExtensions.push_back(glfwExtensions[i]);
+  }
 
 #ifdef DEBUG
   std::cout << "GLFW requested the following extensions: " << std::endl;
@@ -86,10 +106,15 @@ void Renderer::enableRequiredExtensions() {
         break;
       }
     }
-    if(!found) {
-      std::cerr << reqExt << " not found, quiting." << std::endl;
-      cleanup();
-      exit(-1);
+    if(!found)
+      throw std::runtime_error(std::string(reqExt) + " not found, quiting.");
+  }
+
+  // Optional, needed to query descriptor indexing support for bindless textures.
+  for(const auto& ext : supportedExtensions) {
+    if(!std::strcmp(ext.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+      enabledExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+      break;
     }
   }
 }
@@ -107,18 +132,38 @@ void Renderer::enableRequiredLayers() {
 }
 
 void Renderer::pickDevice() {
-  auto physicalDevices = vkInstance->enumeratePhysicalDevices();
-  physicalDevice = DeviceUtils::getOptimalPhysicalDevice(vkInstance);
+  TRACE_FUNCTION();
+  // Devices are only considered if they support every extension enabled here.
+  if(!headless)
+    enabledDeviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+  // Likewise for the formats of the sprite and mesh layouts, whose 16 bit normalized ones are optional for vertex
+  // buffers.
+  std::vector<vk::Format> vertexFormats;
+  for(const VertexAttribute& attribute : SPRITE_INSTANCE_LAYOUT.attributes)
+    vertexFormats.push_back(attribute.format);
+  for(const VertexAttribute& attribute : MESH_VERTEX_LAYOUT.attributes)
+    vertexFormats.push_back(attribute.format);
+
+  physicalDevice = DeviceUtils::getOptimalPhysicalDevice(vkInstance, enabledDeviceExtensions, vertexFormats,
+                                                         uniqueSurface, deviceOverride);
 
 #ifdef DEBUG
+  auto physicalDevices = vkInstance->enumeratePhysicalDevices();
   std::cout << "Physical Devices: " << std::endl;
-  for(auto& device : physicalDevices)
-    std::cout << "\t" << device.getProperties().deviceName << std::endl;
+  for(uint32_t i = 0; i < physicalDevices.size(); ++i)
+    std::cout << "\t" << i << ": " << physicalDevices[i].getProperties().deviceName << " ("
+              << vk::to_string(physicalDevices[i].getProperties().deviceType) << ", score "
+              << DeviceUtils::scorePhysicalDevice(physicalDevices[i], enabledDeviceExtensions, vertexFormats,
+                                                  uniqueSurface) << ")" << std::endl;
+  std::cout << "Selected " << physicalDevice.getProperties().deviceName << std::endl;
 #endif
 
-  std::set<std::optional<uint32_t>> queueFamilyIndices = DeviceUtils::getGraphicsAndPresentQueueFamilyIndices(
-      physicalDevice,
-      uniqueSurface);
+  std::set<std::optional<uint32_t>> queueFamilyIndices;
+  if(headless)
+    queueFamilyIndices.insert(DeviceUtils::getGraphicsQueueFamilyIndex(physicalDevice));
+  else
+    queueFamilyIndices = DeviceUtils::getGraphicsAndPresentQueueFamilyIndices(physicalDevice, uniqueSurface);
 
 
 #ifdef DEBUG
@@ -129,63 +174,133 @@ void Renderer::pickDevice() {
     std::cout << "\tgraphics: "
               << static_cast<bool>(queueFamilyProps[uint32(i)].queueFlags & vk::QueueFlagBits::eGraphics)
               << std::endl;
-    std::cout << "\tpresentation: "
-              << physicalDevice.getSurfaceSupportKHR(uint32(i), uniqueSurface.get()) << std::endl;
+    if(!headless)
+      std::cout << "\tpresentation: "
+                << physicalDevice.getSurfaceSupportKHR(uint32(i), uniqueSurface.get()) << std::endl;
   }
 #endif
 
-  for(const std::optional<uint32_t>& queueFamilyIndex : queueFamilyIndices) {
-    if(queueFamilyIndex.has_value()) continue;
-    std::cerr << "Could not find a queue family supporting graphics and/or presenting." << std::endl;
-    cleanup();
-    exit(-1);
-  }
+  for(const std::optional<uint32_t>& queueFamilyIndex : queueFamilyIndices)
+    if(!queueFamilyIndex.has_value())
+      throw std::runtime_error("Could not find a queue family supporting graphics and/or presenting.");
 
   graphicsQueueFamilyIndex = queueFamilyIndices.begin()->value();
   presentQueueFamilyIndex = queueFamilyIndices.rbegin()->value();
 
+  // Uploads go to a dedicated transfer family, which maps to the copy engines, or to a second graphics queue so they
+  // can at least be submitted from another thread.
+  std::map<uint32_t, uint32_t> queueCounts;
+  for(const auto& queueFamilyIndex : queueFamilyIndices)
+    queueCounts[queueFamilyIndex.value()] = 1;
+  std::optional<uint32_t> dedicatedTransferQueueFamilyIndex =
+      DeviceUtils::getDedicatedTransferQueueFamilyIndex(physicalDevice);
+  transferQueueFamilyIndex = dedicatedTransferQueueFamilyIndex.value_or(graphicsQueueFamilyIndex);
+  uint32_t transferQueueIndex = 0;
+  if(dedicatedTransferQueueFamilyIndex)
+    queueCounts[transferQueueFamilyIndex] = 1;
+  else if(physicalDevice.getQueueFamilyProperties()[graphicsQueueFamilyIndex].queueCount > 1) {
+    queueCounts[graphicsQueueFamilyIndex] = 2;
+    transferQueueIndex = 1;
+  }
+
+  // Optional, post-processing runs behind the sprites on the graphics queue without a dedicated compute family and
+  // timeline semaphores to hand frames between the queues with.
+  std::optional<uint32_t> dedicatedComputeQueueFamilyIndex =
+      DeviceUtils::getDedicatedComputeQueueFamilyIndex(physicalDevice);
+  asyncCompute = asyncCompute && postProcessing && dedicatedComputeQueueFamilyIndex &&
+                 DeviceUtils::getTimelineSemaphoreFeatures(vkInstance, physicalDevice).timelineSemaphore;
+  computeQueueFamilyIndex = asyncCompute ? *dedicatedComputeQueueFamilyIndex : graphicsQueueFamilyIndex;
+  vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures;
+  if(asyncCompute) {
+    queueCounts[computeQueueFamilyIndex] = 1;
+    enabledDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+  }
+
+  // Optional, GPU culling falls back to drawing every chunk without it.
+  drawIndirectCount = DeviceUtils::supportsExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+  if(drawIndirectCount)
+    enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+  enabledFeatures.multiDrawIndirect = physicalDevice.getFeatures().multiDrawIndirect;
+  enabledFeatures.drawIndirectFirstInstance = physicalDevice.getFeatures().drawIndirectFirstInstance;
+
+  // Optional, textures are packed into atlas pages without it.
+  vk::PhysicalDeviceDescriptorIndexingFeaturesEXT supportedIndexingFeatures =
+      DeviceUtils::getDescriptorIndexingFeatures(vkInstance, physicalDevice);
+  vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+  descriptorIndexing = supportedIndexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+                       supportedIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+                       supportedIndexingFeatures.descriptorBindingPartiallyBound &&
+                       supportedIndexingFeatures.runtimeDescriptorArray;
+  if(descriptorIndexing) {
+    enabledDeviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+  }
+
   enableRequiredDeviceExtensions(physicalDevice);
   std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateInfos;
-  std::vector<float *> queuePriorities;
-  float priority = 1;
-  for(const auto& queueFamilyIndex : queueFamilyIndices) {
-    deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo({}, queueFamilyIndex.value(), 1, &priority));
-  }
+  std::array<float, 2> priorities = {1, 1};
+  for(const auto& [queueFamilyIndex, queueCount] : queueCounts)
+    deviceQueueCreateInfos.push_back(vk::DeviceQueueCreateInfo({}, queueFamilyIndex, queueCount, priorities.data()));
 
-  try {
-    logicalDevice = physicalDevice.createDeviceUnique(vk::DeviceCreateInfo({}, vk::size(deviceQueueCreateInfos),
-                                                                           deviceQueueCreateInfos.data(),
-                                                                           vk::size(enabledLayers),
-                                                                           enabledLayers.data(),
-                                                                           vk::size(enabledDeviceExtensions),
-                                                                           enabledDeviceExtensions.data()));
-  } catch(const std::runtime_error& e) {
-    std::cerr << e.what() << std::endl;
-    cleanup();
-    exit(-1);
+  vk::DeviceCreateInfo deviceCreateInfo({}, vk::size(deviceQueueCreateInfos), deviceQueueCreateInfos.data(),
+                                        vk::size(enabledLayers), enabledLayers.data(),
+                                        vk::size(enabledDeviceExtensions), enabledDeviceExtensions.data(),
+                                        &enabledFeatures);
+  if(descriptorIndexing)
+    deviceCreateInfo.pNext = &descriptorIndexingFeatures;
+  if(asyncCompute) {
+    if(descriptorIndexing)
+      timelineSemaphoreFeatures.pNext = &descriptorIndexingFeatures;
+    deviceCreateInfo.pNext = &timelineSemaphoreFeatures;
   }
 
+  logicalDevice = physicalDevice.createDeviceUnique(deviceCreateInfo);
+
   graphicsQueue = logicalDevice->getQueue(graphicsQueueFamilyIndex, 0);
   presentQueue = logicalDevice->getQueue(presentQueueFamilyIndex, 0);
+  transferQueue = logicalDevice->getQueue(transferQueueFamilyIndex, transferQueueIndex);
+  computeQueue = asyncCompute ? logicalDevice->getQueue(computeQueueFamilyIndex, 0) : graphicsQueue;
+  memoryAllocator = std::make_unique<MemoryAllocator>(logicalDevice, physicalDevice);
+  descriptorAllocator = std::make_unique<DescriptorAllocator>(logicalDevice, framesInFlight);
 
 #ifdef DEBUG
   std::cout << "Selecting queue " << graphicsQueueFamilyIndex << " for graphics" << std::endl;
-  std::cout << "Selecting queue " << presentQueueFamilyIndex << " for presenting" << std::endl;
+  if(!headless)
+    std::cout << "Selecting queue " << presentQueueFamilyIndex << " for presenting" << std::endl;
+  std::cout << "Selecting queue " << transferQueueFamilyIndex << " (" << transferQueueIndex << ") for uploads"
+            << std::endl;
+  std::cout << "Descriptor indexing is " << (descriptorIndexing ? "enabled" : "unsupported") << std::endl;
+  if(postProcessing)
+    std::cout << "Selecting queue " << computeQueueFamilyIndex << " for post-processing"
+              << (asyncCompute ? " on async compute" : "") << std::endl;
 #endif
 
 }
 
 void Renderer::createSwapChain() {
-  vk::Extent2D preferredExtent(window->getWidth(), window->getHeight());
+  TRACE_FUNCTION();
+  vk::Extent2D preferredExtent(window->getFramebufferWidth(), window->getFramebufferHeight());
   swapChainSupportDetails = SwapChainUtils::getSwapChainSupport(physicalDevice, uniqueSurface);
   optimalExtent = SwapChainUtils::getOptimalExtent(swapChainSupportDetails, preferredExtent);
   optimalPresentMode = SwapChainUtils::getOptimalPresentMode(swapChainSupportDetails);
   optimalSurfaceFormat = SwapChainUtils::getOptimalSurfaceFormat(swapChainSupportDetails);
 
+  // recreateSwapChain() retires the current swap chain right before calling this.
+  vk::SwapchainKHR oldSwapChain = retiredSwapChains.empty() ? nullptr : retiredSwapChains.back().swapChain.get();
+  // Post-processed frames are copied to the swap chain rather than rendered to it.
+  vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment;
+  if(postProcessing)
+    usage |= vk::ImageUsageFlagBits::eTransferDst;
   swapChain = SwapChainUtils::createSwapChain(logicalDevice, swapChainSupportDetails, uniqueSurface,
                                               optimalPresentMode,
                                               optimalSurfaceFormat, optimalExtent, graphicsQueueFamilyIndex,
-                                              presentQueueFamilyIndex);
+                                              presentQueueFamilyIndex, oldSwapChain, usage);
+  swapChainImages.clear();
   for(const auto& swapChainImage : logicalDevice->getSwapchainImagesKHR(swapChain.get()))
     swapChainImages.push_back(swapChainImage);
   swapChainImageViews = SwapChainUtils::getImageViews(logicalDevice, swapChainImages, optimalSurfaceFormat.format);
@@ -211,7 +326,55 @@ void Renderer::createSwapChain() {
 
 }
 
+void Renderer::recreateSwapChain() {
+  TRACE_FUNCTION();
+  if(window->getFramebufferWidth() == 0 || window->getFramebufferHeight() == 0) return;
+
+  vk::Format format = optimalSurfaceFormat.format;
+  retiredSwapChains.push_back({std::move(swapChain), std::move(swapChainImageViews), frameCount,
+                               std::move(postTargets), std::move(renderGraph), std::move(postGraph),
+                               std::move(presentGraph)});
+  swapChainImageViews.clear();
+  postTargets.clear();
+  createSwapChain();
+  createRenderGraph();
+  // The pipeline only depends on the format, which practically never changes. The new graph's render pass is
+  // compatible with the old one otherwise.
+  if(optimalSurfaceFormat.format != format) {
+    logicalDevice->waitIdle();
+    createPipeline();
+  }
+  imagesInFlight.assign(swapChainImages.size(), nullptr);
+  swapChainOutOfDate = false;
+  resizePending = false;
+
+#ifdef DEBUG
+  std::cout << "Recreated swap chain at " << optimalExtent.width << " X " << optimalExtent.height << ", "
+            << retiredSwapChains.size() << " retired swap chains pending" << std::endl;
+#endif
+}
+
+void Renderer::requestSwapChainRecreation(bool restartDebounce) {
+  if(resizePending && !restartDebounce) return;
+  resizePending = true;
+  lastResize = std::chrono::steady_clock::now();
+}
+
+void Renderer::createOffscreenTargets() {
+  TRACE_FUNCTION();
+  optimalExtent = headlessExtent;
+  optimalSurfaceFormat = vk::SurfaceFormatKHR(headlessFormat, vk::ColorSpaceKHR::eSrgbNonlinear);
+  offscreenTargets = OffscreenUtils::createTargets(logicalDevice, *memoryAllocator, headlessFormat, headlessExtent,
+                                                   framesInFlight);
+
+#ifdef DEBUG
+  std::cout << "Created " << offscreenTargets.size() << " offscreen targets of " << optimalExtent.width << " X "
+            << optimalExtent.height << " " << vk::to_string(headlessFormat) << std::endl;
+#endif
+}
+
 void Renderer::createWindow() {
+  TRACE_FUNCTION();
   glfwInit();
   window = std::make_unique<Window>(800, 600);
   window->center();
@@ -219,197 +382,708 @@ void Renderer::createWindow() {
 }
 
 void Renderer::createSurface() {
+  TRACE_FUNCTION();
   auto res = static_cast<vk::Result>(glfwCreateWindowSurface(static_cast<VkInstance>(vkInstance.get()),
                                                              window->glfwWindow, nullptr,
                                                              reinterpret_cast<VkSurfaceKHR *>(&surface)));
-  if(res != vk::Result::eSuccess) {
-    std::cerr << "Could not create surface to render to" << std::endl;
-    cleanup();
-    exit(-1);
-  } else{
-    uniqueSurface = vk::UniqueSurfaceKHR(surface, vkInstance.get());
-  }
+  if(res != vk::Result::eSuccess)
+    throw std::runtime_error("Could not create surface to render to");
+  uniqueSurface = vk::UniqueSurfaceKHR(surface, vkInstance.get());
 }
 
 void Renderer::cleanup() {
+  TRACE_FUNCTION();
+#ifdef DEBUG
+  if(memoryAllocator)
+    memoryAllocator->printStats(std::cout);
+#endif
+  if(pipelineCache) {
+    try {
+      pipelineCache->save();
+    } catch(const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
   glfwTerminate();
 }
 
+void Renderer::compileShader(const std::string& name) {
+  TRACE_FUNCTION();
+#ifdef VULKAN_SHADER_HOT_RELOAD
+  fs::path path = fs::path(VULKAN_SHADER_DIR).append(name);
+  if(!fs::exists(path))
+    throw std::runtime_error(path.string() + " not found");
+  ShaderUtils::loadSpirv(path, getShaderKind(path), false, ShaderCache(fs::current_path().append("shader-cache")));
+#endif
+}
+
+vk::UniqueShaderModule Renderer::createShaderModule(const std::string& name) const {
+#ifdef VULKAN_SHADER_HOT_RELOAD
+  fs::path path = fs::path(VULKAN_SHADER_DIR).append(name);
+  return ShaderUtils::createShader(logicalDevice, path, getShaderKind(path), false,
+                                   ShaderCache(fs::current_path().append("shader-cache")));
+#else
+  std::span<const uint32_t> spirv = EmbeddedShaders::find(name);
+  if(spirv.empty())
+    throw std::runtime_error(name + " is not embedded");
+  return logicalDevice->createShaderModuleUnique({{}, spirv.size_bytes(), spirv.data()});
+#endif
+}
+
 void Renderer::createShaders() {
-  fs::path shaderPath = fs::current_path().append("shaders");
-  try {
-    vertShaderModUnique = ShaderUtils::createShader(logicalDevice, fs::path(shaderPath).append("vertex.vert"),
-                                                    shaderc_shader_kind::shaderc_vertex_shader);
-  } catch(const std::runtime_error& e) {
-    std::cerr << e.what() << std::endl;
-    exit(1);
-  }
-  try {
-    fragShaderModUnique = ShaderUtils::createShader(logicalDevice, fs::path(shaderPath).append("fragment.frag"),
-                                                    shaderc_shader_kind::shaderc_fragment_shader);
-  } catch(const std::runtime_error& e) {
-    std::cerr << e.what() << std::endl;
-    cleanup();
-    exit(1);
-  }
+  TRACE_FUNCTION();
+  vertShaderModUnique = createShaderModule("vertex.vert");
+  meshShaderModUnique = createShaderModule("mesh.vert");
+  // Without descriptor indexing textures are packed into atlas pages.
+  const char *fragmentShader = descriptorIndexing ? "bindless.frag" : "fragment.frag";
+  fragShaderModUnique = createShaderModule(fragmentShader);
+
+}
 
+void Renderer::createPipelineCache() {
+  TRACE_FUNCTION();
+  pipelineCache = std::make_unique<PipelineCache>(logicalDevice, physicalDevice,
+                                                  fs::current_path().append("pipeline-cache.bin"));
 }
 
 void Renderer::createPipeline() {
-  std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStageCreateInfos = {
-      vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eVertex, vertShaderModUnique.get(), "main",
-                                        nullptr},
-      {{}, vk::ShaderStageFlagBits::eFragment, fragShaderModUnique.get(), "main", nullptr}};
-
-  vk::PipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {{}, 0, nullptr, 0, nullptr};
-  vk::PipelineInputAssemblyStateCreateInfo assemblyStateCreateInfo = {{}, vk::PrimitiveTopology::eTriangleList,
-                                                                      VK_FALSE};
-  vk::Viewport viewport = {0, 0, static_cast<float>(optimalExtent.width), static_cast<float>(optimalExtent.height), 0,
-                           1};
-  vk::Rect2D scissor = {{0, 0}, optimalExtent};
-  vk::PipelineViewportStateCreateInfo viewportStateCreateInfo = {{}, 1, &viewport, 1, &scissor};
-  vk::PipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {{}, VK_FALSE, VK_FALSE,
-                                                                                   vk::PolygonMode::eFill,
-                                                                                   vk::CullModeFlagBits::eBack,
-                                                                                   vk::FrontFace::eClockwise, 0, 0, 0,
-                                                                                   0, 1};
-  vk::PipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {{}, vk::SampleCountFlagBits::e1,
-                                                                               VK_FALSE, 0, nullptr, VK_FALSE,
-                                                                               VK_FALSE};
-  vk::PipelineColorBlendAttachmentState colorBlendAttachmentState = {VK_FALSE, vk::BlendFactor::eOne,
-                                                                     vk::BlendFactor::eZero, vk::BlendOp::eAdd,
-                                                                     vk::BlendFactor::eOne, vk::BlendFactor::eZero,
-                                                                     vk::BlendOp::eAdd, vk::ColorComponentFlagBits::eR |
-                                                                                        vk::ColorComponentFlagBits::eG |
-                                                                                        vk::ColorComponentFlagBits::eB |
-                                                                                        vk::ColorComponentFlagBits::eA};
-  std::array<float, 4> blendConstants = {0, 0, 0, 0};
-  vk::PipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {{}, VK_FALSE, vk::LogicOp::eCopy, 1,
-                                                                     &colorBlendAttachmentState, blendConstants};
-  vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = {{}, 0, nullptr, 0, nullptr};
+  TRACE_FUNCTION();
+  vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::vec4)};
+  vk::DescriptorSetLayout descriptorSetLayout = textureManager->getDescriptorSetLayout();
+  vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = {{}, 1, &descriptorSetLayout, 1, &pushConstantRange};
+
+  GraphicsPipelineState state;
+  state.vertexShader = vertShaderModUnique.get();
+  state.fragmentShader = fragShaderModUnique.get();
+  state.renderPass = renderGraph->getRenderPass("sprites");
+  state.blendMode = BlendMode::eAlpha;
+  std::array<vk::VertexInputAttributeDescription, 5> instanceAttributes =
+      SPRITE_INSTANCE_LAYOUT.getAttributeDescriptions();
+  state.bindings = {SPRITE_INSTANCE_LAYOUT.getBindingDescription()};
+  state.attributes = {instanceAttributes.begin(), instanceAttributes.end()};
+  // Set per command buffer, so resizing never needs a new pipeline.
+  state.dynamicStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+
   pipelineLayoutUnique = logicalDevice->createPipelineLayoutUnique(pipelineLayoutCreateInfo);
+  state.layout = pipelineLayoutUnique.get();
+  graphicsPipeline = pipelineCache->getGraphicsPipeline(state);
+  // Meshes add their vertices as a second binding.
+  std::array<vk::VertexInputAttributeDescription, 3> vertexAttributes =
+      MESH_VERTEX_LAYOUT.getAttributeDescriptions();
+  state.vertexShader = meshShaderModUnique.get();
+  state.bindings.push_back(MESH_VERTEX_LAYOUT.getBindingDescription());
+  state.attributes.insert(state.attributes.end(), vertexAttributes.begin(), vertexAttributes.end());
+  meshPipeline = pipelineCache->getGraphicsPipeline(state);
+  if(textRenderer)
+    textRenderer->createPipeline(*pipelineCache, state.renderPass, vertShaderModUnique.get());
 
 #ifdef DEBUG
-  std::cout << "Fixed Function Pipeline setup" << std::endl;
+  std::cout << "Graphics Pipeline created" << std::endl;
 #endif
 
-  vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {{}, vk::size(shaderStageCreateInfos),
-                                                               shaderStageCreateInfos.data(),
-                                                               &vertexInputStateCreateInfo, &assemblyStateCreateInfo,
-                                                               nullptr, &viewportStateCreateInfo,
-                                                               &pipelineRasterizationStateCreateInfo,
-                                                               &pipelineMultisampleStateCreateInfo, nullptr,
-                                                               &colorBlendStateCreateInfo, nullptr,
-                                                               pipelineLayoutUnique.get(), renderPassUnique.get(), 0,
-                                                               nullptr, -1};
+}
 
-  try {
-    graphicsPipeLineUnique = logicalDevice->createGraphicsPipelineUnique(nullptr, graphicsPipelineCreateInfo);
-  } catch(const std::runtime_error& e) {
-    std::cerr << e.what() << std::endl;
-    cleanup();
+void Renderer::createRenderGraph() {
+  TRACE_FUNCTION();
+  std::vector<ImportedImage> images;
+  if(headless)
+    for(const auto& target : offscreenTargets)
+      images.push_back({target.image.image.get(), target.imageView.get()});
+  else
+    for(uint32_t i = 0; i < swapChainImages.size(); ++i)
+      images.push_back({swapChainImages[i], swapChainImageViews[i].get()});
+  // Swap chain images are acquired at the stage first writing them, color attachment output or the copy of the
+  // post-processed frame, while offscreen targets were last read back by the previous frame using them.
+  ImageState initialState = {vk::ImageLayout::eUndefined,
+                             headless || postProcessor ? vk::PipelineStageFlagBits::eTransfer
+                                                       : vk::PipelineStageFlagBits::eColorAttachmentOutput, {}};
+  std::optional<ImageState> finalState;
+  if(!headless)
+    finalState = ImageState{vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits::eBottomOfPipe, {}};
+  bool async = postProcessor && asyncCompute;
+
+  renderGraph = std::make_unique<RenderGraph>(logicalDevice, *memoryAllocator);
+  if(async)
+    presentGraph = std::make_unique<RenderGraph>(logicalDevice, *memoryAllocator);
+  RenderGraph& presentingGraph = async ? *presentGraph : *renderGraph;
+  RenderGraph::Handle backbuffer = presentingGraph.importImage("backbuffer", optimalSurfaceFormat.format,
+                                                               optimalExtent, images, initialState, finalState);
+  RenderGraph::Handle scene = backbuffer;
+  std::vector<ImportedImage> scenes;
+  std::vector<ImportedImage> outputs;
+  if(async) {
+    postTargets = PostProcessor::createTargets(logicalDevice, *memoryAllocator, optimalExtent, framesInFlight + 1,
+                                               {graphicsQueueFamilyIndex, computeQueueFamilyIndex});
+    lastPostSlot.reset();
+    for(const PostTarget& target : postTargets) {
+      scenes.push_back({target.scene.image.get(), target.sceneView.get()});
+      outputs.push_back({target.output.image.get(), target.outputView.get()});
+    }
+    // Last sampled on the compute queue by a frame whose fence has been waited for.
+    scene = renderGraph->importImage("scene", PostProcessor::SCENE_FORMAT, optimalExtent, scenes,
+                                     {vk::ImageLayout::eUndefined,
+                                      vk::PipelineStageFlagBits::eColorAttachmentOutput, {}},
+                                     ImageState{vk::ImageLayout::eShaderReadOnlyOptimal,
+                                                vk::PipelineStageFlagBits::eBottomOfPipe, {}});
+  } else if(postProcessor) {
+    scene = renderGraph->createImage("scene", PostProcessor::SCENE_FORMAT, optimalExtent);
+  }
+
+  // Writes no image, so nothing but its side effects keeps it. Its record() makes the results visible to the draws.
+  if(gpuCuller)
+    renderGraph->addPass("cull", RenderGraph::PassType::eCompute)
+        .setSideEffects()
+        .setRecord([this](const RenderGraph::Context& context) {
+          gpuCuller->record(context.commandBuffer, currentFrame,
+                            {camera, camera + glm::vec2(optimalExtent.width, optimalExtent.height)});
+        });
+  renderGraph->addPass("sprites", RenderGraph::PassType::eGraphics)
+      .addColorOutput(scene, vk::ClearColorValue{std::array<float, 4>{0.0F, 0.0F, 0.0F, 1.0F}})
+      .setRecord([this](const RenderGraph::Context& context) { recordSprites(context); });
+
+  if(async) {
+    postGraph = std::make_unique<RenderGraph>(logicalDevice, *memoryAllocator);
+    // Drawn and made visible by the graphics queue, which the compute submission waits for through sceneTimeline.
+    RenderGraph::Handle postScene = postGraph->importImage("scene", PostProcessor::SCENE_FORMAT, optimalExtent,
+                                                           scenes, {vk::ImageLayout::eShaderReadOnlyOptimal, {}, {}});
+    // Last copied from on the graphics queue by a frame whose fence has been waited for.
+    RenderGraph::Handle output = postGraph->importImage("post output", PostProcessor::OUTPUT_FORMAT, optimalExtent,
+                                                        outputs, {},
+                                                        ImageState{vk::ImageLayout::eGeneral,
+                                                                   vk::PipelineStageFlagBits::eBottomOfPipe, {}});
+    postProcessor->addPasses(*postGraph, postScene, output, optimalExtent);
+    postGraph->compile();
+    // The previous frame's output, which the present submission waits for through postTimeline. The first frame at
+    // a new extent has none and presents black.
+    presentGraph->addPass("present", RenderGraph::PassType::eTransfer)
+        .addTransferOutput(backbuffer)
+        .setRecord([this, backbuffer](const RenderGraph::Context& context) {
+          if(lastPostSlot) {
+            PostProcessor::recordPresent(context.commandBuffer, postTargets[*lastPostSlot].output.image.get(),
+                                         vk::ImageLayout::eGeneral, context.getImage(backbuffer), optimalExtent);
+            return;
+          }
+          vk::ClearColorValue black(std::array<float, 4>{0.0F, 0.0F, 0.0F, 1.0F});
+          vk::ImageSubresourceRange range = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+          context.commandBuffer.clearColorImage(context.getImage(backbuffer), vk::ImageLayout::eTransferDstOptimal,
+                                                black, range);
+        });
+  } else if(postProcessor) {
+    RenderGraph::Handle output = renderGraph->createImage("post output", PostProcessor::OUTPUT_FORMAT,
+                                                          optimalExtent);
+    postProcessor->addPasses(*renderGraph, scene, output, optimalExtent);
+    renderGraph->addPass("present", RenderGraph::PassType::eTransfer)
+        .addTransferInput(output)
+        .addTransferOutput(backbuffer)
+        .setRecord([this, output, backbuffer](const RenderGraph::Context& context) {
+          PostProcessor::recordPresent(context.commandBuffer, context.getImage(output),
+                                       vk::ImageLayout::eTransferSrcOptimal, context.getImage(backbuffer),
+                                       optimalExtent);
+        });
   }
 
+  if(headless)
+    presentingGraph.addPass("readback", RenderGraph::PassType::eTransfer)
+        .addTransferInput(backbuffer)
+        .setSideEffects()
+        .setRecord([this](const RenderGraph::Context& context) {
+          OffscreenUtils::recordReadback(context.commandBuffer, offscreenTargets[context.index], optimalExtent);
+        });
+  renderGraph->compile();
+  if(async)
+    presentGraph->compile();
+}
+
+void Renderer::setFramesInFlight(uint32_t count) {
+  framesInFlight = std::clamp(count, 1U, MAX_FRAMES_IN_FLIGHT);
+}
+
+uint32_t Renderer::getFramesInFlight() const {
+  return framesInFlight;
+}
+
+void Renderer::setRecordingThreads(uint32_t count) {
+  recordingThreads = std::max(count, 1U);
+}
+
+uint32_t Renderer::getRecordingThreads() const {
+  return recordingThreads;
+}
+
+void Renderer::createThreadPool() {
+  TRACE_FUNCTION();
+  // The thread calling endFrame() records a slice as well.
+  threadPool = std::make_unique<ThreadPool>(recordingThreads - 1);
 #ifdef DEBUG
-  std::cout << "Graphics Pipeline created" << std::endl;
+  std::cout << "Created thread pool with " << threadPool->getThreadCount() << " workers" << std::endl;
 #endif
+}
 
+void Renderer::createCommandPool() {
+  TRACE_FUNCTION();
+  frames.resize(framesInFlight);
+  // Each frame resets its whole pool before recording rather than resetting individual buffers.
+  vk::CommandPoolCreateInfo commandPoolCreateInfo = {vk::CommandPoolCreateFlagBits::eTransient,
+                                                     graphicsQueueFamilyIndex};
+  for(auto& frame : frames) {
+    frame.commandPool = logicalDevice->createCommandPoolUnique(commandPoolCreateInfo);
+    frame.slicePools.resize(recordingThreads);
+    for(auto& slicePool : frame.slicePools)
+      slicePool = logicalDevice->createCommandPoolUnique(commandPoolCreateInfo);
+    if(asyncCompute)
+      frame.postCommandPool = logicalDevice->createCommandPoolUnique({vk::CommandPoolCreateFlagBits::eTransient,
+                                                                      computeQueueFamilyIndex});
+  }
+#ifdef DEBUG
+  std::cout << "Created " << frames.size() << " x " << recordingThreads + 1 << " command pools" << std::endl;
+#endif
 }
 
-void Renderer::createRenderPass() {
-  vk::AttachmentDescription colorAttachment = {{}, optimalSurfaceFormat.format, vk::SampleCountFlagBits::e1,
-                                               vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
-                                               vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
-                                               vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR};
-  vk::AttachmentReference attachmentReference = {0, vk::ImageLayout::eColorAttachmentOptimal};
-  vk::SubpassDescription subpass = {{}, vk::PipelineBindPoint::eGraphics, 0, nullptr, 1, &attachmentReference,
-                                    nullptr,
-                                    nullptr, 0, nullptr};
-  vk::RenderPassCreateInfo renderPassCreateInfo = {{}, 1, &colorAttachment, 1, &subpass, 0, nullptr};
-  try {
-    renderPassUnique = logicalDevice->createRenderPassUnique(renderPassCreateInfo);
-  } catch(const std::runtime_error& e) {
-    std::cerr << e.what() << std::endl;
-    cleanup();
-    exit(1);
+void Renderer::createCommandBuffers() {
+  TRACE_FUNCTION();
+  for(auto& frame : frames) {
+    vk::CommandBufferAllocateInfo allocateInfo = {frame.commandPool.get(), vk::CommandBufferLevel::ePrimary, 1};
+    frame.commandBuffer = std::move(logicalDevice->allocateCommandBuffersUnique(allocateInfo).front());
+    if(asyncCompute) {
+      frame.presentCommandBuffer = std::move(logicalDevice->allocateCommandBuffersUnique(allocateInfo).front());
+      vk::CommandBufferAllocateInfo postAllocateInfo = {frame.postCommandPool.get(),
+                                                        vk::CommandBufferLevel::ePrimary, 1};
+      frame.postCommandBuffer = std::move(logicalDevice->allocateCommandBuffersUnique(postAllocateInfo).front());
+    }
+    frame.sliceCommandBuffers.clear();
+    for(const auto& slicePool : frame.slicePools) {
+      vk::CommandBufferAllocateInfo sliceAllocateInfo = {slicePool.get(), vk::CommandBufferLevel::eSecondary, 1};
+      frame.sliceCommandBuffers.push_back(
+          std::move(logicalDevice->allocateCommandBuffersUnique(sliceAllocateInfo).front()));
+    }
   }
 #ifdef DEBUG
-  std::cout << "Render Pass created" << std::endl;
+  std::cout << "Created " << frames.size() << " command buffers" << std::endl;
 #endif
 }
 
-void Renderer::createFramebuffers() {
-  frameBuffersUnique.resize(swapChainImageViews.size());
-  for(uint32_t i = 0; i < swapChainImageViews.size(); ++i) {
-    std::array<vk::ImageView, 1> attachments = {swapChainImageViews[i].get()};
-    vk::FramebufferCreateInfo framebufferCreateInfo = {{}, renderPassUnique.get(), attachments.size(),
-                                                       attachments.data(), optimalExtent.width, optimalExtent.height,
-                                                       1};
-    try {
-      frameBuffersUnique[i] = logicalDevice->createFramebufferUnique(framebufferCreateInfo);
+void Renderer::createSyncObjects() {
+  TRACE_FUNCTION();
+  for(auto& frame : frames) {
+    if(!headless) {
+      frame.imageAvailable = logicalDevice->createSemaphoreUnique({});
+      frame.renderFinished = logicalDevice->createSemaphoreUnique({});
+    }
+    // Signaled so the first wait on every frame returns immediately.
+    frame.inFlight = logicalDevice->createFenceUnique({vk::FenceCreateFlagBits::eSignaled});
+    if(asyncCompute)
+      frame.postFinished = logicalDevice->createFenceUnique({vk::FenceCreateFlagBits::eSignaled});
+  }
+  if(asyncCompute) {
+    vk::SemaphoreTypeCreateInfoKHR timelineCreateInfo = {vk::SemaphoreTypeKHR::eTimeline, 0};
+    vk::SemaphoreCreateInfo semaphoreCreateInfo;
+    semaphoreCreateInfo.pNext = &timelineCreateInfo;
+    sceneTimeline = logicalDevice->createSemaphoreUnique(semaphoreCreateInfo);
+    postTimeline = logicalDevice->createSemaphoreUnique(semaphoreCreateInfo);
+  }
+  imagesInFlight.assign(swapChainImages.size(), nullptr);
 #ifdef DEBUG
-      std::cout << "frame buffer " << i << " created" << std::endl;
+  std::cout << "Created synchronization objects for " << frames.size() << " frames in flight" << std::endl;
 #endif
-    } catch(const std::runtime_error& e) {
-      std::cerr << e.what() << std::endl;
-      cleanup();
-      exit(-1);
+}
+
+void Renderer::recordCommandBuffer(FrameData& frame, uint32_t imageIndex) {
+  TRACE_FUNCTION();
+  const vk::CommandBuffer& commandBuffer = frame.commandBuffer.get();
+  vk::CommandBufferBeginInfo commandBufferBeginInfo = {vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr};
+  commandBuffer.begin(commandBufferBeginInfo);
+  gpuProfiler->beginFrame(commandBuffer, currentFrame, frameCount);
+  uint32_t frameScope = gpuProfiler->begin(commandBuffer, "frame");
+  // Submits pending uploads and takes ownership of them before anything can read them.
+  frame.uploadSemaphores = uploadManager->acquire(commandBuffer, frame.inFlight.get());
+  // With async compute the sprites are drawn into the frame's post target instead of the backbuffer.
+  uint32_t postSlot = asyncCompute ? uint32(frameCount % postTargets.size()) : 0;
+  renderGraph->execute(commandBuffer, asyncCompute ? postSlot : imageIndex, gpuProfiler.get());
+  gpuProfiler->end(commandBuffer, frameScope);
+  commandBuffer.end();
+  if(!asyncCompute) return;
+
+  // Timed as part of the frame, both are submitted under its fence.
+  const vk::CommandBuffer& presentCommandBuffer = frame.presentCommandBuffer.get();
+  presentCommandBuffer.begin(commandBufferBeginInfo);
+  presentGraph->execute(presentCommandBuffer, imageIndex, gpuProfiler.get());
+  presentCommandBuffer.end();
+
+  const vk::CommandBuffer& postCommandBuffer = frame.postCommandBuffer.get();
+  postCommandBuffer.begin(commandBufferBeginInfo);
+  postProfiler->beginFrame(postCommandBuffer, currentFrame, frameCount);
+  postGraph->execute(postCommandBuffer, postSlot, postProfiler.get());
+  postCommandBuffer.end();
+}
+
+void Renderer::recordSprites(const RenderGraph::Context& context) {
+  FrameData& frame = frames[currentFrame];
+  uint32_t drawCount = spriteBatch->getDrawCount();
+  uint32_t sliceCount = std::clamp(drawCount / MIN_DRAWS_PER_THREAD, 1U, uint32(frame.slicePools.size()));
+  if(sliceCount == 1) {
+    context.beginRenderPass(vk::SubpassContents::eInline);
+    recordDraws(context.commandBuffer, 0, drawCount);
+    return;
+  }
+
+  threadPool->parallelFor(sliceCount, [&](uint32_t slice) {
+    TRACE_SCOPE("record slice");
+    logicalDevice->resetCommandPool(frame.slicePools[slice].get(), {});
+    const vk::CommandBuffer& sliceCommandBuffer = frame.sliceCommandBuffers[slice].get();
+    vk::CommandBufferInheritanceInfo inheritanceInfo = {context.renderPass, 0, context.framebuffer, VK_FALSE, {}, {}};
+    sliceCommandBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+                              vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritanceInfo});
+    {
+      GpuProfiler::Scope scope(*gpuProfiler, sliceCommandBuffer, "sprite slice");
+      uint32_t firstDraw = drawCount * slice / sliceCount;
+      recordDraws(sliceCommandBuffer, firstDraw, drawCount * (slice + 1) / sliceCount - firstDraw);
     }
+    sliceCommandBuffer.end();
+  });
+  std::vector<vk::CommandBuffer> sliceCommandBuffers;
+  for(uint32_t i = 0; i < sliceCount; ++i)
+    sliceCommandBuffers.push_back(frame.sliceCommandBuffers[i].get());
+  context.beginRenderPass(vk::SubpassContents::eSecondaryCommandBuffers);
+  context.commandBuffer.executeCommands(sliceCommandBuffers);
+}
+
+void Renderer::recordDraws(const vk::CommandBuffer& commandBuffer, uint32_t firstDraw, uint32_t drawCount) {
+  // Dynamic state is not inherited by secondary command buffers, so every one sets it.
+  vk::Viewport viewport = {0, 0, float(optimalExtent.width), float(optimalExtent.height), 0, 1};
+  vk::Rect2D scissor = {{0, 0}, optimalExtent};
+  commandBuffer.setViewport(0, viewport);
+  commandBuffer.setScissor(0, scissor);
+  // Sprites are positioned in pixels with the camera in the top left corner.
+  glm::vec2 scale = {2.0F / float(optimalExtent.width), 2.0F / float(optimalExtent.height)};
+  glm::vec4 pixelToNdc = {scale, -1.0F - camera * scale};
+  commandBuffer.pushConstants(pipelineLayoutUnique.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(pixelToNdc),
+                              &pixelToNdc);
+  // Sprites select their texture per instance, so one set serves every draw.
+  vk::DescriptorSet descriptorSet = textureManager->getDescriptorSet();
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayoutUnique.get(), 0, 1, &descriptorSet,
+                                   0, nullptr);
+  // The sprite batch binds its pipelines as its draws need them, only the culled sprites bind one up front.
+  vk::Pipeline boundPipeline;
+  if(gpuCuller && firstDraw == 0) {
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeline);
+    boundPipeline = graphicsPipeline;
+    gpuCuller->draw(commandBuffer, currentFrame);
   }
+  spriteBatch->record(commandBuffer, graphicsPipeline, meshPipeline, firstDraw, drawCount, boundPipeline);
+  // Labels stay in place while the camera moves.
+  if(textRenderer && firstDraw + drawCount == spriteBatch->getDrawCount())
+    textRenderer->record(commandBuffer, currentFrame, {scale, -1.0F, -1.0F});
 }
 
-void Renderer::createCommandPool() {
-  vk::CommandPoolCreateInfo commandPoolCreateInfo = {{}, graphicsQueueFamilyIndex};
-  try {
-    commandPoolUnique = logicalDevice->createCommandPoolUnique(commandPoolCreateInfo);
+void Renderer::createGpuProfiler() {
+  TRACE_FUNCTION();
+  gpuProfiler = std::make_unique<GpuProfiler>(logicalDevice, physicalDevice, graphicsQueueFamilyIndex,
+                                              framesInFlight);
+  if(asyncCompute)
+    postProfiler = std::make_unique<GpuProfiler>(logicalDevice, physicalDevice, computeQueueFamilyIndex,
+                                                 framesInFlight);
+#ifdef DEBUG
+  if(!gpuProfiler->isSupported())
+    std::cout << "The graphics queue does not support timestamps, GPU profiling is disabled" << std::endl;
+#endif
+}
+
+void Renderer::createUploadManager(vk::DeviceSize stagingSize) {
+  TRACE_FUNCTION();
+  uploadManager = std::make_unique<UploadManager>(logicalDevice, *memoryAllocator, transferQueue, graphicsQueue,
+                                                  transferQueueFamilyIndex, graphicsQueueFamilyIndex, stagingSize);
 #ifdef DEBUG
-    std::cout << "Command Pool created" << std::endl;
+  std::cout << "Created upload manager with " << stagingSize << " bytes of staging memory on a "
+            << (uploadManager->isDedicated() ? "dedicated transfer" : "graphics") << " queue" << std::endl;
 #endif
+}
+
+void Renderer::createTextureManager() {
+  TRACE_FUNCTION();
+  uint32_t maxBindlessTextures = 0;
+  if(descriptorIndexing) {
+    vk::PhysicalDeviceDescriptorIndexingPropertiesEXT properties =
+        DeviceUtils::getDescriptorIndexingProperties(vkInstance, physicalDevice);
+    // Every combined image sampler counts as both a sampler and a sampled image.
+    maxBindlessTextures = std::min({properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                    properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                    properties.maxDescriptorSetUpdateAfterBindSamplers,
+                                    properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                    properties.maxPerStageUpdateAfterBindResources});
+  }
+  textureManager = std::make_unique<TextureManager>(logicalDevice, *memoryAllocator, *descriptorAllocator,
+                                                    *uploadManager, maxBindlessTextures);
+#ifdef DEBUG
+  if(textureManager->isBindless())
+    std::cout << "Created bindless texture manager with room for "
+              << std::min(maxBindlessTextures, TextureManager::MAX_TEXTURES) << " textures" << std::endl;
+  else
+    std::cout << "Created texture manager packing " << TextureManager::PAGE_COUNT << " atlas pages" << std::endl;
+#endif
+}
+
+void Renderer::createSpriteBatch(uint32_t capacity) {
+  TRACE_FUNCTION();
+  spriteBatch = std::make_unique<SpriteBatch>(*memoryAllocator, framesInFlight, capacity);
+#ifdef DEBUG
+  std::cout << "Created sprite batch with room for " << capacity << " sprites per frame" << std::endl;
+#endif
+}
+
+void Renderer::createGpuCuller(uint32_t capacity) {
+  TRACE_FUNCTION();
+  vk::UniqueShaderModule shader = createShaderModule("cull.comp");
+  gpuCuller = std::make_unique<GpuCuller>(logicalDevice, physicalDevice, *memoryAllocator, *descriptorAllocator,
+                                          *pipelineCache, std::move(shader), framesInFlight, capacity,
+                                          drawIndirectCount, enabledFeatures.multiDrawIndirect == VK_TRUE,
+                                          enabledFeatures.drawIndirectFirstInstance == VK_TRUE);
+#ifdef DEBUG
+  std::cout << "Created GPU culler for " << capacity << " sprites, "
+            << (gpuCuller->isCompacting() ? "compacting draws" : "drawing every chunk") << std::endl;
+#endif
+}
+
+void Renderer::createTextRenderer(const fs::path& fontPath, uint32_t capacity) {
+  TRACE_FUNCTION();
+  vk::UniqueShaderModule shader = createShaderModule("text.frag");
+  textRenderer = std::make_unique<TextRenderer>(logicalDevice, *memoryAllocator, *descriptorAllocator,
+                                                *uploadManager, std::move(shader), fontPath, framesInFlight,
+                                                capacity);
+  textRenderer->createPipeline(*pipelineCache, renderGraph->getRenderPass("sprites"), vertShaderModUnique.get());
+#ifdef DEBUG
+  std::cout << "Created text renderer for " << fontPath << " with room for " << capacity << " glyphs" << std::endl;
+#endif
+}
+
+void Renderer::createPostProcessor() {
+  TRACE_FUNCTION();
+  postProcessor = std::make_unique<PostProcessor>(logicalDevice, *descriptorAllocator, *pipelineCache,
+                                                  createShaderModule("downsample.comp"),
+                                                  createShaderModule("blur.comp"),
+                                                  createShaderModule("grade.comp"));
+#ifdef DEBUG
+  std::cout << "Created post processor on the " << (asyncCompute ? "async compute" : "graphics") << " queue"
+            << std::endl;
+#endif
+}
+
+void Renderer::beginFrame() {
+  TRACE_FUNCTION();
+  FrameData& frame = frames[currentFrame];
+  frame.stats.frame = frameCount;
+
+  auto waitStart = std::chrono::steady_clock::now();
+  try {
+    TRACE_SCOPE("wait for frame");
+    std::vector<vk::Fence> fences = {frame.inFlight.get()};
+    if(asyncCompute)
+      fences.push_back(frame.postFinished.get());
+    if(logicalDevice->waitForFences(fences, VK_TRUE, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+      throw std::runtime_error("failed waiting for frame " + std::to_string(frameCount));
   } catch(const std::runtime_error& e) {
     std::cerr << e.what() << std::endl;
     cleanup();
     exit(-1);
   }
+  frame.stats.cpuWait = std::chrono::steady_clock::now() - waitStart;
+  if(headless)
+    readback(currentFrame);
+  gpuProfiler->collect(currentFrame);
+  if(postProfiler)
+    postProfiler->collect(currentFrame);
+  descriptorAllocator->beginFrame(currentFrame);
+
+  // Everything retired before the frames that finished by now can go.
+  std::experimental::erase_if(retiredSwapChains, [&](const RetiredSwapChain& retired) {
+    return retired.frame + framesInFlight <= frameCount + 1;
+  });
+  if(!headless) {
+    if(window->takeResized())
+      requestSwapChainRecreation(true);
+    if(swapChainOutOfDate || (resizePending && std::chrono::steady_clock::now() - lastResize >= RESIZE_DEBOUNCE)) {
+      try {
+        recreateSwapChain();
+      } catch(const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        cleanup();
+        exit(-1);
+      }
+    }
+  }
+
+  spriteBatch->begin(currentFrame);
 }
 
-void Renderer::createCommandBuffers() {
-  vk::CommandBufferAllocateInfo allocateInfo = {commandPoolUnique.get(), vk::CommandBufferLevel::ePrimary,
-                                                swapChainImages.size()};
+void Renderer::endFrame() {
+  TRACE_FUNCTION();
+  FrameData& frame = frames[currentFrame];
+  spriteBatch->end();
+  if(textRenderer)
+    textRenderer->update(currentFrame);
+
+  // Headless frames render to their own target, so only the swap chain needs an image acquired. It is acquired as
+  // late as possible so the image is not held while sprites are collected.
+  uint32_t imageIndex = currentFrame;
+  // Still out of date, e.g. while minimized.
+  if(!headless && swapChainOutOfDate) return;
+  auto waitStart = std::chrono::steady_clock::now();
   try {
-    commandBuffersUnique = logicalDevice->allocateCommandBuffersUnique(allocateInfo);
-#ifdef DEBUG
-    std::cout << "Created " << commandBuffersUnique.size() << " command buffers" << std::endl;
-#endif
+    if(!headless) {
+      TRACE_SCOPE("acquire image");
+      vk::ResultValue<uint32_t> acquired = logicalDevice->acquireNextImageKHR(swapChain.get(),
+                                                                              std::numeric_limits<uint64_t>::max(),
+                                                                              frame.imageAvailable.get(), nullptr);
+      imageIndex = acquired.value;
+      if(acquired.result == vk::Result::eSuboptimalKHR)
+        requestSwapChainRecreation(false);
+      // With more frames in flight than swap chain images an image may still be in use by an older frame.
+      if(imagesInFlight[imageIndex] &&
+         logicalDevice->waitForFences(imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max()) !=
+         vk::Result::eSuccess)
+        throw std::runtime_error("failed waiting for swap chain image " + std::to_string(imageIndex));
+      imagesInFlight[imageIndex] = frame.inFlight.get();
+    }
+  } catch(const vk::OutOfDateKHRError&) {
+    // The swap chain no longer matches the surface; drop the frame, the next one recreates it.
+    swapChainOutOfDate = true;
+    return;
   } catch(const std::runtime_error& e) {
     std::cerr << e.what() << std::endl;
     cleanup();
     exit(-1);
   }
-  for(uint32_t i = 0; i < commandBuffersUnique.size(); ++i) {
+  auto recordStart = std::chrono::steady_clock::now();
+  frame.stats.cpuWait += recordStart - waitStart;
+
+  try {
+    // Reset before recording, the upload manager recycles semaphores once the fence the frame acquired them with is
+    // signaled.
+    logicalDevice->resetFences(frame.inFlight.get());
+    logicalDevice->resetCommandPool(frame.commandPool.get(), {});
+    if(asyncCompute) {
+      logicalDevice->resetFences(frame.postFinished.get());
+      logicalDevice->resetCommandPool(frame.postCommandPool.get(), {});
+    }
+    recordCommandBuffer(frame, imageIndex);
+
+    std::vector<vk::Semaphore> waitSemaphores = frame.uploadSemaphores;
+    std::vector<vk::PipelineStageFlags> waitStages(waitSemaphores.size(), UploadManager::getWaitStages());
+    // The backbuffer is first written by the copy of the post-processed frame, if any, else by the sprites.
+    vk::PipelineStageFlags backbufferStage = postProcessor ? vk::PipelineStageFlagBits::eTransfer
+                                                           : vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    if(!asyncCompute) {
+      if(!headless) {
+        waitSemaphores.push_back(frame.imageAvailable.get());
+        waitStages.push_back(backbufferStage);
+      }
+      vk::SubmitInfo submitInfo = {vk::size(waitSemaphores), waitSemaphores.data(), waitStages.data(), 1,
+                                   &frame.commandBuffer.get(), headless ? 0U : 1U, &frame.renderFinished.get()};
+      TRACE_SCOPE("submit");
+      graphicsQueue.submit(submitInfo, frame.inFlight.get());
+    } else {
+      // The scene is drawn and post-processed on computeQueue, while the graphics queue goes on to present the
+      // previous frame's output and draw the next scene. Values of both timelines are frame numbers plus one.
+      uint64_t frameValue = frameCount + 1;
+      vk::TimelineSemaphoreSubmitInfoKHR sceneTimelineInfo = {0, nullptr, 1, &frameValue};
+      vk::SubmitInfo sceneSubmitInfo = {vk::size(waitSemaphores), waitSemaphores.data(), waitStages.data(), 1,
+                                        &frame.commandBuffer.get(), 1, &sceneTimeline.get()};
+      sceneSubmitInfo.pNext = &sceneTimelineInfo;
+
+      // The value of a binary semaphore is ignored.
+      std::vector<vk::Semaphore> presentWaitSemaphores = {postTimeline.get()};
+      std::vector<uint64_t> presentWaitValues = {frameCount};
+      std::vector<vk::PipelineStageFlags> presentWaitStages = {vk::PipelineStageFlagBits::eTransfer};
+      if(!headless) {
+        presentWaitSemaphores.push_back(frame.imageAvailable.get());
+        presentWaitValues.push_back(0);
+        presentWaitStages.push_back(backbufferStage);
+      }
+      vk::TimelineSemaphoreSubmitInfoKHR presentTimelineInfo = {vk::size(presentWaitValues), presentWaitValues.data(),
+                                                                0, nullptr};
+      vk::SubmitInfo presentSubmitInfo = {vk::size(presentWaitSemaphores), presentWaitSemaphores.data(),
+                                          presentWaitStages.data(), 1, &frame.presentCommandBuffer.get(),
+                                          headless ? 0U : 1U, &frame.renderFinished.get()};
+      presentSubmitInfo.pNext = &presentTimelineInfo;
+
+      vk::PipelineStageFlags postWaitStage = vk::PipelineStageFlagBits::eComputeShader;
+      vk::TimelineSemaphoreSubmitInfoKHR postTimelineInfo = {1, &frameValue, 1, &frameValue};
+      vk::SubmitInfo postSubmitInfo = {1, &sceneTimeline.get(), &postWaitStage, 1, &frame.postCommandBuffer.get(), 1,
+                                       &postTimeline.get()};
+      postSubmitInfo.pNext = &postTimelineInfo;
+
+      TRACE_SCOPE("submit");
+      std::array<vk::SubmitInfo, 2> submitInfos = {sceneSubmitInfo, presentSubmitInfo};
+      graphicsQueue.submit(submitInfos, frame.inFlight.get());
+      computeQueue.submit(postSubmitInfo, frame.postFinished.get());
+      lastPostSlot = uint32(frameCount % postTargets.size());
+    }
+
+    if(!headless) {
+      TRACE_SCOPE("present");
+      vk::PresentInfoKHR presentInfo = {1, &frame.renderFinished.get(), 1, &swapChain.get(), &imageIndex, nullptr};
+      if(presentQueue.presentKHR(presentInfo) == vk::Result::eSuboptimalKHR)
+        requestSwapChainRecreation(false);
+    }
+  } catch(const vk::OutOfDateKHRError&) {
+    // Presenting failed but the frame was submitted, so it still counts.
+    swapChainOutOfDate = true;
+  } catch(const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    cleanup();
+    exit(-1);
+  }
+  frame.stats.cpuRecord = std::chrono::steady_clock::now() - recordStart;
+  frameStats = frame.stats;
+
+  if(headless) {
+    offscreenTargets[currentFrame].pending = true;
+    offscreenTargets[currentFrame].frame = frameCount;
+  }
+  ++frameCount;
+  currentFrame = (currentFrame + 1) % uint32(frames.size());
+}
+
+void Renderer::render() {
+  beginFrame();
+  endFrame();
+}
+
+void Renderer::finishFrames() {
+  TRACE_FUNCTION();
+  // Oldest first so onReadback sees frames in order.
+  for(uint32_t i = 0; i < frames.size(); ++i) {
+    uint32_t frameIndex = (currentFrame + i) % uint32(frames.size());
+    std::vector<vk::Fence> fences = {frames[frameIndex].inFlight.get()};
+    if(asyncCompute)
+      fences.push_back(frames[frameIndex].postFinished.get());
     try {
-      vk::CommandBufferBeginInfo commandBufferBeginInfo = {{}, nullptr};
-      commandBuffersUnique[i]->begin(commandBufferBeginInfo);
-#ifdef DEBUG
-      std::cout << "Began recording on command buffer " << i << std::endl;
-#endif
-      vk::ClearValue clearColor = {vk::ClearColorValue{std::array<float, 4>{0.0F, 0.0F, 0.0F, 1.0F}}};
-      vk::RenderPassBeginInfo renderPassBeginInfo = {renderPassUnique.get(), frameBuffersUnique[i].get(), {{}, optimalExtent}, 1,
-                                                     &clearColor};
-      commandBuffersUnique[i]->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-#ifdef DEBUG
-      std::cout << "Began render pass on command buffer " << i << std::endl;
-#endif
-      commandBuffersUnique[i]->bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipeLineUnique.get());
-      commandBuffersUnique[i]->draw(3, 1, 0, 0);
-      commandBuffersUnique[i]->endRenderPass();
+      if(logicalDevice->waitForFences(fences, VK_TRUE, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+        throw std::runtime_error("failed waiting for frame in flight " + std::to_string(frameIndex));
     } catch(const std::runtime_error& e) {
       std::cerr << e.what() << std::endl;
       cleanup();
       exit(-1);
     }
+    if(headless)
+      readback(frameIndex);
+    gpuProfiler->collect(frameIndex);
+    if(postProfiler)
+      postProfiler->collect(frameIndex);
   }
 }
 
-void Renderer::render() {
-
+void Renderer::readback(uint32_t frameIndex) {
+  OffscreenTarget& target = offscreenTargets[frameIndex];
+  if(!target.pending) return;
+  try {
+    memoryAllocator->invalidate(target.readbackBuffer.allocation.get());
+  } catch(const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    cleanup();
+    exit(-1);
+  }
+  target.pending = false;
+  if(onReadback)
+    onReadback({target.readbackBuffer.allocation->mapped, optimalExtent, headlessFormat,
+                OffscreenUtils::getRowPitch(headlessFormat, optimalExtent), target.frame});
 }
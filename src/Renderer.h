@@ -1,7 +1,9 @@
 #ifndef VULKAN_RENDERER_H
 #define VULKAN_RENDERER_H
 
+#include <chrono>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <optional>
@@ -17,34 +19,98 @@
 
 // This must be included after vulkan.hpp
 #include "Window.h"
+#include "DescriptorAllocator.h"
+#include "FrameData.h"
+#include "GpuCuller.h"
+#include "GpuProfiler.h"
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "PostProcessor.h"
+#include "RenderGraph.h"
+#include "SpriteBatch.h"
+#include "TextRenderer.h"
+#include "TextureManager.h"
+#include "UploadManager.h"
+#include "OffscreenUtils.h"
 #include "SwapChainUtils.h"
+#include "ThreadPool.h"
 #include "VkUtils.h"
 
 class Renderer {
 public:
+  static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+  // Splitting fewer draws than this per thread costs more in synchronization than it saves.
+  static constexpr uint32_t MIN_DRAWS_PER_THREAD = 64;
+  // How long the window has to keep its size before the swap chain follows a resize.
+  static constexpr std::chrono::milliseconds RESIZE_DEBOUNCE{100};
+
   std::unique_ptr<Window> window;
 
   vk::UniqueInstance vkInstance;
   vk::UniqueDevice logicalDevice;
+  // Declared right after the device so it outlives every resource allocated from it.
+  std::unique_ptr<MemoryAllocator> memoryAllocator;
+  std::unique_ptr<DescriptorAllocator> descriptorAllocator;
+  std::unique_ptr<UploadManager> uploadManager;
+  // Every texture sprites sample, bound once per command buffer.
+  std::unique_ptr<TextureManager> textureManager;
+  std::unique_ptr<GpuProfiler> gpuProfiler;
+  // Times the post-processing on computeQueue, only created with async compute.
+  std::unique_ptr<GpuProfiler> postProfiler;
+  // With async compute, the frames whose scene has been drawn and whose scene has been post-processed, each signaled
+  // with the frame's number plus one.
+  vk::UniqueSemaphore sceneTimeline;
+  vk::UniqueSemaphore postTimeline;
   std::vector<vk::UniqueImageView> swapChainImageViews;
   vk::UniqueSurfaceKHR uniqueSurface;
   vk::UniqueSwapchainKHR swapChain;
   vk::UniqueShaderModule vertShaderModUnique;
   vk::UniqueShaderModule fragShaderModUnique;
+  vk::UniqueShaderModule meshShaderModUnique;
   vk::UniquePipelineLayout pipelineLayoutUnique;
-  vk::UniqueRenderPass renderPassUnique;
-  vk::UniquePipeline graphicsPipeLineUnique;
-  std::vector<vk::UniqueFramebuffer> frameBuffersUnique;
-  vk::UniqueCommandPool commandPoolUnique;
-  std::vector<vk::UniqueCommandBuffer> commandBuffersUnique;
+  // Only created by createPostProcessor(), grading the sprites before they reach the backbuffer.
+  std::unique_ptr<PostProcessor> postProcessor;
+  // With async compute, the scene each frame draws and the output computeQueue post-processes it into, one more than
+  // frames in flight as a frame's output is presented by the next one. Rebuilt along with the swap chain.
+  std::vector<PostTarget> postTargets;
+  // Records every frame, rebuilt along with the swap chain.
+  std::unique_ptr<RenderGraph> renderGraph;
+  // With async compute, renderGraph only draws the scene, postGraph post-processes it on computeQueue and
+  // presentGraph copies the previous frame's output to the backbuffer.
+  std::unique_ptr<RenderGraph> postGraph;
+  std::unique_ptr<RenderGraph> presentGraph;
+  std::unique_ptr<PipelineCache> pipelineCache;
+  // Owned by pipelineCache.
+  vk::Pipeline graphicsPipeline;
+  // Draws the meshes of spriteBatch, with the same layout and fragment shader as graphicsPipeline.
+  vk::Pipeline meshPipeline;
+  std::vector<FrameData> frames;
+  std::vector<OffscreenTarget> offscreenTargets;
+  std::unique_ptr<SpriteBatch> spriteBatch;
+  // Only created by createGpuCuller().
+  std::unique_ptr<GpuCuller> gpuCuller;
+  // Only created by createTextRenderer(), drawn on top of the sprites without the camera.
+  std::unique_ptr<TextRenderer> textRenderer;
+  std::unique_ptr<ThreadPool> threadPool;
 
   vk::PhysicalDevice physicalDevice;
   std::vector<const char *> enabledExtensions;
   std::vector<const char *> enabledDeviceExtensions;
   std::vector<const char *> enabledLayers;
+  vk::PhysicalDeviceFeatures enabledFeatures;
+  // Whether VK_KHR_draw_indirect_count is enabled.
+  bool drawIndirectCount = false;
+  // Whether VK_EXT_descriptor_indexing is enabled with what bindless textures need.
+  bool descriptorIndexing = false;
   std::vector<vk::Image> swapChainImages;
+  // The fence of the frame currently rendering to each swap chain image, if any.
+  std::vector<vk::Fence> imagesInFlight;
   vk::Queue graphicsQueue;
   vk::Queue presentQueue;
+  // A queue of a dedicated transfer family if the device has one, else a second graphics queue or graphicsQueue.
+  vk::Queue transferQueue;
+  // A queue of a dedicated compute family with async compute, else graphicsQueue.
+  vk::Queue computeQueue;
   vk::SurfaceKHR surface;
   vk::Extent2D optimalExtent;
   vk::PresentModeKHR optimalPresentMode;
@@ -54,15 +120,83 @@ public:
 
   uint32_t graphicsQueueFamilyIndex;
   uint32_t presentQueueFamilyIndex;
+  uint32_t transferQueueFamilyIndex;
+  uint32_t computeQueueFamilyIndex;
+
+  /**
+   * Renders into offscreen images instead of a window's swap chain. Must be set before enableRequiredExtensions().
+   */
+  bool headless = false;
+  vk::Extent2D headlessExtent = {800, 600};
+  vk::Format headlessFormat = vk::Format::eR8G8B8A8Unorm;
+  /**
+   * Index or name substring of the physical device to use instead of the highest scoring one. The VULKAN_DEVICE
+   * environment variable is used when empty.
+   */
+  std::string deviceOverride;
+  /**
+   * Post-processes every frame with postProcessor, which createPostProcessor() creates. Must be set before
+   * pickDevice().
+   */
+  bool postProcessing = false;
+  /**
+   * Post-processes on a dedicated compute queue, overlapping the graphics work of the next frame, instead of behind
+   * the sprites on the graphics queue. Frames then present the output of the frame before them, headless readbacks
+   * included. Cleared by pickDevice() without post-processing or if the device has no dedicated compute family or no
+   * timeline semaphores.
+   */
+  bool asyncCompute = true;
+  /**
+   * Called with the pixels of every finished headless frame, in submission order.
+   */
+  std::function<void(const Readback&)> onReadback;
+  /**
+   * The pixel shown in the top left corner of the frame, scrolling everything drawn.
+   */
+  glm::vec2 camera = {0.0F, 0.0F};
+  uint64_t frameCount = 0;
+  uint32_t currentFrame = 0;
+  // Timings of the most recently submitted frame.
+  FrameStats frameStats;
+
+  /**
+   * Sets how many frames the CPU may record ahead of the GPU, clamped to [1, MAX_FRAMES_IN_FLIGHT]. In headless mode
+   * this is also the number of offscreen targets. Must be called before pickDevice().
+   */
+  void setFramesInFlight(uint32_t count);
+
+  uint32_t getFramesInFlight() const;
+
+  /**
+   * Sets how many threads, including the one calling endFrame(), record a frame's draws, at least 1. Defaults to one
+   * per hardware thread. Must be called before createThreadPool().
+   */
+  void setRecordingThreads(uint32_t count);
+
+  uint32_t getRecordingThreads() const;
+
+  /**
+   * Creates the worker threads recording command buffers.
+   */
+  void createThreadPool();
+
+  // The steps below run as tasks of a startup graph on threadPool, so they throw std::runtime_error on failure rather
+  // than exiting from a worker, and the caller cleans up.
 
   void initVk();
 
   void enableRequiredExtensions();
 
+  /**
+   * Verifies the picked device supports every enabled device extension.
+   */
   void enableRequiredDeviceExtensions(vk::PhysicalDevice device);
 
   void enableRequiredLayers();
 
+  /**
+   * Selects the best suited physical device and creates the logical device and its queues.
+   */
   void pickDevice();
 
   /**
@@ -78,17 +212,52 @@ public:
   void createSwapChain();
 
   /**
-   * Creates the vertex and fragment shader modules from shaders/vertex.vert and shaders/fragment.frag.
+   * Replaces the swap chain with one matching the window's current size, passing the old one as oldSwapchain. Only
+   * the image views, render graphs and post targets are rebuilt; the pipeline uses a dynamic viewport and scissor and
+   * survives. The old swap chain is destroyed once no frame in flight uses it anymore, so nothing waits for the GPU.
+   * Does nothing while the window is minimized.
+   */
+  void recreateSwapChain();
+
+  /**
+   * Creates the device local images rendered to in headless mode, used in place of createSwapChain().
+   */
+  void createOffscreenTargets();
+
+  /**
+   * Waits for every submitted frame, hands the headless ones to onReadback and collects their GPU timings.
+   */
+  void finishFrames();
+
+  /**
+   * Compiles src/shaders/name into the shader cache in hot reload builds, so creating its module later merely loads
+   * it. Needs no device and may run on any thread, alongside any other step. Does nothing when the shaders were
+   * embedded at build time.
+   */
+  void compileShader(const std::string& name);
+
+  /**
+   * Creates the vertex and fragment shader modules from shaders/vertex.vert, shaders/mesh.vert and, with descriptor
+   * indexing, shaders/bindless.frag, else shaders/fragment.frag.
    */
   void createShaders();
 
   /**
-   * Creates the render pass used for the graphics pipeline.
+   * Creates and compiles the render graph drawing the sprites into the swap chain or offscreen targets and, in headless
+   * mode, copying them out. Its render passes and framebuffers replace hand written ones. With a post processor the
+   * sprites are drawn into a scene image, post-processed and copied to the backbuffer, with async compute by graphs of
+   * their own.
    */
-  void createRenderPass();
+  void createRenderGraph();
 
   /**
-   * Creates the graphics pipeline.
+   * Creates the pipeline cache, seeded from pipeline-cache.bin when it matches the device. It is written back by
+   * cleanup().
+   */
+  void createPipelineCache();
+
+  /**
+   * Creates the sprite and mesh pipelines. Must be called after createTextureManager().
    */
   void createPipeline();
 
@@ -97,14 +266,143 @@ public:
    */
   void cleanup();
 
-  void createFramebuffers();
-
+  /**
+   * Creates a command pool for every frame in flight and recording thread.
+   */
   void createCommandPool();
 
+  /**
+   * Allocates the primary command buffer each frame in flight records into and a secondary one per recording thread.
+   */
   void createCommandBuffers();
 
+  /**
+   * Creates the semaphores and fence of every frame in flight. Must be called after createCommandPool() and
+   * createSwapChain() or createOffscreenTargets().
+   */
+  void createSyncObjects();
+
+  /**
+   * Creates the profiler timing the GPU work of every frame in flight.
+   */
+  void createGpuProfiler();
+
+  /**
+   * Creates the upload manager streaming resources to the device on transferQueue.
+   */
+  void createUploadManager(vk::DeviceSize stagingSize = UploadManager::DEFAULT_STAGING_SIZE);
+
+  /**
+   * Creates the texture manager, bindless with descriptor indexing. Must be called after createUploadManager().
+   */
+  void createTextureManager();
+
+  /**
+   * Creates the sprite batch drawn every frame, with room for capacity sprites per frame in flight.
+   */
+  void createSpriteBatch(uint32_t capacity = SpriteBatch::DEFAULT_CAPACITY);
+
+  /**
+   * Creates the GPU culler, with room for capacity sprites, from shaders/cull.comp. Must be called before
+   * createRenderGraph(), which then culls them in a compute pass ahead of drawing them under spriteBatch.
+   */
+  void createGpuCuller(uint32_t capacity);
+
+  /**
+   * Creates the text renderer drawing labels in the font at fontPath, with room for capacity glyphs, from
+   * shaders/text.frag. Must be called after createUploadManager() and createPipeline().
+   */
+  void createTextRenderer(const fs::path& fontPath, uint32_t capacity = TextRenderer::DEFAULT_CAPACITY);
+
+  /**
+   * Creates the post processor from shaders/downsample.comp, shaders/blur.comp and shaders/grade.comp. Must be called
+   * before createRenderGraph(), which then draws the sprites into a scene image it post-processes into the backbuffer.
+   */
+  void createPostProcessor();
+
+  /**
+   * Waits for the oldest frame in flight so its resources can be reused and starts collecting sprites into
+   * spriteBatch. Recreates the swap chain first if it went out of date or the window was resized more than
+   * RESIZE_DEBOUNCE ago.
+   */
+  void beginFrame();
+
+  /**
+   * Records, submits and presents the frame started by beginFrame().
+   */
+  void endFrame();
+
+  /**
+   * Renders a frame without any sprites.
+   */
   void render();
 
+private:
+
+  /**
+   * A replaced swap chain along with everything created from it, kept until the frames using it finished.
+   */
+  struct RetiredSwapChain {
+    vk::UniqueSwapchainKHR swapChain;
+    std::vector<vk::UniqueImageView> imageViews;
+    // The first frame not using it anymore.
+    uint64_t frame;
+    std::vector<PostTarget> postTargets;
+    // Declared last so their framebuffers go before the image views.
+    std::unique_ptr<RenderGraph> renderGraph;
+    std::unique_ptr<RenderGraph> postGraph;
+    std::unique_ptr<RenderGraph> presentGraph;
+  };
+
+  uint32_t framesInFlight = 2;
+  uint32_t recordingThreads = ThreadPool::getDefaultThreadCount() + 1;
+
+  std::vector<RetiredSwapChain> retiredSwapChains;
+  // Presenting is impossible until the swap chain is recreated.
+  bool swapChainOutOfDate = false;
+  bool resizePending = false;
+  // The post target holding the output of the frame submitted last, if it was drawn at the current extent.
+  std::optional<uint32_t> lastPostSlot;
+  std::chrono::steady_clock::time_point lastResize;
+
+  /**
+   * Schedules a debounced swap chain recreation. Resize events restart the debounce, while a swap chain that merely
+   * became suboptimal keeps its deadline so it is recreated even though every frame reports it.
+   */
+  void requestSwapChainRecreation(bool restartDebounce);
+
+  /**
+   * @return A module of the embedded SPIR-V of shader name, or in hot reload builds of src/shaders/name compiled
+   * through the shader cache.
+   * @throws std::runtime_error if there is no such shader or it fails to compile.
+   */
+  vk::UniqueShaderModule createShaderModule(const std::string& name) const;
+
+  /**
+   * Records the frame's primary command buffer by executing the render graph and, with async compute, its
+   * post-processing and present command buffers.
+   */
+  void recordCommandBuffer(FrameData& frame, uint32_t imageIndex);
+
+  /**
+   * Records the sprite pass of the render graph. With enough draws they are split into contiguous slices recorded into
+   * secondary command buffers on threadPool, which are executed in slice order so the result never depends on
+   * scheduling.
+   */
+  void recordSprites(const RenderGraph::Context& context);
+
+  /**
+   * Records the draws [firstDraw, firstDraw + drawCount) of spriteBatch inside the render pass, preceded by the
+   * draws of gpuCuller when starting at the first one and followed by textRenderer when ending at the last one.
+   */
+  void recordDraws(const vk::CommandBuffer& commandBuffer, uint32_t firstDraw, uint32_t drawCount);
+
+  /**
+   * Hands the pixels of a frame's offscreen target to onReadback if it has not been yet. The frame's fence must be
+   * signaled.
+   */
+  void readback(uint32_t frameIndex);
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "SceneIndex.h"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#include "Macros.h"
+
+SceneIndex::SceneIndex(float cellSize) : cellSize(cellSize), inverseCellSize(1.0F / cellSize) {
+  if(!(cellSize > 0.0F))
+    throw std::runtime_error("the cell size of a scene index must be positive");
+}
+
+uint32_t SceneIndex::insert(const Aabb& bounds) {
+  uint32_t id;
+  if(freeIds.empty()) {
+    id = uint32(locations.size());
+    locations.emplace_back();
+  } else {
+    id = freeIds.back();
+    freeIds.pop_back();
+  }
+  add(getCell(bounds), id, bounds);
+  ++count;
+  return id;
+}
+
+void SceneIndex::update(uint32_t id, const Aabb& bounds) {
+  Location location = locations[id];
+  bool fits = bounds.max.x - bounds.min.x <= cellSize && bounds.max.y - bounds.min.y <= cellSize;
+  bool stays = fits ? location.cell != &oversized &&
+                      location.cell->key == getCellKey((bounds.min.x + bounds.max.x) * 0.5F,
+                                                       (bounds.min.y + bounds.max.y) * 0.5F)
+                    : location.cell == &oversized;
+  // Most updates stay within their cell and only overwrite the bounds.
+  if(stays) {
+    Cell& cell = *location.cell;
+    cell.minX[location.slot] = bounds.min.x;
+    cell.minY[location.slot] = bounds.min.y;
+    cell.maxX[location.slot] = bounds.max.x;
+    cell.maxY[location.slot] = bounds.max.y;
+    return;
+  }
+  erase(location);
+  add(getCell(bounds), id, bounds);
+}
+
+void SceneIndex::remove(uint32_t id) {
+  erase(locations[id]);
+  locations[id] = {};
+  freeIds.push_back(id);
+  --count;
+}
+
+void SceneIndex::query(const Aabb& viewport, std::vector<uint32_t>& visible) const {
+  visible.clear();
+  cull(oversized, viewport, visible);
+
+  float margin = cellSize * 0.5F;
+  double firstX = std::floor(double(viewport.min.x - margin) * inverseCellSize);
+  double firstY = std::floor(double(viewport.min.y - margin) * inverseCellSize);
+  double lastX = std::floor(double(viewport.max.x + margin) * inverseCellSize);
+  double lastY = std::floor(double(viewport.max.y + margin) * inverseCellSize);
+  // Zoomed far out, walking the existing cells beats looking up every cell the viewport covers.
+  if((lastX - firstX + 1.0) * (lastY - firstY + 1.0) > double(cells.size())) {
+    for(const auto& [key, cell] : cells) {
+      auto x = double(int32_t(uint32_t(key >> 32U)));
+      auto y = double(int32_t(uint32_t(key)));
+      if(x >= firstX && x <= lastX && y >= firstY && y <= lastY)
+        cull(cell, viewport, visible);
+    }
+    return;
+  }
+  for(auto y = int64_t(firstY); y <= int64_t(lastY); ++y) {
+    for(auto x = int64_t(firstX); x <= int64_t(lastX); ++x) {
+      auto cell = cells.find(uint64_t(uint32_t(int32_t(x))) << 32U | uint32_t(int32_t(y)));
+      if(cell != cells.end())
+        cull(cell->second, viewport, visible);
+    }
+  }
+}
+
+uint32_t SceneIndex::size() const {
+  return count;
+}
+
+uint32_t SceneIndex::getCellCount() const {
+  return uint32(cells.size());
+}
+
+uint64_t SceneIndex::getCellKey(float x, float y) const {
+  auto cellX = int32_t(std::floor(x * inverseCellSize));
+  auto cellY = int32_t(std::floor(y * inverseCellSize));
+  return uint64_t(uint32_t(cellX)) << 32U | uint32_t(cellY);
+}
+
+SceneIndex::Cell& SceneIndex::getCell(const Aabb& bounds) {
+  if(bounds.max.x - bounds.min.x > cellSize || bounds.max.y - bounds.min.y > cellSize)
+    return oversized;
+  uint64_t key = getCellKey((bounds.min.x + bounds.max.x) * 0.5F, (bounds.min.y + bounds.max.y) * 0.5F);
+  Cell& cell = cells[key];
+  cell.key = key;
+  return cell;
+}
+
+void SceneIndex::add(Cell& cell, uint32_t id, const Aabb& bounds) {
+  if(cell.count == cell.ids.size()) {
+    // Padding can never be visible, its minimum lies beyond its maximum.
+    std::size_t size = cell.ids.size() + LANES;
+    cell.minX.resize(size, std::numeric_limits<float>::infinity());
+    cell.minY.resize(size, std::numeric_limits<float>::infinity());
+    cell.maxX.resize(size, -std::numeric_limits<float>::infinity());
+    cell.maxY.resize(size, -std::numeric_limits<float>::infinity());
+    cell.ids.resize(size, 0);
+  }
+  uint32_t slot = cell.count++;
+  cell.minX[slot] = bounds.min.x;
+  cell.minY[slot] = bounds.min.y;
+  cell.maxX[slot] = bounds.max.x;
+  cell.maxY[slot] = bounds.max.y;
+  cell.ids[slot] = id;
+  locations[id] = {&cell, slot};
+}
+
+void SceneIndex::erase(const Location& location) {
+  Cell& cell = *location.cell;
+  uint32_t last = --cell.count;
+  if(location.slot != last) {
+    cell.minX[location.slot] = cell.minX[last];
+    cell.minY[location.slot] = cell.minY[last];
+    cell.maxX[location.slot] = cell.maxX[last];
+    cell.maxY[location.slot] = cell.maxY[last];
+    cell.ids[location.slot] = cell.ids[last];
+    locations[cell.ids[last]].slot = location.slot;
+  }
+  cell.minX[last] = std::numeric_limits<float>::infinity();
+  cell.minY[last] = std::numeric_limits<float>::infinity();
+  cell.maxX[last] = -std::numeric_limits<float>::infinity();
+  cell.maxY[last] = -std::numeric_limits<float>::infinity();
+  if(cell.count == 0 && &cell != &oversized)
+    cells.erase(cell.key);
+}
+
+void SceneIndex::cull(const Cell& cell, const Aabb& viewport, std::vector<uint32_t>& visible) {
+  if(cell.count == 0) return;
+  // Room for every object, the ids are written unconditionally and only the visible ones are kept.
+  std::size_t end = visible.size();
+  std::size_t paddedCount = (cell.count + LANES - 1) / LANES * LANES;
+  visible.resize(end + paddedCount);
+  uint32_t *out = visible.data();
+  const uint32_t *ids = cell.ids.data();
+
+#if defined(__AVX__)
+  __m256 viewportMinX = _mm256_set1_ps(viewport.min.x);
+  __m256 viewportMinY = _mm256_set1_ps(viewport.min.y);
+  __m256 viewportMaxX = _mm256_set1_ps(viewport.max.x);
+  __m256 viewportMaxY = _mm256_set1_ps(viewport.max.y);
+  for(std::size_t i = 0; i < paddedCount; i += 8) {
+    __m256 overlapX = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&cell.maxX[i]), viewportMinX, _CMP_GE_OQ),
+                                    _mm256_cmp_ps(_mm256_loadu_ps(&cell.minX[i]), viewportMaxX, _CMP_LE_OQ));
+    __m256 overlapY = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(&cell.maxY[i]), viewportMinY, _CMP_GE_OQ),
+                                    _mm256_cmp_ps(_mm256_loadu_ps(&cell.minY[i]), viewportMaxY, _CMP_LE_OQ));
+    auto mask = uint32_t(_mm256_movemask_ps(_mm256_and_ps(overlapX, overlapY)));
+    for(uint32_t lane = 0; lane < 8; ++lane) {
+      out[end] = ids[i + lane];
+      end += (mask >> lane) & 1U;
+    }
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  __m128 viewportMinX = _mm_set1_ps(viewport.min.x);
+  __m128 viewportMinY = _mm_set1_ps(viewport.min.y);
+  __m128 viewportMaxX = _mm_set1_ps(viewport.max.x);
+  __m128 viewportMaxY = _mm_set1_ps(viewport.max.y);
+  for(std::size_t i = 0; i < paddedCount; i += 4) {
+    __m128 overlapX = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(&cell.maxX[i]), viewportMinX),
+                                 _mm_cmple_ps(_mm_loadu_ps(&cell.minX[i]), viewportMaxX));
+    __m128 overlapY = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(&cell.maxY[i]), viewportMinY),
+                                 _mm_cmple_ps(_mm_loadu_ps(&cell.minY[i]), viewportMaxY));
+    auto mask = uint32_t(_mm_movemask_ps(_mm_and_ps(overlapX, overlapY)));
+    for(uint32_t lane = 0; lane < 4; ++lane) {
+      out[end] = ids[i + lane];
+      end += (mask >> lane) & 1U;
+    }
+  }
+#else
+  for(std::size_t i = 0; i < paddedCount; ++i) {
+    out[end] = ids[i];
+    end += cell.maxX[i] >= viewport.min.x && cell.minX[i] <= viewport.max.x && cell.maxY[i] >= viewport.min.y &&
+           cell.minY[i] <= viewport.max.y;
+  }
+#endif
+  visible.resize(end);
+}
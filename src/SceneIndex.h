@@ -0,0 +1,106 @@
+#ifndef VULKAN_SCENEINDEX_H
+#define VULKAN_SCENEINDEX_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Axis aligned bounding box in world units.
+ */
+struct Aabb {
+  glm::vec2 min;
+  glm::vec2 max;
+};
+
+/**
+ * Finds the objects overlapping a viewport in a world far larger than it, using a loose uniform grid.
+ *
+ * An object lives in the cell containing its center, so it only changes cells when its center crosses a cell border;
+ * every other update just overwrites its bounds. Objects reach at most half a cell beyond their cell, which a query
+ * accounts for by widening the viewport. Objects larger than a cell are kept apart and tested on every query.
+ *
+ * Each cell stores its bounds as structure of arrays padded to LANES objects, which the query tests LANES at a time
+ * with AVX if compiled for it, else with SSE2 where available.
+ */
+class SceneIndex {
+
+public:
+  static constexpr float DEFAULT_CELL_SIZE = 512.0F;
+  // Objects tested at once, cells are padded to a multiple of it.
+  static constexpr uint32_t LANES = 8;
+
+  explicit SceneIndex(float cellSize = DEFAULT_CELL_SIZE);
+
+  SceneIndex(const SceneIndex&) = delete;
+
+  SceneIndex& operator=(const SceneIndex&) = delete;
+
+  /**
+   * @return The id of the object, reused once it is removed.
+   */
+  uint32_t insert(const Aabb& bounds);
+
+  void update(uint32_t id, const Aabb& bounds);
+
+  void remove(uint32_t id);
+
+  /**
+   * Replaces visible with the ids of every object overlapping viewport, grouped by cell rather than sorted.
+   */
+  void query(const Aabb& viewport, std::vector<uint32_t>& visible) const;
+
+  uint32_t size() const;
+
+  uint32_t getCellCount() const;
+
+private:
+
+  struct Cell {
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<uint32_t> ids;
+    uint32_t count = 0;
+    uint64_t key = 0;
+  };
+
+  struct Location {
+    Cell *cell = nullptr;
+    uint32_t slot = 0;
+  };
+
+  float cellSize;
+  float inverseCellSize;
+  // Nodes of an unordered_map never move, so locations can point at cells.
+  std::unordered_map<uint64_t, Cell> cells;
+  Cell oversized;
+  std::vector<Location> locations;
+  std::vector<uint32_t> freeIds;
+  uint32_t count = 0;
+
+  uint64_t getCellKey(float x, float y) const;
+
+  /**
+   * @return The cell bounds belong in, which is created if needed.
+   */
+  Cell& getCell(const Aabb& bounds);
+
+  void add(Cell& cell, uint32_t id, const Aabb& bounds);
+
+  /**
+   * Moves the last object of its cell into its slot, and drops the cell once it is empty.
+   */
+  void erase(const Location& location);
+
+  /**
+   * Appends the ids of the objects of cell overlapping viewport to visible.
+   */
+  static void cull(const Cell& cell, const Aabb& viewport, std::vector<uint32_t>& visible);
+
+};
+
+#endif
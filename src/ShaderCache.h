@@ -0,0 +1,139 @@
+#ifndef VULKAN_SHADERCACHE_H
+#define VULKAN_SHADERCACHE_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "HashUtils.h"
+#include "Macros.h"
+
+/**
+ * Content addressed on-disk store of compiled SPIR-V. Entries are keyed by a hash of everything that affects the
+ * compiler output, so a changed source or compiler simply misses and stale entries are never read.
+ *
+ * A second, smaller kind of entry maps the hash of an unprocessed source file to the key of its SPIR-V so warm
+ * starts can skip preprocessing as well as compilation.
+ */
+class ShaderCache {
+
+public:
+  // Bump whenever the entry layout or the way keys are derived changes.
+  static constexpr uint32_t FORMAT_VERSION = 1;
+  static constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+  explicit ShaderCache(fs::path directory) : directory(std::move(directory)) {
+    std::error_code error;
+    fs::create_directories(this->directory, error);
+    if(error)
+      std::cerr << "Shader cache disabled, could not create " << this->directory << ": " << error.message()
+                << std::endl;
+    enabled = !error;
+  }
+
+  /**
+   * @return The cached SPIR-V for key, or nothing if it is missing or fails validation.
+   */
+  std::optional<std::vector<uint32_t>> loadSpirv(uint64_t key) const {
+    std::optional<std::vector<char>> entry = read(getPath(key, ".spv"));
+    if(!entry || entry->size() < sizeof(Header) + sizeof(uint32_t))
+      return {};
+    Header header{};
+    std::memcpy(&header, entry->data(), sizeof(Header));
+    std::size_t size = entry->size() - sizeof(Header);
+    if(header.formatVersion != FORMAT_VERSION || header.key != key || size % sizeof(uint32_t) != 0 ||
+       header.checksum != HashUtils::hash(entry->data() + sizeof(Header), size))
+      return {};
+    std::vector<uint32_t> spirv(size / sizeof(uint32_t));
+    std::memcpy(spirv.data(), entry->data() + sizeof(Header), size);
+    if(spirv.front() != SPIRV_MAGIC)
+      return {};
+    return spirv;
+  }
+
+  void storeSpirv(uint64_t key, const std::vector<uint32_t>& spirv) const {
+    Header header = {FORMAT_VERSION, 0, key, HashUtils::hash(spirv.data(), spirv.size() * sizeof(uint32_t))};
+    std::vector<char> entry(sizeof(Header) + spirv.size() * sizeof(uint32_t));
+    std::memcpy(entry.data(), &header, sizeof(Header));
+    std::memcpy(entry.data() + sizeof(Header), spirv.data(), spirv.size() * sizeof(uint32_t));
+    write(getPath(key, ".spv"), entry);
+  }
+
+  /**
+   * @return The SPIR-V key recorded for the unprocessed source with key sourceKey.
+   */
+  std::optional<uint64_t> loadAlias(uint64_t sourceKey) const {
+    std::optional<std::vector<char>> entry = read(getPath(sourceKey, ".src"));
+    if(!entry || entry->size() != 2 * sizeof(uint64_t))
+      return {};
+    std::array<uint64_t, 2> alias{};
+    std::memcpy(alias.data(), entry->data(), entry->size());
+    if(alias[0] != sourceKey)
+      return {};
+    return alias[1];
+  }
+
+  void storeAlias(uint64_t sourceKey, uint64_t key) const {
+    std::array<uint64_t, 2> alias = {sourceKey, key};
+    write(getPath(sourceKey, ".src"), std::vector<char>(reinterpret_cast<const char *>(alias.data()),
+                                                        reinterpret_cast<const char *>(alias.data() + alias.size())));
+  }
+
+private:
+
+  struct Header {
+    uint32_t formatVersion;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t checksum;
+  };
+
+  fs::path directory;
+  bool enabled;
+
+  fs::path getPath(uint64_t key, const char *extension) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << extension;
+    return directory / name.str();
+  }
+
+  std::optional<std::vector<char>> read(const fs::path& path) const {
+    if(!enabled) return {};
+    std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
+    if(!file) return {};
+    std::vector<char> data(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    if(!file.read(data.data(), std::streamsize(data.size())))
+      return {};
+    return data;
+  }
+
+  /**
+   * Writes through a temporary file and renames it into place so concurrent readers never see partial entries.
+   */
+  void write(const fs::path& path, const std::vector<char>& data) const {
+    if(!enabled) return;
+    fs::path tmpPath = path;
+    tmpPath += ".tmp";
+    {
+      std::ofstream file(tmpPath, std::ios_base::binary | std::ios_base::trunc);
+      if(!file.write(data.data(), std::streamsize(data.size())))
+        return;
+    }
+    std::error_code error;
+    fs::rename(tmpPath, path, error);
+    if(error)
+      fs::remove(tmpPath, error);
+  }
+
+};
+
+#endif
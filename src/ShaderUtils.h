@@ -3,12 +3,20 @@
 
 #include <shaderc/shaderc.hpp>
 
+#include <array>
 #include <fstream>
+#include <optional>
 #include <string_view>
 #include <memory>
 #include <string>
 #include <filesystem>
+#include <utility>
+#include <vector>
 #include <exception>
+#include <stdexcept>
+
+#include "HashUtils.h"
+#include "ShaderCache.h"
 
 class ShaderUtils {
 
@@ -26,34 +34,78 @@ public:
     return src;
   }
 
+  /**
+   * Resolves #include directives against includeDirectories, in order.
+   * @throws std::runtime_error with the compiler's messages if preprocessing fails.
+   */
   static std::unique_ptr<std::string>
-  preprocess(const std::string& srcName, const std::string& src, shaderc_shader_kind kind) {
-    shaderc::Compiler compiler;
+  preprocess(const std::string& srcName, const std::string& src, shaderc_shader_kind kind,
+             const std::vector<fs::path>& includeDirectories = {}) {
     shaderc::CompileOptions compilerOptions;
-    shaderc::PreprocessedSourceCompilationResult res = compiler.PreprocessGlsl(src, kind, srcName.c_str(),
-                                                                               compilerOptions);
-    if (res.GetCompilationStatus() != shaderc_compilation_status_success) {
-      std::cerr << res.GetErrorMessage() << std::endl;
-      return std::make_unique<std::string>(nullptr);
-    }
+    compilerOptions.SetIncluder(std::make_unique<Includer>(includeDirectories));
+    shaderc::PreprocessedSourceCompilationResult res = getCompiler().PreprocessGlsl(src, kind, srcName.c_str(),
+                                                                                    compilerOptions);
+    if (res.GetCompilationStatus() != shaderc_compilation_status_success)
+      throw std::runtime_error(res.GetErrorMessage());
     return std::make_unique<std::string>(res.begin(), res.end());
   }
 
+  /**
+   * @throws std::runtime_error with the compiler's messages if compilation fails.
+   */
   static std::unique_ptr<std::vector<uint32_t>>
   compile(const std::string& srcName, const std::string& src, shaderc_shader_kind kind, bool optimize = false) {
-    shaderc::Compiler compiler;
     shaderc::CompileOptions compilerOptions;
     if (optimize) compilerOptions.SetOptimizationLevel(shaderc_optimization_level_performance);
 
-    shaderc::SpvCompilationResult res = compiler.CompileGlslToSpv(src, kind, srcName.c_str(),
-                                                                  compilerOptions);
-    if (res.GetCompilationStatus() != shaderc_compilation_status_success) {
-      std::cerr << res.GetErrorMessage() << std::endl;
-      return {};
-    }
+    shaderc::SpvCompilationResult res = getCompiler().CompileGlslToSpv(src, kind, srcName.c_str(),
+                                                                       compilerOptions);
+    if (res.GetCompilationStatus() != shaderc_compilation_status_success)
+      throw std::runtime_error(res.GetErrorMessage());
     return std::make_unique<std::vector<uint32_t>>(res.begin(), res.end());
   }
 
+  /**
+   * Derives the cache key of a shader from its source and everything else that changes the compiler output.
+   */
+  static uint64_t getCacheKey(const std::string& src, shaderc_shader_kind kind, bool optimize) {
+    unsigned int spvVersion = 0;
+    unsigned int spvRevision = 0;
+    shaderc_get_spv_version(&spvVersion, &spvRevision);
+    std::array<uint32_t, 5> options = {ShaderCache::FORMAT_VERSION, uint32_t(kind), uint32_t(optimize), spvVersion,
+                                       spvRevision};
+    return HashUtils::hash(src, HashUtils::hash(options.data(), options.size() * sizeof(uint32_t)));
+  }
+
+  /**
+   * Loads the SPIR-V of a GLSL file from cache, compiling and caching it on a miss.
+   *
+   * Sources without #include directives are looked up by the hash of the file itself, so warm starts never touch
+   * shaderc. Everything else is looked up by the hash of the preprocessed source, which only costs preprocessing.
+   */
+  static std::vector<uint32_t>
+  loadSpirv(const fs::path& path, const shaderc_shader_kind shaderKind, bool optimize, const ShaderCache& cache) {
+    std::unique_ptr<std::string> src = ShaderUtils::load(path.string());
+    bool includes = src->find("#include") != std::string::npos;
+    uint64_t sourceKey = getCacheKey(path.filename().string() + '\n' + *src, shaderKind, optimize);
+    if (!includes)
+      if (std::optional<uint64_t> key = cache.loadAlias(sourceKey))
+        if (std::optional<std::vector<uint32_t>> spirv = cache.loadSpirv(*key))
+          return std::move(*spirv);
+
+    std::unique_ptr<std::string> shaderPreprocessed = ShaderUtils::preprocess(path.filename().string(), *src,
+                                                                              shaderKind, getIncludeDirectories(path));
+    uint64_t key = getCacheKey(*shaderPreprocessed, shaderKind, optimize);
+    std::optional<std::vector<uint32_t>> spirv = cache.loadSpirv(key);
+    if (!spirv) {
+      spirv = std::move(*ShaderUtils::compile(path.filename().string(), *shaderPreprocessed, shaderKind, optimize));
+      cache.storeSpirv(key, *spirv);
+    }
+    if (!includes)
+      cache.storeAlias(sourceKey, key);
+    return std::move(*spirv);
+  }
+
   static vk::UniqueShaderModule createShader(const vk::UniqueDevice& device, const std::vector<uint32_t>& spvByteCode) {
     vk::ShaderModuleCreateInfo createInfo = {vk::ShaderModuleCreateFlags(), spvByteCode.size() * sizeof(uint32_t),
                                              spvByteCode.data()};
@@ -68,7 +120,7 @@ public:
     std::unique_ptr<std::string> src = ShaderUtils::load(path.string());
 
     std::unique_ptr<std::string> shaderPreprocessed = ShaderUtils::preprocess(path.filename().string(), *src,
-                                                                              shaderKind);
+                                                                              shaderKind, getIncludeDirectories(path));
 
     std::unique_ptr<std::vector<uint32_t>> spvByteCode = ShaderUtils::compile(path.filename().string(),
                                                                               *shaderPreprocessed,
@@ -77,9 +129,78 @@ public:
     return ShaderUtils::createShader(device, *spvByteCode);
   }
 
+  static vk::UniqueShaderModule
+  createShader(const vk::UniqueDevice& device, const fs::path& path, const shaderc_shader_kind shaderKind,
+               bool optimize, const ShaderCache& cache) {
+    if (!fs::exists(path))
+      throw std::runtime_error(path.string() + " not found");
+    return ShaderUtils::createShader(device, loadSpirv(path, shaderKind, optimize, cache));
+  }
+
 protected:
 private:
 
+  /**
+   * Loads included files from the first directory containing them.
+   */
+  class Includer : public shaderc::CompileOptions::IncluderInterface {
+
+  public:
+    explicit Includer(std::vector<fs::path> directories) : directories(std::move(directories)) {}
+
+    shaderc_include_result *GetInclude(const char *requestedSource, shaderc_include_type, const char *,
+                                       size_t) override {
+      auto *include = new Include;
+      for (const fs::path& directory : directories) {
+        fs::path path = fs::path(directory).append(requestedSource);
+        if (fs::exists(path)) {
+          include->name = path.string();
+          include->content = *ShaderUtils::load(include->name);
+          break;
+        }
+      }
+      // An empty name reports the content as the error.
+      if (include->name.empty())
+        include->content = std::string(requestedSource) + " not found";
+      include->result = {include->name.data(), include->name.size(), include->content.data(),
+                         include->content.size(), include};
+      return &include->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result *result) override {
+      delete static_cast<Include *>(result->user_data);
+    }
+
+  private:
+    struct Include {
+      std::string name;
+      std::string content;
+      shaderc_include_result result;
+    };
+
+    std::vector<fs::path> directories;
+
+  };
+
+  /**
+   * The directory of the shader at path, followed by the GLSL the build generates, like the vertex layouts' inputs.
+   */
+  static std::vector<fs::path> getIncludeDirectories(const fs::path& path) {
+    std::vector<fs::path> directories = {path.parent_path()};
+#ifdef VULKAN_SHADER_INCLUDE_DIR
+    directories.emplace_back(VULKAN_SHADER_INCLUDE_DIR);
+#endif
+    return directories;
+  }
+
+  /**
+   * A single compiler is shared, constructing one per shader is a measurable part of start up.
+   */
+  static shaderc::Compiler& getCompiler() {
+    static shaderc::Compiler compiler;
+    return compiler;
+  }
+
 };
 
 #endif
@@ -0,0 +1,75 @@
+#include "SkylinePacker.h"
+
+#include <algorithm>
+#include <limits>
+
+SkylinePacker::SkylinePacker(uint32_t width, uint32_t height) : width(width), height(height) {
+  clear();
+}
+
+std::optional<glm::uvec2> SkylinePacker::pack(uint32_t width, uint32_t height) {
+  if(width == 0 || height == 0)
+    return glm::uvec2(0, 0);
+  std::size_t best = skyline.size();
+  uint32_t bestTop = std::numeric_limits<uint32_t>::max();
+  uint32_t bestY = 0;
+  for(std::size_t i = 0; i < skyline.size(); ++i) {
+    std::optional<uint32_t> y = fit(i, width, height);
+    // Segments are visited left to right, so ties keep the leftmost.
+    if(y && *y + height < bestTop) {
+      best = i;
+      bestTop = *y + height;
+      bestY = *y;
+    }
+  }
+  if(best == skyline.size())
+    return {};
+
+  uint32_t x = skyline[best].x;
+  skyline.insert(skyline.begin() + std::ptrdiff_t(best), {x, bestTop, width});
+  // Cut the segments the rectangle now covers.
+  std::size_t next = best + 1;
+  while(next < skyline.size() && skyline[next].x < x + width) {
+    uint32_t end = skyline[next].x + skyline[next].width;
+    if(end <= x + width) {
+      skyline.erase(skyline.begin() + std::ptrdiff_t(next));
+      continue;
+    }
+    skyline[next].width = end - (x + width);
+    skyline[next].x = x + width;
+    break;
+  }
+  // Merge neighbours at the same height.
+  for(std::size_t i = best > 0 ? best - 1 : 0; i + 1 < skyline.size() && i <= best + 1;) {
+    if(skyline[i].y == skyline[i + 1].y) {
+      skyline[i].width += skyline[i + 1].width;
+      skyline.erase(skyline.begin() + std::ptrdiff_t(i + 1));
+      if(i < best) --best;
+    } else {
+      ++i;
+    }
+  }
+  packedArea += uint64_t(width) * height;
+  return glm::uvec2(x, bestY);
+}
+
+void SkylinePacker::clear() {
+  skyline = {{0, 0, width}};
+  packedArea = 0;
+}
+
+float SkylinePacker::getOccupancy() const {
+  return float(double(packedArea) / (double(width) * double(height)));
+}
+
+std::optional<uint32_t> SkylinePacker::fit(std::size_t segment, uint32_t width, uint32_t height) const {
+  uint32_t x = skyline[segment].x;
+  if(x + width > this->width)
+    return {};
+  uint32_t y = 0;
+  for(std::size_t i = segment; i < skyline.size() && skyline[i].x < x + width; ++i)
+    y = std::max(y, skyline[i].y);
+  if(y + height > this->height)
+    return {};
+  return y;
+}
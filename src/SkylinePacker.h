@@ -0,0 +1,51 @@
+#ifndef VULKAN_SKYLINEPACKER_H
+#define VULKAN_SKYLINEPACKER_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Packs rectangles into a fixed size page, tracking only the skyline formed by the top edges of the packed ones.
+ * Every rectangle goes where its top ends up lowest, leftmost on ties, which packs sprites of similar heights about as
+ * tightly as MaxRects at a fraction of the bookkeeping. The space below an overhang is never reused.
+ */
+class SkylinePacker {
+
+public:
+  SkylinePacker(uint32_t width, uint32_t height);
+
+  /**
+   * @return The top left corner of the rectangle, or nothing if it does not fit anymore.
+   */
+  std::optional<glm::uvec2> pack(uint32_t width, uint32_t height);
+
+  void clear();
+
+  // Share of the page covered by packed rectangles.
+  float getOccupancy() const;
+
+private:
+
+  // A horizontal segment of the skyline, segments are sorted by x and cover the whole width.
+  struct Segment {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+  };
+
+  uint32_t width;
+  uint32_t height;
+  std::vector<Segment> skyline;
+  uint64_t packedArea = 0;
+
+  /**
+   * @return The y a rectangle of width would rest at with its left edge on segment, or nothing if it exceeds the page.
+   */
+  std::optional<uint32_t> fit(std::size_t segment, uint32_t width, uint32_t height) const;
+
+};
+
+#endif
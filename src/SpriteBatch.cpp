@@ -0,0 +1,190 @@
+#include "SpriteBatch.h"
+
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+
+#include "Macros.h"
+#include "Mesh.h"
+#include "Trace.h"
+
+SpriteBatch::SpriteBatch(MemoryAllocator& allocator, uint32_t framesInFlight, uint32_t capacity)
+    : instances(allocator, vk::DeviceSize(capacity) * sizeof(SpriteInstance), framesInFlight,
+                vk::BufferUsageFlagBits::eVertexBuffer), capacity(capacity) {
+  // Batches only break on flush() and state changes, so this is rarely outgrown and never reallocated per sprite.
+  batches.reserve(64);
+  draws.reserve(64);
+}
+
+void SpriteBatch::begin(uint32_t frameIndex) {
+  instances.begin(frameIndex);
+  batches.clear();
+  count = 0;
+  batchStart = 0;
+  batchMesh = nullptr;
+  layer = 0;
+  translucent = true;
+  dropped = 0;
+}
+
+void SpriteBatch::end() {
+  closeBatch(false);
+  sortBatches();
+  instances.flush();
+}
+
+SpriteInstance *SpriteBatch::allocate(uint32_t instanceCount) {
+  return allocate(instanceCount, nullptr);
+}
+
+SpriteInstance *SpriteBatch::allocate(uint32_t instanceCount, const Mesh *mesh) {
+  if(mesh != batchMesh) {
+    closeBatch(false);
+    batchMesh = mesh;
+  }
+  if(instanceCount > capacity - count) {
+    dropped += instanceCount;
+    return nullptr;
+  }
+  // Aligned to whole instances, so the ranges of a frame are contiguous and count indexes them.
+  std::optional<LinearAllocator::Range> range = instances.allocate(vk::DeviceSize(instanceCount) *
+                                                                   sizeof(SpriteInstance), sizeof(SpriteInstance));
+  count += instanceCount;
+  return static_cast<SpriteInstance *>(range->mapped);
+}
+
+void SpriteBatch::draw(const SpriteInstance& instance) {
+  if(SpriteInstance *dst = allocate(1))
+    *dst = instance;
+}
+
+void SpriteBatch::draw(const glm::vec2& position, const glm::vec2& size, float rotation, uint32_t color,
+                       const glm::vec4& uvRect, uint32_t textureIndex) {
+  SpriteInstance *dst = allocate(1);
+  if(!dst) return;
+  float cos = std::cos(rotation);
+  float sin = std::sin(rotation);
+  // Write the whole instance at once, the mapped memory is likely write combined.
+  *dst = {{cos * size.x, -sin * size.y, position.x},
+          {sin * size.x, cos * size.y, position.y},
+          packUvRect(uvRect), color, textureIndex};
+}
+
+void SpriteBatch::draw(const Mesh& mesh, const SpriteInstance& instance) {
+  if(SpriteInstance *dst = allocate(1, &mesh))
+    *dst = instance;
+}
+
+void SpriteBatch::flush() {
+  closeBatch(true);
+}
+
+void SpriteBatch::setLayer(uint8_t layer) {
+  if(layer == this->layer) return;
+  closeBatch(false);
+  this->layer = layer;
+}
+
+void SpriteBatch::setTranslucent(bool translucent) {
+  if(translucent == this->translucent) return;
+  closeBatch(false);
+  this->translucent = translucent;
+}
+
+void SpriteBatch::closeBatch(bool flushed) {
+  if(count == batchStart) return;
+  batches.push_back({batchStart, count - batchStart, batchMesh, layer, translucent, flushed});
+  batchStart = count;
+}
+
+void SpriteBatch::sortBatches() {
+  TRACE_FUNCTION();
+  queue.clear();
+  meshIds.clear();
+  for(uint32_t i = 0; i < batches.size(); ++i) {
+    const Batch& batch = batches[i];
+    // Sprites are material 0 of pipeline 0, meshes are numbered in the order the frame first draws them.
+    uint16_t material = 0;
+    if(batch.mesh)
+      material = meshIds.try_emplace(batch.mesh, uint16_t(meshIds.size() + 1)).first->second;
+    // Opaque batches do not overlap, so their submission order only keeps the sort stable.
+    queue.push(RenderQueue::makeKey(batch.layer, batch.translucent, batch.mesh ? 1 : 0, material, i), i);
+  }
+  queue.sort();
+
+  draws.clear();
+  stateChanges = 0;
+  const Batch *previous = nullptr;
+  const Mesh *lastMesh = nullptr;
+  for(const RenderQueue::Item& item : queue.getItems()) {
+    const Batch& batch = batches[item.index];
+    if(previous && !previous->flushed && previous->mesh == batch.mesh &&
+       draws.back().firstInstance + draws.back().instanceCount == batch.firstInstance) {
+      draws.back().instanceCount += batch.instanceCount;
+    } else {
+      if(draws.empty() || (draws.back().mesh == nullptr) != (batch.mesh == nullptr))
+        ++stateChanges;
+      // Sprites do not read the mesh binding, so a mesh stays bound across them.
+      if(batch.mesh && batch.mesh != lastMesh) {
+        ++stateChanges;
+        lastMesh = batch.mesh;
+      }
+      draws.push_back({batch.firstInstance, batch.instanceCount, batch.mesh});
+    }
+    previous = &batch;
+  }
+}
+
+void SpriteBatch::record(const vk::CommandBuffer& commandBuffer, vk::Pipeline spritePipeline,
+                         vk::Pipeline meshPipeline, vk::Pipeline boundPipeline) const {
+  record(commandBuffer, spritePipeline, meshPipeline, 0, getDrawCount(), boundPipeline);
+}
+
+void SpriteBatch::record(const vk::CommandBuffer& commandBuffer, vk::Pipeline spritePipeline,
+                         vk::Pipeline meshPipeline, uint32_t firstDraw, uint32_t drawCount,
+                         vk::Pipeline boundPipeline) const {
+  if(drawCount == 0) return;
+  vk::DeviceSize offset = 0;
+  vk::Buffer instanceBuffer = instances.getBuffer();
+  commandBuffer.bindVertexBuffers(SPRITE_INSTANCE_LAYOUT.binding, 1, &instanceBuffer, &offset);
+  vk::Pipeline bound = boundPipeline;
+  const Mesh *boundMesh = nullptr;
+  for(uint32_t i = firstDraw; i < firstDraw + drawCount; ++i) {
+    const Draw& draw = draws[i];
+    vk::Pipeline pipeline = draw.mesh ? meshPipeline : spritePipeline;
+    if(pipeline != bound) {
+      commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+      bound = pipeline;
+    }
+    if(!draw.mesh) {
+      commandBuffer.draw(VERTICES_PER_SPRITE, draw.instanceCount, 0, draw.firstInstance);
+      continue;
+    }
+    if(draw.mesh != boundMesh) {
+      draw.mesh->bind(commandBuffer);
+      boundMesh = draw.mesh;
+    }
+    commandBuffer.drawIndexed(draw.mesh->getIndexCount(), draw.instanceCount, 0, 0, draw.firstInstance);
+  }
+}
+
+uint32_t SpriteBatch::getSpriteCount() const {
+  return count;
+}
+
+uint32_t SpriteBatch::getDrawCount() const {
+  return uint32(draws.size());
+}
+
+uint32_t SpriteBatch::getStateChangeCount() const {
+  return stateChanges;
+}
+
+uint32_t SpriteBatch::getDroppedCount() const {
+  return dropped;
+}
+
+uint32_t SpriteBatch::getCapacity() const {
+  return capacity;
+}
@@ -0,0 +1,208 @@
+#ifndef VULKAN_SPRITEBATCH_H
+#define VULKAN_SPRITEBATCH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "MemoryAllocator.h"
+#include "RenderQueue.h"
+#include "VertexLayout.h"
+
+class Mesh;
+
+/**
+ * Per instance data of a sprite, laid out exactly as the vertex shader reads it.
+ */
+struct SpriteInstance {
+  // Rows of the 2x3 affine transform mapping the unit quad centered on the origin to pixels.
+  glm::vec3 transform0;
+  glm::vec3 transform1;
+  // u0, v0, u1, v1 as 16 bit unorm, see packUvRect().
+  glm::u16vec4 uvRect;
+  // RGBA8, red in the lowest byte.
+  uint32_t color;
+  uint32_t textureIndex;
+};
+
+static_assert(sizeof(SpriteInstance) == 40, "SpriteInstance must match the vertex input layout");
+
+/**
+ * Read per instance from binding 0 by the sprite and mesh vertex shaders.
+ */
+constexpr VertexLayout<5> SPRITE_INSTANCE_LAYOUT = {0, vk::VertexInputRate::eInstance, sizeof(SpriteInstance), 0, {{
+    {"inTransform0", vk::Format::eR32G32B32Sfloat, offsetof(SpriteInstance, transform0)},
+    {"inTransform1", vk::Format::eR32G32B32Sfloat, offsetof(SpriteInstance, transform1)},
+    {"inUvRect", vk::Format::eR16G16B16A16Unorm, offsetof(SpriteInstance, uvRect)},
+    {"inColor", vk::Format::eR8G8B8A8Unorm, offsetof(SpriteInstance, color)},
+    {"inTextureIndex", vk::Format::eR32Uint, offsetof(SpriteInstance, textureIndex)}}}};
+
+static_assert(SPRITE_INSTANCE_LAYOUT.isValid(), "SPRITE_INSTANCE_LAYOUT must lie within SpriteInstance");
+
+/**
+ * Quantizes texture coordinates in [0, 1] to the 16 bit unorm of SpriteInstance::uvRect, 1/64 texel on a 1024 texel
+ * atlas page.
+ */
+inline glm::u16vec4 packUvRect(const glm::vec4& uvRect) {
+  return glm::u16vec4(glm::round(glm::clamp(uvRect, 0.0F, 1.0F) * 65535.0F));
+}
+
+/**
+ * Packs a color into the RGBA8 layout of SpriteInstance::color.
+ */
+constexpr uint32_t packColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+  return uint32_t(r) | uint32_t(g) << 8U | uint32_t(b) << 16U | uint32_t(a) << 24U;
+}
+
+/**
+ * Collects sprites into a persistently mapped instance buffer per frame in flight and draws each batch with a
+ * single instanced draw. Sprites are bump allocated by a LinearAllocator and written straight into mapped memory.
+ *
+ * Meshes are drawn from the same instances, each instance placing the mesh like it would a sprite's quad. Consecutive
+ * instances of the same mesh share an indexed draw, switching between sprites and meshes starts a new batch.
+ *
+ * When the frame ends, its batches are ordered by a RenderQueue: by layer, and within a layer opaque batches grouped
+ * by pipeline and mesh ahead of the translucent ones, which keep their order. Batches that end up next to each other
+ * with the same state and adjoining instances merge into one draw, and recording only binds what changed.
+ */
+class SpriteBatch {
+
+public:
+  static constexpr uint32_t DEFAULT_CAPACITY = 1U << 19U;
+  static constexpr uint32_t VERTICES_PER_SPRITE = 6;
+
+  SpriteBatch(MemoryAllocator& allocator, uint32_t framesInFlight, uint32_t capacity = DEFAULT_CAPACITY);
+
+  /**
+   * Starts collecting sprites into the instance buffer of a frame in flight. The frame's previous submission must
+   * have finished.
+   */
+  void begin(uint32_t frameIndex);
+
+  /**
+   * Closes the current batch and makes the written instances visible to the device.
+   */
+  void end();
+
+  /**
+   * Reserves space for count instances in the current batch.
+   * @return Mapped memory to write count instances to, or nullptr if the frame's buffer is full.
+   */
+  SpriteInstance *allocate(uint32_t count);
+
+  void draw(const SpriteInstance& instance);
+
+  /**
+   * Draws a sprite of size pixels centered on position, rotated by rotation radians.
+   */
+  void draw(const glm::vec2& position, const glm::vec2& size, float rotation, uint32_t color,
+            const glm::vec4& uvRect = {0, 0, 1, 1}, uint32_t textureIndex = 0);
+
+  /**
+   * Draws mesh placed by instance, which must outlive the frame's submission.
+   */
+  void draw(const Mesh& mesh, const SpriteInstance& instance);
+
+  /**
+   * Ends the current batch so the following sprites are drawn by a separate draw call.
+   */
+  void flush();
+
+  /**
+   * Puts the following sprites and meshes on layer, drawn after every lower layer. Layer 0 until begin().
+   */
+  void setLayer(uint8_t layer);
+
+  /**
+   * Whether the following sprites and meshes must be blended in the order they are drawn, true until begin(). Opaque
+   * ones are drawn ahead of the translucent ones of their layer in any order, so they must not overlap each other.
+   */
+  void setTranslucent(bool translucent);
+
+  /**
+   * Records every draw of the frame ended last, binding spritePipeline or meshPipeline as the draws switch between
+   * sprites and meshes. Both pipelines must share their layout.
+   * @param boundPipeline The pipeline commandBuffer has bound already, if any.
+   */
+  void record(const vk::CommandBuffer& commandBuffer, vk::Pipeline spritePipeline, vk::Pipeline meshPipeline,
+              vk::Pipeline boundPipeline = {}) const;
+
+  /**
+   * Records the draws [firstDraw, firstDraw + drawCount) only, so a frame can be split across threads recording
+   * concurrently.
+   */
+  void record(const vk::CommandBuffer& commandBuffer, vk::Pipeline spritePipeline, vk::Pipeline meshPipeline,
+              uint32_t firstDraw, uint32_t drawCount, vk::Pipeline boundPipeline = {}) const;
+
+  uint32_t getSpriteCount() const;
+
+  // Draws of the frame ended last, after merging.
+  uint32_t getDrawCount() const;
+
+  // Pipeline and mesh binds the draws of the frame ended last take when recorded on a single thread.
+  uint32_t getStateChangeCount() const;
+
+  // Sprites that did not fit into the frame's instance buffer since begin().
+  uint32_t getDroppedCount() const;
+
+  uint32_t getCapacity() const;
+
+private:
+
+  struct Batch {
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    // nullptr for sprites.
+    const Mesh *mesh;
+    uint8_t layer;
+    bool translucent;
+    // Ended by flush(), so it is never merged with the next.
+    bool flushed;
+  };
+
+  struct Draw {
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    const Mesh *mesh;
+  };
+
+  // The frame's instances, released at once by begin().
+  LinearAllocator instances;
+  std::vector<Batch> batches;
+  // The batches in drawing order, once the frame ended.
+  std::vector<Draw> draws;
+  RenderQueue queue;
+  // Materials of the frame's meshes in their sort keys.
+  std::unordered_map<const Mesh *, uint16_t> meshIds;
+  uint32_t capacity;
+  uint32_t count = 0;
+  uint32_t batchStart = 0;
+  const Mesh *batchMesh = nullptr;
+  uint8_t layer = 0;
+  bool translucent = true;
+  uint32_t dropped = 0;
+  uint32_t stateChanges = 0;
+
+  void closeBatch(bool flushed);
+
+  /**
+   * Orders the frame's batches into draws.
+   */
+  void sortBatches();
+
+  /**
+   * Reserves instances of mesh, or of sprites if nullptr, starting a new batch if the current one draws something
+   * else.
+   */
+  SpriteInstance *allocate(uint32_t count, const Mesh *mesh);
+
+};
+
+#endif
@@ -30,29 +30,37 @@ public:
     return imageViews;
   }
 
+  /**
+   * @param oldSwapChain The swap chain being replaced, if any. Its resources are reused where possible and it stays
+   * valid until destroyed so frames still using it can finish.
+   * @param usage How the images are written, e.g. copied to rather than rendered to.
+   */
   static vk::UniqueSwapchainKHR
   createSwapChain(const vk::UniqueDevice& device,
                   const SwapChainSupportDetails& swapChainSupportDetails, const vk::UniqueSurfaceKHR& surface,
                   vk::PresentModeKHR presentMode,
                   vk::SurfaceFormatKHR surfaceFormat, vk::Extent2D extent, uint32_t graphicsQueueFamily,
-                  uint32_t presentQueueFamily) {
+                  uint32_t presentQueueFamily, vk::SwapchainKHR oldSwapChain = nullptr,
+                  vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment) {
     bool sharedQueues = graphicsQueueFamily == presentQueueFamily;
     std::array<uint32_t, 2> queueFamilyIndices = {graphicsQueueFamily, presentQueueFamily};
+    uint32_t imageCount = swapChainSupportDetails.capabilities.minImageCount + 1;
+    // A maxImageCount of 0 means there is no limit.
+    if (swapChainSupportDetails.capabilities.maxImageCount > 0)
+      imageCount = std::min(imageCount, swapChainSupportDetails.capabilities.maxImageCount);
     vk::SwapchainCreateInfoKHR createInfo = {{}, surface.get(),
-                                             std::clamp(swapChainSupportDetails.capabilities.minImageCount + 1,
-                                                        swapChainSupportDetails.capabilities.minImageCount,
-                                                        swapChainSupportDetails.capabilities.maxImageCount),
+                                             imageCount,
                                              surfaceFormat.format,
                                              surfaceFormat.colorSpace,
                                              extent,
                                              1,
-                                             vk::ImageUsageFlagBits::eColorAttachment,
+                                             usage,
                                              sharedQueues ? vk::SharingMode::eExclusive : vk::SharingMode::eConcurrent,
                                              uint32(sharedQueues ? 0 : 2),
                                              sharedQueues ? nullptr : queueFamilyIndices.data(),
                                              swapChainSupportDetails.capabilities.currentTransform,
                                              vk::CompositeAlphaFlagBitsKHR::eOpaque,
-                                             presentMode, VK_TRUE, nullptr
+                                             presentMode, VK_TRUE, oldSwapChain
     };
     vk::UniqueSwapchainKHR swapChain;
     try {
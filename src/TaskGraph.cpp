@@ -0,0 +1,139 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+
+#include "Trace.h"
+
+uint32_t TaskGraph::add(std::string name, std::function<void()> function, const std::vector<uint32_t>& dependencies,
+                        bool mainThread) {
+  auto id = uint32_t(tasks.size());
+  for(uint32_t dependency : dependencies)
+    if(dependency >= id)
+      throw std::out_of_range("task " + name + " depends on task " + std::to_string(dependency) +
+                              ", which does not exist yet");
+  for(uint32_t dependency : dependencies)
+    tasks[dependency].dependents.push_back(id);
+  tasks.push_back({std::move(name), std::move(function), {}, uint32_t(dependencies.size()), mainThread});
+  return id;
+}
+
+void TaskGraph::run(ThreadPool& threadPool) {
+  TRACE_FUNCTION();
+  auto start = std::chrono::steady_clock::now();
+  timings.assign(tasks.size(), {});
+  std::vector<uint32_t> remainingDependencies(tasks.size());
+  for(std::size_t i = 0; i < tasks.size(); ++i) {
+    timings[i].name = tasks[i].name;
+    timings[i].mainThread = tasks[i].mainThread || threadPool.getThreadCount() == 0;
+    remainingDependencies[i] = tasks[i].dependencyCount;
+  }
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  // Ready tasks waiting for the calling thread.
+  std::deque<uint32_t> mainThreadTasks;
+  // Ready or running tasks.
+  uint32_t pending = 0;
+  std::exception_ptr error;
+
+  std::function<void(uint32_t)> execute;
+  // Must be called with mutex locked.
+  auto schedule = [&](uint32_t task) {
+    ++pending;
+    if(timings[task].mainThread)
+      mainThreadTasks.push_back(task);
+    else
+      threadPool.submit([&execute, task]() { execute(task); });
+  };
+  execute = [&](uint32_t task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(error) {
+        --pending;
+        condition.notify_all();
+        return;
+      }
+    }
+    auto taskStart = std::chrono::steady_clock::now();
+    std::exception_ptr taskError;
+    try {
+      tasks[task].function();
+    } catch(...) {
+      taskError = std::current_exception();
+    }
+    auto taskEnd = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    timings[task].start = taskStart - start;
+    timings[task].duration = taskEnd - taskStart;
+    if(taskError && !error)
+      error = taskError;
+    if(!error)
+      for(uint32_t dependent : tasks[task].dependents)
+        if(--remainingDependencies[dependent] == 0)
+          schedule(dependent);
+    --pending;
+    condition.notify_all();
+  };
+
+  std::unique_lock<std::mutex> lock(mutex);
+  for(uint32_t task = 0; task < tasks.size(); ++task)
+    if(remainingDependencies[task] == 0)
+      schedule(task);
+  while(true) {
+    condition.wait(lock, [&]() { return !mainThreadTasks.empty() || pending == 0; });
+    if(error) {
+      pending -= uint32_t(mainThreadTasks.size());
+      mainThreadTasks.clear();
+    }
+    if(mainThreadTasks.empty()) {
+      if(pending == 0) break;
+      continue;
+    }
+    // Without workers this keeps the order tasks were added in, as long as they were added after their dependencies.
+    std::sort(mainThreadTasks.begin(), mainThreadTasks.end());
+    uint32_t task = mainThreadTasks.front();
+    mainThreadTasks.pop_front();
+    lock.unlock();
+    execute(task);
+    lock.lock();
+  }
+  duration = std::chrono::steady_clock::now() - start;
+  if(error)
+    std::rethrow_exception(error);
+}
+
+const std::vector<TaskGraph::Timing>& TaskGraph::getTimings() const {
+  return timings;
+}
+
+TaskGraph::Milliseconds TaskGraph::getDuration() const {
+  return duration;
+}
+
+void TaskGraph::printReport(std::ostream& out) const {
+  std::vector<const Timing *> started;
+  for(const Timing& timing : timings)
+    started.push_back(&timing);
+  std::stable_sort(started.begin(), started.end(),
+                   [](const Timing *a, const Timing *b) { return a->start < b->start; });
+  Milliseconds work = std::accumulate(timings.begin(), timings.end(), Milliseconds(0),
+                                      [](Milliseconds sum, const Timing& timing) { return sum + timing.duration; });
+
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(1) << timings.size() << " tasks took " << duration.count() << "ms for "
+      << work.count() << "ms of work:" << std::endl;
+  for(const Timing *timing : started)
+    out << "  " << std::setw(8) << timing->start.count() << "ms +" << std::setw(8) << timing->duration.count()
+        << "ms  " << timing->name << (timing->mainThread ? " (main thread)" : "") << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
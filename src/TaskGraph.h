@@ -0,0 +1,76 @@
+#ifndef VULKAN_TASKGRAPH_H
+#define VULKAN_TASKGRAPH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/**
+ * Tasks with dependencies between them, each started on a thread pool as soon as the tasks it depends on finished, so
+ * independent work overlaps. Tasks that must stay on the thread calling run(), like anything creating windows, are
+ * run there in between waiting for the others.
+ */
+class TaskGraph {
+
+public:
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+
+  struct Timing {
+    std::string name;
+    // Relative to the start of run().
+    Milliseconds start{0};
+    Milliseconds duration{0};
+    bool mainThread = false;
+  };
+
+  /**
+   * @param dependencies Ids of tasks that must finish first, tasks can only depend on ones added before them.
+   * @param mainThread Whether the task has to run on the thread calling run().
+   * @return The id of the task.
+   * @throws std::out_of_range if a dependency does not exist.
+   */
+  uint32_t add(std::string name, std::function<void()> function, const std::vector<uint32_t>& dependencies = {},
+               bool mainThread = false);
+
+  /**
+   * Runs every task once and returns when they finished. Without workers in threadPool every task runs on the calling
+   * thread, in the order they were added. The first exception thrown by a task is rethrown once the running tasks
+   * finished, tasks that did not start by then are skipped.
+   */
+  void run(ThreadPool& threadPool);
+
+  /**
+   * @return The timings of the tasks of the last run(), in the order they were added.
+   */
+  const std::vector<Timing>& getTimings() const;
+
+  // From the start of the last run() until its last task finished.
+  Milliseconds getDuration() const;
+
+  /**
+   * Writes when every task of the last run() started and how long it took, in the order they started.
+   */
+  void printReport(std::ostream& out) const;
+
+private:
+
+  struct Task {
+    std::string name;
+    std::function<void()> function;
+    std::vector<uint32_t> dependents;
+    uint32_t dependencyCount = 0;
+    bool mainThread = false;
+  };
+
+  std::vector<Task> tasks;
+  std::vector<Timing> timings;
+  Milliseconds duration{0};
+
+};
+
+#endif
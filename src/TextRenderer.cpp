@@ -0,0 +1,346 @@
+#include "TextRenderer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "Trace.h"
+#include "VkUtils.h"
+
+namespace {
+
+  // Degenerate, so a glyph missing from the atlas or a freed instance draws nothing.
+  const SpriteInstance EMPTY_INSTANCE = {glm::vec3(0.0F), glm::vec3(0.0F), glm::u16vec4(0), 0, 0};
+
+  const GlyphPlacement MISSING_GLYPH = {glm::vec4(0.0F), glm::vec2(0.0F), glm::vec2(0.0F)};
+
+}
+
+TextRenderer::TextRenderer(const vk::UniqueDevice& device, MemoryAllocator& allocator,
+                           DescriptorAllocator& descriptorAllocator, UploadManager& uploadManager,
+                           vk::UniqueShaderModule fragmentShader, const fs::path& fontPath, uint32_t framesInFlight,
+                           uint32_t capacity)
+    : device(device), allocator(allocator), atlas(device, allocator, uploadManager, fontPath, framesInFlight),
+      fragmentShader(std::move(fragmentShader)), capacity(capacity), instances(capacity, EMPTY_INSTANCE) {
+  vk::SamplerCreateInfo samplerCreateInfo = {{}, vk::Filter::eLinear, vk::Filter::eLinear,
+                                             vk::SamplerMipmapMode::eNearest, vk::SamplerAddressMode::eClampToEdge,
+                                             vk::SamplerAddressMode::eClampToEdge,
+                                             vk::SamplerAddressMode::eClampToEdge};
+  sampler = device->createSamplerUnique(samplerCreateInfo);
+  vk::DescriptorSetLayout descriptorSetLayout = descriptorAllocator.getLayout(
+      {vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eCombinedImageSampler, 1,
+                                      vk::ShaderStageFlagBits::eFragment}});
+  vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::vec4)};
+  pipelineLayout = device->createPipelineLayoutUnique({{}, 1, &descriptorSetLayout, 1, &pushConstantRange});
+
+  // Every frame samples the same atlas, so one set serves them all.
+  descriptorSet = descriptorAllocator.getCachedSet(
+      descriptorSetLayout, DescriptorBindings().image(0, vk::DescriptorType::eCombinedImageSampler, sampler.get(),
+                                                      atlas.getImageView(), vk::ImageLayout::eShaderReadOnlyOptimal));
+
+  frames.resize(framesInFlight);
+  for(Frame& frame : frames)
+    frame.instanceBuffer = allocator.createBuffer({{}, std::max<vk::DeviceSize>(vk::DeviceSize(capacity) *
+                                                                                sizeof(SpriteInstance), 4),
+                                                   vk::BufferUsageFlagBits::eVertexBuffer,
+                                                   vk::SharingMode::eExclusive}, MemoryUsage::eCpuToGpu);
+}
+
+void TextRenderer::createPipeline(PipelineCache& pipelineCache, vk::RenderPass renderPass,
+                                  vk::ShaderModule vertexShader) {
+  std::array<vk::VertexInputAttributeDescription, 5> attributeDescriptions =
+      SPRITE_INSTANCE_LAYOUT.getAttributeDescriptions();
+  GraphicsPipelineState state;
+  state.vertexShader = vertexShader;
+  state.fragmentShader = fragmentShader.get();
+  state.layout = pipelineLayout.get();
+  state.renderPass = renderPass;
+  state.blendMode = BlendMode::eAlpha;
+  state.bindings = {SPRITE_INSTANCE_LAYOUT.getBindingDescription()};
+  state.attributes = {attributeDescriptions.begin(), attributeDescriptions.end()};
+  state.dynamicStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+  pipeline = pipelineCache.getGraphicsPipeline(state);
+}
+
+uint32_t TextRenderer::createLabel(std::string_view text, const glm::vec2& position, float size, uint32_t color) {
+  Label label;
+  label.run = getRun(text);
+  label.position = position;
+  label.size = size;
+  label.color = color;
+  resize(label, uint32(label.run->glyphs.size()));
+  uint32_t id = nextLabel++;
+  write(id, labels.emplace(id, std::move(label)).first->second);
+  return id;
+}
+
+void TextRenderer::setText(uint32_t id, std::string_view text) {
+  Label& label = labels.at(id);
+  std::shared_ptr<const GlyphRun> run = getRun(text);
+  if(run == label.run) return;
+  resize(label, uint32(run->glyphs.size()));
+  label.run = std::move(run);
+  write(id, label);
+}
+
+void TextRenderer::setPosition(uint32_t id, const glm::vec2& position) {
+  Label& label = labels.at(id);
+  if(label.position == position) return;
+  label.position = position;
+  place(label);
+}
+
+void TextRenderer::setColor(uint32_t id, uint32_t color) {
+  Label& label = labels.at(id);
+  if(label.color == color) return;
+  label.color = color;
+  place(label);
+}
+
+void TextRenderer::destroyLabel(uint32_t id) {
+  Label& label = labels.at(id);
+  for(uint32_t codepoint : label.acquired)
+    atlas.release(codepoint, frameCount);
+  freeRange(label.first, label.count);
+  glyphCount -= label.count;
+  incompleteLabels.erase(id);
+  labels.erase(id);
+}
+
+glm::vec2 TextRenderer::getSize(uint32_t id) const {
+  const Label& label = labels.at(id);
+  return label.run->size * (label.size / float(GlyphAtlas::GLYPH_SIZE));
+}
+
+void TextRenderer::update(uint32_t frameIndex) {
+  TRACE_SCOPE("update text");
+  atlas.setFrame(frameCount);
+  if(!incompleteLabels.empty()) {
+    std::vector<uint32_t> retries(incompleteLabels.begin(), incompleteLabels.end());
+    for(uint32_t id : retries)
+      write(id, labels.at(id));
+  }
+
+  Frame& frame = frames[frameIndex];
+  auto& ranges = frame.dirtyRanges;
+  std::sort(ranges.begin(), ranges.end());
+  auto *mapped = static_cast<SpriteInstance *>(frame.instanceBuffer.allocation->mapped);
+  for(std::size_t i = 0; i < ranges.size();) {
+    // Coalesce overlapping and adjacent ranges into one copy and flush.
+    uint32_t first = ranges[i].first;
+    uint32_t end = first + ranges[i].second;
+    for(++i; i < ranges.size() && ranges[i].first <= end; ++i)
+      end = std::max(end, ranges[i].first + ranges[i].second);
+    std::memcpy(mapped + first, instances.data() + first, std::size_t(end - first) * sizeof(SpriteInstance));
+    allocator.flush(frame.instanceBuffer.allocation.get(), vk::DeviceSize(first) * sizeof(SpriteInstance),
+                    vk::DeviceSize(end - first) * sizeof(SpriteInstance));
+  }
+  ranges.clear();
+  frame.instanceCount = instanceEnd;
+  ++frameCount;
+}
+
+void TextRenderer::record(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex,
+                          const glm::vec4& pixelToNdc) const {
+  const Frame& frame = frames[frameIndex];
+  if(frame.instanceCount == 0 || !pipeline) return;
+  commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout.get(), 0, 1, &descriptorSet, 0,
+                                   nullptr);
+  commandBuffer.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(pixelToNdc),
+                              &pixelToNdc);
+  vk::DeviceSize offset = 0;
+  commandBuffer.bindVertexBuffers(0, 1, &frame.instanceBuffer.buffer.get(), &offset);
+  commandBuffer.draw(SpriteBatch::VERTICES_PER_SPRITE, frame.instanceCount, 0, 0);
+}
+
+std::shared_ptr<const GlyphRun> TextRenderer::getRun(std::string_view text) {
+  std::string key(text);
+  auto cached = runs.find(key);
+  if(cached != runs.end())
+    return cached->second;
+  if(runs.size() >= RUN_CACHE_SIZE) {
+    for(auto it = runs.begin(); it != runs.end();)
+      it = it->second.use_count() == 1 ? runs.erase(it) : std::next(it);
+  }
+  std::shared_ptr<const GlyphRun> run = layout(decodeUtf8(text));
+  ++layoutCount;
+  runs.emplace(std::move(key), run);
+  return run;
+}
+
+uint32_t TextRenderer::getLabelCount() const {
+  return uint32(labels.size());
+}
+
+uint32_t TextRenderer::getGlyphCount() const {
+  return glyphCount;
+}
+
+uint64_t TextRenderer::getLayoutCount() const {
+  return layoutCount;
+}
+
+uint32_t TextRenderer::getCapacity() const {
+  return capacity;
+}
+
+const GlyphAtlas& TextRenderer::getAtlas() const {
+  return atlas;
+}
+
+std::vector<uint32_t> TextRenderer::decodeUtf8(std::string_view text) {
+  constexpr uint32_t REPLACEMENT = 0xFFFD;
+  std::vector<uint32_t> codepoints;
+  codepoints.reserve(text.size());
+  for(std::size_t i = 0; i < text.size();) {
+    auto lead = uint8_t(text[i++]);
+    uint32_t length = lead < 0x80 ? 0 : lead >= 0xC2 && lead < 0xE0 ? 1 : lead >= 0xE0 && lead < 0xF0 ? 2
+                                                                          : lead >= 0xF0 && lead < 0xF5 ? 3 : 4;
+    if(length == 0) {
+      codepoints.push_back(lead);
+      continue;
+    }
+    if(length == 4) {
+      codepoints.push_back(REPLACEMENT);
+      continue;
+    }
+    uint32_t codepoint = lead & (0x3FU >> length);
+    uint32_t read = 0;
+    for(; read < length && i < text.size() && (uint8_t(text[i]) & 0xC0U) == 0x80; ++read, ++i)
+      codepoint = codepoint << 6U | (uint8_t(text[i]) & 0x3FU);
+    // Truncated, overlong, surrogate or beyond U+10FFFF.
+    constexpr uint32_t MINIMUM[] = {0, 0x80, 0x800, 0x10000};
+    if(read < length || codepoint < MINIMUM[length] || (codepoint >= 0xD800 && codepoint < 0xE000) ||
+       codepoint > 0x10FFFF)
+      codepoint = REPLACEMENT;
+    codepoints.push_back(codepoint);
+  }
+  return codepoints;
+}
+
+std::shared_ptr<const GlyphRun> TextRenderer::layout(const std::vector<uint32_t>& codepoints) {
+  auto run = std::make_shared<GlyphRun>();
+  float lineHeight = atlas.getLineHeight();
+  glm::vec2 pen = {0.0F, atlas.getAscender()};
+  float width = 0.0F;
+  std::optional<uint32_t> previous;
+  for(uint32_t codepoint : codepoints) {
+    if(codepoint == '\n') {
+      width = std::max(width, pen.x);
+      pen = {0.0F, pen.y + lineHeight};
+      previous.reset();
+      continue;
+    }
+    if(previous)
+      pen.x += atlas.getKerning(*previous, codepoint);
+    if(atlas.hasPixels(codepoint))
+      run->glyphs.push_back({codepoint, pen});
+    pen.x += atlas.getAdvance(codepoint);
+    previous = codepoint;
+  }
+  run->size = {std::max(width, pen.x), pen.y - atlas.getAscender() + lineHeight};
+  return run;
+}
+
+void TextRenderer::resize(Label& label, uint32_t count) {
+  if(count == label.count) return;
+  uint32_t first = allocateRange(count);
+  freeRange(label.first, label.count);
+  glyphCount += count - label.count;
+  label.first = first;
+  label.count = count;
+}
+
+void TextRenderer::write(uint32_t id, Label& label) {
+  std::vector<uint32_t> previous = std::move(label.acquired);
+  label.acquired.clear();
+  label.placements.assign(label.run->glyphs.size(), MISSING_GLYPH);
+  bool complete = true;
+  // Acquired before the previous glyphs are released, so the ones still in use never get evicted in between.
+  for(std::size_t i = 0; i < label.placements.size(); ++i) {
+    uint32_t codepoint = label.run->glyphs[i].codepoint;
+    std::optional<GlyphPlacement> placement = atlas.acquire(codepoint);
+    if(!placement) {
+      complete = false;
+      continue;
+    }
+    label.placements[i] = *placement;
+    label.acquired.push_back(codepoint);
+  }
+  for(uint32_t codepoint : previous)
+    atlas.release(codepoint, frameCount);
+  if(complete)
+    incompleteLabels.erase(id);
+  else
+    incompleteLabels.insert(id);
+  place(label);
+}
+
+void TextRenderer::place(Label& label) {
+  float scale = label.size / float(GlyphAtlas::GLYPH_SIZE);
+  for(uint32_t i = 0; i < label.count; ++i) {
+    const GlyphPlacement& placement = label.placements[i];
+    SpriteInstance& instance = instances[label.first + i];
+    if(placement.size.x == 0.0F) {
+      instance = EMPTY_INSTANCE;
+      continue;
+    }
+    glm::vec2 size = placement.size * scale;
+    glm::vec2 center = label.position + (label.run->glyphs[i].pen + placement.offset) * scale + size * 0.5F;
+    instance = {{size.x, 0.0F, center.x}, {0.0F, size.y, center.y}, packUvRect(placement.uvRect), label.color, 0};
+  }
+  markDirty(label.first, label.count);
+}
+
+uint32_t TextRenderer::allocateRange(uint32_t count) {
+  if(count == 0) return 0;
+  for(auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+    if(it->second < count) continue;
+    uint32_t first = it->first;
+    uint32_t remaining = it->second - count;
+    freeRanges.erase(it);
+    if(remaining > 0)
+      freeRanges.emplace(first + count, remaining);
+    return first;
+  }
+  if(count > capacity - instanceEnd)
+    throw std::runtime_error(std::to_string(glyphCount + count) + " glyphs exceed the text capacity of " +
+                             std::to_string(capacity));
+  uint32_t first = instanceEnd;
+  instanceEnd += count;
+  return first;
+}
+
+void TextRenderer::freeRange(uint32_t first, uint32_t count) {
+  if(count == 0) return;
+  std::fill_n(instances.begin() + first, count, EMPTY_INSTANCE);
+  markDirty(first, count);
+  auto next = freeRanges.find(first + count);
+  if(next != freeRanges.end()) {
+    count += next->second;
+    freeRanges.erase(next);
+  }
+  auto previous = freeRanges.lower_bound(first);
+  if(previous != freeRanges.begin() && std::prev(previous)->first + std::prev(previous)->second == first) {
+    --previous;
+    first = previous->first;
+    count += previous->second;
+    freeRanges.erase(previous);
+  }
+  // Ranges at the end shrink the draw instead.
+  if(first + count == instanceEnd)
+    instanceEnd = first;
+  else
+    freeRanges.emplace(first, count);
+}
+
+void TextRenderer::markDirty(uint32_t first, uint32_t count) {
+  if(count == 0) return;
+  for(Frame& frame : frames)
+    frame.dirtyRanges.emplace_back(first, count);
+}
@@ -0,0 +1,209 @@
+#ifndef VULKAN_TEXTRENDERER_H
+#define VULKAN_TEXTRENDERER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+
+#include "DescriptorAllocator.h"
+#include "GlyphAtlas.h"
+#include "Macros.h"
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "SpriteBatch.h"
+#include "UploadManager.h"
+
+/**
+ * A string laid out at GlyphAtlas::GLYPH_SIZE, relative to the top left corner of its first line.
+ */
+struct GlyphRun {
+  struct Glyph {
+    uint32_t codepoint;
+    // Pen position on the baseline.
+    glm::vec2 pen;
+  };
+
+  // Only glyphs with pixels, so every one becomes a quad.
+  std::vector<Glyph> glyphs;
+  glm::vec2 size;
+};
+
+/**
+ * Draws retained text labels in screen space with a single instanced draw.
+ *
+ * Strings are laid out once into GlyphRuns shared by every label showing them. Each label owns a fixed range of a
+ * persistent instance buffer per frame in flight, written only when the label changes, so a frame in which no label
+ * changed costs nothing beyond the draw itself. Glyphs come from a GlyphAtlas and are rendered from their distance
+ * fields by shaders/text.frag.
+ */
+class TextRenderer {
+
+public:
+  static constexpr uint32_t DEFAULT_CAPACITY = 1U << 16U;
+  // Runs no label uses anymore are dropped once the cache holds more than this.
+  static constexpr std::size_t RUN_CACHE_SIZE = 4096;
+
+  /**
+   * @param fragmentShader Compiled from shaders/text.frag.
+   * @param capacity How many glyphs all labels together can show.
+   * @throws std::runtime_error if the font can not be loaded.
+   */
+  TextRenderer(const vk::UniqueDevice& device, MemoryAllocator& allocator, DescriptorAllocator& descriptorAllocator,
+               UploadManager& uploadManager, vk::UniqueShaderModule fragmentShader, const fs::path& fontPath,
+               uint32_t framesInFlight, uint32_t capacity = DEFAULT_CAPACITY);
+
+  TextRenderer(const TextRenderer&) = delete;
+
+  TextRenderer& operator=(const TextRenderer&) = delete;
+
+  /**
+   * Gets the pipeline for renderPass from pipelineCache, drawing with the sprite vertex shader. Must be called again
+   * whenever the render pass changes.
+   */
+  void createPipeline(PipelineCache& pipelineCache, vk::RenderPass renderPass, vk::ShaderModule vertexShader);
+
+  /**
+   * Creates a label showing UTF-8 text with its top left corner at position, in pixels.
+   * @param size The height of an em in pixels.
+   * @param color RGBA8 as packed by packColor().
+   * @return An id for the other label methods.
+   * @throws std::runtime_error if the glyphs do not fit the capacity.
+   */
+  uint32_t createLabel(std::string_view text, const glm::vec2& position, float size, uint32_t color);
+
+  /**
+   * Changes the text of a label, doing nothing if it is unchanged.
+   * @throws std::runtime_error if the glyphs do not fit the capacity.
+   */
+  void setText(uint32_t label, std::string_view text);
+
+  void setPosition(uint32_t label, const glm::vec2& position);
+
+  void setColor(uint32_t label, uint32_t color);
+
+  void destroyLabel(uint32_t label);
+
+  /**
+   * @return The size of label's text in pixels.
+   */
+  glm::vec2 getSize(uint32_t label) const;
+
+  /**
+   * Copies the labels changed since the frame in flight frameIndex was last updated into its instance buffer. Called
+   * once per frame after the frame's previous submission finished.
+   */
+  void update(uint32_t frameIndex);
+
+  /**
+   * Draws every label of the frame in flight frameIndex inside a render pass with a dynamic viewport and scissor.
+   * @param pixelToNdc Scale in xy and offset in zw mapping pixels to normalized device coordinates.
+   */
+  void record(const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, const glm::vec4& pixelToNdc) const;
+
+  /**
+   * Lays out UTF-8 text, or returns the cached run if it was laid out before.
+   */
+  std::shared_ptr<const GlyphRun> getRun(std::string_view text);
+
+  uint32_t getLabelCount() const;
+
+  // Glyphs shown by every label.
+  uint32_t getGlyphCount() const;
+
+  // Strings laid out since creation, cache misses of getRun().
+  uint64_t getLayoutCount() const;
+
+  uint32_t getCapacity() const;
+
+  const GlyphAtlas& getAtlas() const;
+
+  /**
+   * Decodes UTF-8, replacing malformed sequences with U+FFFD.
+   */
+  static std::vector<uint32_t> decodeUtf8(std::string_view text);
+
+private:
+
+  struct Label {
+    std::shared_ptr<const GlyphRun> run;
+    glm::vec2 position;
+    float size;
+    uint32_t color;
+    // Instance range owned by the label, sized to its run.
+    uint32_t first = 0;
+    uint32_t count = 0;
+    // Where each glyph of the run lies in the atlas, zero sized if it is missing.
+    std::vector<GlyphPlacement> placements;
+    // Glyphs acquired from the atlas, released when the label changes.
+    std::vector<uint32_t> acquired;
+  };
+
+  struct Frame {
+    AllocatedBuffer instanceBuffer;
+    // Instance ranges changed since the frame was last updated.
+    std::vector<std::pair<uint32_t, uint32_t>> dirtyRanges;
+    uint32_t instanceCount = 0;
+  };
+
+  const vk::UniqueDevice& device;
+  MemoryAllocator& allocator;
+  GlyphAtlas atlas;
+  vk::UniqueShaderModule fragmentShader;
+  vk::UniqueSampler sampler;
+  vk::UniquePipelineLayout pipelineLayout;
+  // Owned by the descriptor allocator.
+  vk::DescriptorSet descriptorSet;
+  // Owned by the pipeline cache.
+  vk::Pipeline pipeline;
+  std::vector<Frame> frames;
+  uint32_t capacity;
+  // What the instance buffers should hold, copied into them range by range.
+  std::vector<SpriteInstance> instances;
+  // Free instance ranges below instanceEnd by first instance.
+  std::map<uint32_t, uint32_t> freeRanges;
+  uint32_t instanceEnd = 0;
+  std::unordered_map<uint32_t, Label> labels;
+  uint32_t nextLabel = 0;
+  // Labels missing glyphs because the atlas was full, retried every update.
+  std::unordered_set<uint32_t> incompleteLabels;
+  std::unordered_map<std::string, std::shared_ptr<const GlyphRun>> runs;
+  uint64_t layoutCount = 0;
+  uint32_t glyphCount = 0;
+  // Counts update() calls, the atlas frees glyphs by it.
+  uint64_t frameCount = 0;
+
+  std::shared_ptr<const GlyphRun> layout(const std::vector<uint32_t>& codepoints);
+
+  /**
+   * Moves label to an instance range of count glyphs, leaving it untouched if that does not fit.
+   */
+  void resize(Label& label, uint32_t count);
+
+  /**
+   * Acquires the glyphs of label's run and writes its instances, then releases the glyphs it used before.
+   */
+  void write(uint32_t id, Label& label);
+
+  /**
+   * Rewrites only the transforms and colors of a label whose glyphs did not change.
+   */
+  void place(Label& label);
+
+  uint32_t allocateRange(uint32_t count);
+
+  void freeRange(uint32_t first, uint32_t count);
+
+  void markDirty(uint32_t first, uint32_t count);
+
+};
+
+#endif
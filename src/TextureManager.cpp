@@ -0,0 +1,160 @@
+#include "TextureManager.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+TextureManager::TextureManager(const vk::UniqueDevice& device, MemoryAllocator& allocator,
+                               DescriptorAllocator& descriptorAllocator, UploadManager& uploadManager,
+                               uint32_t maxBindlessTextures)
+    : device(device), allocator(allocator), uploadManager(uploadManager),
+      capacity(std::min(maxBindlessTextures, MAX_TEXTURES)) {
+  vk::SamplerCreateInfo samplerCreateInfo = {{}, vk::Filter::eLinear, vk::Filter::eLinear,
+                                             vk::SamplerMipmapMode::eNearest, vk::SamplerAddressMode::eClampToEdge,
+                                             vk::SamplerAddressMode::eClampToEdge,
+                                             vk::SamplerAddressMode::eClampToEdge};
+  sampler = device->createSamplerUnique(samplerCreateInfo);
+  if(isBindless())
+    createBindless();
+  else
+    createPages(descriptorAllocator);
+}
+
+TextureRegion TextureManager::add(const void *rgba, uint32_t width, uint32_t height) {
+  if(width == 0 || height == 0)
+    throw std::runtime_error("textures must not be empty");
+  TextureRegion region = isBindless() ? addBindless(rgba, width, height) : addPacked(rgba, width, height);
+  ++textureCount;
+  return region;
+}
+
+vk::DescriptorSetLayout TextureManager::getDescriptorSetLayout() const {
+  return descriptorSetLayout;
+}
+
+vk::DescriptorSet TextureManager::getDescriptorSet() const {
+  return descriptorSet;
+}
+
+bool TextureManager::isBindless() const {
+  return capacity > 0;
+}
+
+uint32_t TextureManager::getTextureCount() const {
+  return textureCount;
+}
+
+float TextureManager::getOccupancy() const {
+  if(pages.empty()) return 0.0F;
+  float occupancy = 0.0F;
+  for(const SkylinePacker& page : pages)
+    occupancy += page.getOccupancy();
+  return occupancy / float(pages.size());
+}
+
+void TextureManager::createBindless() {
+  // Descriptors are only written for added textures, and while frames in flight have the set bound.
+  vk::DescriptorBindingFlagsEXT bindingFlags = vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+                                               vk::DescriptorBindingFlagBitsEXT::ePartiallyBound;
+  vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo = {1, &bindingFlags};
+  vk::DescriptorSetLayoutBinding binding = {0, vk::DescriptorType::eCombinedImageSampler, capacity,
+                                            vk::ShaderStageFlagBits::eFragment};
+  vk::DescriptorSetLayoutCreateInfo layoutCreateInfo = {vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT,
+                                                        1, &binding};
+  layoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+  bindlessSetLayout = device->createDescriptorSetLayoutUnique(layoutCreateInfo);
+  descriptorSetLayout = bindlessSetLayout.get();
+
+  vk::DescriptorPoolSize poolSize = {vk::DescriptorType::eCombinedImageSampler, capacity};
+  bindlessPool = device->createDescriptorPoolUnique({vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT, 1, 1,
+                                                     &poolSize});
+  descriptorSet = device->allocateDescriptorSets({bindlessPool.get(), 1, &descriptorSetLayout}).front();
+}
+
+void TextureManager::createPages(DescriptorAllocator& descriptorAllocator) {
+  // Textures are packed on the graphics queue, so only the initial transition moves the pages over from the transfer
+  // queue.
+  vk::ImageCreateInfo imageCreateInfo = {{}, vk::ImageType::e2D, vk::Format::eR8G8B8A8Unorm,
+                                         {PAGE_SIZE, PAGE_SIZE, 1}, 1, PAGE_COUNT, vk::SampleCountFlagBits::e1,
+                                         vk::ImageTiling::eOptimal,
+                                         vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                                         vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined};
+  images.push_back(allocator.createImage(imageCreateInfo, MemoryUsage::eGpuOnly));
+  vk::ImageViewCreateInfo imageViewCreateInfo = {{}, images.back().image.get(), vk::ImageViewType::e2DArray,
+                                                 vk::Format::eR8G8B8A8Unorm, {},
+                                                 {vk::ImageAspectFlagBits::eColor, 0, 1, 0, PAGE_COUNT}};
+  imageViews.push_back(device->createImageViewUnique(imageViewCreateInfo));
+  // Transitions every page, the texels nothing is packed into are never sampled.
+  std::array<uint8_t, 4> texel = {0, 0, 0, 0};
+  uploadManager.uploadImage(images.back().image.get(), texel.data(), texel.size(), {1, 1, 1},
+                            vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+  pages.assign(PAGE_COUNT, SkylinePacker(PAGE_SIZE, PAGE_SIZE));
+
+  descriptorSetLayout = descriptorAllocator.getLayout(
+      {vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eCombinedImageSampler, 1,
+                                      vk::ShaderStageFlagBits::eFragment}});
+  descriptorSet = descriptorAllocator.getCachedSet(
+      descriptorSetLayout, DescriptorBindings().image(0, vk::DescriptorType::eCombinedImageSampler, sampler.get(),
+                                                      imageViews.back().get(),
+                                                      vk::ImageLayout::eShaderReadOnlyOptimal));
+}
+
+TextureRegion TextureManager::addBindless(const void *rgba, uint32_t width, uint32_t height) {
+  if(textureCount == capacity)
+    throw std::runtime_error("no room for more than " + std::to_string(capacity) + " textures");
+  vk::ImageCreateInfo imageCreateInfo = {{}, vk::ImageType::e2D, vk::Format::eR8G8B8A8Unorm, {width, height, 1}, 1, 1,
+                                         vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal,
+                                         vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                                         vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined};
+  images.push_back(allocator.createImage(imageCreateInfo, MemoryUsage::eGpuOnly));
+  vk::ImageViewCreateInfo imageViewCreateInfo = {{}, images.back().image.get(), vk::ImageViewType::e2D,
+                                                 vk::Format::eR8G8B8A8Unorm, {},
+                                                 {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1}};
+  imageViews.push_back(device->createImageViewUnique(imageViewCreateInfo));
+  uploadManager.uploadImage(images.back().image.get(), rgba, vk::DeviceSize(width) * height * 4, {width, height, 1},
+                            vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+  vk::DescriptorImageInfo imageInfo = {sampler.get(), imageViews.back().get(),
+                                       vk::ImageLayout::eShaderReadOnlyOptimal};
+  vk::WriteDescriptorSet write = {descriptorSet, 0, textureCount, 1, vk::DescriptorType::eCombinedImageSampler,
+                                  &imageInfo};
+  device->updateDescriptorSets(1, &write, 0, nullptr);
+  return {textureCount + 1, glm::vec4(0.0F, 0.0F, 1.0F, 1.0F)};
+}
+
+TextureRegion TextureManager::addPacked(const void *rgba, uint32_t width, uint32_t height) {
+  uint32_t paddedWidth = width + 2 * BORDER;
+  uint32_t paddedHeight = height + 2 * BORDER;
+  if(paddedWidth > PAGE_SIZE || paddedHeight > PAGE_SIZE)
+    throw std::runtime_error("a " + std::to_string(width) + "x" + std::to_string(height) +
+                             " texture does not fit an atlas page");
+  uint32_t page = 0;
+  std::optional<glm::uvec2> position;
+  for(; page < PAGE_COUNT && !position; ++page)
+    position = pages[page].pack(paddedWidth, paddedHeight);
+  if(!position)
+    throw std::runtime_error("the atlas pages are full");
+  --page;
+
+  // Extrudes the edge texels into the border.
+  auto texels = static_cast<const uint8_t *>(rgba);
+  std::vector<uint32_t> padded(std::size_t(paddedWidth) * paddedHeight);
+  for(uint32_t y = 0; y < paddedHeight; ++y) {
+    uint32_t sourceY = std::min(std::max(y, BORDER) - BORDER, height - 1);
+    for(uint32_t x = 0; x < paddedWidth; ++x) {
+      uint32_t sourceX = std::min(std::max(x, BORDER) - BORDER, width - 1);
+      std::memcpy(&padded[std::size_t(y) * paddedWidth + x], &texels[(std::size_t(sourceY) * width + sourceX) * 4],
+                  sizeof(uint32_t));
+    }
+  }
+  // Frames in flight may be sampling the other textures of the pages, so the copy waits for them.
+  uploadManager.updateImage(images.front().image.get(), padded.data(), padded.size() * sizeof(uint32_t),
+                            {paddedWidth, paddedHeight, 1}, {int32_t(position->x), int32_t(position->y), 0}, page);
+
+  glm::vec2 topLeft = glm::vec2(float(position->x + BORDER), float(position->y + BORDER)) / float(PAGE_SIZE);
+  glm::vec2 size = glm::vec2(float(width), float(height)) / float(PAGE_SIZE);
+  return {page + 1, glm::vec4(topLeft, topLeft + size)};
+}
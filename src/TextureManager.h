@@ -0,0 +1,102 @@
+#ifndef VULKAN_TEXTUREMANAGER_H
+#define VULKAN_TEXTUREMANAGER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "SkylinePacker.h"
+#include "UploadManager.h"
+
+/**
+ * Where a texture added to a TextureManager lies, as set on a SpriteInstance.
+ */
+struct TextureRegion {
+  uint32_t textureIndex;
+  glm::vec4 uvRect;
+};
+
+/**
+ * Every texture sprites sample, behind a single descriptor set bound once per command buffer, so sprites differing only
+ * in texture still share a draw. Sprites select a texture by the index in their instance, 0 draws them untextured.
+ *
+ * With descriptor indexing, every texture is an image of its own in a large array of descriptors, written as textures
+ * are added while the set stays bound. Without it, shaders can not select a descriptor per sprite, so textures are
+ * packed into the layers of one array image instead, each surrounded by a copy of its edge texels so filtering never
+ * picks up its neighbours.
+ *
+ * Textures live as long as the manager. The bindless set comes from a pool of its own, as only pools created for it can
+ * hold sets updated after binding.
+ */
+class TextureManager {
+
+public:
+  // Upper bound of bindless textures, the device's limits may allow fewer.
+  static constexpr uint32_t MAX_TEXTURES = 4096;
+  static constexpr uint32_t PAGE_SIZE = 1024;
+  static constexpr uint32_t PAGE_COUNT = 8;
+  // Texels repeated around every packed texture.
+  static constexpr uint32_t BORDER = 1;
+
+  /**
+   * @param maxBindlessTextures How many textures the device can bind at once with descriptor indexing, 0 to pack them
+   * into atlas pages instead.
+   */
+  TextureManager(const vk::UniqueDevice& device, MemoryAllocator& allocator, DescriptorAllocator& descriptorAllocator,
+                 UploadManager& uploadManager, uint32_t maxBindlessTextures);
+
+  TextureManager(const TextureManager&) = delete;
+
+  TextureManager& operator=(const TextureManager&) = delete;
+
+  /**
+   * Uploads a texture of tightly packed 8 bit RGBA texels. It can be drawn from the next frame submitted on.
+   * @throws std::runtime_error if there is no room left for it.
+   */
+  TextureRegion add(const void *rgba, uint32_t width, uint32_t height);
+
+  vk::DescriptorSetLayout getDescriptorSetLayout() const;
+
+  vk::DescriptorSet getDescriptorSet() const;
+
+  bool isBindless() const;
+
+  uint32_t getTextureCount() const;
+
+  // Share of the atlas pages covered by textures, 0 when bindless.
+  float getOccupancy() const;
+
+private:
+
+  const vk::UniqueDevice& device;
+  MemoryAllocator& allocator;
+  UploadManager& uploadManager;
+  uint32_t capacity;
+  vk::UniqueSampler sampler;
+  // Owned by the descriptor allocator unless bindless.
+  vk::DescriptorSetLayout descriptorSetLayout;
+  vk::UniqueDescriptorSetLayout bindlessSetLayout;
+  vk::UniqueDescriptorPool bindlessPool;
+  vk::DescriptorSet descriptorSet;
+  // One per texture when bindless, else the atlas pages.
+  std::vector<AllocatedImage> images;
+  std::vector<vk::UniqueImageView> imageViews;
+  std::vector<SkylinePacker> pages;
+  uint32_t textureCount = 0;
+
+  void createBindless();
+
+  void createPages(DescriptorAllocator& descriptorAllocator);
+
+  TextureRegion addBindless(const void *rgba, uint32_t width, uint32_t height);
+
+  TextureRegion addPacked(const void *rgba, uint32_t width, uint32_t height);
+
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include "Trace.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+  threads.reserve(threadCount);
+  for(uint32_t i = 0; i < threadCount; ++i)
+    threads.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  condition.notify_all();
+  for(auto& thread : threads)
+    thread.join();
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& function) {
+  std::atomic<uint32_t> next = 0;
+  auto run = [&]() {
+    for(uint32_t i = next++; i < count; i = next++)
+      function(i);
+  };
+
+  // The calling thread takes part, so it never idles while waiting for the workers.
+  uint32_t helperCount = std::min(count > 0 ? count - 1 : 0, getThreadCount());
+  std::vector<std::future<void>> helpers;
+  helpers.reserve(helperCount);
+  for(uint32_t i = 0; i < helperCount; ++i)
+    helpers.push_back(submit(run));
+
+  std::exception_ptr exception;
+  try {
+    run();
+  } catch(...) {
+    exception = std::current_exception();
+    // Keep the helpers from picking up further indices.
+    next = count;
+  }
+  // The helpers reference this stack frame, so all of them are waited for before anything is rethrown.
+  for(auto& helper : helpers) {
+    try {
+      helper.get();
+    } catch(...) {
+      if(!exception)
+        exception = std::current_exception();
+      next = count;
+    }
+  }
+  if(exception)
+    std::rethrow_exception(exception);
+}
+
+uint32_t ThreadPool::getThreadCount() const {
+  return static_cast<uint32_t>(threads.size());
+}
+
+uint32_t ThreadPool::getDefaultThreadCount() {
+  uint32_t hardwareThreads = std::thread::hardware_concurrency();
+  return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+void ThreadPool::work() {
+  TRACE_THREAD_NAME("worker");
+  for(;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if(tasks.empty()) return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef VULKAN_THREADPOOL_H
+#define VULKAN_THREADPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A fixed set of worker threads executing tasks in submission order.
+ */
+class ThreadPool {
+
+public:
+
+  /**
+   * @param threadCount The number of workers, may be 0 in which case parallelFor() runs on the calling thread only.
+   */
+  explicit ThreadPool(uint32_t threadCount = getDefaultThreadCount());
+
+  /**
+   * Finishes every queued task before joining the workers.
+   */
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * Queues a task. Exceptions thrown by it are rethrown by the returned future.
+   */
+  template<class F>
+  std::future<std::invoke_result_t<F>> submit(F&& task) {
+    // std::function needs a copyable target, a packaged_task is move only.
+    auto packagedTask = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(task));
+    std::future<std::invoke_result_t<F>> future = packagedTask->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace_back([packagedTask]() { (*packagedTask)(); });
+    }
+    condition.notify_one();
+    return future;
+  }
+
+  /**
+   * Calls function(i) for every i in [0, count) on the workers and the calling thread, returning once all calls
+   * returned. The first exception thrown by any call is rethrown.
+   */
+  void parallelFor(uint32_t count, const std::function<void(uint32_t)>& function);
+
+  uint32_t getThreadCount() const;
+
+  /**
+   * @return One worker per hardware thread besides the calling one.
+   */
+  static uint32_t getDefaultThreadCount();
+
+private:
+  std::vector<std::thread> threads;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping = false;
+
+  void work();
+
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "Trace.h"
+
+#ifdef VULKAN_TRACING
+
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+  // How often the rings are drained. At 64k events per ring this leaves plenty of headroom.
+  constexpr std::chrono::milliseconds DRAIN_INTERVAL{10};
+
+  struct Drain {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::unique_ptr<Trace::Ring>> rings;
+    std::thread thread;
+    std::ofstream file;
+    // Ticks and steady clock time when tracing started, to convert ticks into time.
+    uint64_t origin = 0;
+    std::chrono::steady_clock::time_point originTime;
+    bool stopping = false;
+    bool firstEvent = true;
+
+    ~Drain() {
+      // Only reached if Trace::stop() was never called, the file is left incomplete then.
+      if(!thread.joinable()) return;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      condition.notify_all();
+      thread.join();
+    }
+  };
+
+  Drain& getDrain() {
+    static Drain drain;
+    return drain;
+  }
+
+  // Set by TRACE_THREAD_NAME, handed to the thread's ring whenever it is registered.
+  thread_local const char *currentThreadName = nullptr;
+
+  struct DrainedEvent {
+    Trace::Event event;
+    uint32_t threadId;
+  };
+
+  void writeName(std::ostream& out, const char *name) {
+    for(const char *c = name; *c; ++c) {
+      if(*c == '"' || *c == '\\')
+        out << '\\';
+      out << *c;
+    }
+  }
+
+  /**
+   * Moves everything recorded since the last call into events. Called with the drain's mutex held, so it only copies.
+   */
+  void collectEvents(Drain& drain, std::vector<DrainedEvent>& events) {
+    for(const auto& ring : drain.rings) {
+      uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+      uint64_t head = ring->head.load(std::memory_order_acquire);
+      for(uint64_t i = tail; i < head; ++i)
+        events.push_back({ring->events[i % Trace::RING_CAPACITY], ring->threadId});
+      ring->tail.store(head, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Writes events collected by collectEvents(). Called without the mutex, so threads registering their rings never
+   * wait for the file.
+   */
+  void writeEvents(Drain& drain, const std::vector<DrainedEvent>& events) {
+    // The longer tracing runs the more precise the tick rate gets.
+    uint64_t ticks = Trace::now() - drain.origin;
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - drain.originTime;
+    double microsecondsPerTick = ticks > 0 ? elapsed.count() / double(ticks) : 0.0;
+    for(const auto& [event, threadId] : events) {
+      if(event.start < drain.origin) continue;
+      drain.file << (drain.firstEvent ? "" : ",\n") << R"({"name":")";
+      writeName(drain.file, event.name);
+      drain.file << R"(","cat":"cpu","ph":"X","pid":0,"tid":)" << threadId << R"(,"ts":)"
+                 << double(event.start - drain.origin) * microsecondsPerTick << R"(,"dur":)"
+                 << double(event.end - event.start) * microsecondsPerTick << "}";
+      drain.firstEvent = false;
+    }
+  }
+
+}
+
+std::atomic<bool> Trace::enabled = false;
+
+void Trace::start(const fs::path& path) {
+  Drain& drain = getDrain();
+  std::lock_guard<std::mutex> lock(drain.mutex);
+  if(drain.thread.joinable()) return;
+  drain.file.open(path, std::ios_base::trunc);
+  if(!drain.file)
+    throw std::runtime_error("could not open trace file " + path.string());
+  drain.file << std::fixed << std::setprecision(3);
+  drain.file << R"({"displayTimeUnit":"ms","traceEvents":[)" << '\n';
+  drain.origin = now();
+  drain.originTime = std::chrono::steady_clock::now();
+  drain.stopping = false;
+  drain.firstEvent = true;
+  // Discard whatever was recorded by an earlier trace.
+  for(const auto& ring : drain.rings)
+    ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+  enabled = true;
+
+  drain.thread = std::thread([&drain]() {
+    std::vector<DrainedEvent> events;
+    std::unique_lock<std::mutex> lock(drain.mutex);
+    while(!drain.stopping) {
+      drain.condition.wait_for(lock, DRAIN_INTERVAL);
+      events.clear();
+      collectEvents(drain, events);
+      lock.unlock();
+      writeEvents(drain, events);
+      lock.lock();
+    }
+  });
+}
+
+void Trace::stop() {
+  Drain& drain = getDrain();
+  {
+    std::lock_guard<std::mutex> lock(drain.mutex);
+    if(!drain.thread.joinable()) return;
+    enabled = false;
+    drain.stopping = true;
+  }
+  drain.condition.notify_all();
+  drain.thread.join();
+
+  std::lock_guard<std::mutex> lock(drain.mutex);
+  std::vector<DrainedEvent> events;
+  collectEvents(drain, events);
+  writeEvents(drain, events);
+  uint64_t dropped = 0;
+  for(const auto& ring : drain.rings) {
+    const char *threadName = ring->threadName.load();
+    if(threadName) {
+      drain.file << (drain.firstEvent ? "" : ",\n") << R"({"name":"thread_name","ph":"M","pid":0,"tid":)"
+                 << ring->threadId << R"(,"args":{"name":")";
+      writeName(drain.file, threadName);
+      drain.file << "\"}}";
+      drain.firstEvent = false;
+    }
+    dropped += ring->dropped.exchange(0);
+  }
+  drain.file << "\n]}\n";
+  drain.file.close();
+  if(dropped > 0)
+    std::cerr << "Dropped " << dropped << " trace events, the trace buffers ran full" << std::endl;
+}
+
+void Trace::setThreadName(const char *name) {
+  // Only threads that record while tracing need a ring, naming one registers none.
+  currentThreadName = name;
+  if(Ring *ring = getThreadRing())
+    ring->threadName = name;
+}
+
+Trace::Ring *Trace::registerRing() {
+  Drain& drain = getDrain();
+  std::lock_guard<std::mutex> lock(drain.mutex);
+  drain.rings.push_back(std::make_unique<Ring>());
+  drain.rings.back()->threadId = uint32(drain.rings.size());
+  drain.rings.back()->threadName = currentThreadName;
+  return drain.rings.back().get();
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef VULKAN_TRACE_H
+#define VULKAN_TRACE_H
+
+/**
+ * CPU instrumentation. TRACE_SCOPE("name") times the rest of the enclosing block, TRACE_FUNCTION() the enclosing
+ * function. Names must be string literals. Without VULKAN_TRACING defined every macro expands to nothing and none of
+ * the tracing code is compiled.
+ */
+#ifdef VULKAN_TRACING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Macros.h"
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+
+/**
+ * Every thread records its scopes into its own fixed size ring buffer without locking, which a background thread
+ * drains into a Chrome trace_event JSON file. Scopes are dropped while tracing is stopped or a ring is full.
+ */
+class Trace {
+
+public:
+  static constexpr std::size_t RING_CAPACITY = std::size_t(1) << 16U;
+
+  struct Event {
+    const char *name;
+    // Ticks of now().
+    uint64_t start;
+    uint64_t end;
+  };
+
+  /**
+   * Single producer, single consumer ring owned by one thread.
+   */
+  struct Ring {
+    std::array<Event, RING_CAPACITY> events;
+    // Only written by the owning thread.
+    alignas(64) std::atomic<uint64_t> head = 0;
+    // The owning thread's last view of tail, so it only touches the draining thread's cache line when full.
+    uint64_t cachedTail = 0;
+    // Only written by the draining thread.
+    alignas(64) std::atomic<uint64_t> tail = 0;
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<const char *> threadName = nullptr;
+    uint32_t threadId = 0;
+  };
+
+  class Scope {
+
+  public:
+    explicit Scope(const char *name) : name(name), start(now()) {
+    }
+
+    ~Scope() {
+      record(name, start, now());
+    }
+
+    Scope(const Scope&) = delete;
+
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const char *name;
+    uint64_t start;
+
+  };
+
+  /**
+   * Starts the thread draining every ring into path, truncating it.
+   * @throws std::runtime_error if the file cannot be opened.
+   */
+  static void start(const fs::path& path);
+
+  /**
+   * Drains what is left, completes the file and joins the draining thread.
+   */
+  static void stop();
+
+  static void setThreadName(const char *name);
+
+  /**
+   * @return A timestamp in ticks. The time stamp counter is read directly where available, as it costs a fraction of
+   * a steady clock query; ticks are converted to time when drained.
+   */
+  static uint64_t now() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+  }
+
+  static void record(const char *name, uint64_t start, uint64_t end) {
+    if(!enabled.load(std::memory_order_relaxed)) return;
+    Ring& ring = getRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if(head - ring.cachedTail >= RING_CAPACITY) {
+      ring.cachedTail = ring.tail.load(std::memory_order_acquire);
+      if(head - ring.cachedTail >= RING_CAPACITY) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    ring.events[head % RING_CAPACITY] = {name, start, end};
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+private:
+  static std::atomic<bool> enabled;
+
+  static Ring& getRing() {
+    Ring *&ring = getThreadRing();
+    if(!ring)
+      ring = registerRing();
+    return *ring;
+  }
+
+  /**
+   * @return The calling thread's ring, nullptr until it first records.
+   */
+  static Ring *&getThreadRing() {
+    thread_local Ring *ring = nullptr;
+    return ring;
+  }
+
+  /**
+   * Creates the calling thread's ring. Rings outlive their threads so nothing recorded is lost.
+   */
+  static Ring *registerRing();
+
+};
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_FUNCTION()
+#define TRACE_THREAD_NAME(name)
+
+#endif
+
+#endif
@@ -0,0 +1,259 @@
+#include "TransformSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+#if defined(__AVX__)
+  using Vector = __m256;
+  constexpr uint32_t WIDTH = 8;
+
+  inline Vector load(const float *values) { return _mm256_loadu_ps(values); }
+
+  inline void store(float *values, Vector vector) { _mm256_storeu_ps(values, vector); }
+
+  inline Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+
+  inline Vector sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+
+  inline Vector mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+#elif defined(__SSE2__) || defined(_M_X64)
+  using Vector = __m128;
+  constexpr uint32_t WIDTH = 4;
+
+  inline Vector load(const float *values) { return _mm_loadu_ps(values); }
+
+  inline void store(float *values, Vector vector) { _mm_storeu_ps(values, vector); }
+
+  inline Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+
+  inline Vector sub(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+
+  inline Vector mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+#else
+  using Vector = float;
+  constexpr uint32_t WIDTH = 1;
+
+  inline Vector load(const float *values) { return *values; }
+
+  inline void store(float *values, Vector vector) { *values = vector; }
+
+  inline Vector add(Vector a, Vector b) { return a + b; }
+
+  inline Vector sub(Vector a, Vector b) { return a - b; }
+
+  inline Vector mul(Vector a, Vector b) { return a * b; }
+#endif
+
+  static_assert(TransformSystem::LANES % WIDTH == 0, "a block must hold whole vectors");
+
+}
+
+uint32_t TransformSystem::create(uint32_t parent) {
+  if(parent != NO_PARENT && parent >= count)
+    throw std::out_of_range("parent node " + std::to_string(parent) + " does not exist");
+  uint32_t node = count++;
+  if(node % LANES == 0) {
+    // Padding nodes are never dirty or drawn, they only keep whole blocks readable.
+    std::size_t padded = node + LANES;
+    positionX.resize(padded, 0.0F);
+    positionY.resize(padded, 0.0F);
+    cosines.resize(padded, 1.0F);
+    sines.resize(padded, 0.0F);
+    scaleX.resize(padded, 1.0F);
+    scaleY.resize(padded, 1.0F);
+    parents.resize(padded, NO_PARENT);
+    dirty.resize(padded, 0);
+    worldA.resize(padded, 1.0F);
+    worldB.resize(padded, 0.0F);
+    worldC.resize(padded, 0.0F);
+    worldD.resize(padded, 0.0F);
+    worldE.resize(padded, 1.0F);
+    worldF.resize(padded, 0.0F);
+    drawn.resize(padded, 0);
+    colors.resize(padded, 0);
+    uvRects.resize(padded, packUvRect({0.0F, 0.0F, 1.0F, 1.0F}));
+    textureIndices.resize(padded, 0);
+  }
+  parents[node] = parent;
+  dirty[node] = 1;
+  changed = true;
+  return node;
+}
+
+void TransformSystem::setPosition(uint32_t node, const glm::vec2& position) {
+  positionX[node] = position.x;
+  positionY[node] = position.y;
+  dirty[node] = 1;
+  changed = true;
+}
+
+void TransformSystem::setRotation(uint32_t node, float rotation) {
+  cosines[node] = std::cos(rotation);
+  sines[node] = std::sin(rotation);
+  dirty[node] = 1;
+  changed = true;
+}
+
+void TransformSystem::setScale(uint32_t node, const glm::vec2& scale) {
+  scaleX[node] = scale.x;
+  scaleY[node] = scale.y;
+  dirty[node] = 1;
+  changed = true;
+}
+
+void TransformSystem::setSprite(uint32_t node, uint32_t color, const glm::vec4& uvRect, uint32_t textureIndex) {
+  if(!drawn[node])
+    ++spriteCount;
+  drawn[node] = 1;
+  colors[node] = color;
+  uvRects[node] = packUvRect(uvRect);
+  textureIndices[node] = textureIndex;
+}
+
+void TransformSystem::clear() {
+  *this = TransformSystem();
+}
+
+void TransformSystem::update() {
+  updatedCount = 0;
+  if(!changed) return;
+  changed = false;
+  // Parents precede their children, so this dirties whole subtrees in one pass.
+  for(uint32_t i = 0; i < count; ++i)
+    if(parents[i] != NO_PARENT)
+      dirty[i] |= dirty[parents[i]];
+
+  static_assert(LANES == sizeof(uint64_t), "a block's dirty flags are tested as one word");
+  for(uint32_t first = 0; first < count; first += LANES) {
+    uint64_t flags;
+    std::memcpy(&flags, &dirty[first], sizeof(flags));
+    if(flags == 0) continue;
+    composeBlock(first);
+    updatedCount += std::min(LANES, count - first);
+  }
+  std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+void TransformSystem::write(SpriteInstance *instances) const {
+  for(uint32_t i = 0; i < count; ++i) {
+    if(!drawn[i]) continue;
+    // Write the whole instance at once, the mapped memory is likely write combined.
+    *instances++ = {{worldA[i], worldB[i], worldC[i]}, {worldD[i], worldE[i], worldF[i]}, uvRects[i], colors[i],
+                    textureIndices[i]};
+  }
+}
+
+void TransformSystem::draw(SpriteBatch& spriteBatch) const {
+  if(spriteCount == 0) return;
+  if(SpriteInstance *instances = spriteBatch.allocate(spriteCount))
+    write(instances);
+}
+
+std::pair<glm::vec3, glm::vec3> TransformSystem::getWorldTransform(uint32_t node) const {
+  return {{worldA[node], worldB[node], worldC[node]}, {worldD[node], worldE[node], worldF[node]}};
+}
+
+uint32_t TransformSystem::size() const {
+  return count;
+}
+
+uint32_t TransformSystem::getSpriteCount() const {
+  return spriteCount;
+}
+
+uint32_t TransformSystem::getUpdatedCount() const {
+  return updatedCount;
+}
+
+void TransformSystem::composeBlock(uint32_t first) {
+  // Parent transforms gathered into lanes, identity for roots.
+  alignas(32) float parentA[LANES], parentB[LANES], parentC[LANES], parentD[LANES], parentE[LANES], parentF[LANES];
+  uint32_t fixups = 0;
+  for(uint32_t lane = 0; lane < LANES; ++lane) {
+    uint32_t parent = parents[first + lane];
+    // A parent in this block is not composed yet, so the lane is redone once it is.
+    if(parent != NO_PARENT && parent >= first)
+      fixups |= 1U << lane;
+    if(parent == NO_PARENT || parent >= first) {
+      parentA[lane] = 1.0F;
+      parentB[lane] = 0.0F;
+      parentC[lane] = 0.0F;
+      parentD[lane] = 0.0F;
+      parentE[lane] = 1.0F;
+      parentF[lane] = 0.0F;
+    } else {
+      parentA[lane] = worldA[parent];
+      parentB[lane] = worldB[parent];
+      parentC[lane] = worldC[parent];
+      parentD[lane] = worldD[parent];
+      parentE[lane] = worldE[parent];
+      parentF[lane] = worldF[parent];
+    }
+  }
+
+  for(uint32_t lane = 0; lane < LANES; lane += WIDTH) {
+    uint32_t i = first + lane;
+    Vector cos = load(&cosines[i]);
+    Vector sin = load(&sines[i]);
+    Vector sx = load(&scaleX[i]);
+    Vector sy = load(&scaleY[i]);
+    Vector x = load(&positionX[i]);
+    Vector y = load(&positionY[i]);
+    // The local transform is [cos*sx -sin*sy x] [sin*sx cos*sy y].
+    Vector localA = mul(cos, sx);
+    Vector negatedLocalB = mul(sin, sy);
+    Vector localD = mul(sin, sx);
+    Vector localE = mul(cos, sy);
+    Vector a = load(&parentA[lane]);
+    Vector b = load(&parentB[lane]);
+    Vector d = load(&parentD[lane]);
+    Vector e = load(&parentE[lane]);
+    store(&worldA[i], add(mul(a, localA), mul(b, localD)));
+    store(&worldB[i], sub(mul(b, localE), mul(a, negatedLocalB)));
+    store(&worldC[i], add(add(mul(a, x), mul(b, y)), load(&parentC[lane])));
+    store(&worldD[i], add(mul(d, localA), mul(e, localD)));
+    store(&worldE[i], sub(mul(e, localE), mul(d, negatedLocalB)));
+    store(&worldF[i], add(add(mul(d, x), mul(e, y)), load(&parentF[lane])));
+  }
+
+  // In lane order, so a parent that needs fixing up itself is fixed before its children.
+  for(uint32_t lane = 0; fixups != 0; ++lane, fixups >>= 1U)
+    if(fixups & 1U)
+      composeNode(first + lane);
+}
+
+void TransformSystem::composeNode(uint32_t node) {
+  float localA = cosines[node] * scaleX[node];
+  float localB = -sines[node] * scaleY[node];
+  float localD = sines[node] * scaleX[node];
+  float localE = cosines[node] * scaleY[node];
+  float x = positionX[node];
+  float y = positionY[node];
+  uint32_t parent = parents[node];
+  if(parent == NO_PARENT) {
+    worldA[node] = localA;
+    worldB[node] = localB;
+    worldC[node] = x;
+    worldD[node] = localD;
+    worldE[node] = localE;
+    worldF[node] = y;
+    return;
+  }
+  float a = worldA[parent], b = worldB[parent], c = worldC[parent];
+  float d = worldD[parent], e = worldE[parent], f = worldF[parent];
+  worldA[node] = a * localA + b * localD;
+  worldB[node] = a * localB + b * localE;
+  worldC[node] = a * x + b * y + c;
+  worldD[node] = d * localA + e * localD;
+  worldE[node] = d * localB + e * localE;
+  worldF[node] = d * x + e * y + f;
+}
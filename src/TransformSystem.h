@@ -0,0 +1,120 @@
+#ifndef VULKAN_TRANSFORMSYSTEM_H
+#define VULKAN_TRANSFORMSYSTEM_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "SpriteBatch.h"
+
+/**
+ * Hierarchies of 2D transforms stored as structure of arrays, whose world transforms are composed LANES nodes at a
+ * time and written straight into sprite instances.
+ *
+ * A node's local transform scales, then rotates, then translates; its world transform applies its parent's world
+ * transform on top, so children are positioned in their parent's units. A drawn node's world transform maps the unit
+ * quad, so its scale is the sprite's size in pixels when it has no scaled ancestors.
+ *
+ * Parents are always created before their children, so a single pass in node order visits every parent first. Only
+ * blocks of LANES nodes holding a changed node or a descendant of one are recomputed, with AVX if compiled for it, else
+ * with SSE2 where available. Nodes whose parent lies in the same block are fixed up one by one afterwards.
+ */
+class TransformSystem {
+
+public:
+  // Nodes composed at once, the arrays are padded to a multiple of it.
+  static constexpr uint32_t LANES = 8;
+  static constexpr uint32_t NO_PARENT = ~0U;
+
+  /**
+   * Creates a node at the origin with a rotation of 0 and a scale of 1. Nodes live until clear().
+   * @param parent An existing node, or NO_PARENT for a root.
+   * @return The id of the node, ids are handed out in order.
+   * @throws std::out_of_range if parent does not exist.
+   */
+  uint32_t create(uint32_t parent = NO_PARENT);
+
+  void setPosition(uint32_t node, const glm::vec2& position);
+
+  /**
+   * @param rotation Radians, clockwise on screen.
+   */
+  void setRotation(uint32_t node, float rotation);
+
+  void setScale(uint32_t node, const glm::vec2& scale);
+
+  /**
+   * Draws node as a sprite from now on.
+   */
+  void setSprite(uint32_t node, uint32_t color, const glm::vec4& uvRect = {0, 0, 1, 1}, uint32_t textureIndex = 0);
+
+  void clear();
+
+  /**
+   * Recomputes the world transforms of the nodes changed since the last update and of their descendants.
+   */
+  void update();
+
+  /**
+   * Writes an instance for every drawn node, in node order.
+   * @param instances Room for getSpriteCount() instances.
+   */
+  void write(SpriteInstance *instances) const;
+
+  /**
+   * Writes an instance for every drawn node into spriteBatch.
+   */
+  void draw(SpriteBatch& spriteBatch) const;
+
+  /**
+   * @return The rows of node's world transform as of the last update().
+   */
+  std::pair<glm::vec3, glm::vec3> getWorldTransform(uint32_t node) const;
+
+  uint32_t size() const;
+
+  uint32_t getSpriteCount() const;
+
+  // Nodes the last update() recomputed, including the clean ones sharing a block with changed ones.
+  uint32_t getUpdatedCount() const;
+
+private:
+
+  std::vector<float> positionX;
+  std::vector<float> positionY;
+  // Rotations are kept as their cosine and sine, so composing needs no trigonometry.
+  std::vector<float> cosines;
+  std::vector<float> sines;
+  std::vector<float> scaleX;
+  std::vector<float> scaleY;
+  std::vector<uint32_t> parents;
+  std::vector<uint8_t> dirty;
+  // Rows of the world transforms, [a b c] and [d e f].
+  std::vector<float> worldA;
+  std::vector<float> worldB;
+  std::vector<float> worldC;
+  std::vector<float> worldD;
+  std::vector<float> worldE;
+  std::vector<float> worldF;
+  std::vector<uint8_t> drawn;
+  std::vector<uint32_t> colors;
+  std::vector<glm::u16vec4> uvRects;
+  std::vector<uint32_t> textureIndices;
+  uint32_t count = 0;
+  uint32_t spriteCount = 0;
+  uint32_t updatedCount = 0;
+  // Whether any node is dirty.
+  bool changed = false;
+
+  /**
+   * Composes the world transforms of the LANES nodes starting at first.
+   */
+  void composeBlock(uint32_t first);
+
+  void composeNode(uint32_t node);
+
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include "UploadManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "Macros.h"
+#include "Trace.h"
+#include "VkUtils.h"
+
+UploadManager::UploadManager(const vk::UniqueDevice& device, MemoryAllocator& allocator, vk::Queue transferQueue,
+                             vk::Queue graphicsQueue, uint32_t transferQueueFamilyIndex,
+                             uint32_t graphicsQueueFamilyIndex, vk::DeviceSize stagingSize)
+    : device(device), allocator(allocator), transferQueue(transferQueue),
+      transferQueueFamilyIndex(transferQueueFamilyIndex), graphicsQueueFamilyIndex(graphicsQueueFamilyIndex),
+      onGraphicsQueue(transferQueue == graphicsQueue), stagingSize(stagingSize) {
+  vk::CommandPoolCreateInfo commandPoolCreateInfo = {vk::CommandPoolCreateFlagBits::eTransient |
+                                                     vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                                                     transferQueueFamilyIndex};
+  commandPool = device->createCommandPoolUnique(commandPoolCreateInfo);
+  vk::BufferCreateInfo bufferCreateInfo = {{}, stagingSize, vk::BufferUsageFlagBits::eTransferSrc,
+                                           vk::SharingMode::eExclusive};
+  stagingBuffer = allocator.createBuffer(bufferCreateInfo, MemoryUsage::eCpuToGpu);
+}
+
+UploadManager::~UploadManager() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<vk::Fence> fences;
+  for(const auto& batch : submitted)
+    if(batch->staged)
+      fences.push_back(batch->fence.get());
+  if(!fences.empty())
+    static_cast<void>(device->waitForFences(fences, VK_TRUE, std::numeric_limits<uint64_t>::max()));
+}
+
+void UploadManager::uploadBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void *data, vk::DeviceSize size,
+                                 vk::SharingMode sharingMode) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  // A quarter of the ring leaves room for the next chunk while the previous ones are still copied.
+  vk::DeviceSize maxChunkSize = std::max<vk::DeviceSize>(stagingSize / 4, DEFAULT_ALIGNMENT);
+  for(vk::DeviceSize done = 0; done < size;) {
+    vk::DeviceSize chunkSize = std::min(size - done, maxChunkSize);
+    vk::DeviceSize stagingOffset = stage(bytes + done, chunkSize, DEFAULT_ALIGNMENT);
+    // Looked up after staging, which may have flushed the pending copies.
+    auto it = pendingBufferIndices.find(static_cast<VkBuffer>(buffer));
+    if(it == pendingBufferIndices.end()) {
+      it = pendingBufferIndices.emplace(static_cast<VkBuffer>(buffer), pendingBuffers.size()).first;
+      pendingBuffers.push_back({buffer, sharingMode, {}});
+    }
+    pendingBuffers[it->second].regions.emplace_back(stagingOffset, offset + done, chunkSize);
+    done += chunkSize;
+  }
+}
+
+void UploadManager::uploadImage(vk::Image image, const void *data, vk::DeviceSize size, const vk::Extent3D& extent,
+                                vk::ImageLayout oldLayout, vk::ImageLayout newLayout, const vk::Offset3D& offset,
+                                uint32_t arrayLayer, vk::SharingMode sharingMode) {
+  if(oldLayout != vk::ImageLayout::eUndefined && !onGraphicsQueue) {
+    ImageUpdate update = createUpdate(image, data, size, extent, offset, arrayLayer, oldLayout, newLayout);
+    std::lock_guard<std::mutex> lock(mutex);
+    uploadedSize += size;
+    pendingUpdates.push_back(std::move(update));
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  vk::DeviceSize stagingOffset = stage(data, size, DEFAULT_ALIGNMENT);
+  auto it = pendingImageIndices.find(static_cast<VkImage>(image));
+  if(it == pendingImageIndices.end()) {
+    it = pendingImageIndices.emplace(static_cast<VkImage>(image), pendingImages.size()).first;
+    pendingImages.push_back({image, sharingMode, oldLayout, newLayout, {}});
+  }
+  // Several regions of one image share a single transition into and out of eTransferDstOptimal.
+  ImageCopies& copies = pendingImages[it->second];
+  copies.newLayout = newLayout;
+  copies.regions.emplace_back(stagingOffset, 0, 0, vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0,
+                                                                              arrayLayer, 1}, offset, extent);
+}
+
+void UploadManager::updateImage(vk::Image image, const void *data, vk::DeviceSize size, const vk::Extent3D& extent,
+                                const vk::Offset3D& offset, uint32_t arrayLayer) {
+  ImageUpdate update = createUpdate(image, data, size, extent, offset, arrayLayer,
+                                    vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+  std::lock_guard<std::mutex> lock(mutex);
+  uploadedSize += size;
+  pendingUpdates.push_back(std::move(update));
+}
+
+bool UploadManager::flush() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return flushLocked();
+}
+
+std::vector<vk::Semaphore> UploadManager::acquire(const vk::CommandBuffer& commandBuffer, vk::Fence fence) {
+  std::lock_guard<std::mutex> lock(mutex);
+  collect();
+  flushLocked();
+
+  std::vector<vk::Semaphore> semaphores;
+  std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+  std::vector<vk::ImageMemoryBarrier> imageBarriers;
+  for(auto& batch : submitted) {
+    if(batch->acquired) continue;
+    batch->acquired = true;
+    batch->consumer = fence;
+    semaphores.push_back(batch->semaphore.get());
+    // These must match the releases recorded by flushLocked() exactly.
+    for(const BufferCopies& copies : batch->buffers)
+      if(needsOwnershipTransfer(copies.sharingMode))
+        bufferBarriers.emplace_back(vk::AccessFlags(), getBufferAccess(), transferQueueFamilyIndex,
+                                    graphicsQueueFamilyIndex, copies.buffer, 0, VK_WHOLE_SIZE);
+    for(const ImageCopies& copies : batch->images)
+      if(needsOwnershipTransfer(copies.sharingMode))
+        imageBarriers.emplace_back(vk::AccessFlags(), vk::AccessFlagBits::eShaderRead,
+                                   vk::ImageLayout::eTransferDstOptimal, copies.newLayout, transferQueueFamilyIndex,
+                                   graphicsQueueFamilyIndex, copies.image,
+                                   vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0,
+                                                             VK_REMAINING_ARRAY_LAYERS});
+  }
+  if(!bufferBarriers.empty() || !imageBarriers.empty())
+    commandBuffer.pipelineBarrier(getWaitStages(), getWaitStages(), {}, 0, nullptr, vk::size(bufferBarriers),
+                                  bufferBarriers.data(), vk::size(imageBarriers), imageBarriers.data());
+  if(!pendingUpdates.empty()) {
+    recordUpdates(commandBuffer);
+    recordedUpdates.push_back({std::move(pendingUpdates), fence});
+    pendingUpdates.clear();
+  }
+  return semaphores;
+}
+
+vk::PipelineStageFlags UploadManager::getWaitStages() {
+  return vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eDrawIndirect |
+         vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader |
+         vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+}
+
+std::vector<uint32_t> UploadManager::getQueueFamilyIndices() const {
+  if(isDedicated())
+    return {transferQueueFamilyIndex, graphicsQueueFamilyIndex};
+  return {graphicsQueueFamilyIndex};
+}
+
+bool UploadManager::isDedicated() const {
+  return transferQueueFamilyIndex != graphicsQueueFamilyIndex;
+}
+
+vk::DeviceSize UploadManager::getUploadedSize() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return uploadedSize;
+}
+
+vk::DeviceSize UploadManager::stage(const void *data, vk::DeviceSize size, vk::DeviceSize alignment) {
+  std::optional<vk::DeviceSize> offset = allocateStaging(size, alignment);
+  while(!offset) {
+    if(!pendingBuffers.empty() || !pendingImages.empty())
+      flushLocked();
+    auto oldest = std::find_if(submitted.begin(), submitted.end(), [](const auto& batch) { return batch->staged; });
+    if(oldest == submitted.end())
+      throw std::runtime_error("upload of " + std::to_string(size) + " bytes does not fit the staging buffer of " +
+                               std::to_string(stagingSize) + " bytes");
+    if(device->waitForFences((*oldest)->fence.get(), VK_TRUE, std::numeric_limits<uint64_t>::max()) !=
+       vk::Result::eSuccess)
+      throw std::runtime_error("failed waiting for uploads");
+    collect();
+    offset = allocateStaging(size, alignment);
+  }
+  std::memcpy(static_cast<uint8_t *>(stagingBuffer.allocation->mapped) + *offset, data, size);
+  allocator.flush(stagingBuffer.allocation.get(), *offset, size);
+  uploadedSize += size;
+  return *offset;
+}
+
+std::optional<vk::DeviceSize> UploadManager::allocateStaging(vk::DeviceSize size, vk::DeviceSize alignment) {
+  // The head never catches up with the tail from behind, so head == tail always means the ring is empty.
+  vk::DeviceSize offset = (stagingHead + alignment - 1) / alignment * alignment;
+  if(stagingHead >= stagingTail) {
+    if(offset + size <= stagingSize) {
+      stagingHead = offset + size;
+      return offset;
+    }
+    // Wrap around, skipping the rest of the buffer.
+    if(size < stagingTail) {
+      stagingHead = size;
+      return 0;
+    }
+  } else if(offset + size < stagingTail) {
+    stagingHead = offset + size;
+    return offset;
+  }
+  return {};
+}
+
+UploadManager::ImageUpdate UploadManager::createUpdate(vk::Image image, const void *data, vk::DeviceSize size,
+                                                       const vk::Extent3D& extent, const vk::Offset3D& offset,
+                                                       uint32_t arrayLayer, vk::ImageLayout oldLayout,
+                                                       vk::ImageLayout newLayout) const {
+  vk::BufferCreateInfo bufferCreateInfo = {{}, size, vk::BufferUsageFlagBits::eTransferSrc,
+                                           vk::SharingMode::eExclusive};
+  AllocatedBuffer staging = allocator.createBuffer(bufferCreateInfo, MemoryUsage::eCpuToGpu);
+  std::memcpy(staging.allocation->mapped, data, size);
+  allocator.flush(staging.allocation.get(), 0, size);
+  return {image, std::move(staging),
+          {0, 0, 0, vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, arrayLayer, 1}, offset, extent},
+          oldLayout, newLayout};
+}
+
+void UploadManager::collect() {
+  // Batches finish in submission order on the transfer queue.
+  for(auto& batch : submitted) {
+    if(!batch->staged) continue;
+    if(device->getFenceStatus(batch->fence.get()) != vk::Result::eSuccess) break;
+    batch->staged = false;
+    stagingTail = batch->stagingEnd;
+  }
+  if(stagingHead == stagingTail && pendingBuffers.empty() && pendingImages.empty())
+    stagingHead = stagingTail = 0;
+
+  // Frames finish in submission order on the graphics queue.
+  while(!recordedUpdates.empty() &&
+        device->getFenceStatus(recordedUpdates.front().consumer) == vk::Result::eSuccess)
+    recordedUpdates.pop_front();
+
+  // A binary semaphore can only be signaled again once the submission waiting on it has finished.
+  while(!submitted.empty()) {
+    Batch& batch = *submitted.front();
+    if(batch.staged || !batch.acquired || device->getFenceStatus(batch.consumer) != vk::Result::eSuccess) break;
+    device->resetFences(batch.fence.get());
+    batch.buffers.clear();
+    batch.images.clear();
+    batch.acquired = false;
+    batch.consumer = nullptr;
+    freeBatches.push_back(std::move(submitted.front()));
+    submitted.pop_front();
+  }
+}
+
+void UploadManager::recordUpdates(const vk::CommandBuffer& commandBuffer) const {
+  // Each image is transitioned once, from the layout of its first update to that of its last.
+  std::vector<const ImageUpdate *> firstUpdates;
+  std::vector<const ImageUpdate *> lastUpdates;
+  for(const ImageUpdate& update : pendingUpdates) {
+    auto it = std::find_if(firstUpdates.begin(), firstUpdates.end(),
+                           [&](const ImageUpdate *first) { return first->image == update.image; });
+    if(it == firstUpdates.end()) {
+      firstUpdates.push_back(&update);
+      lastUpdates.push_back(&update);
+    } else {
+      lastUpdates[it - firstUpdates.begin()] = &update;
+    }
+  }
+
+  // Earlier frames may still be sampling the images or copying earlier updates to them.
+  vk::ImageSubresourceRange subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS};
+  std::vector<vk::ImageMemoryBarrier> barriers;
+  for(const ImageUpdate *update : firstUpdates)
+    barriers.emplace_back(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferWrite,
+                          update->oldLayout, vk::ImageLayout::eTransferDstOptimal, VK_QUEUE_FAMILY_IGNORED,
+                          VK_QUEUE_FAMILY_IGNORED, update->image, subresourceRange);
+  commandBuffer.pipelineBarrier(getWaitStages(), vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr,
+                                vk::size(barriers), barriers.data());
+
+  for(const ImageUpdate& update : pendingUpdates)
+    commandBuffer.copyBufferToImage(update.staging.buffer.get(), update.image, vk::ImageLayout::eTransferDstOptimal,
+                                    1, &update.region);
+
+  barriers.clear();
+  for(const ImageUpdate *update : lastUpdates)
+    barriers.emplace_back(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
+                          vk::ImageLayout::eTransferDstOptimal, update->newLayout, VK_QUEUE_FAMILY_IGNORED,
+                          VK_QUEUE_FAMILY_IGNORED, update->image, subresourceRange);
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, getWaitStages(), {}, 0, nullptr, 0, nullptr,
+                                vk::size(barriers), barriers.data());
+}
+
+std::unique_ptr<UploadManager::Batch> UploadManager::createBatch() {
+  auto batch = std::make_unique<Batch>();
+  vk::CommandBufferAllocateInfo allocateInfo = {commandPool.get(), vk::CommandBufferLevel::ePrimary, 1};
+  batch->commandBuffer = std::move(device->allocateCommandBuffersUnique(allocateInfo).front());
+  batch->fence = device->createFenceUnique({});
+  batch->semaphore = device->createSemaphoreUnique({});
+  return batch;
+}
+
+bool UploadManager::flushLocked() {
+  if(pendingBuffers.empty() && pendingImages.empty()) return false;
+  TRACE_SCOPE("flush uploads");
+  collect();
+  std::unique_ptr<Batch> batch;
+  if(freeBatches.empty()) {
+    batch = createBatch();
+  } else {
+    batch = std::move(freeBatches.back());
+    freeBatches.pop_back();
+  }
+
+  vk::CommandBuffer commandBuffer = batch->commandBuffer.get();
+  commandBuffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr});
+  vk::ImageSubresourceRange subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS};
+
+  // Only first uploads discard the contents, images uploaded again wait for the frames and copies before them, which
+  // only reach here on the graphics queue itself.
+  vk::PipelineStageFlags srcStages = vk::PipelineStageFlagBits::eTopOfPipe;
+  std::vector<vk::ImageMemoryBarrier> imageBarriers;
+  for(const ImageCopies& copies : pendingImages) {
+    vk::AccessFlags srcAccess;
+    if(copies.oldLayout != vk::ImageLayout::eUndefined) {
+      srcStages = getWaitStages();
+      srcAccess = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferWrite;
+    }
+    imageBarriers.emplace_back(srcAccess, vk::AccessFlagBits::eTransferWrite, copies.oldLayout,
+                               vk::ImageLayout::eTransferDstOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                               copies.image, subresourceRange);
+  }
+  if(!imageBarriers.empty())
+    commandBuffer.pipelineBarrier(srcStages, vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr,
+                                  vk::size(imageBarriers), imageBarriers.data());
+
+  for(const BufferCopies& copies : pendingBuffers)
+    commandBuffer.copyBuffer(stagingBuffer.buffer.get(), copies.buffer, vk::size(copies.regions),
+                             copies.regions.data());
+  for(const ImageCopies& copies : pendingImages)
+    commandBuffer.copyBufferToImage(stagingBuffer.buffer.get(), copies.image, vk::ImageLayout::eTransferDstOptimal,
+                                    vk::size(copies.regions), copies.regions.data());
+
+  // A dedicated transfer queue cannot wait on graphics stages, so the semaphore makes the writes visible there and
+  // exclusive resources are released to the graphics queue family. Otherwise one barrier covers everything.
+  vk::PipelineStageFlags dstStages = isDedicated() ? vk::PipelineStageFlags(vk::PipelineStageFlagBits::eBottomOfPipe)
+                                                   : getWaitStages();
+  std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+  for(const BufferCopies& copies : pendingBuffers) {
+    bool transfer = needsOwnershipTransfer(copies.sharingMode);
+    bufferBarriers.emplace_back(vk::AccessFlagBits::eTransferWrite,
+                                isDedicated() ? vk::AccessFlags() : getBufferAccess(),
+                                transfer ? transferQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED,
+                                transfer ? graphicsQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED, copies.buffer, 0,
+                                VK_WHOLE_SIZE);
+  }
+  imageBarriers.clear();
+  for(const ImageCopies& copies : pendingImages) {
+    bool transfer = needsOwnershipTransfer(copies.sharingMode);
+    imageBarriers.emplace_back(vk::AccessFlagBits::eTransferWrite,
+                               isDedicated() ? vk::AccessFlags() : vk::AccessFlags(vk::AccessFlagBits::eShaderRead),
+                               vk::ImageLayout::eTransferDstOptimal, copies.newLayout,
+                               transfer ? transferQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED,
+                               transfer ? graphicsQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED, copies.image,
+                               subresourceRange);
+  }
+  commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dstStages, {}, 0, nullptr,
+                                vk::size(bufferBarriers), bufferBarriers.data(), vk::size(imageBarriers),
+                                imageBarriers.data());
+  commandBuffer.end();
+
+  vk::SubmitInfo submitInfo = {0, nullptr, nullptr, 1, &commandBuffer, 1, &batch->semaphore.get()};
+  transferQueue.submit(submitInfo, batch->fence.get());
+
+  batch->buffers = std::move(pendingBuffers);
+  batch->images = std::move(pendingImages);
+  batch->stagingEnd = stagingHead;
+  batch->staged = true;
+  pendingBuffers.clear();
+  pendingImages.clear();
+  pendingBufferIndices.clear();
+  pendingImageIndices.clear();
+  submitted.push_back(std::move(batch));
+  return true;
+}
+
+bool UploadManager::needsOwnershipTransfer(vk::SharingMode sharingMode) const {
+  return sharingMode == vk::SharingMode::eExclusive && isDedicated();
+}
+
+vk::AccessFlags UploadManager::getBufferAccess() {
+  return vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eIndexRead |
+         vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eUniformRead |
+         vk::AccessFlagBits::eShaderRead;
+}
@@ -0,0 +1,219 @@
+#ifndef VULKAN_UPLOADMANAGER_H
+#define VULKAN_UPLOADMANAGER_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+
+/**
+ * Streams buffer and image data to the device through a staging ring buffer on the transfer queue, so uploads never
+ * stall the graphics queue or the frame loop.
+ *
+ * Copies are collected until flush(), which submits all of them in one batch signaling a semaphore. The renderer then
+ * calls acquire() while recording its next frame, which records the matching queue family ownership acquires and
+ * returns the semaphores its submit has to wait on.
+ *
+ * Resources are expected to be created with vk::SharingMode::eExclusive, in which case ownership is moved to the
+ * graphics queue family after every upload. Resources rewritten while no frame samples them should rather be created
+ * concurrent over getQueueFamilyIndices() and uploaded with vk::SharingMode::eConcurrent, as an exclusive resource
+ * owned by the graphics queue family would lose its contents on the transfer queue. Images sampled by frames in
+ * flight while they are written to, like atlases, are updated with updateImage() instead.
+ *
+ * Every method may be called from any thread. When the transfer queue is the graphics queue itself, flush() and the
+ * uploads, which flush when the staging buffer runs full, must be called from the thread submitting frames.
+ */
+class UploadManager {
+
+public:
+  static constexpr vk::DeviceSize DEFAULT_STAGING_SIZE = vk::DeviceSize(32) << 20U;
+  static constexpr vk::DeviceSize DEFAULT_ALIGNMENT = 16;
+
+  /**
+   * @param graphicsQueue The queue frames are submitted to, which may be transferQueue itself.
+   */
+  UploadManager(const vk::UniqueDevice& device, MemoryAllocator& allocator, vk::Queue transferQueue,
+                vk::Queue graphicsQueue, uint32_t transferQueueFamilyIndex, uint32_t graphicsQueueFamilyIndex,
+                vk::DeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+
+  /**
+   * Waits for every submitted copy.
+   */
+  ~UploadManager();
+
+  UploadManager(const UploadManager&) = delete;
+
+  UploadManager& operator=(const UploadManager&) = delete;
+
+  /**
+   * Copies size bytes of data to offset in buffer. Uploads larger than the staging buffer are split up.
+   */
+  void uploadBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void *data, vk::DeviceSize size,
+                    vk::SharingMode sharingMode = vk::SharingMode::eExclusive);
+
+  /**
+   * Copies tightly packed texels to a region of the first mip level of a color image and transitions it from
+   * oldLayout to newLayout. eUndefined discards the previous contents of the whole image. Anything else overwrites an
+   * image frames may have read, which only the graphics queue can wait for, so unless that is the transfer queue the
+   * copy is recorded by acquire() like updateImage().
+   * @throws std::runtime_error if the texels do not fit the staging buffer.
+   */
+  void uploadImage(vk::Image image, const void *data, vk::DeviceSize size, const vk::Extent3D& extent,
+                   vk::ImageLayout oldLayout, vk::ImageLayout newLayout, const vk::Offset3D& offset = {},
+                   uint32_t arrayLayer = 0, vk::SharingMode sharingMode = vk::SharingMode::eExclusive);
+
+  /**
+   * Copies tightly packed texels to a region of the first mip level of a color image in eShaderReadOnlyOptimal that
+   * frames in flight may be sampling. The copy is recorded on the graphics queue by the next acquire(), after every
+   * earlier read of the image, rather than racing them on the transfer queue.
+   */
+  void updateImage(vk::Image image, const void *data, vk::DeviceSize size, const vk::Extent3D& extent,
+                   const vk::Offset3D& offset = {}, uint32_t arrayLayer = 0);
+
+  /**
+   * Submits every copy collected since the last flush as one batch.
+   * @return Whether anything was submitted.
+   */
+  bool flush();
+
+  /**
+   * Records the ownership acquires of every batch submitted since the last call and the image updates collected
+   * since then into a graphics command buffer, before any command using the uploaded resources.
+   * @param fence The fence signaled by the submission of commandBuffer. The semaphores and the staging memory of the
+   * updates are reused once it signals.
+   * @return The semaphores the submission has to wait on at getWaitStages().
+   */
+  std::vector<vk::Semaphore> acquire(const vk::CommandBuffer& commandBuffer, vk::Fence fence);
+
+  /**
+   * @return The stages uploaded resources may be consumed in, including the transfer stage copying image updates.
+   */
+  static vk::PipelineStageFlags getWaitStages();
+
+  /**
+   * @return The transfer and graphics queue family indices, for creating concurrent resources.
+   */
+  std::vector<uint32_t> getQueueFamilyIndices() const;
+
+  /**
+   * @return Whether copies run on a different queue family than graphics.
+   */
+  bool isDedicated() const;
+
+  /**
+   * @return Bytes uploaded since creation.
+   */
+  vk::DeviceSize getUploadedSize() const;
+
+private:
+
+  struct BufferCopies {
+    vk::Buffer buffer;
+    vk::SharingMode sharingMode;
+    std::vector<vk::BufferCopy> regions;
+  };
+
+  struct ImageCopies {
+    vk::Image image;
+    vk::SharingMode sharingMode;
+    vk::ImageLayout oldLayout;
+    vk::ImageLayout newLayout;
+    std::vector<vk::BufferImageCopy> regions;
+  };
+
+  struct ImageUpdate {
+    vk::Image image;
+    // Staged apart from the ring, whose batches are released by the transfer queue.
+    AllocatedBuffer staging;
+    vk::BufferImageCopy region;
+    vk::ImageLayout oldLayout;
+    vk::ImageLayout newLayout;
+  };
+
+  struct RecordedUpdates {
+    std::vector<ImageUpdate> updates;
+    // Signaled once the graphics queue has copied them.
+    vk::Fence consumer;
+  };
+
+  struct Batch {
+    vk::UniqueCommandBuffer commandBuffer;
+    vk::UniqueFence fence;
+    vk::UniqueSemaphore semaphore;
+    std::vector<BufferCopies> buffers;
+    std::vector<ImageCopies> images;
+    // The staging head when the batch was submitted, everything before it is free once the fence signals.
+    vk::DeviceSize stagingEnd = 0;
+    // Whether the batch still holds on to its staging memory.
+    bool staged = false;
+    bool acquired = false;
+    // Signaled once the semaphore has been waited on.
+    vk::Fence consumer;
+  };
+
+  const vk::UniqueDevice& device;
+  MemoryAllocator& allocator;
+  vk::Queue transferQueue;
+  uint32_t transferQueueFamilyIndex;
+  uint32_t graphicsQueueFamilyIndex;
+  // Whether copies are submitted to the graphics queue itself, so barriers order them after the frames.
+  bool onGraphicsQueue;
+  vk::UniqueCommandPool commandPool;
+  AllocatedBuffer stagingBuffer;
+  vk::DeviceSize stagingSize;
+  vk::DeviceSize stagingHead = 0;
+  vk::DeviceSize stagingTail = 0;
+  std::vector<BufferCopies> pendingBuffers;
+  std::vector<ImageCopies> pendingImages;
+  std::unordered_map<VkBuffer, std::size_t> pendingBufferIndices;
+  std::unordered_map<VkImage, std::size_t> pendingImageIndices;
+  std::vector<ImageUpdate> pendingUpdates;
+  std::deque<RecordedUpdates> recordedUpdates;
+  std::deque<std::unique_ptr<Batch>> submitted;
+  std::vector<std::unique_ptr<Batch>> freeBatches;
+  vk::DeviceSize uploadedSize = 0;
+  mutable std::mutex mutex;
+
+  /**
+   * Copies data into the staging buffer, making room by flushing and waiting for older batches if necessary.
+   * @return The offset of the copy in the staging buffer.
+   */
+  vk::DeviceSize stage(const void *data, vk::DeviceSize size, vk::DeviceSize alignment);
+
+  std::optional<vk::DeviceSize> allocateStaging(vk::DeviceSize size, vk::DeviceSize alignment);
+
+  /**
+   * Copies texels into a staging buffer of their own for a copy recorded by acquire().
+   */
+  ImageUpdate createUpdate(vk::Image image, const void *data, vk::DeviceSize size, const vk::Extent3D& extent,
+                           const vk::Offset3D& offset, uint32_t arrayLayer, vk::ImageLayout oldLayout,
+                           vk::ImageLayout newLayout) const;
+
+  /**
+   * Releases the staging memory of finished batches and updates and recycles batches whose semaphore was waited on.
+   */
+  void collect();
+
+  /**
+   * Records the pending updates between barriers waiting for earlier reads and writes of their images.
+   */
+  void recordUpdates(const vk::CommandBuffer& commandBuffer) const;
+
+  std::unique_ptr<Batch> createBatch();
+
+  bool flushLocked();
+
+  bool needsOwnershipTransfer(vk::SharingMode sharingMode) const;
+
+  static vk::AccessFlags getBufferAccess();
+
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef VULKAN_VERTEXLAYOUT_H
+#define VULKAN_VERTEXLAYOUT_H
+
+#include <array>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * One input of a vertex layout, as the vertex shader names it.
+ */
+struct VertexAttribute {
+  std::string_view name;
+  vk::Format format;
+  uint32_t offset;
+};
+
+/**
+ * The formats vertex layouts may use, with their size and the GLSL type a vertex shader reads them as. Normalized and
+ * half float formats read as floats, so compact formats need no changes to the shader math.
+ */
+class VertexFormats {
+
+public:
+  static constexpr uint32_t getSize(vk::Format format) {
+    switch(format) {
+      case vk::Format::eR32Sfloat:
+      case vk::Format::eR32Uint:
+      case vk::Format::eR8G8B8A8Unorm:
+      case vk::Format::eR16G16Snorm:
+      case vk::Format::eR16G16Unorm:
+      case vk::Format::eR16G16Sfloat:
+        return 4;
+      case vk::Format::eR32G32Sfloat:
+      case vk::Format::eR16G16B16A16Snorm:
+      case vk::Format::eR16G16B16A16Unorm:
+      case vk::Format::eR16G16B16A16Sfloat:
+        return 8;
+      case vk::Format::eR32G32B32Sfloat:
+        return 12;
+      case vk::Format::eR32G32B32A32Sfloat:
+        return 16;
+      default:
+        return 0;
+    }
+  }
+
+  static constexpr std::string_view getGlslType(vk::Format format) {
+    switch(format) {
+      case vk::Format::eR32Sfloat:
+        return "float";
+      case vk::Format::eR32Uint:
+        return "uint";
+      case vk::Format::eR16G16Snorm:
+      case vk::Format::eR16G16Unorm:
+      case vk::Format::eR16G16Sfloat:
+      case vk::Format::eR32G32Sfloat:
+        return "vec2";
+      case vk::Format::eR32G32B32Sfloat:
+        return "vec3";
+      default:
+        return "vec4";
+    }
+  }
+
+};
+
+/**
+ * The attributes of a vertex buffer binding, declared once so the Vulkan binding and attribute descriptions and the
+ * vertex shader's inputs all follow from it. Attributes take consecutive locations from firstLocation on.
+ */
+template<std::size_t N>
+struct VertexLayout {
+  uint32_t binding;
+  vk::VertexInputRate inputRate;
+  uint32_t stride;
+  uint32_t firstLocation;
+  std::array<VertexAttribute, N> attributes;
+
+  // The first location after the attributes, where another binding's layout may start.
+  constexpr uint32_t getEndLocation() const {
+    return firstLocation + uint32_t(N);
+  }
+
+  /**
+   * @return Whether every attribute has a known format and lies 4 byte aligned within the stride, for static_asserts
+   * next to the declaration.
+   */
+  constexpr bool isValid() const {
+    for(const VertexAttribute& attribute : attributes) {
+      uint32_t size = VertexFormats::getSize(attribute.format);
+      if(size == 0 || attribute.offset % 4 != 0 || attribute.offset + size > stride)
+        return false;
+    }
+    return true;
+  }
+
+  vk::VertexInputBindingDescription getBindingDescription() const {
+    return {binding, stride, inputRate};
+  }
+
+  std::array<vk::VertexInputAttributeDescription, N> getAttributeDescriptions() const {
+    std::array<vk::VertexInputAttributeDescription, N> descriptions;
+    for(std::size_t i = 0; i < N; ++i)
+      descriptions[i] = {firstLocation + uint32_t(i), binding, attributes[i].format, attributes[i].offset};
+    return descriptions;
+  }
+
+  /**
+   * @return The GLSL input declarations of the attributes, one per line.
+   */
+  std::string getGlslInputs() const {
+    std::ostringstream glsl;
+    for(std::size_t i = 0; i < N; ++i)
+      glsl << "layout(location = " << firstLocation + i << ") in " << VertexFormats::getGlslType(attributes[i].format)
+           << " " << attributes[i].name << ";\n";
+    return glsl.str();
+  }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include "Mesh.h"
+#include "SpriteBatch.h"
+#include "VertexLayout.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/**
+ * Writes the vertex shader inputs of every vertex layout as GLSL includes into the directory given as the only
+ * argument, so shaders never restate a layout by hand. Run by the build ahead of compiling the shaders.
+ */
+
+template<std::size_t N>
+bool writeInputs(const std::filesystem::path& path, const VertexLayout<N>& layout, const char *declaration) {
+  std::ofstream out(path, std::ios_base::trunc);
+  out << "// Generated from " << declaration << " by vulkan-vertex-layouts, do not edit.\n" << layout.getGlslInputs();
+  if(!out)
+    std::cerr << "Could not write " << path << std::endl;
+  return bool(out);
+}
+
+int main(int argc, char **argv) {
+  if(argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " <output directory>" << std::endl;
+    return 1;
+  }
+  std::filesystem::path directory = argv[1];
+  std::filesystem::create_directories(directory);
+  bool written = writeInputs(directory / "sprite_instance.glsl", SPRITE_INSTANCE_LAYOUT, "SPRITE_INSTANCE_LAYOUT");
+  written = writeInputs(directory / "mesh_vertex.glsl", MESH_VERTEX_LAYOUT, "MESH_VERTEX_LAYOUT") && written;
+  return written ? 0 : 1;
+}
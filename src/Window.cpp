@@ -8,6 +8,8 @@ Window::Window() {
   glfwWindowHint(GLFW_FLOATING, false);
   glfwWindowHint(GLFW_MAXIMIZED, true);
   glfwWindow = glfwCreateWindow(800, 600, "Vulkan", nullptr, nullptr);
+  glfwSetWindowUserPointer(glfwWindow, this);
+  glfwSetFramebufferSizeCallback(glfwWindow, onFramebufferResize);
 }
 
 Window::Window(uint32_t width, uint32_t height) {
@@ -16,6 +18,8 @@ Window::Window(uint32_t width, uint32_t height) {
   glfwWindowHint(GLFW_FLOATING, false);
   glfwWindowHint(GLFW_MAXIMIZED, false);
   glfwWindow = glfwCreateWindow(static_cast<int>(width), static_cast<int>(height), "Vulkan", nullptr, nullptr);
+  glfwSetWindowUserPointer(glfwWindow, this);
+  glfwSetFramebufferSizeCallback(glfwWindow, onFramebufferResize);
 }
 
 void Window::zoom() {
@@ -61,3 +65,25 @@ uint32_t Window::getHeight() {
 bool Window::isClosing() {
   return glfwWindowShouldClose(glfwWindow);
 }
+
+uint32_t Window::getFramebufferWidth() {
+  int width, height;
+  glfwGetFramebufferSize(glfwWindow, &width, &height);
+  return uint32(width);
+}
+
+uint32_t Window::getFramebufferHeight() {
+  int width, height;
+  glfwGetFramebufferSize(glfwWindow, &width, &height);
+  return uint32(height);
+}
+
+bool Window::takeResized() {
+  bool wasResized = resized;
+  resized = false;
+  return wasResized;
+}
+
+void Window::onFramebufferResize(GLFWwindow *glfwWindow, int, int) {
+  static_cast<Window *>(glfwGetWindowUserPointer(glfwWindow))->resized = true;
+}
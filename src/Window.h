@@ -20,6 +20,18 @@ public:
 
   uint32_t getHeight();
 
+  /**
+   * @return The size of the framebuffer in pixels, which differs from the window size on high DPI displays.
+   */
+  uint32_t getFramebufferWidth();
+
+  uint32_t getFramebufferHeight();
+
+  /**
+   * @return Whether the framebuffer was resized since the last call.
+   */
+  bool takeResized();
+
   void center();
 
   void setTitle(const std::string_view& title);
@@ -30,6 +42,11 @@ public:
 
   void minimize();
 
+private:
+  bool resized = false;
+
+  static void onFramebufferResize(GLFWwindow *glfwWindow, int width, int height);
+
 };
 
 #endif
@@ -0,0 +1,814 @@
+#include "Renderer.h"
+#include "HashUtils.h"
+#include "Mesh.h"
+#include "SceneIndex.h"
+#include "TaskGraph.h"
+#include "Trace.h"
+#include "TransformSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+
+/**
+ * Renders scripted workloads headlessly and reports their frame times, draw calls, submitted bytes and the renderer's
+ * startup phases as JSON. Every workload derives all of its sprites from the frame number and fixed seeds, so two
+ * runs render exactly the same frames and can be compared, e.g. against a baseline in CI.
+ */
+
+// Sprites per draw call of the small batches workload.
+constexpr uint32_t SMALL_BATCH_SIZE = 8;
+// The texture streaming workload uploads this many layers of its texture array every frame.
+constexpr uint32_t TEXTURE_LAYERS = 16;
+constexpr uint32_t TEXTURE_UPLOADS_PER_FRAME = 8;
+constexpr uint32_t TEXTURE_SIZE = 256;
+// Textures of random sizes the many textures workload spreads its sprites over.
+constexpr uint32_t MANY_TEXTURES = 256;
+constexpr uint32_t MAX_MANY_TEXTURE_SIZE = 64;
+// The culled world workload spreads its sprites over this many frames in either direction.
+constexpr uint32_t WORLD_SCALE = 16;
+// The text labels workload shows one label per this many sprites and changes one in this many labels every frame.
+constexpr uint32_t SPRITES_PER_LABEL = 8;
+constexpr uint32_t CHANGED_LABEL_RATIO = 100;
+// Sprites orbiting each pivot of the transform hierarchy workload.
+constexpr uint32_t SPRITES_PER_PIVOT = 15;
+// Star meshes of 3 to 2 + this many points the indexed meshes workload draws.
+constexpr uint32_t MESH_COUNT = 8;
+// The layered meshes workload alternates between sprites and meshes every this many instances, on this many layers.
+constexpr uint32_t LAYERED_RUN_LENGTH = 64;
+constexpr uint32_t LAYER_COUNT = 4;
+
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+/**
+ * Draws the sprites of one frame, given the index of the frame within the workload.
+ */
+using DrawFunction = std::function<void(Renderer&, uint64_t)>;
+
+struct Workload {
+  const char *name;
+  /**
+   * Creates whatever the workload needs besides sprites. The returned function is destroyed, along with everything
+   * it captured, once the workload's frames have finished.
+   */
+  std::function<DrawFunction(Renderer&, uint32_t spriteCount)> create;
+  // Draws through the renderer's GPU culler, which is only created if such a workload runs.
+  bool gpuCulling = false;
+  // Draws labels through the renderer's text renderer, which needs --font.
+  bool text = false;
+};
+
+struct Phase {
+  std::string name;
+  // Since startup began, phases run concurrently may overlap.
+  Milliseconds start;
+  Milliseconds duration;
+};
+
+struct Percentiles {
+  double mean = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+struct WorkloadResult {
+  const char *name;
+  uint32_t spriteCount;
+  Percentiles frameTime;
+  Percentiles cpuWait;
+  Percentiles cpuRecord;
+  double drawCalls = 0;
+  double stateChanges = 0;
+  double submittedBytes = 0;
+  uint64_t droppedSprites = 0;
+  std::vector<GpuScopeStats> gpuStats;
+};
+
+/**
+ * @return A value in [0, 1) that only depends on index and seed.
+ */
+float random(uint32_t index, uint32_t seed) {
+  return float(HashUtils::hashValue(index, HashUtils::hashValue(seed)) >> 40U) / float(1U << 24U);
+}
+
+/**
+ * Nearest rank percentiles of samples in milliseconds.
+ */
+Percentiles getPercentiles(std::vector<double> samples) {
+  Percentiles percentiles;
+  if(samples.empty()) return percentiles;
+  std::sort(samples.begin(), samples.end());
+  auto rank = [&](double p) { return samples[std::size_t(p * double(samples.size() - 1) + 0.5)]; };
+  percentiles.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / double(samples.size());
+  percentiles.p50 = rank(0.5);
+  percentiles.p90 = rank(0.9);
+  percentiles.p99 = rank(0.99);
+  percentiles.max = samples.back();
+  return percentiles;
+}
+
+/**
+ * Sprites laid out on a grid filling the frame, the same every frame.
+ */
+DrawFunction createStaticSprites(Renderer&, uint32_t spriteCount) {
+  return [spriteCount](Renderer& renderer, uint64_t) {
+    if(spriteCount == 0) return;
+    auto columns = uint32_t(std::ceil(std::sqrt(double(spriteCount))));
+    auto rows = (spriteCount + columns - 1) / columns;
+    glm::vec2 cell = {float(renderer.headlessExtent.width) / float(columns),
+                      float(renderer.headlessExtent.height) / float(rows)};
+    for(uint32_t i = 0; i < spriteCount; ++i) {
+      uint32_t column = i % columns;
+      uint32_t row = i / columns;
+      renderer.spriteBatch->draw({(float(column) + 0.5F) * cell.x, (float(row) + 0.5F) * cell.y}, cell * 0.8F, 0.0F,
+                                 packColor(uint8_t(column * 255 / columns), uint8_t(row * 255 / rows), 128));
+    }
+  };
+}
+
+/**
+ * Sprites of random size moving and spinning at random speeds, wrapping around the edges of the frame.
+ */
+DrawFunction createMovingSprites(Renderer&, uint32_t spriteCount) {
+  return [spriteCount](Renderer& renderer, uint64_t frame) {
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    auto time = float(frame) / 60.0F;
+    for(uint32_t i = 0; i < spriteCount; ++i) {
+      glm::vec2 start = glm::vec2(random(i, 0), random(i, 1)) * extent;
+      glm::vec2 velocity = (glm::vec2(random(i, 2), random(i, 3)) - 0.5F) * 400.0F;
+      glm::vec2 position = glm::mod(start + velocity * time, extent);
+      float size = 4.0F + random(i, 4) * 28.0F;
+      renderer.spriteBatch->draw(position, {size, size}, time * (random(i, 5) - 0.5F) * 8.0F,
+                                 packColor(uint8_t(random(i, 6) * 255), uint8_t(random(i, 7) * 255), 255));
+    }
+  };
+}
+
+/**
+ * Star meshes of 3 to 2 + MESH_COUNT points, of quantized, indexed vertices.
+ */
+std::vector<std::shared_ptr<Mesh>> createStarMeshes(Renderer& renderer) {
+  std::vector<std::shared_ptr<Mesh>> meshes;
+  for(uint32_t points = 3; points < 3 + MESH_COUNT; ++points) {
+    // A fan around the center, alternating between outer and inner corners.
+    std::vector<MeshVertex> vertices = {packMeshVertex({0.0F, 0.0F}, {0.5F, 0.5F}, packColor(255, 255, 255))};
+    std::vector<uint16_t> indices;
+    for(uint32_t i = 0; i < points * 2; ++i) {
+      float angle = float(i) * 3.14159265F / float(points);
+      glm::vec2 position = glm::vec2(std::sin(angle), -std::cos(angle)) * (i % 2 ? 0.5F : 1.0F);
+      vertices.push_back(packMeshVertex(position, position * 0.5F + 0.5F,
+                                        i % 2 ? packColor(160, 160, 160) : packColor(255, 255, 255)));
+      indices.insert(indices.end(), {0, uint16_t(1 + i), uint16_t(1 + (i + 1) % (points * 2))});
+    }
+    meshes.push_back(std::make_shared<Mesh>(*renderer.memoryAllocator, *renderer.uploadManager, vertices, indices));
+  }
+  return meshes;
+}
+
+/**
+ * The moving sprites drawn as star meshes. Neighbouring sprites share a mesh, so every mesh takes a single draw.
+ */
+DrawFunction createIndexedMeshes(Renderer& renderer, uint32_t spriteCount) {
+  return [spriteCount, meshes = createStarMeshes(renderer)](Renderer& renderer, uint64_t frame) {
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    auto time = float(frame) / 60.0F;
+    for(uint32_t i = 0; i < spriteCount; ++i) {
+      glm::vec2 start = glm::vec2(random(i, 0), random(i, 1)) * extent;
+      glm::vec2 velocity = (glm::vec2(random(i, 2), random(i, 3)) - 0.5F) * 400.0F;
+      glm::vec2 position = glm::mod(start + velocity * time, extent);
+      float size = 4.0F + random(i, 4) * 28.0F;
+      float rotation = time * (random(i, 5) - 0.5F) * 8.0F;
+      float cos = std::cos(rotation) * size;
+      float sin = std::sin(rotation) * size;
+      renderer.spriteBatch->draw(*meshes[uint64_t(i) * meshes.size() / spriteCount],
+                                 {{cos, -sin, position.x}, {sin, cos, position.y}, packUvRect({0, 0, 1, 1}),
+                                  packColor(uint8_t(random(i, 6) * 255), uint8_t(random(i, 7) * 255), 255), 0});
+    }
+  };
+}
+
+/**
+ * Runs of LAYERED_RUN_LENGTH opaque sprites and star meshes alternating, each run on a random layer, like a scene
+ * drawn in whatever order its objects are visited. Sorting groups every layer's sprites and meshes, so pipelines and
+ * meshes are bound a few times per layer instead of every run.
+ */
+DrawFunction createLayeredMeshes(Renderer& renderer, uint32_t spriteCount) {
+  return [spriteCount, meshes = createStarMeshes(renderer)](Renderer& renderer, uint64_t frame) {
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    auto time = float(frame) / 60.0F;
+    renderer.spriteBatch->setTranslucent(false);
+    for(uint32_t i = 0; i < spriteCount; ++i) {
+      uint32_t run = i / LAYERED_RUN_LENGTH;
+      if(i % LAYERED_RUN_LENGTH == 0)
+        renderer.spriteBatch->setLayer(uint8_t(random(run, 8) * LAYER_COUNT));
+      glm::vec2 start = glm::vec2(random(i, 0), random(i, 1)) * extent;
+      glm::vec2 velocity = (glm::vec2(random(i, 2), random(i, 3)) - 0.5F) * 400.0F;
+      glm::vec2 position = glm::mod(start + velocity * time, extent);
+      float size = 4.0F + random(i, 4) * 28.0F;
+      uint32_t color = packColor(uint8_t(random(i, 6) * 255), uint8_t(random(i, 7) * 255), 255);
+      if(run % 2 == 0) {
+        renderer.spriteBatch->draw(position, {size, size}, 0.0F, color);
+        continue;
+      }
+      renderer.spriteBatch->draw(*meshes[(run / 2) % meshes.size()],
+                                 {{size, 0.0F, position.x}, {0.0F, size, position.y}, packUvRect({0, 0, 1, 1}), color,
+                                  0});
+    }
+  };
+}
+
+/**
+ * The moving sprites split into a draw call every SMALL_BATCH_SIZE sprites, like a scene switching state often.
+ */
+DrawFunction createSmallBatches(Renderer&, uint32_t spriteCount) {
+  return [spriteCount](Renderer& renderer, uint64_t frame) {
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    auto time = float(frame) / 60.0F;
+    for(uint32_t i = 0; i < spriteCount; ++i) {
+      glm::vec2 start = glm::vec2(random(i, 0), random(i, 1)) * extent;
+      glm::vec2 velocity = (glm::vec2(random(i, 2), random(i, 3)) - 0.5F) * 400.0F;
+      renderer.spriteBatch->draw(glm::mod(start + velocity * time, extent), {8.0F, 8.0F}, 0.0F,
+                                 packColor(uint8_t(random(i, 6) * 255), 128, uint8_t(random(i, 7) * 255)));
+      if((i + 1) % SMALL_BATCH_SIZE == 0)
+        renderer.spriteBatch->flush();
+    }
+  };
+}
+
+/**
+ * Sprites spread over the layers of a texture array, of which TEXTURE_UPLOADS_PER_FRAME layers are streamed through
+ * the upload manager every frame. The array only measures streaming, the sprites are drawn untextured.
+ */
+DrawFunction createTextureStreaming(Renderer& renderer, uint32_t spriteCount) {
+  // Concurrent sharing keeps the layers that are not rewritten valid across a dedicated transfer queue.
+  std::vector<uint32_t> queueFamilyIndices = renderer.uploadManager->getQueueFamilyIndices();
+  vk::SharingMode sharingMode = queueFamilyIndices.size() > 1 ? vk::SharingMode::eConcurrent
+                                                              : vk::SharingMode::eExclusive;
+  vk::ImageCreateInfo imageCreateInfo = {{}, vk::ImageType::e2D, vk::Format::eR8G8B8A8Unorm,
+                                         {TEXTURE_SIZE, TEXTURE_SIZE, 1}, 1, TEXTURE_LAYERS,
+                                         vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal,
+                                         vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+                                         sharingMode, vk::size(queueFamilyIndices), queueFamilyIndices.data(),
+                                         vk::ImageLayout::eUndefined};
+  auto texture = std::make_shared<AllocatedImage>(renderer.memoryAllocator->createImage(imageCreateInfo,
+                                                                                        MemoryUsage::eGpuOnly));
+  auto texels = std::make_shared<std::vector<uint32_t>>(TEXTURE_SIZE * TEXTURE_SIZE);
+  for(uint32_t i = 0; i < texels->size(); ++i)
+    (*texels)[i] = packColor(uint8_t(i % TEXTURE_SIZE), uint8_t(i / TEXTURE_SIZE), uint8_t(random(i, 8) * 255));
+  vk::DeviceSize layerSize = vk::DeviceSize(texels->size()) * sizeof(uint32_t);
+  // Every layer is filled once up front, the transition out of eUndefined would discard all of them.
+  for(uint32_t layer = 0; layer < TEXTURE_LAYERS; ++layer)
+    renderer.uploadManager->uploadImage(texture->image.get(), texels->data(), layerSize,
+                                        {TEXTURE_SIZE, TEXTURE_SIZE, 1}, vk::ImageLayout::eUndefined,
+                                        vk::ImageLayout::eShaderReadOnlyOptimal, {}, layer, sharingMode);
+
+  return [=](Renderer& renderer, uint64_t frame) {
+    for(uint32_t i = 0; i < TEXTURE_UPLOADS_PER_FRAME; ++i) {
+      auto layer = uint32_t((frame * TEXTURE_UPLOADS_PER_FRAME + i) % TEXTURE_LAYERS);
+      renderer.uploadManager->uploadImage(texture->image.get(), texels->data(), layerSize,
+                                          {TEXTURE_SIZE, TEXTURE_SIZE, 1}, vk::ImageLayout::eShaderReadOnlyOptimal,
+                                          vk::ImageLayout::eShaderReadOnlyOptimal, {}, layer, sharingMode);
+    }
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    auto time = float(frame) / 60.0F;
+    for(uint32_t i = 0; i < spriteCount; ++i) {
+      glm::vec2 start = glm::vec2(random(i, 0), random(i, 1)) * extent;
+      glm::vec2 velocity = (glm::vec2(random(i, 2), random(i, 3)) - 0.5F) * 400.0F;
+      float size = 16.0F + random(i, 4) * 48.0F;
+      renderer.spriteBatch->draw(glm::mod(start + velocity * time, extent), {size, size}, 0.0F,
+                                 packColor(255, 255, 255));
+    }
+  };
+}
+
+/**
+ * The moving sprites, each sampling one of MANY_TEXTURES textures added to the texture manager up front. Sprites
+ * select their texture per instance, so this draws as few batches as untextured sprites do.
+ */
+DrawFunction createManyTextures(Renderer& renderer, uint32_t spriteCount) {
+  std::vector<TextureRegion> regions;
+  std::vector<uint32_t> texels;
+  for(uint32_t i = 0; i < MANY_TEXTURES; ++i) {
+    auto width = uint32_t(4 + random(i, 11) * float(MAX_MANY_TEXTURE_SIZE - 4));
+    auto height = uint32_t(4 + random(i, 12) * float(MAX_MANY_TEXTURE_SIZE - 4));
+    texels.resize(std::size_t(width) * height);
+    for(uint32_t y = 0; y < height; ++y)
+      for(uint32_t x = 0; x < width; ++x)
+        texels[y * width + x] = ((x / 4 + y / 4) % 2) ? packColor(uint8_t(random(i, 13) * 255), 255, 255)
+                                                      : packColor(64, 64, uint8_t(random(i, 14) * 255));
+    regions.push_back(renderer.textureManager->add(texels.data(), width, height));
+  }
+
+  return [spriteCount, regions = std::move(regions)](Renderer& renderer, uint64_t frame) {
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    auto time = float(frame) / 60.0F;
+    for(uint32_t i = 0; i < spriteCount; ++i) {
+      glm::vec2 start = glm::vec2(random(i, 0), random(i, 1)) * extent;
+      glm::vec2 velocity = (glm::vec2(random(i, 2), random(i, 3)) - 0.5F) * 400.0F;
+      float size = 8.0F + random(i, 4) * 24.0F;
+      const TextureRegion& region = regions[i % regions.size()];
+      renderer.spriteBatch->draw(glm::mod(start + velocity * time, extent), {size, size}, 0.0F,
+                                 packColor(255, 255, 255), region.uvRect, region.textureIndex);
+    }
+  };
+}
+
+/**
+ * The moving sprites spread over a world WORLD_SCALE frames wide and high, of which a panning camera shows one frame.
+ * Every sprite updates its bounds in a scene index, and only the ones the index finds within the frame are drawn, in
+ * their usual order.
+ */
+DrawFunction createCulledWorld(Renderer&, uint32_t spriteCount) {
+  auto index = std::make_shared<SceneIndex>();
+  for(uint32_t i = 0; i < spriteCount; ++i)
+    index->insert({{0.0F, 0.0F}, {0.0F, 0.0F}});
+  auto visible = std::make_shared<std::vector<uint32_t>>();
+  return [=](Renderer& renderer, uint64_t frame) {
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    glm::vec2 world = extent * float(WORLD_SCALE);
+    auto time = float(frame) / 60.0F;
+    auto position = [&](uint32_t i) {
+      glm::vec2 start = glm::vec2(random(i, 0), random(i, 1)) * world;
+      glm::vec2 velocity = (glm::vec2(random(i, 2), random(i, 3)) - 0.5F) * 400.0F;
+      return glm::mod(start + velocity * time, world);
+    };
+    auto size = [](uint32_t i) { return 4.0F + random(i, 4) * 28.0F; };
+    {
+      TRACE_SCOPE("update scene index");
+      for(uint32_t i = 0; i < spriteCount; ++i) {
+        // Covers the sprite at any rotation.
+        glm::vec2 center = position(i);
+        float radius = size(i) * 0.7072F;
+        index->update(i, {center - radius, center + radius});
+      }
+    }
+    glm::vec2 camera = glm::mod(glm::vec2(0.37F, 0.21F) * world * time / 10.0F, world - extent);
+    {
+      TRACE_SCOPE("query scene index");
+      index->query({camera, camera + extent}, *visible);
+      std::sort(visible->begin(), visible->end());
+    }
+    for(uint32_t i : *visible) {
+      renderer.spriteBatch->draw(position(i) - camera, {size(i), size(i)}, time * (random(i, 5) - 0.5F) * 8.0F,
+                                 packColor(uint8_t(random(i, 6) * 255), uint8_t(random(i, 7) * 255), 255));
+    }
+  };
+}
+
+/**
+ * Still sprites spread over the same world as the culled world, uploaded once and culled on the GPU every frame as the
+ * camera pans over them.
+ */
+DrawFunction createGpuCulledWorld(Renderer& renderer, uint32_t spriteCount) {
+  glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+  glm::vec2 world = extent * float(WORLD_SCALE);
+  std::vector<SpriteInstance> objects;
+  objects.reserve(spriteCount);
+  for(uint32_t i = 0; i < spriteCount; ++i) {
+    glm::vec2 position = glm::vec2(random(i, 0), random(i, 1)) * world;
+    float size = 4.0F + random(i, 4) * 28.0F;
+    float rotation = random(i, 5) * 6.2832F;
+    objects.push_back({{std::cos(rotation) * size, -std::sin(rotation) * size, position.x},
+                       {std::sin(rotation) * size, std::cos(rotation) * size, position.y}, packUvRect({0, 0, 1, 1}),
+                       packColor(uint8_t(random(i, 6) * 255), uint8_t(random(i, 7) * 255), 255), 0});
+  }
+  renderer.gpuCuller->setObjects(*renderer.uploadManager, objects);
+
+  return [world, extent](Renderer& renderer, uint64_t frame) {
+    auto time = float(frame) / 60.0F;
+    renderer.camera = glm::mod(glm::vec2(0.37F, 0.21F) * world * time / 10.0F, world - extent);
+  };
+}
+
+/**
+ * Labels on a grid wrapping around the frame, of which a fixed share change their text every frame while the rest stay
+ * untouched.
+ */
+DrawFunction createTextLabels(Renderer& renderer, uint32_t spriteCount) {
+  // Destroys the labels along with the draw function.
+  struct Labels {
+    TextRenderer& textRenderer;
+    std::vector<uint32_t> ids;
+
+    ~Labels() {
+      for(uint32_t id : ids)
+        textRenderer.destroyLabel(id);
+    }
+  };
+
+  std::shared_ptr<Labels> labels(new Labels{*renderer.textRenderer, {}});
+  uint32_t labelCount = std::max(spriteCount / SPRITES_PER_LABEL, 1U);
+  auto columns = std::max(renderer.headlessExtent.width / 160, 1U);
+  auto rows = std::max(renderer.headlessExtent.height / 20, 1U);
+  for(uint32_t i = 0; i < labelCount; ++i) {
+    glm::vec2 position = {float(i % columns * 160), float(i / columns % rows * 20)};
+    labels->ids.push_back(renderer.textRenderer->createLabel("label " + std::to_string(i), position, 16.0F,
+                                                             packColor(255, uint8_t(random(i, 0) * 255), 128)));
+  }
+  return [labels](Renderer& renderer, uint64_t frame) {
+    TRACE_SCOPE("update labels");
+    for(auto i = uint32_t(frame % CHANGED_LABEL_RATIO); i < labels->ids.size(); i += CHANGED_LABEL_RATIO)
+      renderer.textRenderer->setText(labels->ids[i], "label " + std::to_string(i) + ": " +
+                                                     std::to_string(frame % 1000));
+  };
+}
+
+/**
+ * The moving sprites grouped under pivots that move and spin every frame, so every sprite's world transform is
+ * composed from its pivot's in a transform system writing the instances.
+ */
+DrawFunction createTransformHierarchy(Renderer&, uint32_t spriteCount) {
+  auto transforms = std::make_shared<TransformSystem>();
+  std::vector<uint32_t> pivots;
+  for(uint32_t i = 0; i < spriteCount; ++i) {
+    if(i % SPRITES_PER_PIVOT == 0)
+      pivots.push_back(transforms->create());
+    uint32_t sprite = transforms->create(pivots.back());
+    float angle = random(i, 0) * 6.2832F;
+    transforms->setPosition(sprite, glm::vec2(std::cos(angle), std::sin(angle)) * (8.0F + random(i, 1) * 40.0F));
+    transforms->setRotation(sprite, angle);
+    float size = 4.0F + random(i, 4) * 12.0F;
+    transforms->setScale(sprite, {size, size});
+    transforms->setSprite(sprite, packColor(uint8_t(random(i, 6) * 255), uint8_t(random(i, 7) * 255), 255));
+  }
+  return [transforms, pivots = std::move(pivots)](Renderer& renderer, uint64_t frame) {
+    glm::vec2 extent = {float(renderer.headlessExtent.width), float(renderer.headlessExtent.height)};
+    auto time = float(frame) / 60.0F;
+    {
+      TRACE_SCOPE("update transforms");
+      for(uint32_t i = 0; i < pivots.size(); ++i) {
+        glm::vec2 start = glm::vec2(random(i, 8), random(i, 9)) * extent;
+        glm::vec2 velocity = (glm::vec2(random(i, 10), random(i, 11)) - 0.5F) * 200.0F;
+        transforms->setPosition(pivots[i], glm::mod(start + velocity * time, extent));
+        transforms->setRotation(pivots[i], time * (random(i, 12) - 0.5F) * 4.0F);
+      }
+      transforms->update();
+    }
+    transforms->draw(*renderer.spriteBatch);
+  };
+}
+
+const std::vector<Workload> WORKLOADS = {
+    {"static-sprites", createStaticSprites},
+    {"moving-sprites", createMovingSprites},
+    {"indexed-meshes", createIndexedMeshes},
+    {"layered-meshes", createLayeredMeshes},
+    {"small-batches", createSmallBatches},
+    {"texture-streaming", createTextureStreaming},
+    {"many-textures", createManyTextures},
+    {"culled-world", createCulledWorld},
+    {"gpu-culled-world", createGpuCulledWorld, true},
+    {"text-labels", createTextLabels, false, true},
+    {"transform-hierarchy", createTransformHierarchy},
+};
+
+WorkloadResult runWorkload(Renderer& renderer, const Workload& workload, uint32_t spriteCount, uint64_t warmupFrames,
+                           uint64_t frames) {
+  TRACE_SCOPE("workload");
+  WorkloadResult result = {workload.name, spriteCount};
+  std::vector<double> frameTimes, cpuWaits, cpuRecords;
+  uint64_t drawCalls = 0;
+  uint64_t stateChanges = 0;
+  vk::DeviceSize submittedBytes = 0;
+  {
+    DrawFunction draw = workload.create(renderer, spriteCount);
+    for(uint64_t frame = 0; frame < warmupFrames + frames; ++frame) {
+      if(frame == warmupFrames) {
+        renderer.gpuProfiler->resetStats();
+        if(renderer.postProfiler)
+          renderer.postProfiler->resetStats();
+        submittedBytes = 0;
+      }
+      TRACE_SCOPE("frame");
+      auto start = std::chrono::steady_clock::now();
+      vk::DeviceSize uploadedBefore = renderer.uploadManager->getUploadedSize();
+      renderer.beginFrame();
+      draw(renderer, frame);
+      renderer.endFrame();
+      Milliseconds frameTime = std::chrono::steady_clock::now() - start;
+      if(frame < warmupFrames) continue;
+
+      frameTimes.push_back(frameTime.count());
+      cpuWaits.push_back(renderer.frameStats.cpuWait.count());
+      cpuRecords.push_back(renderer.frameStats.cpuRecord.count());
+      drawCalls += renderer.spriteBatch->getDrawCount();
+      stateChanges += renderer.spriteBatch->getStateChangeCount();
+      result.droppedSprites += renderer.spriteBatch->getDroppedCount();
+      // Instances are written straight into device visible memory, uploads go through the staging ring.
+      submittedBytes += vk::DeviceSize(renderer.spriteBatch->getSpriteCount()) * sizeof(SpriteInstance) +
+                        renderer.uploadManager->getUploadedSize() - uploadedBefore;
+    }
+    renderer.finishFrames();
+    if(renderer.gpuCuller)
+      renderer.gpuCuller->clearObjects();
+    renderer.camera = {0.0F, 0.0F};
+  }
+
+  result.frameTime = getPercentiles(frameTimes);
+  result.cpuWait = getPercentiles(cpuWaits);
+  result.cpuRecord = getPercentiles(cpuRecords);
+  result.drawCalls = double(drawCalls) / double(frames);
+  result.stateChanges = double(stateChanges) / double(frames);
+  result.submittedBytes = double(submittedBytes) / double(frames);
+  result.gpuStats = renderer.gpuProfiler->getStats();
+  // Post-processing on the async compute queue is timed separately, its scopes never share a name with the others.
+  if(renderer.postProfiler) {
+    std::vector<GpuScopeStats> postStats = renderer.postProfiler->getStats();
+    result.gpuStats.insert(result.gpuStats.end(), postStats.begin(), postStats.end());
+  }
+  return result;
+}
+
+/**
+ * Writes str as the contents of a JSON string, escaped like the trace writers do.
+ */
+void writeString(std::ostream& out, std::string_view str) {
+  for(char c : str) {
+    if(c == '"' || c == '\\')
+      out << '\\';
+    out << c;
+  }
+}
+
+void writePercentiles(std::ostream& out, const Percentiles& percentiles) {
+  out << R"({"mean":)" << percentiles.mean << R"(,"p50":)" << percentiles.p50 << R"(,"p90":)" << percentiles.p90
+      << R"(,"p99":)" << percentiles.p99 << R"(,"max":)" << percentiles.max << "}";
+}
+
+/**
+ * Writes the report. Every workload is kept on a single line with its frame time percentiles first, which
+ * readBaseline() relies on.
+ */
+void writeReport(std::ostream& out, const Renderer& renderer, const std::vector<Phase>& phases, Milliseconds startup,
+                 const std::vector<WorkloadResult>& results, uint64_t warmupFrames, uint64_t frames) {
+  vk::PhysicalDeviceProperties properties = renderer.physicalDevice.getProperties();
+  out << std::fixed << std::setprecision(4);
+  out << "{\n"
+      << R"(  "device":")";
+  writeString(out, std::string(properties.deviceName));
+  out << "\",\n"
+      << R"(  "deviceType":")" << vk::to_string(properties.deviceType) << "\",\n"
+      << R"(  "extent":[)" << renderer.headlessExtent.width << "," << renderer.headlessExtent.height << "],\n"
+      << R"(  "framesInFlight":)" << renderer.getFramesInFlight() << ",\n"
+      << R"(  "recordingThreads":)" << renderer.getRecordingThreads() << ",\n"
+      << R"(  "postProcessing":")"
+      << (!renderer.postProcessing ? "off" : renderer.asyncCompute ? "async compute" : "graphics queue") << "\",\n"
+      << R"(  "warmupFrames":)" << warmupFrames << ",\n"
+      << R"(  "frames":)" << frames << ",\n"
+      << R"(  "startup":[)";
+  for(std::size_t i = 0; i < phases.size(); ++i) {
+    out << (i ? "," : "") << R"({"name":")";
+    writeString(out, phases[i].name);
+    out << R"(","startMs":)" << phases[i].start.count() << R"(,"ms":)" << phases[i].duration.count() << "}";
+  }
+  out << "],\n"
+      << R"(  "startupMs":)" << startup.count() << ",\n"
+      << R"(  "workloads":[)" << '\n';
+  for(std::size_t i = 0; i < results.size(); ++i) {
+    const WorkloadResult& result = results[i];
+    out << R"(    {"name":")";
+    writeString(out, result.name);
+    out << R"(","frameTimeMs":)";
+    writePercentiles(out, result.frameTime);
+    out << R"(,"cpuWaitMs":)";
+    writePercentiles(out, result.cpuWait);
+    out << R"(,"cpuRecordMs":)";
+    writePercentiles(out, result.cpuRecord);
+    out << R"(,"sprites":)" << result.spriteCount << R"(,"drawCallsPerFrame":)" << result.drawCalls
+        << R"(,"stateChangesPerFrame":)" << result.stateChanges << R"(,"submittedBytesPerFrame":)"
+        << result.submittedBytes << R"(,"droppedSprites":)" << result.droppedSprites << R"(,"gpuMs":{)";
+    for(std::size_t j = 0; j < result.gpuStats.size(); ++j) {
+      const GpuScopeStats& stats = result.gpuStats[j];
+      out << (j ? "," : "") << '"';
+      writeString(out, stats.name);
+      out << R"(":{"min":)" << stats.min << R"(,"mean":)" << stats.average
+          << R"(,"p99":)" << stats.p99 << "}";
+    }
+    out << "}}" << (i + 1 < results.size() ? "," : "") << '\n';
+  }
+  out << "  ]\n"
+      << "}\n";
+}
+
+/**
+ * Reads the median frame time of every workload from a report written by writeReport().
+ */
+std::vector<std::pair<std::string, double>> readBaseline(const fs::path& path) {
+  std::ifstream file(path);
+  if(!file)
+    throw std::runtime_error("could not open baseline " + path.string());
+  std::vector<std::pair<std::string, double>> baseline;
+  std::string line;
+  const std::string nameKey = R"({"name":")";
+  const std::string p50Key = R"("p50":)";
+  while(std::getline(file, line)) {
+    std::size_t name = line.find(nameKey);
+    if(name == std::string::npos || line.find("frameTimeMs") == std::string::npos) continue;
+    name += nameKey.size();
+    std::size_t p50 = line.find(p50Key, name);
+    if(p50 == std::string::npos) continue;
+    baseline.emplace_back(line.substr(name, line.find('"', name) - name), std::stod(line.substr(p50 + p50Key.size())));
+  }
+  return baseline;
+}
+
+int main(int argc, char **argv) {
+
+  Renderer renderer;
+  renderer.headless = true;
+  uint32_t spriteCount = 10000;
+  uint64_t warmupFrames = 30;
+  uint64_t frames = 300;
+  std::vector<std::string> selected;
+  std::string outputPath = "bench.json";
+  std::string baselinePath;
+  double tolerance = 10.0;
+  std::string tracePath;
+  std::string fontPath;
+  for(int i = 1; i < argc; ++i) {
+    if(!std::strcmp(argv[i], "--frames") && i + 1 < argc)
+      frames = std::max<uint64_t>(std::stoull(argv[++i]), 1);
+    else if(!std::strcmp(argv[i], "--warmup") && i + 1 < argc)
+      warmupFrames = std::stoull(argv[++i]);
+    else if(!std::strcmp(argv[i], "--sprites") && i + 1 < argc)
+      spriteCount = uint32_t(std::stoul(argv[++i]));
+    else if(!std::strcmp(argv[i], "--workload") && i + 1 < argc)
+      selected.emplace_back(argv[++i]);
+    else if(!std::strcmp(argv[i], "--frames-in-flight") && i + 1 < argc)
+      renderer.setFramesInFlight(uint32_t(std::stoul(argv[++i])));
+    else if(!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+      renderer.setRecordingThreads(uint32_t(std::stoul(argv[++i])));
+    else if(!std::strcmp(argv[i], "--device") && i + 1 < argc)
+      renderer.deviceOverride = argv[++i];
+    else if(!std::strcmp(argv[i], "--output") && i + 1 < argc)
+      outputPath = argv[++i];
+    else if(!std::strcmp(argv[i], "--baseline") && i + 1 < argc)
+      baselinePath = argv[++i];
+    else if(!std::strcmp(argv[i], "--tolerance") && i + 1 < argc)
+      tolerance = std::stod(argv[++i]);
+    else if(!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+      tracePath = argv[++i];
+    else if(!std::strcmp(argv[i], "--font") && i + 1 < argc)
+      fontPath = argv[++i];
+    else if(!std::strcmp(argv[i], "--post-processing"))
+      renderer.postProcessing = true;
+    else if(!std::strcmp(argv[i], "--no-async-compute"))
+      renderer.asyncCompute = false;
+  }
+
+  std::vector<const Workload *> workloads;
+  for(const Workload& workload : WORKLOADS)
+    if(selected.empty() || std::find(selected.begin(), selected.end(), workload.name) != selected.end())
+      workloads.push_back(&workload);
+  if(workloads.empty()) {
+    std::cerr << "No such workload, choose from:";
+    for(const Workload& workload : WORKLOADS)
+      std::cerr << " " << workload.name;
+    std::cerr << std::endl;
+    return 1;
+  }
+  bool text = std::any_of(workloads.begin(), workloads.end(), [](const Workload *workload) { return workload->text; });
+  if(text && fontPath.empty()) {
+    if(!selected.empty()) {
+      std::cerr << "The text workloads need a font, pass one with --font" << std::endl;
+      return 1;
+    }
+    // Running everything by default should not require a font.
+    std::experimental::erase_if(workloads, [](const Workload *workload) { return workload->text; });
+    text = false;
+  }
+
+  if(!tracePath.empty()) {
+#ifdef VULKAN_TRACING
+    TRACE_THREAD_NAME("main");
+    try {
+      Trace::start(tracePath);
+    } catch(const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+    }
+#else
+    std::cerr << "--trace is ignored, this build has no CPU trace scopes compiled in" << std::endl;
+#endif
+  }
+
+  auto startupStart = std::chrono::steady_clock::now();
+  renderer.createThreadPool();
+  Milliseconds threadPoolDuration = std::chrono::steady_clock::now() - startupStart;
+
+  // The same graph as the renderer's own startup, minus the window.
+  TaskGraph startup;
+  uint32_t compileVertex = startup.add("compile vertex.vert", [&]() { renderer.compileShader("vertex.vert"); });
+  uint32_t compileMesh = startup.add("compile mesh.vert", [&]() { renderer.compileShader("mesh.vert"); });
+  uint32_t compileFragment = startup.add("compile fragment.frag", [&]() { renderer.compileShader("fragment.frag"); });
+  uint32_t compileBindless = startup.add("compile bindless.frag", [&]() { renderer.compileShader("bindless.frag"); });
+  uint32_t extensions = startup.add("enableRequiredExtensions", [&]() { renderer.enableRequiredExtensions(); });
+  uint32_t layers = startup.add("enableRequiredLayers", [&]() { renderer.enableRequiredLayers(); });
+  uint32_t instance = startup.add("initVk", [&]() { renderer.initVk(); }, {extensions, layers});
+  uint32_t device = startup.add("pickDevice", [&]() { renderer.pickDevice(); }, {instance});
+  uint32_t targets = startup.add("createOffscreenTargets", [&]() { renderer.createOffscreenTargets(); }, {device});
+  uint32_t pipelineCache = startup.add("createPipelineCache", [&]() { renderer.createPipelineCache(); }, {device});
+  uint32_t uploadManager = startup.add("createUploadManager", [&]() { renderer.createUploadManager(); }, {device});
+  uint32_t textureManager = startup.add("createTextureManager", [&]() { renderer.createTextureManager(); },
+                                        {uploadManager});
+  uint32_t shaders = startup.add("createShaders", [&]() { renderer.createShaders(); },
+                                 {device, compileVertex, compileMesh, compileFragment, compileBindless});
+  std::vector<uint32_t> renderGraphDependencies = {targets};
+  if(std::any_of(workloads.begin(), workloads.end(), [](const Workload *workload) { return workload->gpuCulling; })) {
+    uint32_t compileCull = startup.add("compile cull.comp", [&]() { renderer.compileShader("cull.comp"); });
+    // After createTextureManager, both allocate from the descriptor allocator.
+    renderGraphDependencies.push_back(startup.add("createGpuCuller", [&]() {
+      renderer.createGpuCuller(std::max(spriteCount, 1U));
+    }, {pipelineCache, textureManager, compileCull}));
+  }
+  if(renderer.postProcessing) {
+    uint32_t compileDownsample = startup.add("compile downsample.comp", [&]() {
+      renderer.compileShader("downsample.comp");
+    });
+    uint32_t compileBlur = startup.add("compile blur.comp", [&]() { renderer.compileShader("blur.comp"); });
+    uint32_t compileGrade = startup.add("compile grade.comp", [&]() { renderer.compileShader("grade.comp"); });
+    // After createTextureManager and createGpuCuller, which allocate from the descriptor allocator too.
+    std::vector<uint32_t> postProcessorDependencies = renderGraphDependencies;
+    postProcessorDependencies.insert(postProcessorDependencies.end(),
+                                     {pipelineCache, textureManager, compileDownsample, compileBlur, compileGrade});
+    renderGraphDependencies.push_back(startup.add("createPostProcessor", [&]() { renderer.createPostProcessor(); },
+                                                  postProcessorDependencies));
+  }
+  uint32_t renderGraph = startup.add("createRenderGraph", [&]() { renderer.createRenderGraph(); },
+                                     renderGraphDependencies);
+  uint32_t pipeline = startup.add("createPipeline", [&]() { renderer.createPipeline(); },
+                                  {shaders, renderGraph, pipelineCache, textureManager});
+  uint32_t commandPool = startup.add("createCommandPool", [&]() { renderer.createCommandPool(); }, {device});
+  startup.add("createCommandBuffers", [&]() { renderer.createCommandBuffers(); }, {commandPool});
+  // After createCommandPool, which creates the frames they belong to.
+  startup.add("createSyncObjects", [&]() { renderer.createSyncObjects(); }, {targets, commandPool});
+  startup.add("createGpuProfiler", [&]() { renderer.createGpuProfiler(); }, {device});
+  startup.add("createSpriteBatch", [&]() { renderer.createSpriteBatch(std::max(spriteCount, 1U)); }, {device});
+  if(text) {
+    uint32_t compileText = startup.add("compile text.frag", [&]() { renderer.compileShader("text.frag"); });
+    startup.add("createTextRenderer", [&]() {
+      renderer.createTextRenderer(fontPath, std::max(spriteCount * 2, TextRenderer::DEFAULT_CAPACITY));
+    }, {pipeline, uploadManager, compileText});
+  }
+  try {
+    startup.run(*renderer.threadPool);
+  } catch(const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    renderer.cleanup();
+    return 1;
+  }
+  startup.printReport(std::cout);
+  std::vector<Phase> phases = {{"createThreadPool", Milliseconds(0), threadPoolDuration}};
+  for(const TaskGraph::Timing& timing : startup.getTimings())
+    phases.push_back({timing.name, threadPoolDuration + timing.start, timing.duration});
+
+  std::vector<WorkloadResult> results;
+  for(const Workload *workload : workloads) {
+    results.push_back(runWorkload(renderer, *workload, spriteCount, warmupFrames, frames));
+    const WorkloadResult& result = results.back();
+    std::cout << result.name << ": p50 " << result.frameTime.p50 << "ms, p99 " << result.frameTime.p99 << "ms, "
+              << result.drawCalls << " draws, " << result.stateChanges << " binds, " << result.submittedBytes / 1024.0
+              << "KiB per frame" << std::endl;
+  }
+
+  std::ofstream output(outputPath, std::ios_base::trunc);
+  writeReport(output, renderer, phases, threadPoolDuration + startup.getDuration(), results, warmupFrames, frames);
+  if(!output)
+    std::cerr << "Could not write " << outputPath << std::endl;
+
+#ifdef VULKAN_TRACING
+  Trace::stop();
+#endif
+  renderer.logicalDevice->waitIdle();
+  renderer.cleanup();
+
+  // Medians rather than tails are compared, shared CI machines make the slowest frames too noisy to gate on.
+  int exitCode = 0;
+  if(!baselinePath.empty()) {
+    try {
+      for(const auto& [name, p50] : readBaseline(baselinePath)) {
+        auto result = std::find_if(results.begin(), results.end(),
+                                   [&name = name](const WorkloadResult& result) { return result.name == name; });
+        if(result == results.end()) continue;
+        double change = (result->frameTime.p50 / p50 - 1.0) * 100.0;
+        bool regressed = change > tolerance;
+        std::cout << name << ": median frame time " << std::showpos << change << std::noshowpos << "% against "
+                  << baselinePath << (regressed ? ", regressed" : "") << std::endl;
+        if(regressed)
+          exitCode = 2;
+      }
+    } catch(const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      exitCode = 1;
+    }
+  }
+  return exitCode;
+}
@@ -1,35 +1,212 @@
 #include "Renderer.h"
+#include "TaskGraph.h"
+#include "Trace.h"
 
 #include <GLFW/glfw3.h>
 
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
-int main() {
+/**
+ * Draws a grid of spinning sprites filling the frame.
+ */
+void drawSprites(Renderer& renderer, uint32_t spriteCount) {
+  TRACE_FUNCTION();
+  if(spriteCount == 0) return;
+  auto columns = uint32_t(std::ceil(std::sqrt(double(spriteCount))));
+  auto rows = (spriteCount + columns - 1) / columns;
+  glm::vec2 cell = {float(renderer.optimalExtent.width) / float(columns),
+                    float(renderer.optimalExtent.height) / float(rows)};
+  float time = float(renderer.frameCount) / 60.0F;
+  for(uint32_t i = 0; i < spriteCount; ++i) {
+    uint32_t column = i % columns;
+    uint32_t row = i / columns;
+    renderer.spriteBatch->draw({(float(column) + 0.5F) * cell.x, (float(row) + 0.5F) * cell.y}, cell * 0.8F,
+                               time + float(i) * 0.01F,
+                               packColor(uint8_t(column * 255 / columns), uint8_t(row * 255 / rows), 128));
+  }
+}
+
+int main(int argc, char **argv) {
 
   Renderer renderer;
-  renderer.createWindow();
-
-  renderer.enableRequiredExtensions();
-  renderer.enableRequiredLayers();
-  renderer.initVk();
-  renderer.createSurface();
-  renderer.pickDevice();
-  renderer.createSwapChain();
-  renderer.createShaders();
-  renderer.createRenderPass();
-  renderer.createPipeline();
-  renderer.createFramebuffers();
-  renderer.createCommandPool();
-  renderer.createCommandBuffers();
-
-  while(!renderer.window->isClosing()) {
-    glfwPollEvents();
-    break;
+  uint64_t headlessFrames = 100;
+  uint32_t spriteCount = 10000;
+  std::string gpuTracePath;
+  std::string tracePath;
+  std::string fontPath;
+  for(int i = 1; i < argc; ++i) {
+    if(!std::strcmp(argv[i], "--headless"))
+      renderer.headless = true;
+    else if(!std::strcmp(argv[i], "--frames") && i + 1 < argc)
+      headlessFrames = std::stoull(argv[++i]);
+    else if(!std::strcmp(argv[i], "--frames-in-flight") && i + 1 < argc)
+      renderer.setFramesInFlight(uint32_t(std::stoul(argv[++i])));
+    else if(!std::strcmp(argv[i], "--device") && i + 1 < argc)
+      renderer.deviceOverride = argv[++i];
+    else if(!std::strcmp(argv[i], "--sprites") && i + 1 < argc)
+      spriteCount = uint32_t(std::stoul(argv[++i]));
+    else if(!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+      renderer.setRecordingThreads(uint32_t(std::stoul(argv[++i])));
+    else if(!std::strcmp(argv[i], "--gpu-trace") && i + 1 < argc)
+      gpuTracePath = argv[++i];
+    else if(!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+      tracePath = argv[++i];
+    else if(!std::strcmp(argv[i], "--font") && i + 1 < argc)
+      fontPath = argv[++i];
+    else if(!std::strcmp(argv[i], "--post-processing"))
+      renderer.postProcessing = true;
+    else if(!std::strcmp(argv[i], "--no-async-compute"))
+      renderer.asyncCompute = false;
+  }
+
+  if(!tracePath.empty()) {
+#ifdef VULKAN_TRACING
+    TRACE_THREAD_NAME("main");
+    try {
+      Trace::start(tracePath);
+    } catch(const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+    }
+#else
+    std::cerr << "--trace is ignored, this build has no CPU trace scopes compiled in" << std::endl;
+#endif
+  }
+
+  renderer.createThreadPool();
+  // Shaders compile into the shader cache while the instance and device are created, so creating their modules later
+  // merely loads them. Whatever only needs the device is created alongside the rest once it exists.
+  TaskGraph startup;
+  std::vector<uint32_t> windowTask;
+  if(!renderer.headless)
+    windowTask.push_back(startup.add("createWindow", [&]() { renderer.createWindow(); }, {}, true));
+  uint32_t compileVertex = startup.add("compile vertex.vert", [&]() { renderer.compileShader("vertex.vert"); });
+  uint32_t compileMesh = startup.add("compile mesh.vert", [&]() { renderer.compileShader("mesh.vert"); });
+  // Which fragment shader is used depends on the device, both are compiled before it is picked.
+  uint32_t compileFragment = startup.add("compile fragment.frag", [&]() { renderer.compileShader("fragment.frag"); });
+  uint32_t compileBindless = startup.add("compile bindless.frag", [&]() { renderer.compileShader("bindless.frag"); });
+  uint32_t extensions = startup.add("enableRequiredExtensions", [&]() { renderer.enableRequiredExtensions(); },
+                                    windowTask);
+  uint32_t layers = startup.add("enableRequiredLayers", [&]() { renderer.enableRequiredLayers(); });
+  uint32_t instance = startup.add("initVk", [&]() { renderer.initVk(); }, {extensions, layers});
+  std::vector<uint32_t> deviceDependencies = {instance};
+  if(!renderer.headless) {
+    std::vector<uint32_t> surfaceDependencies = {instance, windowTask.front()};
+    deviceDependencies.push_back(startup.add("createSurface", [&]() { renderer.createSurface(); },
+                                             surfaceDependencies));
   }
+  uint32_t device = startup.add("pickDevice", [&]() { renderer.pickDevice(); }, deviceDependencies);
+  uint32_t targets = renderer.headless
+                     ? startup.add("createOffscreenTargets", [&]() { renderer.createOffscreenTargets(); }, {device})
+                     : startup.add("createSwapChain", [&]() { renderer.createSwapChain(); }, {device});
+  uint32_t pipelineCache = startup.add("createPipelineCache", [&]() { renderer.createPipelineCache(); }, {device});
+  uint32_t uploadManager = startup.add("createUploadManager", [&]() { renderer.createUploadManager(); }, {device});
+  uint32_t textureManager = startup.add("createTextureManager", [&]() { renderer.createTextureManager(); },
+                                        {uploadManager});
+  uint32_t shaders = startup.add("createShaders", [&]() { renderer.createShaders(); },
+                                 {device, compileVertex, compileMesh, compileFragment, compileBindless});
+  std::vector<uint32_t> renderGraphDependencies = {targets};
+  if(renderer.postProcessing) {
+    uint32_t compileDownsample = startup.add("compile downsample.comp", [&]() {
+      renderer.compileShader("downsample.comp");
+    });
+    uint32_t compileBlur = startup.add("compile blur.comp", [&]() { renderer.compileShader("blur.comp"); });
+    uint32_t compileGrade = startup.add("compile grade.comp", [&]() { renderer.compileShader("grade.comp"); });
+    // After createTextureManager, both allocate from the descriptor allocator.
+    renderGraphDependencies.push_back(startup.add("createPostProcessor", [&]() { renderer.createPostProcessor(); },
+                                                  {pipelineCache, textureManager, compileDownsample, compileBlur,
+                                                   compileGrade}));
+  }
+  uint32_t renderGraph = startup.add("createRenderGraph", [&]() { renderer.createRenderGraph(); },
+                                     renderGraphDependencies);
+  uint32_t pipeline = startup.add("createPipeline", [&]() { renderer.createPipeline(); },
+                                  {shaders, renderGraph, pipelineCache, textureManager});
+  uint32_t commandPool = startup.add("createCommandPool", [&]() { renderer.createCommandPool(); }, {device});
+  startup.add("createCommandBuffers", [&]() { renderer.createCommandBuffers(); }, {commandPool});
+  // After createCommandPool, which creates the frames they belong to.
+  startup.add("createSyncObjects", [&]() { renderer.createSyncObjects(); }, {targets, commandPool});
+  startup.add("createGpuProfiler", [&]() { renderer.createGpuProfiler(); }, {device});
+  startup.add("createSpriteBatch", [&]() { renderer.createSpriteBatch(std::max(spriteCount, 1U)); }, {device});
+  if(!fontPath.empty()) {
+    uint32_t compileText = startup.add("compile text.frag", [&]() { renderer.compileShader("text.frag"); });
+    // After createPipeline, which allocates from the descriptor allocator too.
+    startup.add("createTextRenderer", [&]() { renderer.createTextRenderer(fontPath); },
+                {pipeline, uploadManager, compileText});
+  }
+  try {
+    startup.run(*renderer.threadPool);
+  } catch(const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    renderer.cleanup();
+    return -1;
+  }
+  startup.printReport(std::cout);
+
+  if(renderer.headless) {
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> cpuWait{0};
+    for(uint64_t i = 0; i < headlessFrames; ++i) {
+      TRACE_SCOPE("frame");
+      renderer.beginFrame();
+      drawSprites(renderer, spriteCount);
+      renderer.endFrame();
+      cpuWait += renderer.frameStats.cpuWait;
+    }
+    renderer.finishFrames();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << headlessFrames << " headless frames in " << elapsed.count() << "s ("
+              << double(headlessFrames) / elapsed.count() << " fps, " << cpuWait.count() / double(headlessFrames)
+              << "ms average cpu wait with " << renderer.getFramesInFlight() << " frames in flight)" << std::endl;
+    for(const GpuProfiler *profiler : {renderer.gpuProfiler.get(), renderer.postProfiler.get()}) {
+      if(!profiler) continue;
+      for(const GpuScopeStats& stats : profiler->getStats())
+        std::cout << "gpu " << stats.name << ": min " << stats.min << "ms, avg " << stats.average << "ms, p99 "
+                  << stats.p99 << "ms" << std::endl;
+    }
+  } else {
+    // Shows the frame rate of the last second when a font was given.
+    std::optional<uint32_t> fpsLabel;
+    if(renderer.textRenderer)
+      fpsLabel = renderer.textRenderer->createLabel("", {8.0F, 8.0F}, 20.0F, packColor(255, 255, 255));
+    auto fpsStart = std::chrono::steady_clock::now();
+    uint64_t fpsFrames = renderer.frameCount;
+    while(!renderer.window->isClosing()) {
+      glfwPollEvents();
+      // Nothing can be presented while minimized, so sleep until the window is restored.
+      while(renderer.window->getFramebufferWidth() == 0 && !renderer.window->isClosing())
+        glfwWaitEvents();
+      TRACE_SCOPE("frame");
+      renderer.beginFrame();
+      drawSprites(renderer, spriteCount);
+      std::chrono::duration<double> fpsElapsed = std::chrono::steady_clock::now() - fpsStart;
+      if(fpsLabel && fpsElapsed.count() >= 1.0) {
+        renderer.textRenderer->setText(*fpsLabel, std::to_string(std::lround(double(renderer.frameCount - fpsFrames) /
+                                                                             fpsElapsed.count())) + " fps");
+        fpsStart = std::chrono::steady_clock::now();
+        fpsFrames = renderer.frameCount;
+      }
+      renderer.endFrame();
+    }
+    renderer.finishFrames();
+  }
+
+  if(!gpuTracePath.empty())
+    renderer.gpuProfiler->writeTrace(gpuTracePath);
+#ifdef VULKAN_TRACING
+  Trace::stop();
+#endif
 
 #ifdef DEBUG
   std::cout << "exiting" << std::endl;
 #endif
+  renderer.logicalDevice->waitIdle();
   renderer.cleanup();
   return 0;
-}
\ No newline at end of file
+}
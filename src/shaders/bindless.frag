@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Every texture on its own, see TextureManager. Only the ones added so far are written.
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragUv;
+layout(location = 2) flat in uint fragTextureIndex;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Index 0 is untextured, the others are one past the descriptor.
+    vec4 texel = vec4(1.0);
+    if (fragTextureIndex != 0u) {
+        // Sprites in one draw sample different textures, so the index is not uniform.
+        texel = textureLod(textures[nonuniformEXT(fragTextureIndex - 1u)], fragUv, 0.0);
+    }
+    outColor = fragColor * texel;
+}
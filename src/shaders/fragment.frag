@@ -1,9 +1,20 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) in vec3 fragColor;
+// Atlas pages packed with every texture, see TextureManager.
+layout(set = 0, binding = 0) uniform sampler2DArray pages;
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragUv;
+layout(location = 2) flat in uint fragTextureIndex;
+
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    // Index 0 is untextured, the others are one past the page.
+    vec4 texel = vec4(1.0);
+    if (fragTextureIndex != 0u) {
+        texel = textureLod(pages, vec3(fragUv, float(fragTextureIndex - 1u)), 0.0);
+    }
+    outColor = fragColor * texel;
+}
@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Maps pixels to normalized device coordinates.
+layout(push_constant) uniform PushConstants {
+    vec2 scale;
+    vec2 offset;
+} pushConstants;
+
+// SpriteInstance, one per mesh, followed by MeshVertex, generated from SPRITE_INSTANCE_LAYOUT and MESH_VERTEX_LAYOUT.
+#include "sprite_instance.glsl"
+#include "mesh_vertex.glsl"
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragUv;
+layout(location = 2) flat out uint fragTextureIndex;
+
+void main() {
+    // The instance transform maps the unit quad centered on the origin, which the mesh spans from -1 to 1.
+    vec3 local = vec3(inPosition * 0.5, 1.0);
+    vec2 position = vec2(dot(inTransform0, local), dot(inTransform1, local));
+    gl_Position = vec4(position * pushConstants.scale + pushConstants.offset, 0.0, 1.0);
+    fragColor = inColor * inVertexColor;
+    fragUv = mix(inUvRect.xy, inUvRect.zw, inUv);
+    fragTextureIndex = inTextureIndex;
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Signed distance fields of the glyphs, 0.5 on their outlines.
+layout(set = 0, binding = 0) uniform sampler2D atlas;
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragUv;
+layout(location = 2) flat in uint fragTextureIndex;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    float distance = texture(atlas, fragUv).r;
+    // Antialiases across about one screen pixel whatever the glyphs are scaled to.
+    float width = max(0.5 * fwidth(distance), 1e-4);
+    float coverage = smoothstep(0.5 - width, 0.5 + width, distance);
+    outColor = vec4(fragColor.rgb, fragColor.a * coverage);
+}
@@ -1,21 +1,36 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) out vec3 fragColor;
+// Maps pixels to normalized device coordinates.
+layout(push_constant) uniform PushConstants {
+    vec2 scale;
+    vec2 offset;
+} pushConstants;
 
-vec2 positions[3] = vec2[](
-vec2(0.0, -0.5),
-vec2(0.5, 0.5),
-vec2(-0.5, 0.5)
-);
+// SpriteInstance, one per quad, generated from SPRITE_INSTANCE_LAYOUT.
+#include "sprite_instance.glsl"
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragUv;
+layout(location = 2) flat out uint fragTextureIndex;
 
-vec3 colors[3] = vec3[](
-vec3(1.0, 0.0, 0.0),
-vec3(0.0, 1.0, 0.0),
-vec3(0.0, 0.0, 1.0)
+// Two triangles covering the unit square.
+vec2 corners[6] = vec2[](
+vec2(0.0, 0.0),
+vec2(1.0, 0.0),
+vec2(1.0, 1.0),
+vec2(1.0, 1.0),
+vec2(0.0, 1.0),
+vec2(0.0, 0.0)
 );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    vec2 corner = corners[gl_VertexIndex];
+    vec3 local = vec3(corner - 0.5, 1.0);
+    vec2 position = vec2(dot(inTransform0, local), dot(inTransform1, local));
+    gl_Position = vec4(position * pushConstants.scale + pushConstants.offset, 0.0, 1.0);
+    fragColor = inColor;
+    fragUv = mix(inUvRect.xy, inUvRect.zw, corner);
+    fragTextureIndex = inTextureIndex;
+}